@@ -18,7 +18,7 @@
 // If your board has only one hardware serial, consider using SoftwareSerial (not recommended for high baud).
 // But for demonstration, let's assume we have [HardwareSerial 2 of the ESP32] for the A9G module.
 
-//? Do not forget to reboot the A9G if any issue occurs :D
+//? If the A9G wedges, A9GRecovery can restart it without rebooting the board
 
 const char* gprsApn = "internet";
 const char* gprsUser = "";
@@ -63,12 +63,18 @@ void setup() {
     while (true) { delay(1000); }
   }
 
-  // Optional: Wait until the modem is ready (it prints "READY")
+  // Optional: Wait until the modem is ready (it reports "READY")
   a9g.waitForModemReady();
 
   // Check signal quality
   a9g.readSignalQuality();
 
+  // The library logs into a ring buffer; print what it recorded so far
+  // (trace() is left out when built with A9G_TRACE_LEVEL=A9G_TRACE_OFF)
+#if A9G_TRACE_LEVEL > A9G_TRACE_OFF
+  a9g.trace().drain(Serial);
+#endif
+
   // Attach GPRS (for MQTT)
   if (!a9g.attachGPRS(gprsApn, gprsUser, gprsPass)) {
     Serial.println("Failed to attach GPRS!");
@@ -108,6 +114,11 @@ void loop() {
   // Example of sending an SMS (uncomment if needed):
   // a9g.sendSMS("+1234567890", "Hello from A9G!");
 
+  // Print the library's log when timing does not matter
+#if A9G_TRACE_LEVEL > A9G_TRACE_OFF
+  a9g.trace().drain(Serial);
+#endif
+
   // Add any custom logic here...
   delay(1000);
 }
@@ -0,0 +1,96 @@
+#ifndef SCRIPTSTREAM_H
+#define SCRIPTSTREAM_H
+
+#include "Arduino.h"
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*!
+ * @file ScriptStream.h
+ *
+ * @brief Emulated A9G UART for the host tests: every line A9G writes is
+ *        recorded and answered by a script (by default OK, plus canned
+ *        +CSQ / +CREG answers); feed() injects URCs at any time.
+ */
+
+/**
+ * @brief assert() that also runs under NDEBUG: the tests drive the code
+ *        under test from inside their checks.
+ */
+#define CHECK(cond) ((cond) ? (void)0 : checkFailed(#cond, __FILE__, __LINE__))
+
+inline void checkFailed(const char *cond, const char *file, int line) {
+  fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, cond);
+  abort();
+}
+
+class ScriptStream : public Stream {
+public:
+  typedef std::function<std::string(ScriptStream &, const std::string &)> Script;
+
+  int csq = 20;            ///< RSSI index answered to AT+CSQ
+  int creg = 1;            ///< <stat> answered to AT+CREG?
+  bool silent = false;     ///< Answer nothing (a dead module)
+  Script script;           ///< Overrides the default answers when set
+  std::vector<std::string> lines;  ///< Lines written by A9G, CR/LF stripped
+
+  /**
+     * @brief Default answer to one command line.
+     */
+  std::string answer(const std::string &l) {
+    if (silent) return "";
+    if (l == "AT+CSQ") return "\r\n+CSQ: " + std::to_string(csq) + ",0\r\n\r\nOK\r\n";
+    if (l == "AT+CREG?") return "\r\n+CREG: 1," + std::to_string(creg) + "\r\n\r\nOK\r\n";
+    return "\r\nOK\r\n";
+  }
+
+  void feed(const std::string &s) { _rx.insert(_rx.end(), s.begin(), s.end()); }
+
+  /**
+     * @brief Lines starting with @p prefix, from line @p from on.
+     */
+  int count(const std::string &prefix, size_t from = 0) const {
+    int n = 0;
+    for (size_t i = from; i < lines.size(); i++) {
+      if (lines[i].compare(0, prefix.size(), prefix) == 0) n++;
+    }
+    return n;
+  }
+
+  size_t write(uint8_t c) override {
+    if (c != '\n') {
+      _line += (char)c;
+      return 1;
+    }
+    std::string l = _line;
+    _line.clear();
+    if (!l.empty() && l[l.size() - 1] == '\r') l.erase(l.size() - 1);
+    lines.push_back(l);
+    feed(script ? script(*this, l) : answer(l));
+    return 1;
+  }
+  using Print::write;
+
+  int available() override {
+    hostAdvance(1);  // a polling loop moves time forward
+    return _rx.size();
+  }
+  int read() override {
+    if (_rx.empty()) return -1;
+    uint8_t c = _rx.front();
+    _rx.pop_front();
+    return c;
+  }
+  int peek() override { return _rx.empty() ? -1 : (uint8_t)_rx.front(); }
+  int availableForWrite() override { return 1 << 20; }
+
+private:
+  std::string _line;
+  std::deque<char> _rx;
+};
+
+#endif  // SCRIPTSTREAM_H
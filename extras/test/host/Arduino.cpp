@@ -0,0 +1,14 @@
+#include "Arduino.h"
+HostSerial Serial;
+static unsigned long g_host_us = 0;
+unsigned long micros() { return g_host_us; }
+unsigned long millis() { return g_host_us / 1000; }
+void delay(unsigned long ms) { g_host_us += ms * 1000; }
+void delayMicroseconds(unsigned int us) { g_host_us += us; }
+void hostAdvance(unsigned long us) { g_host_us += us; }
+long random(long a, long b) { return a + rand() % (b - a); }
+long random(long b) { return rand() % b; }
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return 0; }
+void yield() { g_host_us += 10; }
@@ -0,0 +1,110 @@
+// Minimal host stand-in for the Arduino core, enough to build the library
+// and the tests in extras/test on a PC. Time only moves through delay(),
+// yield() and hostAdvance(), so the tests are deterministic.
+#ifndef ARDUINO_H_HOST
+#define ARDUINO_H_HOST
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+typedef bool boolean;
+typedef uint8_t byte;
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+#define pgm_read_byte(a) (*(const uint8_t *)(a))
+#define pgm_read_word(a) (*(const uint16_t *)(a))
+#define pgm_read_dword(a) (*(const uint32_t *)(a))
+#define pgm_read_ptr(a) (*(void * const *)(a))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+long random(long, long);
+long random(long);
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+void yield();
+void hostAdvance(unsigned long us);
+class String {
+public:
+  std::string s;
+  String(const char *c = "") : s(c ? c : "") {}
+  String(int v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+  String(double v, int d = 2) { char b[32]; snprintf(b, 32, "%.*f", d, v); s = b; }
+  const char *c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.size(); }
+  String &operator+=(char c) { s += c; return *this; }
+  String &operator+=(const char *c) { s += c; return *this; }
+  String &operator+=(const String &o) { s += o.s; return *this; }
+  String &operator=(const char *c) { s = c ? c : ""; return *this; }
+  friend String operator+(const String &a, const String &b) { String r; r.s = a.s + b.s; return r; }
+  friend String operator+(const char *a, const String &b) { String r; r.s = std::string(a) + b.s; return r; }
+  friend String operator+(const String &a, const char *b) { String r; r.s = a.s + b; return r; }
+  int indexOf(const char *c, unsigned f = 0) const { size_t p = s.find(c, f); return p == std::string::npos ? -1 : (int)p; }
+  int indexOf(char c, unsigned f = 0) const { size_t p = s.find(c, f); return p == std::string::npos ? -1 : (int)p; }
+  String substring(unsigned a, unsigned b) const { String r; r.s = s.substr(a, b - a); return r; }
+  long toInt() const { return atol(s.c_str()); }
+  void reserve(unsigned) {}
+};
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *b, size_t n) { size_t i = 0; while (i < n && write(b[i])) i++; return i; }
+  size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+  size_t write(const char *s, size_t n) { return write((const uint8_t *)s, n); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+  size_t print(const char *s) { return write(s); }
+  size_t print(const __FlashStringHelper *s) { return write((const char *)s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = 10) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = 10) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = 10) { char b[24]; snprintf(b, 24, base == 16 ? "%lx" : "%ld", v); return write(b); }
+  size_t print(unsigned long v, int base = 10) { char b[24]; snprintf(b, 24, base == 16 ? "%lx" : "%lu", v); return write(b); }
+  size_t print(unsigned char v, int base = 10) { return print((unsigned long)v, base); }
+  size_t print(double v, int d = 2) { char b[32]; snprintf(b, 32, "%.*f", d, v); return write(b); }
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(T v, int b) { size_t n = print(v, b); return n + println(); }
+};
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long) {}
+};
+class HostSerial : public Stream {
+public:
+  size_t write(uint8_t c) override { fputc(c, stdout); return 1; }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  int availableForWrite() override { return 64; }
+  void begin(unsigned long) {}
+};
+extern HostSerial Serial;
+#endif
@@ -0,0 +1,2 @@
+// Host stand-in: the Arduino core declares Stream in Arduino.h
+#include "Arduino.h"
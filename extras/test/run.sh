@@ -0,0 +1,17 @@
+#!/bin/sh
+# Builds and runs the host tests: ./run.sh [test_name ...]
+# Needs a C++11 compiler; CXX and CXXFLAGS are honoured.
+cd "$(dirname "$0")" || exit 1
+CXX=${CXX:-g++}
+SRC=../../src
+OUT=${TMPDIR:-/tmp}/a9gmod-tests
+mkdir -p "$OUT"
+tests=${*:-$(ls test_*.cpp | sed 's/\.cpp$//')}
+failed=0
+for t in $tests; do
+  if ! $CXX -std=gnu++11 -Wall -Wextra $CXXFLAGS -Ihost -I. -I$SRC host/Arduino.cpp $SRC/*.cpp "$t.cpp" -o "$OUT/$t"; then
+    echo "$t: BUILD FAILED"; failed=1; continue
+  fi
+  if "$OUT/$t"; then echo "$t: ok"; else echo "$t: FAILED"; failed=1; fi
+done
+exit $failed
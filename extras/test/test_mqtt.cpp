@@ -0,0 +1,260 @@
+// A9GMqttClient against a scripted broker behind the +CIPRCV / AT+CIPSEND
+// framing: CONNECT, QoS 1 acknowledgement and expiry, SUBACK refusal,
+// keepalive, oversized and split inbound packets, stray SEND OK, and in
+// A9Gmod the in-flight window as backpressure and inbound duplicates.
+#include "ScriptStream.h"
+#include "A9GMqtt.h"
+
+/**
+ * @brief ScriptStream with a socket: the bytes after a CIPSEND prompt are
+ *        MQTT packets and are answered as a broker would.
+ */
+class BrokerStream : public ScriptStream {
+public:
+  uint8_t connack = 0;     ///< Return code of the CONNACK
+  bool pubAck = true;      ///< Acknowledge QoS 1 publishes
+  bool refuseSub = false;  ///< SUBACK with 0x80
+  bool sendOk = false;     ///< Late "SEND OK" after a data phase, with the next answer
+  std::string ignore;      ///< Command left unanswered
+  int pings = 0;
+  std::vector<std::string> published;  ///< Topics of the PUBLISH packets
+
+  BrokerStream() {
+    script = [this](ScriptStream &s, const std::string &l) -> std::string {
+      if (l.compare(0, 12, "AT+CIPSTART=") == 0) return "\r\nOK\r\n\r\nCONNECT OK\r\n";
+      if (l.compare(0, 11, "AT+CIPSEND=") == 0) {
+        _dataLeft = atoi(l.c_str() + 11);
+        return "\r\n> ";
+      }
+      std::string late;
+      late.swap(_late);
+      return late + (l == ignore ? "" : s.answer(l));
+    };
+  }
+
+  /**
+     * @brief Deliver @p pkt as one +CIPRCV chunk.
+     */
+  void receive(const std::string &pkt) {
+    feed("\r\n+CIPRCV:" + std::to_string(pkt.size()) + "," + pkt + "\r\n");
+  }
+
+  static std::string packet(uint8_t header, const std::string &body) {
+    std::string p(1, (char)header);
+    size_t n = body.size();
+    do {
+      uint8_t b = n & 0x7F;
+      n >>= 7;
+      p += (char)(n ? b | 0x80 : b);
+    } while (n);
+    return p + body;
+  }
+
+  static std::string str(const std::string &s) {
+    return std::string(1, (char)(s.size() >> 8)) + (char)s.size() + s;
+  }
+
+  size_t write(uint8_t c) override {
+    if (!_dataLeft) return ScriptStream::write(c);
+    _data += (char)c;
+    if (!--_dataLeft) {
+      feed("\r\nOK\r\n");
+      if (sendOk) _late = "\r\nSEND OK\r\n";
+      _packet(_data);
+      _data.clear();
+    }
+    return 1;
+  }
+  using Print::write;
+
+private:
+  size_t _dataLeft = 0;
+  std::string _data;
+  std::string _late;
+
+  void _packet(const std::string &p) {
+    uint8_t type = (uint8_t)p[0] >> 4;
+    size_t pos = 1;
+    while ((uint8_t)p[pos] & 0x80) pos++;
+    std::string body = p.substr(pos + 1);
+    switch (type) {
+      case 1:  // CONNECT
+        receive(packet(0x20, std::string("\0", 1) + (char)connack));
+        break;
+      case 3: {  // PUBLISH
+        size_t topicLen = ((uint8_t)body[0] << 8) | (uint8_t)body[1];
+        published.push_back(body.substr(2, topicLen));
+        if ((p[0] & 0x06) && pubAck) receive(packet(0x40, body.substr(2 + topicLen, 2)));
+        break;
+      }
+      case 8:  // SUBSCRIBE
+        receive(packet(0x90, body.substr(0, 2) + (refuseSub ? '\x80' : body[body.size() - 1])));
+        break;
+      case 12:  // PINGREQ
+        pings++;
+        receive(packet(0xD0, ""));
+        break;
+    }
+  }
+};
+
+static int got = 0;
+static std::string gotTopic;
+static size_t gotLen = 0;
+static void onData(void *, const char *topic, const uint8_t *, size_t len) {
+  got++;
+  gotTopic = topic;
+  gotLen = len;
+}
+
+static int acked = 0, lost = 0;
+static void onResult(void *, bool ok) { ok ? acked++ : lost++; }
+
+static void spin(A9GMqttClient &c, unsigned long ms) {
+  for (unsigned long t = 0; t < ms; t += 10) {
+    c.loop();
+    hostAdvance(10000);
+  }
+}
+
+static void testSession() {
+  BrokerStream s;
+  A9G a;
+  CHECK(a.init(&s));
+  A9GMqttClient c(a);
+  c.onMessage(onData);
+  c.onPublishResult(onResult);
+
+  // CONNECT / CONNACK, refused and accepted
+  s.connack = 5;
+  CHECK(!c.connect("broker", 1883, "dev") && c.connackCode() == 5);
+  s.connack = 0;
+  CHECK(c.connect("broker", 1883, "dev", nullptr, nullptr, 20) && c.connected());
+
+  // QoS 1: the slot is held until the PUBACK
+  const uint8_t data[] = { 0, 1, 2, '\n', 0xFF };
+  CHECK(c.publish("t/raw", data, sizeof(data), 1));
+  spin(c, 50);
+  CHECK(acked == 1 && c.inFlight() == 0 && s.published.back() == "t/raw");
+
+  // ... and counted as failed without one
+  s.pubAck = false;
+  CHECK(c.publish("t/raw", data, sizeof(data), 1) && c.inFlight() == 1);
+  spin(c, A9G_MQTT_ACK_TIMEOUT + 100);
+  CHECK(lost == 1 && c.ackTimeouts() == 1 && c.inFlight() == 0);
+  s.pubAck = true;
+
+  // SUBACK refusal
+  CHECK(c.subscribe("in", 1));
+  s.refuseSub = true;
+  CHECK(!c.subscribe("secret", 1) && c.connected());
+  s.refuseSub = false;
+
+  // Keepalive: PINGREQ after 3/4 of the period of silence, answered
+  int pings = s.pings;
+  spin(c, 16000);
+  CHECK(s.pings == pings + 1 && c.connected());
+  spin(c, 20000);
+  CHECK(c.connected());
+
+  // A PUBLISH over A9G_MQTT_PACKET_MAX is skipped, in chunks that fit the
+  // socket buffer; the stream stays in step
+  std::string big = BrokerStream::packet(0x30, BrokerStream::str("in") +
+                                               std::string(A9G_MQTT_PACKET_MAX + 100, 'x'));
+  for (size_t i = 0; i < big.size(); i += 400) {
+    s.receive(big.substr(i, 400));
+    spin(c, 20);
+  }
+  CHECK(c.oversized() == 1 && got == 0 && c.connected());
+
+  // One packet split over two +CIPRCV, polled apart
+  std::string pkt = BrokerStream::packet(0x30, BrokerStream::str("in/x") + "hello");
+  s.receive(pkt.substr(0, 4));
+  spin(c, 20);
+  CHECK(got == 0);
+  s.receive(pkt.substr(4));
+  spin(c, 20);
+  CHECK(got == 1 && gotTopic == "in/x" && gotLen == 5 && c.connected());
+
+  // A SEND OK trailing the OK of a data phase does not complete the next command,
+  // even when it only shows up after that command went out
+  s.sendOk = true;
+  s.ignore = "AT+CGATT?";
+  CHECK(c.publish("t", data, 1, 0));
+  CHECK(!a.isGPRSAttached() && a.timedOut());
+}
+
+/**
+ * @brief A full in-flight window holds the outbox back without counting
+ *        failures or ending the session.
+ */
+static void testBackpressure() {
+  BrokerStream s;
+  s.pubAck = false;
+  A9G a;
+  CHECK(a.init(&s));
+  A9GMqttClient c(a);
+  A9Gmod m(a);
+  m.useNativeMQTT(&c);
+  m.setMQTTServer("broker", 1883);
+  CHECK(m.connectMQTT("dev"));
+
+  for (int i = 0; i < A9G_MQTT_INFLIGHT; i++) CHECK(m.publishMQTT("t", "v", 1));
+  CHECK(!c.canPublish(1) && c.canPublish(0));
+  CHECK(!m.publishMQTT("t", "v", 1));
+  CHECK(m.publishFailures() == 0 && m.publishStats().failed[1] == 0);
+  CHECK(m.publishStats().sent[1] == A9G_MQTT_INFLIGHT);
+
+  CHECK(m.queueMQTT("t", "queued", PRIO_NORMAL, 1));
+  for (int i = 0; i < 10; i++) {
+    m.processMQTT();
+    hostAdvance(10000);
+  }
+  CHECK(m.pendingMQTT() == 1 && m.publishFailures() == 0 && m.isMQTTConnected());
+
+  // PUBACKs free the window, the queued message goes out
+  s.pubAck = true;
+  for (uint16_t id = 1; id <= A9G_MQTT_INFLIGHT; id++) {
+    s.receive(BrokerStream::packet(0x40, std::string(1, (char)(id >> 8)) + (char)id));
+  }
+  for (int i = 0; i < 50; i++) {
+    m.processMQTT();
+    hostAdvance(10000);
+  }
+  CHECK(m.pendingMQTT() == 0 && m.publishStats().completed[1] == A9G_MQTT_INFLIGHT + 1);
+  CHECK(m.publishStats().failed[1] == 0);
+}
+
+/**
+ * @brief A QoS 1 redelivery on the native transport is dropped by the
+ *        duplicate window, like one of the AT transport.
+ */
+static void testDuplicates() {
+  BrokerStream s;
+  A9G a;
+  CHECK(a.init(&s));
+  A9GMqttClient c(a);
+  A9Gmod m(a);
+  m.useNativeMQTT(&c);
+  m.setMQTTServer("broker", 1883);
+  CHECK(m.connectMQTT("dev"));
+  m.onMQTTData(onData);
+  m.setDuplicateWindow(5000);
+
+  got = 0;
+  std::string pub = BrokerStream::packet(0x32, BrokerStream::str("in") + std::string("\0\x07", 2) + "on");
+  std::string redelivered = pub;
+  redelivered[0] |= 0x08;  // DUP flag
+  s.receive(pub);
+  s.receive(redelivered);
+  s.receive(BrokerStream::packet(0x30, BrokerStream::str("in") + "off"));
+  for (int i = 0; i < 10; i++) m.processMQTT();
+  CHECK(got == 2 && gotLen == 3 && m.duplicatesDropped() == 1);
+}
+
+int main() {
+  testSession();
+  testBackpressure();
+  testDuplicates();
+  return 0;
+}
@@ -0,0 +1,176 @@
+// A9GPool over three emulated modules: selection, merged inbound stream,
+// failover on lost registration and on failing publishes, drain, recovery.
+#include "ScriptStream.h"
+#include "A9GPool.h"
+
+static int got = 0;
+static uint8_t gotFrom = 0xFF;
+static void onMsg(uint8_t modem, const char *, const char *) {
+  got++;
+  gotFrom = modem;
+}
+
+static void spin(A9GPool &pool, unsigned long ms) {
+  for (unsigned long t = 0; t < ms; t += 10) {
+    pool.loop();
+    hostAdvance(10000);
+  }
+}
+
+static std::string noPubAck(ScriptStream &s, const std::string &l) {
+  return l.compare(0, 10, "AT+MQTTPUB") == 0 ? "" : s.answer(l);
+}
+
+static void testFailover() {
+  ScriptStream s0, s1, s2;
+  s0.csq = 10;
+  s1.csq = 25;
+  s2.csq = 18;
+  A9G a0, a1, a2;
+  A9Gmod c0(a0), c1(a1), c2(a2);
+  CHECK(a0.init(&s0) && a1.init(&s1) && a2.init(&s2));
+  A9GPool pool;
+  CHECK(pool.addModem(c0) && pool.addModem(c1) && pool.addModem(c2));
+  pool.setMQTTServer("broker", 1883);
+  pool.onMessage(onMsg);
+  CHECK(pool.connectAll("dev") == 3);
+  a0.querySignalQuality();
+  a1.querySignalQuality();
+  a2.querySignalQuality();
+
+  // Selection: strongest signal first, queue depth evens it out
+  CHECK(pool.selectModem() == 1);
+  for (int i = 0; i < 4; i++) CHECK(pool.publish("t", "x"));
+  CHECK(c1.pendingMQTT() == 2 && c2.pendingMQTT() == 1 && c0.pendingMQTT() == 1);
+  spin(pool, 500);
+  CHECK(pool.pending() == 0);
+  CHECK(s0.count("AT+MQTTPUB") == 1 && s1.count("AT+MQTTPUB") == 2 && s2.count("AT+MQTTPUB") == 1);
+
+  // Subscriptions live on the primary; only its deliveries are merged
+  CHECK(pool.subscribe("in") && pool.primaryModem() == 0);
+  CHECK(s0.count("AT+MQTTSUB") == 1 && s1.count("AT+MQTTSUB") == 0);
+  s1.feed("+MQTTPUBLISH: in,1,3,dup\r\n");
+  s0.feed("+MQTTPUBLISH: in,1,5,hello\r\n");
+  spin(pool, 100);
+  CHECK(got == 1 && gotFrom == 0);
+
+  // Module 0 loses registration: marked down from the background AT+CREG?,
+  // the subscriptions move to the new primary
+  s0.creg = 0;
+  spin(pool, 31000);
+  CHECK(!pool.isHealthy(0) && pool.primaryModem() == 1 && s1.count("AT+MQTTSUB") == 1);
+  s0.feed("+MQTTPUBLISH: in,1,5,stale\r\n");
+  s1.feed("+MQTTPUBLISH: in,1,5,fresh\r\n");
+  spin(pool, 100);
+  CHECK(got == 2 && gotFrom == 1);
+
+  // A silent module never stalls loop(): health checks do not wait
+  s0.silent = true;
+  for (int i = 0; i < 40; i++) {
+    hostAdvance(1000000UL);
+    unsigned long t0 = millis();
+    pool.loop();
+    CHECK(millis() - t0 < 50);
+  }
+  s0.silent = false;
+
+  // Module 2 stops acknowledging publishes: taken out, its queue drained
+  s2.script = noPubAck;
+  size_t mark1 = s1.lines.size();
+  for (int i = 0; i < 6; i++) CHECK(pool.publish("t", "y"));
+  CHECK(c2.pendingMQTT() > 0);
+  spin(pool, 20000);
+  CHECK(!pool.isHealthy(2) && pool.pending() == 0);
+  CHECK(s1.count("AT+MQTTPUB", mark1) + s2.count("AT+MQTTPUB") - 1 >= 6);
+
+  // Module 0 registers again: the former primary is disconnected (its old
+  // session may hold the subscriptions) and reconnected in the background,
+  // in the same check round
+  size_t mark0 = s0.lines.size();
+  s0.creg = 1;
+  for (int t = 0; t < 70000 && !s0.count("AT+MQTTDISCONN", mark0); t += 10) {
+    pool.loop();
+    hostAdvance(10000);
+  }
+  size_t disc = s0.lines.size() - 1;
+  CHECK(s0.lines[disc] == "AT+MQTTDISCONN");
+  spin(pool, 100);
+  CHECK(pool.isHealthy(0) && pool.primaryModem() == 1);
+  size_t conn = disc + 1;
+  while (conn < s0.lines.size() && s0.lines[conn].compare(0, 12, "AT+MQTTCONN=") != 0) conn++;
+  CHECK(conn < s0.lines.size());
+  CHECK(s0.lines[conn].find(",1,") != std::string::npos);  // clean session
+  CHECK(s0.lines[conn].find("\"dev-0\"") != std::string::npos);
+}
+
+/**
+ * A module marked down while its head publish is in flight: the publish
+ * completes during the drain, nothing is re-queued elsewhere.
+ */
+static void testDrainInFlight() {
+  ScriptStream s0, s1;
+  s0.csq = 25;
+  s1.csq = 10;
+  s0.script = noPubAck;
+  A9G a0, a1;
+  A9Gmod c0(a0), c1(a1);
+  CHECK(a0.init(&s0) && a1.init(&s1));
+  a0.setAsyncTx(true);
+  A9GPool pool;
+  pool.addModem(c0);
+  pool.addModem(c1);
+  pool.setMQTTServer("broker", 1883);
+  CHECK(pool.connectAll("dev") == 2);
+  a0.querySignalQuality();
+  a1.querySignalQuality();
+
+  CHECK(pool.publish("t", "x") && c0.pendingMQTT() == 1);
+  spin(pool, 50);
+  CHECK(s0.count("AT+MQTTPUB") == 1 && a0.isBusy());
+  s0.feed("\r\n+CREG: 0\r\n\r\nOK\r\n");
+  spin(pool, 100);
+  CHECK(!pool.isHealthy(0) && c0.pendingMQTT() == 0);
+  CHECK(c1.pendingMQTT() == 0 && s1.count("AT+MQTTPUB") == 0);
+}
+
+/**
+ * The same with the publish left unanswered: the drain does not wait for it,
+ * the message moves once the publish has timed out.
+ */
+static void testDrainWaitsForResult() {
+  ScriptStream s0, s1;
+  s0.csq = 25;
+  s1.csq = 10;
+  s0.script = noPubAck;
+  A9G a0, a1;
+  A9Gmod c0(a0), c1(a1);
+  CHECK(a0.init(&s0) && a1.init(&s1));
+  a0.setAsyncTx(true);
+  A9GPool pool;
+  pool.addModem(c0);
+  pool.addModem(c1);
+  pool.setMQTTServer("broker", 1883);
+  CHECK(pool.connectAll("dev") == 2);
+  a0.querySignalQuality();
+  a1.querySignalQuality();
+
+  CHECK(pool.publish("t", "x"));
+  spin(pool, 50);
+  s0.feed("\r\n+CREG: 0\r\n");
+  for (int i = 0; i < 20; i++) {
+    unsigned long t0 = millis();
+    pool.loop();
+    CHECK(millis() - t0 < 50);
+    hostAdvance(10000);
+  }
+  CHECK(!pool.isHealthy(0) && a0.isBusy() && c0.pendingMQTT() == 1 && c1.pendingMQTT() == 0);
+  spin(pool, 20000);
+  CHECK(c0.pendingMQTT() == 0 && s1.count("AT+MQTTPUB") == 1);
+}
+
+int main() {
+  testFailover();
+  testDrainInFlight();
+  testDrainWaitsForResult();
+  return 0;
+}
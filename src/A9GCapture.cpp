@@ -0,0 +1,259 @@
+#include "A9GCapture.h"
+
+/* ------------------------------------------------------------------
+ *                   A9G_CaptureStream IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+#define CHUNK_TX 0x80
+#define CHUNK_MAX 0x7F
+
+static uint8_t varintLen(unsigned long v) {
+  uint8_t n = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+A9G_CaptureStream::A9G_CaptureStream(Stream &inner)
+  : _inner(&inner),
+    _enabled(true),
+    _dropped(0) {
+  clear();
+}
+
+void A9G_CaptureStream::clear() {
+  _tail = 0;
+  _used = 0;
+  _open = -1;
+  _openTx = false;
+  _last = 0;
+  _hasLast = false;
+}
+
+int A9G_CaptureStream::read() {
+  int c = _inner->read();
+  if (c >= 0) {
+    uint8_t b = c;
+    _record(false, &b, 1);
+  }
+  return c;
+}
+
+size_t A9G_CaptureStream::write(const uint8_t *buffer, size_t size) {
+  size_t n = _inner->write(buffer, size);
+  _record(true, buffer, n);
+  return n;
+}
+
+/**
+ * @brief Append bytes, growing the open chunk when the direction matches and
+ *        the previous record is recent enough.
+ */
+void A9G_CaptureStream::_record(bool tx, const uint8_t *data, size_t len) {
+  if (!_enabled || !len) return;
+  unsigned long now = micros();
+  unsigned long dt = _hasLast ? now - _last : 0;
+  _last = now;
+  _hasLast = true;
+
+  bool merge = _open >= 0 && _openTx == tx && dt <= A9G_CAPTURE_MERGE_US;
+  while (len) {
+    if (merge && (_at(_open) & CHUNK_MAX) < CHUNK_MAX && _makeRoom(1) && _open >= 0) {
+      _at(_open)++;  // count lives in the low bits of the header
+      _push(*data++);
+      len--;
+      continue;
+    }
+    // New chunk: header, delta, first byte
+    if (!_makeRoom(1 + varintLen(dt) + 1)) return;
+    _open = _used;
+    _openTx = tx;
+    _push((tx ? CHUNK_TX : 0) | 1);
+    unsigned long v = dt;
+    while (v >= 0x80) {
+      _push((v & 0x7F) | 0x80);
+      v >>= 7;
+    }
+    _push(v);
+    _push(*data++);
+    len--;
+    dt = 0;  // the rest of this call happened at the same time
+    merge = true;
+  }
+}
+
+/**
+ * @brief Drop the oldest chunks until n more bytes fit.
+ */
+bool A9G_CaptureStream::_makeRoom(size_t n) {
+  if (n > A9G_CAPTURE_SIZE) return false;
+  while (A9G_CAPTURE_SIZE - _used < n) {
+    _dropOldest();
+  }
+  return true;
+}
+
+void A9G_CaptureStream::_dropOldest() {
+  size_t size = 1;
+  uint8_t count = _at(0) & CHUNK_MAX;
+  while (_at(size) & 0x80) size++;  // delta continuation bytes
+  size += 1 + count;
+  if (size > _used) size = _used;
+
+  _tail = (_tail + size) % A9G_CAPTURE_SIZE;
+  _used -= size;
+  if (_open >= 0) {
+    // Positions are relative to the tail
+    _open = (size_t)_open >= size ? _open - size : -1;
+  }
+  _dropped++;
+  // The delta of the new oldest chunk now refers to a chunk that is gone;
+  // replay only uses differences, so it simply starts from there.
+}
+
+void A9G_CaptureStream::_push(uint8_t b) {
+  _buf[(_tail + _used) % A9G_CAPTURE_SIZE] = b;
+  _used++;
+}
+
+size_t A9G_CaptureStream::copy(uint8_t *out, size_t cap) const {
+  if (cap < size()) return 0;
+  out[0] = A9G_CAPTURE_MAGIC0;
+  out[1] = A9G_CAPTURE_MAGIC1;
+  for (size_t i = 0; i < _used; i++) {
+    out[2 + i] = _buf[(_tail + i) % A9G_CAPTURE_SIZE];
+  }
+  return size();
+}
+
+void A9G_CaptureStream::dump(Print &out) const {
+  static const char digits[] = "0123456789ABCDEF";
+  char line[65];
+  uint8_t n = 0;
+  for (size_t i = 0; i < size(); i++) {
+    uint8_t b;
+    if (i == 0) b = A9G_CAPTURE_MAGIC0;
+    else if (i == 1) b = A9G_CAPTURE_MAGIC1;
+    else b = _buf[(_tail + i - 2) % A9G_CAPTURE_SIZE];
+    line[n++] = digits[b >> 4];
+    line[n++] = digits[b & 0x0F];
+    if (n == 64 || i + 1 == size()) {
+      line[n] = '\0';
+      out.println(line);
+      n = 0;
+    }
+  }
+}
+
+size_t A9G_Capture_fromHex(const char *hex, uint8_t *out, size_t cap) {
+  size_t n = 0;
+  int8_t high = -1;
+  for (const char *p = hex; *p && n < cap; p++) {
+    int8_t v;
+    if (*p >= '0' && *p <= '9') v = *p - '0';
+    else if (*p >= 'A' && *p <= 'F') v = *p - 'A' + 10;
+    else if (*p >= 'a' && *p <= 'f') v = *p - 'a' + 10;
+    else continue;
+    if (high < 0) {
+      high = v;
+    } else {
+      out[n++] = (high << 4) | v;
+      high = -1;
+    }
+  }
+  return n;
+}
+
+/* ------------------------------------------------------------------
+ *                   A9G_ReplayStream IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9G_ReplayStream::A9G_ReplayStream(const uint8_t *capture, size_t len, bool realTime)
+  : _data(capture),
+    _len(len),
+    _realTime(realTime) {
+  rewind();
+}
+
+void A9G_ReplayStream::rewind() {
+  _valid = _len >= 2 && _data[0] == A9G_CAPTURE_MAGIC0 && _data[1] == A9G_CAPTURE_MAGIC1;
+  _pos = _valid ? 2 : _len;
+  _left = 0;
+  _tx = false;
+  _chunkTime = 0;
+  _anchorRec = 0;
+  _anchorReal = micros();
+  _mismatches = 0;
+  _next();
+  // Recorded times count from the first chunk
+  _anchorRec = _chunkTime;
+}
+
+/**
+ * @brief Load the next chunk header.
+ * @return false at the end of the capture
+ */
+bool A9G_ReplayStream::_next() {
+  if (_pos >= _len) return false;
+  uint8_t hdr = _data[_pos++];
+  unsigned long dt = 0;
+  uint8_t shift = 0;
+  while (_pos < _len) {
+    uint8_t b = _data[_pos++];
+    dt |= (unsigned long)(b & 0x7F) << shift;
+    shift += 7;
+    if (!(b & 0x80)) break;
+  }
+  _tx = hdr & CHUNK_TX;
+  _left = hdr & CHUNK_MAX;
+  _chunkTime += dt;
+  if (_pos + _left > _len) {
+    // Cut short (e.g. a partial dump): stop here
+    _valid = false;
+    _left = 0;
+    _pos = _len;
+    return false;
+  }
+  return _left > 0 || _next();
+}
+
+/**
+ * @brief Whether the current read chunk may be handed out yet.
+ */
+bool A9G_ReplayStream::_due() {
+  if (!_left || _tx) return false;
+  if (!_realTime) return true;
+  return micros() - _anchorReal >= _chunkTime - _anchorRec;
+}
+
+int A9G_ReplayStream::available() {
+  return _due() ? _left : 0;
+}
+
+int A9G_ReplayStream::peek() {
+  return _due() ? _data[_pos] : -1;
+}
+
+int A9G_ReplayStream::read() {
+  if (!_due()) return -1;
+  uint8_t c = _data[_pos++];
+  if (!--_left) _next();
+  return c;
+}
+
+size_t A9G_ReplayStream::write(uint8_t c) {
+  if (!_left || !_tx) {
+    // Nothing was written at this point of the capture
+    _mismatches++;
+    return 1;
+  }
+  if (_data[_pos] != c) _mismatches++;
+  _pos++;
+  // The replies to this write are timed from now on
+  _anchorReal = micros();
+  _anchorRec = _chunkTime;
+  if (!--_left) _next();
+  return 1;
+}
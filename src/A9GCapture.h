@@ -0,0 +1,191 @@
+#ifndef A9GCAPTURE_H
+#define A9GCAPTURE_H
+
+#include <Arduino.h>
+#include <Stream.h>
+
+/*!
+ * @file A9GCapture.h
+ *
+ * @brief UART capture and replay.
+ *        - A9G_CaptureStream sits between A9G and the modem serial port and
+ *          records every byte in both directions with microsecond timing.
+ *        - A9G_ReplayStream plays such a capture back into A9G, with the
+ *          original response timing or as fast as possible.
+ *
+ * Capture format (after the two magic bytes A9 C1), a sequence of chunks:
+ *   <hdr> <delta us, LEB128 varint> <data bytes>
+ *   hdr bit 7: 1 = written to the modem, 0 = read from it; bits 0-6: byte count (1..127)
+ * The delta is measured from the previous chunk; consecutive reads closer than
+ * A9G_CAPTURE_MERGE_US share one chunk.
+ */
+
+/* ------------------------------------------------------------------
+ *                      CAPTURE CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_CAPTURE_SIZE
+#if defined(__AVR__)
+#define A9G_CAPTURE_SIZE 256         ///< Ring size in bytes; the oldest chunks are dropped
+#else
+#define A9G_CAPTURE_SIZE 4096
+#endif
+#endif
+
+#ifndef A9G_CAPTURE_MERGE_US
+#define A9G_CAPTURE_MERGE_US 200     ///< Reads closer than this are stored as one chunk
+#endif
+
+#define A9G_CAPTURE_MAGIC0 0xA9
+#define A9G_CAPTURE_MAGIC1 0xC1
+
+/**
+ * @class A9G_CaptureStream
+ * @brief Pass-through Stream that records the traffic of another Stream.
+ *
+ * Usage:
+ *   A9G_CaptureStream capture(modemSerial);
+ *   a9g.init(&capture);
+ *   ...
+ *   capture.dump(Serial);   // hex lines, feed them to A9G_Capture_fromHex() on the host
+ */
+class A9G_CaptureStream : public Stream {
+public:
+  explicit A9G_CaptureStream(Stream &inner);
+
+  /**
+     * @brief Pause or resume recording (traffic always passes through).
+     */
+  void setEnabled(bool enabled) { _enabled = enabled; }
+  bool enabled() const { return _enabled; }
+
+  /**
+     * @brief Forget everything recorded.
+     */
+  void clear();
+
+  /**
+     * @brief Size of the capture as returned by copy(), including the magic.
+     */
+  size_t size() const { return _used + 2; }
+
+  /**
+     * @brief Chunks dropped because the ring was full.
+     */
+  uint32_t droppedChunks() const { return _dropped; }
+
+  /**
+     * @brief Copy the capture (magic + chunks, oldest first), e.g. to a file.
+     * @return Bytes copied, 0 if @p cap is smaller than size()
+     */
+  size_t copy(uint8_t *out, size_t cap) const;
+
+  /**
+     * @brief Print the capture as hex, 32 bytes per line.
+     */
+  void dump(Print &out) const;
+
+  // Stream
+  int available() override { return _inner->available(); }
+  int read() override;
+  int peek() override { return _inner->peek(); }
+  void flush() override { _inner->flush(); }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  int availableForWrite() override { return _inner->availableForWrite(); }
+  using Print::write;
+
+private:
+  static_assert(A9G_CAPTURE_SIZE >= 160, "A9G_CAPTURE_SIZE must hold at least one full chunk");
+
+  Stream *_inner;
+  uint8_t _buf[A9G_CAPTURE_SIZE];
+  size_t _tail;                      ///< Oldest chunk
+  size_t _used;
+  int _open;                         ///< Position of the header of the chunk still growing (-1 = none)
+  bool _openTx;
+  unsigned long _last;               ///< micros() of the previous record
+  bool _hasLast;
+  bool _enabled;
+  uint32_t _dropped;
+
+  void _record(bool tx, const uint8_t *data, size_t len);
+  bool _makeRoom(size_t n);
+  void _dropOldest();
+  void _push(uint8_t b);
+  uint8_t &_at(size_t i) { return _buf[(_tail + i) % A9G_CAPTURE_SIZE]; }
+};
+
+/**
+ * @class A9G_ReplayStream
+ * @brief Stream that plays a capture back to A9G.
+ *
+ * Recorded reads are handed out in order. A recorded write blocks the reads
+ * behind it until A9G has written as many bytes, so responses never arrive
+ * before their command. Written bytes that differ from the capture are
+ * counted in mismatches().
+ *
+ * With realTime the reads after a write keep their recorded distance to it,
+ * otherwise they are available immediately.
+ */
+class A9G_ReplayStream : public Stream {
+public:
+  /**
+     * @param capture Output of A9G_CaptureStream::copy() (must stay valid)
+     */
+  A9G_ReplayStream(const uint8_t *capture, size_t len, bool realTime = true);
+
+  /**
+     * @brief Start over from the first chunk.
+     */
+  void rewind();
+
+  /**
+     * @brief All chunks were consumed.
+     */
+  bool done() const { return _left == 0 && _pos >= _len; }
+
+  /**
+     * @brief Written bytes that did not match the capture (or came while reads were pending).
+     */
+  uint32_t mismatches() const { return _mismatches; }
+
+  /**
+     * @brief false if the data does not start with the capture magic or is cut short.
+     */
+  bool valid() const { return _valid; }
+
+  // Stream
+  int available() override;
+  int read() override;
+  int peek() override;
+  void flush() override {}
+  size_t write(uint8_t c) override;
+  int availableForWrite() override { return 1024; }
+  using Print::write;
+
+private:
+  const uint8_t *_data;
+  size_t _len;
+  size_t _pos;                       ///< Next chunk header
+  bool _realTime;
+  bool _valid;
+
+  bool _tx;                          ///< Direction of the current chunk
+  uint8_t _left;                     ///< Bytes left in the current chunk
+  unsigned long _chunkTime;          ///< Recorded time of the current chunk (us)
+  unsigned long _anchorRec;          ///< Recorded time of the last write
+  unsigned long _anchorReal;         ///< micros() when it was replayed
+  uint32_t _mismatches;
+
+  bool _next();
+  bool _due();
+};
+
+/**
+ * @brief Decode a hex dump (whitespace and line breaks are skipped).
+ * @return Bytes decoded
+ */
+size_t A9G_Capture_fromHex(const char *hex, uint8_t *out, size_t cap);
+
+#endif  // A9GCAPTURE_H
@@ -0,0 +1,205 @@
+#include "A9GClock.h"
+
+/* ------------------------------------------------------------------
+ *                   CALENDAR
+ * ------------------------------------------------------------------ */
+
+// Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's algorithm)
+static long daysFromCivil(long y, uint8_t m, uint8_t d) {
+  y -= m <= 2;
+  long era = y / 400;
+  long yoe = y - era * 400;
+  long doy = (153L * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097L + doe - 719468L;
+}
+
+uint32_t A9G_makeTime(uint16_t year, uint8_t month, uint8_t day,
+                      uint8_t hour, uint8_t minute, uint8_t second) {
+  return (uint32_t)daysFromCivil(year, month, day) * 86400UL +
+         hour * 3600UL + minute * 60UL + second;
+}
+
+static char *twoDigits(char *p, uint8_t v) {
+  *p++ = '0' + v / 10;
+  *p++ = '0' + v % 10;
+  return p;
+}
+
+size_t A9G_formatTime(uint32_t utc, char *buf, size_t len) {
+  if (len < 21) return 0;
+  long z = utc / 86400UL + 719468L;
+  uint32_t sec = utc % 86400UL;
+  long era = z / 146097L;
+  long doe = z - era * 146097L;
+  long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  long mp = (5 * doy + 2) / 153;
+  uint8_t day = doy - (153 * mp + 2) / 5 + 1;
+  uint8_t month = mp < 10 ? mp + 3 : mp - 9;
+  long year = yoe + era * 400 + (month <= 2);
+
+  char *p = twoDigits(twoDigits(buf, year / 100), year % 100);
+  *p++ = '-';
+  p = twoDigits(p, month);
+  *p++ = '-';
+  p = twoDigits(p, day);
+  *p++ = 'T';
+  p = twoDigits(p, sec / 3600);
+  *p++ = ':';
+  p = twoDigits(p, sec / 60 % 60);
+  *p++ = ':';
+  p = twoDigits(p, sec % 60);
+  *p++ = 'Z';
+  *p = '\0';
+  return p - buf;
+}
+
+/* ------------------------------------------------------------------
+ *                   A9GClock IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9GClock::A9GClock(A9G &modem)
+  : _modem(&modem),
+    _source(TIME_NONE),
+    _baseUtc(0),
+    _baseMs(0),
+    _refUtc(0),
+    _refMs(0),
+    _syncMs(0),
+    _gpsMs(0),
+    _gpsSynced(false),
+    _queryMs(0),
+    _queried(false),
+    _due(false),
+    _drift(0),
+    _offset(0),
+    _steps(0) {
+  _modem->addEventHandler(_onEvent, this);
+}
+
+A9GClock::~A9GClock() {
+  _modem->removeEventHandler(_onEvent, this);
+}
+
+/**
+ * @brief AT+CCLK? goes out once at start, then every A9G_CLOCK_RETRY while
+ *        unsynced and A9G_CLOCK_REFRESH after the last sync from any source.
+ */
+void A9GClock::loop() {
+  unsigned long now = millis();
+  bool due = _due || !_queried;
+  if (!due && now - _queryMs >= A9G_CLOCK_RETRY * 1000UL) {
+    due = !synced() || now - _syncMs >= A9G_CLOCK_REFRESH * 1000UL;
+  }
+  if (!due || !_modem->requestClock()) return;
+  _queryMs = now;
+  _queried = true;
+  _due = false;
+}
+
+uint32_t A9GClock::at(unsigned long ms) const {
+  if (!synced()) return 0;
+  return (uint32_t)(_atMs(ms) / 1000);
+}
+
+bool A9GClock::parse(const char *text, uint32_t *utc, int16_t *offsetMin) {
+  const char *p = text;
+  while (*p == ' ' || *p == '"') p++;
+  *utc = 0;
+  bool any = false;
+  if (*p >= '0' && *p <= '9') {
+    // yy/MM/dd,hh:mm:ss
+    long v[6];
+    static const char seps[] = "//,::";
+    for (uint8_t i = 0; i < 6; i++) {
+      if (*p < '0' || *p > '9') return false;
+      v[i] = 0;
+      while (*p >= '0' && *p <= '9') v[i] = v[i] * 10 + (*p++ - '0');
+      if (i < 5 && *p++ != seps[i]) return false;
+    }
+    if (v[0] < 100) v[0] += 2000;
+    if (v[1] < 1 || v[1] > 12 || v[2] < 1 || v[2] > 31 || v[3] > 23 || v[4] > 59 || v[5] > 60) {
+      return false;
+    }
+    *utc = A9G_makeTime(v[0], v[1], v[2], v[3], v[4], v[5]);
+    any = true;
+    if (*p == ',') p++;
+  }
+  if ((*p == '+' || *p == '-') && p[1] >= '0' && p[1] <= '9') {
+    *offsetMin = (int16_t)(atoi(p + 1) * 15) * (*p == '-' ? -1 : 1);
+    any = true;
+  }
+  return any;
+}
+
+void A9GClock::_onEvent(A9G_Event *evt, void *ctx) {
+  A9GClock *self = static_cast<A9GClock *>(ctx);
+  static const uint32_t minTime = A9G_makeTime(A9G_CLOCK_MIN_YEAR, 1, 1, 0, 0, 0);
+  if (evt->id == EV_CTZV || evt->id == EV_CCLK) {
+    uint32_t t;
+    int16_t offset = self->_offset;
+    if (!parse(evt->message, &t, &offset)) return;
+    self->_offset = offset;
+    if (t < minTime) return;  // zone only, or the modem's clock was never set
+    if (evt->id == EV_CCLK || A9G_CTZV_LOCAL) t -= offset * 60L;
+    self->_sync(t, millis(), evt->id == EV_CCLK ? TIME_CCLK : TIME_CTZV);
+  } else if (evt->id == EV_GPS_FIX && evt->fix && evt->fix->valid) {
+    const A9G_GPSFix &f = *evt->fix;
+    if (self->_gpsSynced && f.stamp - self->_gpsMs < A9G_CLOCK_GPS_INTERVAL * 1000UL) return;
+    uint32_t t = A9G_makeTime(2000 + f.date % 100, f.date / 100 % 100, f.date / 10000,
+                              f.time / 10000, f.time / 100 % 100, f.time % 100);
+    if (t < minTime) return;
+    self->_gpsMs = f.stamp;
+    self->_gpsSynced = true;
+    self->_sync(t, f.stamp, TIME_GPS);
+  }
+}
+
+/**
+ * @brief Sources report whole seconds, so the true time at @p ms lies in
+ *        [utc, utc + 1 s). A prediction inside that window is kept; outside
+ *        it is moved to the nearest edge, so now() changes as little as
+ *        possible. A disagreement beyond what drift explains is a step.
+ *        The drift is measured over the span since the last step, which
+ *        grows with every sync and so gets more precise.
+ */
+void A9GClock::_sync(uint32_t utc, unsigned long ms, A9G_TimeSource source) {
+  int64_t lo = (int64_t)utc * 1000;
+  int64_t hi = lo + 999;
+  unsigned long span = ms - _refMs;
+  if (_source == TIME_NONE) {
+    _setBase(lo, ms);
+    _refUtc = utc;
+    _refMs = ms;
+  } else {
+    int64_t p = _atMs(ms);
+    int64_t allowed = 2000 + (int64_t)span * A9G_CLOCK_MAX_DRIFT / 1000000L;
+    if (p < lo - allowed || p > hi + allowed) {
+      _setBase(lo, ms);
+      _refUtc = utc;
+      _refMs = ms;
+      _steps++;
+    } else {
+      _setBase(p < lo ? lo : p > hi ? hi : p, ms);
+      if (span >= A9G_CLOCK_DRIFT_SPAN * 1000UL) {
+        int64_t real = ((int64_t)utc - _refUtc) * 1000;
+        int64_t drift = (real - (int64_t)span) * 1000000000LL / (int64_t)span;
+        int64_t limit = A9G_CLOCK_MAX_DRIFT * 1000L;
+        _drift = drift > limit ? limit : drift < -limit ? -limit : drift;
+      }
+    }
+  }
+  _syncMs = ms;
+  _source = source;
+}
+
+void A9GClock::_setBase(int64_t utcMs, unsigned long ms) {
+  _baseUtc = utcMs / 1000;
+  _baseMs = ms - (unsigned long)(utcMs % 1000);
+}
+
+int64_t A9GClock::_atMs(unsigned long ms) const {
+  int32_t e = (int32_t)(ms - _baseMs);
+  return (int64_t)_baseUtc * 1000 + e + (int64_t)e * _drift / 1000000000LL;
+}
@@ -0,0 +1,163 @@
+#ifndef A9GCLOCK_H
+#define A9GCLOCK_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GClock.h
+ *
+ * @brief UTC time kept locally from the modem's time sources:
+ *        - +CTZV network time reports, +CCLK answers (AT+CCLK? is sent in the
+ *          background when due) and the UTC time of GPS fixes
+ *        - a millis() -> UTC mapping, so now() is arithmetic, not a command
+ *        - the local oscillator's drift, estimated over a growing span
+ *          between syncs and applied to the mapping
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GClock CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_CLOCK_REFRESH
+#define A9G_CLOCK_REFRESH 21600UL    ///< Seconds after the last sync before AT+CCLK? is asked again
+#endif
+
+#ifndef A9G_CLOCK_RETRY
+#define A9G_CLOCK_RETRY 60UL         ///< Seconds between AT+CCLK? while not synced
+#endif
+
+#ifndef A9G_CLOCK_GPS_INTERVAL
+#define A9G_CLOCK_GPS_INTERVAL 600UL ///< Seconds between two syncs taken from GPS fixes
+#endif
+
+#ifndef A9G_CLOCK_DRIFT_SPAN
+#define A9G_CLOCK_DRIFT_SPAN 21600UL ///< Seconds of sync history before a drift is estimated
+#endif
+
+#ifndef A9G_CLOCK_MAX_DRIFT
+#define A9G_CLOCK_MAX_DRIFT 500L     ///< ppm; a larger disagreement is a time step, not drift
+#endif
+
+#ifndef A9G_CLOCK_MIN_YEAR
+#define A9G_CLOCK_MIN_YEAR 2024      ///< Earlier times are an unset modem clock
+#endif
+
+#ifndef A9G_CTZV_LOCAL
+#define A9G_CTZV_LOCAL 0             ///< 1 if the firmware reports +CTZV in local time (NITZ sends UTC)
+#endif
+
+/**
+ * @brief Where the time came from
+ */
+typedef enum A9G_TimeSource {
+  TIME_NONE = 0,
+  TIME_CCLK,           ///< AT+CCLK? answer (local time and zone)
+  TIME_CTZV,           ///< Network time report
+  TIME_GPS,            ///< UTC time of a valid RMC fix
+  TIME_USER            ///< set() by the sketch (NTP, RTC)
+} A9G_TimeSource;
+
+/**
+ * @brief Seconds since 1970-01-01 00:00 UTC of a calendar time (UTC).
+ */
+uint32_t A9G_makeTime(uint16_t year, uint8_t month, uint8_t day,
+                      uint8_t hour, uint8_t minute, uint8_t second);
+
+/**
+ * @brief "YYYY-MM-DDThh:mm:ssZ".
+ * @return Length written, 0 if @p len is below 21
+ */
+size_t A9G_formatTime(uint32_t utc, char *buf, size_t len);
+
+/**
+ * @class A9GClock
+ * @brief Keeps UTC for one A9G; listens to +CTZV, +CCLK and EV_GPS_FIX.
+ *
+ * Usage:
+ *   A9GClock clock(a9g);
+ *   ...
+ *   clock.loop();                        // sends AT+CCLK? when due, never waits
+ *   if (clock.synced()) record.t = clock.now();
+ *   fixTime = clock.at(a9g.gpsFix().stamp);
+ */
+class A9GClock {
+public:
+  explicit A9GClock(A9G &modem);
+  ~A9GClock();
+
+  void loop();
+
+  /**
+     * @brief Ask the modem on the next loop(), e.g. after registration.
+     */
+  void requestSync() { _due = true; }
+
+  /**
+     * @brief Take a time from elsewhere (NTP, RTC).
+     */
+  void set(uint32_t utc) { _sync(utc, millis(), TIME_USER); }
+
+  bool synced() const { return _source != TIME_NONE; }
+
+  /**
+     * @brief Current UTC seconds; 0 until synced.
+     */
+  uint32_t now() const { return at(millis()); }
+
+  /**
+     * @brief UTC seconds of an earlier (or later) millis() stamp, such as
+     *        A9G_GPSFix::stamp or the time a record was spooled; 0 until synced.
+     */
+  uint32_t at(unsigned long ms) const;
+
+  /**
+     * @brief Offset of local time in minutes, from +CCLK / +CTZV (0 if none).
+     */
+  int16_t utcOffset() const { return _offset; }
+
+  /**
+     * @brief Estimated drift of millis() in parts per billion (positive:
+     *        millis() runs slow).
+     */
+  int32_t drift() const { return _drift; }
+
+  A9G_TimeSource source() const { return _source; }
+
+  /**
+     * @brief Times the clock had to jump instead of being corrected.
+     */
+  uint16_t steps() const { return _steps; }
+
+  /**
+     * @brief Decode "yy/MM/dd,hh:mm:ss±zz" (also quoted, or with ',' before
+     *        the zone). A text with only "±zz" sets just @p offsetMin.
+     * @param utc       Time as written (not shifted by the zone); 0 if absent
+     * @param offsetMin Zone in minutes (quarter hours x 15)
+     * @return false if nothing could be decoded
+     */
+  static bool parse(const char *text, uint32_t *utc, int16_t *offsetMin);
+
+private:
+  A9G *_modem;
+  A9G_TimeSource _source;
+  uint32_t _baseUtc;             ///< UTC second at _baseMs
+  unsigned long _baseMs;
+  uint32_t _refUtc;              ///< Start of the span the drift is measured over
+  unsigned long _refMs;
+  unsigned long _syncMs;         ///< millis() of the last sync of any source
+  unsigned long _gpsMs;          ///< millis() of the last sync from GPS
+  bool _gpsSynced;
+  unsigned long _queryMs;        ///< millis() of the last AT+CCLK?
+  bool _queried;
+  bool _due;
+  int32_t _drift;
+  int16_t _offset;
+  uint16_t _steps;
+
+  static void _onEvent(A9G_Event *evt, void *ctx);
+  void _sync(uint32_t utc, unsigned long ms, A9G_TimeSource source);
+  void _setBase(int64_t utcMs, unsigned long ms);
+  int64_t _atMs(unsigned long ms) const;
+};
+
+#endif  // A9GCLOCK_H
@@ -0,0 +1,99 @@
+#include "A9GCmd.h"
+
+/* ------------------------------------------------------------------
+ *                   A9G_CmdBuilder IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+/**
+ * @brief Make room for n more bytes (plus terminator) or mark the overflow.
+ */
+bool A9G_CmdBuilder::_reserve(size_t n) {
+  if (_overflow) return false;
+  if (_len + n >= _cap) {
+    _overflow = true;
+    return false;
+  }
+  return true;
+}
+
+A9G_CmdBuilder &A9G_CmdBuilder::add(const char *str) {
+  return add(str, str ? strlen(str) : 0);
+}
+
+A9G_CmdBuilder &A9G_CmdBuilder::add(const char *str, size_t len) {
+  if (!_reserve(len)) return *this;
+  memcpy(_buf + _len, str, len);
+  _len += len;
+  _buf[_len] = '\0';
+  return *this;
+}
+
+A9G_CmdBuilder &A9G_CmdBuilder::add(char c) {
+  return add(&c, 1);
+}
+
+A9G_CmdBuilder &A9G_CmdBuilder::add(const __FlashStringHelper *str) {
+  if (!str) return *this;
+  PGM_P p = reinterpret_cast<PGM_P>(str);
+  size_t len = strlen_P(p);
+  if (!_reserve(len)) return *this;
+  memcpy_P(_buf + _len, p, len);
+  _len += len;
+  _buf[_len] = '\0';
+  return *this;
+}
+
+A9G_CmdBuilder &A9G_CmdBuilder::add(long value) {
+  if (value < 0) {
+    add('-');
+    // Negate in unsigned space so LONG_MIN does not overflow
+    return add(0UL - (unsigned long)value);
+  }
+  return add((unsigned long)value);
+}
+
+A9G_CmdBuilder &A9G_CmdBuilder::add(unsigned long value) {
+  char digits[20];  // Enough for a 64-bit unsigned long
+  uint8_t n = 0;
+  do {
+    digits[n++] = '0' + (value % 10);
+    value /= 10;
+  } while (value && n < sizeof(digits));
+
+  if (!_reserve(n)) return *this;
+  while (n) {
+    _buf[_len++] = digits[--n];
+  }
+  _buf[_len] = '\0';
+  return *this;
+}
+
+A9G_CmdBuilder &A9G_CmdBuilder::addQuoted(const char *str) {
+  add('"');
+  for (const char *p = str; p && *p; p++) {
+    switch (*p) {
+      case '"': add("\\22", 3); break;
+      case '\r':
+      case '\n': break;
+      default: add(*p); break;
+    }
+  }
+  return add('"');
+}
+
+A9G_CmdBuilder &A9G_CmdBuilder::addHex(const uint8_t *data, size_t len) {
+  static const char digits[] = "0123456789ABCDEF";
+  if (!_reserve(2 * len)) return *this;
+  for (size_t i = 0; i < len; i++) {
+    _buf[_len++] = digits[data[i] >> 4];
+    _buf[_len++] = digits[data[i] & 0x0F];
+  }
+  _buf[_len] = '\0';
+  return *this;
+}
+
+void A9G_CmdBuilder::reset() {
+  _len = 0;
+  _overflow = false;
+  _buf[0] = '\0';
+}
@@ -0,0 +1,133 @@
+#ifndef A9GCMD_H
+#define A9GCMD_H
+
+#include <Arduino.h>
+
+/*!
+ * @file A9GCmd.h
+ *
+ * @brief AT command line builder. A whole command line is formatted into one
+ *        stack buffer and handed to the modem with a single write(), instead of
+ *        one print() per fragment.
+ *
+ * Usage:
+ *   A9G_Cmd<64> cmd;
+ *   cmd.add(GF("AT+MQTTSUB=")).addQuoted(topic).add(',').add(qos).end();
+ *   stream->write(cmd.data(), cmd.length());
+ */
+
+#ifndef GF
+#define GF(x) (reinterpret_cast<const __FlashStringHelper *>(PSTR(x)))  ///< Command literal kept in flash
+#endif
+
+#ifndef A9G_CMD_BUFFER_SIZE
+#define A9G_CMD_BUFFER_SIZE 256      ///< Capacity of the line buffer used by the A9G commands
+#endif
+
+/**
+ * @class A9G_CmdBuilder
+ * @brief Appends command fragments to a caller-provided buffer.
+ *
+ * Storage comes from A9G_Cmd<N>, so the capacity is fixed at compile time and
+ * the appending code exists only once regardless of how many sizes are used.
+ * Once a fragment does not fit the builder is marked as overflowed and keeps
+ * ignoring input; an overflowed command must not be sent.
+ */
+class A9G_CmdBuilder {
+public:
+  /**
+     * @brief Raw text, copied as is.
+     */
+  A9G_CmdBuilder &add(const char *str);
+  A9G_CmdBuilder &add(const char *str, size_t len);
+  A9G_CmdBuilder &add(char c);
+
+  /**
+     * @brief Text stored in flash (GF("...")), read without a RAM copy.
+     */
+  A9G_CmdBuilder &add(const __FlashStringHelper *str);
+
+  /**
+     * @brief Decimal numbers, formatted without printf.
+     */
+  A9G_CmdBuilder &add(int value) { return add((long)value); }
+  A9G_CmdBuilder &add(unsigned int value) { return add((unsigned long)value); }
+  A9G_CmdBuilder &add(long value);
+  A9G_CmdBuilder &add(unsigned long value);
+
+  /**
+     * @brief A double-quoted string parameter. Only '"' would end it early;
+     *        it is sent as \22, the hex escape of V.250 5.4.2.2 (not covered
+     *        by the A9G AT manual, so avoid quotes where the receiver cannot
+     *        decode them). Commas and backslashes go out as they are: a comma
+     *        inside quotes does not split the parameter. CR/LF are dropped.
+     */
+  A9G_CmdBuilder &addQuoted(const char *str);
+
+  /**
+     * @brief Bytes as upper-case hex pairs (PDU mode bodies).
+     */
+  A9G_CmdBuilder &addHex(const uint8_t *data, size_t len);
+
+  /**
+     * @brief Terminates the line with CR LF.
+     */
+  A9G_CmdBuilder &end() { return add("\r\n", 2); }
+
+  /**
+     * @brief Forget the content, keep the storage.
+     */
+  void reset();
+
+  const char *c_str() const { return _buf; }
+  const uint8_t *data() const { return (const uint8_t *)_buf; }
+  size_t length() const { return _len; }
+  size_t capacity() const { return _cap; }
+
+  /**
+     * @brief true if something did not fit; the command is then incomplete.
+     */
+  bool overflow() const { return _overflow; }
+
+protected:
+  A9G_CmdBuilder(char *buf, size_t cap)
+    : _buf(buf), _cap(cap), _len(0), _overflow(false) {
+    _buf[0] = '\0';
+  }
+
+private:
+  char *_buf;
+  size_t _cap;
+  size_t _len;
+  bool _overflow;
+
+  bool _reserve(size_t n);
+};
+
+/**
+ * @brief A9G_CmdBuilder with N bytes of inline storage (including the terminator).
+ */
+template <size_t N>
+class A9G_Cmd : public A9G_CmdBuilder {
+public:
+  A9G_Cmd() : A9G_CmdBuilder(_storage, N) {}
+
+private:
+  static_assert(N >= 4, "A9G_Cmd needs room for at least \"AT\\r\\n\"");
+  char _storage[N];
+
+  // Copying would leave the base pointing at the other object's storage
+  A9G_Cmd(const A9G_Cmd &);
+  A9G_Cmd &operator=(const A9G_Cmd &);
+};
+
+/**
+ * @brief A9G_CmdBuilder over a caller-owned buffer, for text that is not
+ *        a command line (trace lines, metric snapshots).
+ */
+class A9G_TextBuilder : public A9G_CmdBuilder {
+public:
+  A9G_TextBuilder(char *buf, size_t cap) : A9G_CmdBuilder(buf, cap) {}
+};
+
+#endif  // A9GCMD_H
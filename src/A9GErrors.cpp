@@ -0,0 +1,226 @@
+#include "A9GErrors.h"
+
+#if A9G_ERROR_NAMES
+
+/* ------------------------------------------------------------------
+ *                      ERROR NAME TABLES
+ *   X(code, name), in ascending code order (the lookup bisects).
+ * ------------------------------------------------------------------ */
+
+#define A9G_CME_ERRORS(X) \
+  X(0, "phone failure") \
+  X(1, "no connection to phone") \
+  X(2, "phone adapter link reserved") \
+  X(3, "operation not allowed") \
+  X(4, "operation not supported") \
+  X(5, "PH-SIM PIN required") \
+  X(6, "PH-FSIM PIN required") \
+  X(7, "PH-FSIM PUK required") \
+  X(10, "SIM not inserted") \
+  X(11, "SIM PIN required") \
+  X(12, "SIM PUK required") \
+  X(13, "SIM failure") \
+  X(14, "SIM busy") \
+  X(15, "SIM wrong") \
+  X(16, "incorrect password") \
+  X(17, "SIM PIN2 required") \
+  X(18, "SIM PUK2 required") \
+  X(20, "memory full") \
+  X(21, "invalid index") \
+  X(22, "not found") \
+  X(23, "memory failure") \
+  X(24, "text string too long") \
+  X(25, "invalid characters in text") \
+  X(26, "dial string too long") \
+  X(27, "invalid characters in dial string") \
+  X(30, "no network service") \
+  X(31, "network timeout") \
+  X(32, "emergency calls only") \
+  X(40, "network personalization PIN required") \
+  X(41, "network personalization PUK required") \
+  X(42, "network subset PIN required") \
+  X(43, "network subset PUK required") \
+  X(44, "service provider PIN required") \
+  X(45, "service provider PUK required") \
+  X(46, "corporate PIN required") \
+  X(47, "corporate PUK required") \
+  X(48, "PH-SIM phonebook required") \
+  X(49, "not supported") \
+  X(50, "execution failed") \
+  X(51, "no memory") \
+  X(52, "option not supported") \
+  X(53, "invalid parameter") \
+  X(54, "ext REG missing") \
+  X(55, "ext SMS missing") \
+  X(56, "ext PBK missing") \
+  X(57, "ext FFS missing") \
+  X(58, "invalid command line") \
+  X(103, "illegal MS") \
+  X(106, "illegal ME") \
+  X(107, "GPRS service not allowed") \
+  X(111, "PLMN not allowed") \
+  X(112, "location area not allowed") \
+  X(113, "roaming not allowed in this area") \
+  X(132, "service option not supported") \
+  X(133, "service option not subscribed") \
+  X(134, "service option temporarily out of order") \
+  X(148, "unspecified GPRS error") \
+  X(149, "PDP authentication failure") \
+  X(150, "invalid mobile class") \
+  X(264, "SIM verify failed") \
+  X(265, "SIM unblock failed") \
+  X(266, "SIM access condition not fulfilled") \
+  X(267, "SIM unblock failed, no retries left") \
+  X(268, "SIM verify failed, no retries left") \
+  X(269, "SIM invalid parameter") \
+  X(270, "SIM unknown command") \
+  X(271, "SIM wrong class") \
+  X(272, "SIM technical problem") \
+  X(273, "SIM CHV needs unblock") \
+  X(274, "SIM no EF selected") \
+  X(275, "SIM file does not match command") \
+  X(276, "SIM contradiction with CHV") \
+  X(277, "SIM contradiction with invalidation") \
+  X(278, "SIM max value reached") \
+  X(279, "SIM pattern not found") \
+  X(280, "SIM file ID not found") \
+  X(281, "SIM toolkit busy") \
+  X(282, "SIM unknown error") \
+  X(283, "SIM profile error")
+
+#define A9G_CMS_ERRORS(X) \
+  X(1, "unassigned number") \
+  X(8, "operator determined barring") \
+  X(10, "call barred") \
+  X(21, "short message transfer rejected") \
+  X(27, "destination out of service") \
+  X(28, "unidentified subscriber") \
+  X(29, "facility rejected") \
+  X(30, "unknown subscriber") \
+  X(38, "network out of order") \
+  X(41, "temporary failure") \
+  X(42, "congestion") \
+  X(47, "resources unavailable") \
+  X(50, "facility not subscribed") \
+  X(69, "facility not implemented") \
+  X(81, "invalid SM reference") \
+  X(95, "invalid message") \
+  X(96, "invalid mandatory information") \
+  X(97, "message type not implemented") \
+  X(98, "message not compatible") \
+  X(99, "information element not implemented") \
+  X(111, "protocol error") \
+  X(127, "interworking unspecified") \
+  X(128, "telematic interworking not supported") \
+  X(129, "SM type 0 not supported") \
+  X(130, "cannot replace SM") \
+  X(143, "unspecified TP-PID error") \
+  X(144, "data coding scheme not supported") \
+  X(145, "message class not supported") \
+  X(159, "unspecified TP-DCS error") \
+  X(160, "command cannot be actioned") \
+  X(161, "command unsupported") \
+  X(175, "unspecified TP-Command error") \
+  X(176, "TPDU not supported") \
+  X(192, "SC busy") \
+  X(193, "no SC subscription") \
+  X(194, "SC system failure") \
+  X(195, "invalid SME address") \
+  X(196, "destination SME barred") \
+  X(197, "SM rejected, duplicate") \
+  X(198, "TP-VPF not supported") \
+  X(199, "TP-VP not supported") \
+  X(208, "SIM SMS storage full") \
+  X(209, "no SMS storage in SIM") \
+  X(210, "error in MS") \
+  X(211, "memory capacity exceeded") \
+  X(212, "SIM toolkit busy") \
+  X(213, "SIM data download error") \
+  X(255, "unspecified error cause") \
+  X(300, "ME failure") \
+  X(301, "SMS service reserved") \
+  X(302, "operation not allowed") \
+  X(303, "operation not supported") \
+  X(304, "invalid PDU mode parameter") \
+  X(305, "invalid text mode parameter") \
+  X(310, "SIM not inserted") \
+  X(311, "SIM PIN required") \
+  X(312, "PH-SIM PIN required") \
+  X(313, "SIM failure") \
+  X(314, "SIM busy") \
+  X(315, "SIM wrong") \
+  X(316, "SIM PUK required") \
+  X(317, "SIM PIN2 required") \
+  X(318, "SIM PUK2 required") \
+  X(320, "memory failure") \
+  X(321, "invalid memory index") \
+  X(322, "memory full") \
+  X(330, "SMSC address unknown") \
+  X(331, "no network service") \
+  X(332, "network timeout") \
+  X(340, "no +CNMA acknowledgement expected") \
+  X(500, "unknown error") \
+  X(512, "aborted by user") \
+  X(513, "unable to store") \
+  X(514, "invalid status") \
+  X(515, "invalid character in address") \
+  X(516, "invalid length") \
+  X(517, "invalid character in PDU") \
+  X(518, "invalid parameter") \
+  X(519, "invalid length or character") \
+  X(520, "invalid character in text") \
+  X(521, "timer expired")
+
+typedef struct A9G_ErrorName {
+  uint16_t code;
+  PGM_P name;
+} A9G_ErrorName;
+
+#define NAME_STRING(prefix, code, name) static const char prefix##code[] PROGMEM = name;
+#define CME_STRING(code, name) NAME_STRING(cme, code, name)
+#define CMS_STRING(code, name) NAME_STRING(cms, code, name)
+#define CME_ENTRY(code, name) { code, cme##code },
+#define CMS_ENTRY(code, name) { code, cms##code },
+
+A9G_CME_ERRORS(CME_STRING)
+A9G_CMS_ERRORS(CMS_STRING)
+
+static const A9G_ErrorName cmeNames[] PROGMEM = { A9G_CME_ERRORS(CME_ENTRY) };
+static const A9G_ErrorName cmsNames[] PROGMEM = { A9G_CMS_ERRORS(CMS_ENTRY) };
+
+/**
+ * @brief Bisect a flash table for @p code.
+ */
+static const __FlashStringHelper *findName(const A9G_ErrorName *table, size_t count, int code) {
+  if (code < 0 || code > 0xFFFF) return nullptr;
+  size_t lo = 0, hi = count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    A9G_ErrorName e;
+    memcpy_P(&e, &table[mid], sizeof(e));
+    if (e.code == code) return reinterpret_cast<const __FlashStringHelper *>(e.name);
+    if (e.code < code) lo = mid + 1;
+    else hi = mid;
+  }
+  return nullptr;
+}
+
+const __FlashStringHelper *A9G_cmeErrorName(int code) {
+  return findName(cmeNames, sizeof(cmeNames) / sizeof(cmeNames[0]), code);
+}
+
+const __FlashStringHelper *A9G_cmsErrorName(int code) {
+  return findName(cmsNames, sizeof(cmsNames) / sizeof(cmsNames[0]), code);
+}
+
+#else
+
+const __FlashStringHelper *A9G_cmeErrorName(int) {
+  return nullptr;
+}
+
+const __FlashStringHelper *A9G_cmsErrorName(int) {
+  return nullptr;
+}
+
+#endif  // A9G_ERROR_NAMES
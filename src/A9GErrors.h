@@ -0,0 +1,38 @@
+#ifndef A9GERRORS_H
+#define A9GERRORS_H
+
+#include <Arduino.h>
+
+/*!
+ * @file A9GErrors.h
+ *
+ * @brief Names of the +CME ERROR / +CMS ERROR codes (A9G_CME_Error,
+ *        A9G_CMS_Error). The tables live in flash, sorted by code, and are
+ *        searched by bisection.
+ *
+ * Usage:
+ *   const __FlashStringHelper *name = A9G_cmeErrorName(a9g.lastError());
+ *   if (name) Serial.println(name);
+ */
+
+/* ------------------------------------------------------------------
+ *                      ERROR NAME CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_ERROR_NAMES
+#define A9G_ERROR_NAMES 1            ///< 0 leaves the tables out; the lookups then return nullptr
+#endif
+
+/**
+ * @brief Name of a +CME ERROR code.
+ * @return Flash string, nullptr if the code is unknown
+ */
+const __FlashStringHelper *A9G_cmeErrorName(int code);
+
+/**
+ * @brief Name of a +CMS ERROR code.
+ * @return Flash string, nullptr if the code is unknown
+ */
+const __FlashStringHelper *A9G_cmsErrorName(int code);
+
+#endif  // A9GERRORS_H
@@ -0,0 +1,241 @@
+#include "A9GGeofence.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GGeofence IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+#define NO_ENTRY 0xFFFF
+
+A9GGeofence::A9GGeofence(A9G &modem)
+  : _modem(&modem),
+    _count(0),
+    _epoch(0),
+    _tested(0),
+    _cb(nullptr),
+    _ctx(nullptr) {
+  _rebuild();
+  _modem->addEventHandler(_onEvent, this);
+}
+
+A9GGeofence::~A9GGeofence() {
+  _modem->removeEventHandler(_onEvent, this);
+}
+
+void A9GGeofence::onEvent(A9G_GeofenceCallback cb, void *ctx) {
+  _cb = cb;
+  _ctx = ctx;
+}
+
+bool A9GGeofence::addCircle(uint16_t id, int32_t latE7, int32_t lonE7, uint32_t radiusM,
+                            uint16_t dwellSec) {
+  Fence *f = _add(id, dwellSec);
+  if (!f) return false;
+  float scaleX = A9G_geoScaleX(latE7);
+  if (scaleX < 1e-6f) scaleX = 1e-6f;  // at the poles any longitude is close
+  f->circle.lat = latE7;
+  f->circle.lon = lonE7;
+  f->circle.radius = radiusM;
+  f->circle.scaleX = scaleX;
+  int32_t dLat = radiusM / A9G_GEO_SCALE_Y + 1;
+  int32_t dLon = radiusM / scaleX + 1;
+  f->minLat = latE7 - dLat;
+  f->maxLat = latE7 + dLat;
+  f->minLon = lonE7 - dLon;
+  f->maxLon = lonE7 + dLon;
+  _index(_count++);
+  return true;
+}
+
+bool A9GGeofence::addPolygon(uint16_t id, const A9G_GeoPoint *points, uint8_t count,
+                             uint16_t dwellSec) {
+  if (!points || count < 3) return false;
+  Fence *f = _add(id, dwellSec);
+  if (!f) return false;
+  f->flags |= F_POLYGON;
+  f->polygon.points = points;
+  f->polygon.count = count;
+  f->minLat = f->maxLat = points[0].latE7;
+  f->minLon = f->maxLon = points[0].lonE7;
+  for (uint8_t i = 1; i < count; i++) {
+    if (points[i].latE7 < f->minLat) f->minLat = points[i].latE7;
+    if (points[i].latE7 > f->maxLat) f->maxLat = points[i].latE7;
+    if (points[i].lonE7 < f->minLon) f->minLon = points[i].lonE7;
+    if (points[i].lonE7 > f->maxLon) f->maxLon = points[i].lonE7;
+  }
+  _index(_count++);
+  return true;
+}
+
+bool A9GGeofence::remove(uint16_t id) {
+  int i = _find(id);
+  if (i < 0) return false;
+  // Keep the table dense; the index refers to positions, so rebuild it
+  _fences[i] = _fences[--_count];
+  _rebuild();
+  return true;
+}
+
+void A9GGeofence::clear() {
+  _count = 0;
+  _rebuild();
+}
+
+bool A9GGeofence::inside(uint16_t id) const {
+  int i = _find(id);
+  return i >= 0 && (_fences[i].flags & F_INSIDE);
+}
+
+/**
+ * @brief Test the fences of the fix's grid cell and the large ones; fences
+ *        the fix was inside of but that were not tested are outside now.
+ */
+void A9GGeofence::update(const A9G_GPSFix &fix) {
+  if (!fix.valid) return;
+  if (!++_epoch) {
+    // Wrapped: a fence last tested 256 updates ago would look tested now
+    for (uint16_t i = 0; i < _count; i++) _fences[i].epoch = 0;
+    _epoch = 1;
+  }
+  _tested = 0;
+  uint16_t e = _buckets[_bucket(_cell(fix.latE7), _cell(fix.lonE7))];
+  while (e != NO_ENTRY) {
+    _test(_fences[_entries[e].fence], fix);
+    e = _entries[e].next;
+  }
+  for (uint16_t i = 0; i < _count; i++) {
+    Fence &f = _fences[i];
+    if (f.flags & F_WIDE) {
+      _test(f, fix);
+    } else if (f.epoch != _epoch && ((f.flags & F_INSIDE) || f.pending)) {
+      _observe(f, false, fix);
+    }
+  }
+}
+
+void A9GGeofence::_onEvent(A9G_Event *evt, void *ctx) {
+  if (evt->id == EV_GPS_FIX && evt->fix) {
+    static_cast<A9GGeofence *>(ctx)->update(*evt->fix);
+  }
+}
+
+/* ------------------------------------------------------------------
+ *   TABLE & GRID INDEX
+ * ------------------------------------------------------------------ */
+
+A9GGeofence::Fence *A9GGeofence::_add(uint16_t id, uint16_t dwellSec) {
+  if (_count >= A9G_GEOFENCE_MAX || _find(id) >= 0) return nullptr;
+  Fence *f = &_fences[_count];
+  memset(f, 0, sizeof(*f));
+  f->id = id;
+  f->dwell = dwellSec;
+  f->epoch = _epoch;
+  return f;
+}
+
+int A9GGeofence::_find(uint16_t id) const {
+  for (uint16_t i = 0; i < _count; i++) {
+    if (_fences[i].id == id) return i;
+  }
+  return -1;
+}
+
+int32_t A9GGeofence::_cell(int32_t e7) {
+  // Floor division, so cells do not double up around 0
+  return e7 >= 0 ? e7 / A9G_GEOFENCE_CELL : -((-e7 - 1) / A9G_GEOFENCE_CELL) - 1;
+}
+
+uint16_t A9GGeofence::_bucket(int32_t cellLat, int32_t cellLon) {
+  uint32_t h = (uint32_t)cellLat * 73856093UL ^ (uint32_t)cellLon * 19349663UL;
+  return h % A9G_GEOFENCE_BUCKETS;
+}
+
+/**
+ * @brief Add fence @p f to the bucket of every cell its bounding box touches.
+ *        Fences over too many cells (or with the entry pool used up) are
+ *        flagged wide and tested on every fix instead.
+ */
+void A9GGeofence::_index(uint16_t f) {
+  Fence &fence = _fences[f];
+  int32_t lat0 = _cell(fence.minLat), lat1 = _cell(fence.maxLat);
+  int32_t lon0 = _cell(fence.minLon), lon1 = _cell(fence.maxLon);
+  uint32_t cells = (uint32_t)(lat1 - lat0 + 1) * (uint32_t)(lon1 - lon0 + 1);
+  if (cells > A9G_GEOFENCE_MAX_CELLS || cells > (uint32_t)(A9G_GEOFENCE_ENTRIES - _entryCount)) {
+    fence.flags |= F_WIDE;
+    return;
+  }
+  for (int32_t la = lat0; la <= lat1; la++) {
+    for (int32_t lo = lon0; lo <= lon1; lo++) {
+      uint16_t b = _bucket(la, lo);
+      Entry &e = _entries[_entryCount];
+      e.fence = f;
+      e.next = _buckets[b];
+      _buckets[b] = _entryCount++;
+    }
+  }
+}
+
+void A9GGeofence::_rebuild() {
+  for (uint16_t b = 0; b < A9G_GEOFENCE_BUCKETS; b++) _buckets[b] = NO_ENTRY;
+  _entryCount = 0;
+  for (uint16_t i = 0; i < _count; i++) {
+    _fences[i].flags &= ~F_WIDE;
+    _index(i);
+  }
+}
+
+/* ------------------------------------------------------------------
+ *   GEOMETRY & STATE
+ * ------------------------------------------------------------------ */
+
+bool A9GGeofence::_contains(const Fence &f, int32_t latE7, int32_t lonE7) const {
+  if (latE7 < f.minLat || latE7 > f.maxLat || lonE7 < f.minLon || lonE7 > f.maxLon) {
+    return false;
+  }
+  if (!(f.flags & F_POLYGON)) {
+    float dx = (float)(lonE7 - f.circle.lon) * f.circle.scaleX;
+    float dy = (float)(latE7 - f.circle.lat) * A9G_GEO_SCALE_Y;
+    return dx * dx + dy * dy <= f.circle.radius * f.circle.radius;
+  }
+  // Ray casting towards east; the crossing test is done in integers
+  const A9G_GeoPoint *p = f.polygon.points;
+  uint8_t n = f.polygon.count;
+  bool in = false;
+  for (uint8_t i = 0, j = n - 1; i < n; j = i++) {
+    int64_t yi = p[i].latE7, yj = p[j].latE7;
+    if ((yi > latE7) == (yj > latE7)) continue;
+    int64_t xi = p[i].lonE7, xj = p[j].lonE7;
+    // lonE7 < xi + (latE7 - yi) * (xj - xi) / (yj - yi), without the division
+    int64_t lhs = (lonE7 - xi) * (yj - yi);
+    int64_t rhs = (latE7 - yi) * (xj - xi);
+    if (yj > yi ? lhs < rhs : lhs > rhs) in = !in;
+  }
+  return in;
+}
+
+void A9GGeofence::_test(Fence &f, const A9G_GPSFix &fix) {
+  if (f.epoch == _epoch) return;  // reached through two cells of one bucket
+  f.epoch = _epoch;
+  _tested++;
+  _observe(f, _contains(f, fix.latE7, fix.lonE7), fix);
+}
+
+void A9GGeofence::_observe(Fence &f, bool in, const A9G_GPSFix &fix) {
+  unsigned long now = millis();
+  if (in == ((f.flags & F_INSIDE) != 0)) {
+    f.pending = 0;
+    if (in && f.dwell && !(f.flags & F_DWELLED) && now - f.since >= f.dwell * 1000UL) {
+      f.flags |= F_DWELLED;
+      if (_cb) _cb(_ctx, f.id, GEOFENCE_DWELL, fix);
+    }
+    return;
+  }
+  if (++f.pending < A9G_GEOFENCE_CONFIRM) return;
+  f.pending = 0;
+  if (in) {
+    f.flags = (f.flags | F_INSIDE) & ~F_DWELLED;
+    f.since = now;
+  } else {
+    f.flags &= ~(F_INSIDE | F_DWELLED);
+  }
+  if (_cb) _cb(_ctx, f.id, in ? GEOFENCE_ENTER : GEOFENCE_EXIT, fix);
+}
@@ -0,0 +1,173 @@
+#ifndef A9GGEOFENCE_H
+#define A9GGEOFENCE_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GGeofence.h
+ *
+ * @brief On-device geofencing, evaluated on every EV_GPS_FIX:
+ *        - circular and polygonal fences, identified by the caller's id
+ *        - a uniform grid over latitude/longitude, hashed into buckets, so a
+ *          fix is only tested against the fences of its own cell
+ *        - enter / exit / dwell events after A9G_GEOFENCE_CONFIRM agreeing
+ *          fixes, so a position jittering on a border does not flap
+ *        The sketch publishes these events instead of every raw position.
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GGeofence CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_GEOFENCE_MAX
+#if defined(__AVR__)
+#define A9G_GEOFENCE_MAX 8           ///< Fences held at the same time
+#else
+#define A9G_GEOFENCE_MAX 256
+#endif
+#endif
+
+#ifndef A9G_GEOFENCE_BUCKETS
+#if defined(__AVR__)
+#define A9G_GEOFENCE_BUCKETS 16      ///< Hash buckets of the grid index
+#else
+#define A9G_GEOFENCE_BUCKETS 128
+#endif
+#endif
+
+#ifndef A9G_GEOFENCE_ENTRIES
+#define A9G_GEOFENCE_ENTRIES (4 * A9G_GEOFENCE_MAX)  ///< (fence, cell) pairs of the grid index
+#endif
+
+#ifndef A9G_GEOFENCE_CELL
+#define A9G_GEOFENCE_CELL 100000L    ///< Grid cell edge in 1e-7 degrees (0.01 deg, about 1.1 km)
+#endif
+
+#ifndef A9G_GEOFENCE_MAX_CELLS
+#define A9G_GEOFENCE_MAX_CELLS 16    ///< Larger fences skip the grid and are tested on every fix
+#endif
+
+#ifndef A9G_GEOFENCE_CONFIRM
+#define A9G_GEOFENCE_CONFIRM 2       ///< Consecutive fixes needed to change inside/outside
+#endif
+
+/**
+ * @brief What happened at a fence
+ */
+typedef enum A9G_GeofenceEvent {
+  GEOFENCE_ENTER = 0,
+  GEOFENCE_EXIT,
+  GEOFENCE_DWELL       ///< Inside for the fence's dwell time (once per visit)
+} A9G_GeofenceEvent;
+
+/**
+ * @brief Called for every fence transition, from pollModem()
+ */
+typedef void (*A9G_GeofenceCallback)(void *ctx, uint16_t id, A9G_GeofenceEvent event,
+                                     const A9G_GPSFix &fix);
+
+/**
+ * @class A9GGeofence
+ * @brief Fence table with a grid index; listens to the A9G's EV_GPS_FIX.
+ *
+ * Usage:
+ *   A9GGeofence fences(a9g);
+ *   fences.addCircle(1, 523456789, 134567890, 150);      // depot, 150 m
+ *   fences.addPolygon(2, yard, 5, 600);                   // dwell after 10 min
+ *   fences.onEvent(onFence, nullptr);                     // publish these
+ *   a9g.setGPSReport(5);
+ */
+class A9GGeofence {
+public:
+  explicit A9GGeofence(A9G &modem);
+  ~A9GGeofence();
+
+  /**
+     * @param radiusM  Radius in meters
+     * @param dwellSec Report GEOFENCE_DWELL after this long inside (0 = never)
+     * @return false if the table is full or @p id is taken
+     */
+  bool addCircle(uint16_t id, int32_t latE7, int32_t lonE7, uint32_t radiusM,
+                 uint16_t dwellSec = 0);
+
+  /**
+     * @param points Vertices in order; not copied, must stay valid (up to 255)
+     */
+  bool addPolygon(uint16_t id, const A9G_GeoPoint *points, uint8_t count,
+                  uint16_t dwellSec = 0);
+
+  bool remove(uint16_t id);
+  void clear();
+
+  uint16_t count() const { return _count; }
+
+  /**
+     * @brief Confirmed state of a fence (false for unknown ids).
+     */
+  bool inside(uint16_t id) const;
+
+  void onEvent(A9G_GeofenceCallback cb, void *ctx = nullptr);
+
+  /**
+     * @brief Evaluate a fix; called automatically for EV_GPS_FIX. Invalid fixes are ignored.
+     */
+  void update(const A9G_GPSFix &fix);
+
+  /**
+     * @brief Fences tested by the last update() (grid candidates plus large fences).
+     */
+  uint16_t lastTested() const { return _tested; }
+
+private:
+  enum { F_POLYGON = 0x01, F_INSIDE = 0x02, F_DWELLED = 0x04, F_WIDE = 0x08 };
+
+  struct Fence {
+    int32_t minLat, minLon, maxLat, maxLon;  ///< Bounding box
+    union {
+      struct {
+        int32_t lat, lon;
+        float radius;
+        float scaleX;            ///< Meters per 1e-7 degree of longitude here
+      } circle;
+      struct {
+        const A9G_GeoPoint *points;
+        uint8_t count;
+      } polygon;
+    };
+    unsigned long since;         ///< millis() of the confirmed enter
+    uint16_t id;
+    uint16_t dwell;              ///< Seconds, 0 = no dwell event
+    uint8_t flags;
+    uint8_t pending;             ///< Fixes disagreeing with the confirmed state
+    uint8_t epoch;               ///< update() that last tested it
+  };
+
+  struct Entry {
+    uint16_t fence;
+    uint16_t next;               ///< Next entry of the bucket (0xFFFF = end)
+  };
+
+  A9G *_modem;
+  Fence _fences[A9G_GEOFENCE_MAX];
+  uint16_t _count;
+  uint16_t _buckets[A9G_GEOFENCE_BUCKETS];
+  Entry _entries[A9G_GEOFENCE_ENTRIES];
+  uint16_t _entryCount;
+  uint8_t _epoch;
+  uint16_t _tested;
+  A9G_GeofenceCallback _cb;
+  void *_ctx;
+
+  static void _onEvent(A9G_Event *evt, void *ctx);
+  Fence *_add(uint16_t id, uint16_t dwellSec);
+  int _find(uint16_t id) const;
+  void _index(uint16_t f);
+  void _rebuild();
+  static uint16_t _bucket(int32_t cellLat, int32_t cellLon);
+  static int32_t _cell(int32_t e7);
+  bool _contains(const Fence &f, int32_t latE7, int32_t lonE7) const;
+  void _test(Fence &f, const A9G_GPSFix &fix);
+  void _observe(Fence &f, bool in, const A9G_GPSFix &fix);
+};
+
+#endif  // A9GGEOFENCE_H
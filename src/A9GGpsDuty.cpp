@@ -0,0 +1,167 @@
+#include "A9GGpsDuty.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GGpsDuty IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9GGpsDuty::A9GGpsDuty(A9G &modem)
+  : _modem(&modem),
+    _state(GPS_DUTY_STOPPED),
+    _fast(A9G_GPS_FAST_INTERVAL),
+    _slow(A9G_GPS_SLOW_INTERVAL),
+    _radius(A9G_GPS_STILL_RADIUS),
+    _speed(A9G_GPS_STILL_SPEED),
+    _stillTime(A9G_GPS_STILL_TIME),
+    _offAfter(A9G_GPS_OFF_AFTER),
+    _wakeEvery(A9G_GPS_WAKE_EVERY),
+    _probeTime(A9G_GPS_PROBE_TIME),
+    _hasAnchor(false),
+    _moved(false),
+    _fixSeen(false),
+    _wakeRequest(false),
+    _since(0),
+    _stillSince(0),
+    _failedAt(0),
+    _onSince(0),
+    _onTotal(0) {
+  _modem->addEventHandler(_onEvent, this);
+}
+
+A9GGpsDuty::~A9GGpsDuty() {
+  _modem->removeEventHandler(_onEvent, this);
+}
+
+void A9GGpsDuty::setIntervals(uint8_t fastSec, uint8_t slowSec) {
+  _fast = fastSec ? fastSec : 1;
+  _slow = slowSec ? slowSec : 1;
+}
+
+void A9GGpsDuty::setStillness(uint16_t radiusM, uint16_t speedCms, uint16_t stillSec) {
+  _radius = radiusM;
+  _speed = speedCms;
+  _stillTime = stillSec;
+}
+
+void A9GGpsDuty::setPowerOff(uint16_t offAfterSec, uint16_t wakeEverySec, uint16_t probeSec) {
+  _offAfter = offAfterSec;
+  _wakeEvery = wakeEverySec;
+  _probeTime = probeSec;
+}
+
+bool A9GGpsDuty::begin() {
+  _failedAt = 0;
+  return _enter(GPS_DUTY_TRACKING);
+}
+
+bool A9GGpsDuty::stop() {
+  _failedAt = 0;
+  return _enter(GPS_DUTY_STOPPED);
+}
+
+unsigned long A9GGpsDuty::onTime() const {
+  return _onTotal + (_powered() ? millis() - _onSince : 0);
+}
+
+/**
+ * @brief OFF -> PROBE on schedule; PROBE -> TRACKING if the fix moved,
+ *        else back OFF; TRACKING -> SPARSE -> OFF while the fixes stay still;
+ *        movement or wake() -> TRACKING.
+ */
+void A9GGpsDuty::loop() {
+  if (_state == GPS_DUTY_STOPPED) return;
+  unsigned long now = millis();
+  if (_failedAt && now - _failedAt < 1000) return;  // retry a failed command slowly
+
+  if (_wakeRequest && _state != GPS_DUTY_TRACKING) {
+    if (_enter(GPS_DUTY_TRACKING)) _wakeRequest = false;
+    return;
+  }
+  _wakeRequest = false;
+
+  switch (_state) {
+    case GPS_DUTY_OFF:
+      if (_wakeEvery && now - _since >= _wakeEvery * 1000UL) _enter(GPS_DUTY_PROBE);
+      break;
+    case GPS_DUTY_PROBE:
+      if (_fixSeen) {
+        _enter(_moved ? GPS_DUTY_TRACKING : GPS_DUTY_OFF);
+      } else if (now - _since >= _probeTime * 1000UL) {
+        _enter(GPS_DUTY_OFF);
+      }
+      break;
+    case GPS_DUTY_TRACKING:
+      if (now - _stillSince >= _stillTime * 1000UL) _enter(GPS_DUTY_SPARSE);
+      break;
+    case GPS_DUTY_SPARSE:
+      if (_moved) {
+        _enter(GPS_DUTY_TRACKING);
+      } else if (_offAfter && now - _stillSince >= _offAfter * 1000UL) {
+        _enter(GPS_DUTY_OFF);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void A9GGpsDuty::_onEvent(A9G_Event *evt, void *ctx) {
+  if (evt->id == EV_GPS_FIX && evt->fix) {
+    static_cast<A9GGpsDuty *>(ctx)->_onFix(*evt->fix);
+  }
+}
+
+/**
+ * @brief A fix away from the anchor, or fast enough, starts a new still
+ *        period there. The anchor survives power off, so a probe fix can
+ *        be compared with where the unit was parked.
+ */
+void A9GGpsDuty::_onFix(const A9G_GPSFix &fix) {
+  if (!fix.valid || !_powered()) return;
+  _fixSeen = true;
+  if (_hasAnchor && fix.speedCms <= _speed &&
+      A9G_geoDistance(_anchor.latE7, _anchor.lonE7, fix.latE7, fix.lonE7) <= _radius) {
+    return;
+  }
+  _anchor.latE7 = fix.latE7;
+  _anchor.lonE7 = fix.lonE7;
+  _hasAnchor = true;
+  _moved = true;
+  _stillSince = millis();
+}
+
+/**
+ * @brief Issue the commands for @p next. Reports stop before the receiver is
+ *        powered off; after power on they start at the new interval.
+ */
+bool A9GGpsDuty::_enter(A9G_GpsDutyState next) {
+  bool power = next >= GPS_DUTY_PROBE;
+  bool ok = true;
+  if (power) {
+    uint8_t interval = next == GPS_DUTY_SPARSE ? _slow : _fast;
+    uint8_t current = !_powered() ? 0 : _state == GPS_DUTY_SPARSE ? _slow : _fast;
+    if (!_powered()) ok = _modem->enableGPS();
+    if (ok && interval != current) ok = _modem->setGPSReport(interval);
+  } else if (_powered()) {
+    _modem->setGPSReport(0);
+    ok = _modem->disableGPS();
+  }
+  unsigned long now = millis();
+  if (!ok) {
+    _failedAt = now ? now : 1;
+    return false;
+  }
+  _failedAt = 0;
+  if (power != _powered()) {
+    if (power) {
+      _onSince = now;
+    } else {
+      _onTotal += now - _onSince;
+    }
+  }
+  if (next == GPS_DUTY_TRACKING) _stillSince = now;
+  _state = next;
+  _since = now;
+  _moved = false;
+  _fixSeen = false;
+  return true;
+}
@@ -0,0 +1,153 @@
+#ifndef A9GGPSDUTY_H
+#define A9GGPSDUTY_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GGpsDuty.h
+ *
+ * @brief Motion-aware GPS duty cycling:
+ *        - fast NMEA reports while moving, sparse ones once the fixes stay
+ *          within a small radius at low speed
+ *        - the receiver is powered off (AT+GPS=0) after a longer still period
+ *        - wake() on external motion, or a scheduled probe fix that powers
+ *          the GPS off again right away if the unit has not moved
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GGpsDuty CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_GPS_FAST_INTERVAL
+#define A9G_GPS_FAST_INTERVAL 1      ///< AT+GPSRD seconds while moving
+#endif
+
+#ifndef A9G_GPS_SLOW_INTERVAL
+#define A9G_GPS_SLOW_INTERVAL 15     ///< AT+GPSRD seconds while standing still
+#endif
+
+#ifndef A9G_GPS_STILL_RADIUS
+#define A9G_GPS_STILL_RADIUS 30      ///< Meters the fixes may wander while still
+#endif
+
+#ifndef A9G_GPS_STILL_SPEED
+#define A9G_GPS_STILL_SPEED 150      ///< Ground speed (cm/s) that counts as moving
+#endif
+
+#ifndef A9G_GPS_STILL_TIME
+#define A9G_GPS_STILL_TIME 120       ///< Seconds still before the sparse interval
+#endif
+
+#ifndef A9G_GPS_OFF_AFTER
+#define A9G_GPS_OFF_AFTER 600        ///< Seconds still before power off (0 = never)
+#endif
+
+#ifndef A9G_GPS_WAKE_EVERY
+#define A9G_GPS_WAKE_EVERY 1800      ///< Seconds off before a probe fix (0 = only wake())
+#endif
+
+#ifndef A9G_GPS_PROBE_TIME
+#define A9G_GPS_PROBE_TIME 120       ///< Seconds a probe waits for a fix
+#endif
+
+/**
+ * @brief What the scheduler is doing with the receiver
+ */
+typedef enum A9G_GpsDutyState {
+  GPS_DUTY_STOPPED = 0,  ///< Not started, or stop()ped
+  GPS_DUTY_OFF,          ///< Powered off while parked
+  GPS_DUTY_PROBE,        ///< Powered for a scheduled check fix
+  GPS_DUTY_TRACKING,     ///< Moving: fast reports
+  GPS_DUTY_SPARSE        ///< Still: sparse reports
+} A9G_GpsDutyState;
+
+/**
+ * @class A9GGpsDuty
+ * @brief Drives AT+GPS / AT+GPSRD from the motion seen in EV_GPS_FIX.
+ *
+ * Usage:
+ *   A9GGpsDuty gps(a9g);
+ *   gps.begin();                 // power on, fast reports
+ *   ...
+ *   gps.loop();                  // from loop(); issues the AT commands
+ *   if (accelMoved) gps.wake();  // optional external motion trigger
+ *
+ * Decisions are taken in loop(), never inside pollModem(), because the
+ * commands wait for their answers.
+ */
+class A9GGpsDuty {
+public:
+  explicit A9GGpsDuty(A9G &modem);
+  ~A9GGpsDuty();
+
+  /**
+     * @brief Power the GPS and start tracking.
+     */
+  bool begin();
+
+  /**
+     * @brief Power the GPS off and stop scheduling.
+     */
+  bool stop();
+
+  void loop();
+
+  /**
+     * @brief Movement reported from outside (accelerometer, ignition):
+     *        go straight to tracking.
+     */
+  void wake() { _wakeRequest = true; }
+
+  void setIntervals(uint8_t fastSec, uint8_t slowSec);
+
+  /**
+     * @param radiusM  Wander allowed while still
+     * @param speedCms Speed that counts as moving
+     * @param stillSec Still time before the sparse interval
+     */
+  void setStillness(uint16_t radiusM, uint16_t speedCms, uint16_t stillSec);
+
+  /**
+     * @param offAfterSec Still time before power off (0 = never)
+     * @param wakeEverySec Time off before a probe (0 = only wake())
+     * @param probeSec    Time a probe waits for its fix
+     */
+  void setPowerOff(uint16_t offAfterSec, uint16_t wakeEverySec, uint16_t probeSec);
+
+  A9G_GpsDutyState state() const { return _state; }
+
+  /**
+     * @brief Total milliseconds the receiver was powered by this scheduler.
+     */
+  unsigned long onTime() const;
+
+private:
+  A9G *_modem;
+  A9G_GpsDutyState _state;
+  uint8_t _fast;
+  uint8_t _slow;
+  uint16_t _radius;
+  uint16_t _speed;
+  uint16_t _stillTime;
+  uint16_t _offAfter;
+  uint16_t _wakeEvery;
+  uint16_t _probeTime;
+
+  A9G_GeoPoint _anchor;          ///< Where the unit is considered to stand
+  bool _hasAnchor;
+  bool _moved;                   ///< A fix left the anchor since the last state change
+  bool _fixSeen;                 ///< A valid fix arrived since the last state change
+  bool _wakeRequest;
+  unsigned long _since;          ///< millis() of the last state change
+  unsigned long _stillSince;     ///< millis() the fixes settled at _anchor
+  unsigned long _failedAt;       ///< millis() of a failed command (0 = none)
+  unsigned long _onSince;
+  unsigned long _onTotal;
+
+  static void _onEvent(A9G_Event *evt, void *ctx);
+  void _onFix(const A9G_GPSFix &fix);
+  bool _enter(A9G_GpsDutyState next);
+  bool _powered() const { return _state >= GPS_DUTY_PROBE; }
+};
+
+#endif  // A9GGPSDUTY_H
@@ -0,0 +1,101 @@
+#include "A9GInbox.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GInbox IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9GInbox::A9GInbox(A9G &modem)
+  : _modem(&modem),
+    _count(0),
+    _newCount(0),
+    _truncated(false),
+    _leftover(true),  // whatever was stored before we started
+    _syncing(false) {
+  _modem->addEventHandler(_onEvent, this);
+}
+
+A9GInbox::~A9GInbox() {
+  _modem->removeEventHandler(_onEvent, this);
+}
+
+bool A9GInbox::sync(bool force) {
+  purge();
+  if (!force && !_newCount && !_leftover && !_count) return false;
+
+  // Held messages and leftovers are already marked read: only a full listing returns them
+  bool all = _leftover || _count;
+  _count = 0;
+  _truncated = false;
+  _syncing = true;
+  bool ok = _modem->listSMS(!all);
+  _syncing = false;
+
+  if (ok) _newCount = 0;
+  _leftover = !ok || _truncated;
+  return _count > 0;
+}
+
+void A9GInbox::markProcessed(uint8_t i) {
+  if (i < _count) _msgs[i].processed = true;
+}
+
+uint8_t A9GInbox::purge() {
+  uint8_t processed = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_msgs[i].processed) processed++;
+  }
+  if (!processed) return 0;
+
+  if (processed == _count && !_leftover) {
+    // Every read message on the modem is one of ours
+    if (!_modem->deleteSMS(1, READ_MESSAGE)) return 0;
+    _count = 0;
+    return processed;
+  }
+
+  uint8_t deleted = 0;
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_msgs[i].processed && _modem->deleteSMS(_msgs[i].index)) {
+      deleted++;
+      continue;
+    }
+    if (kept != i) _msgs[kept] = _msgs[i];
+    kept++;
+  }
+  _count = kept;
+  return deleted;
+}
+
+/**
+ * @brief Event handler registered on the modem.
+ */
+void A9GInbox::_onEvent(A9G_Event *evt, void *ctx) {
+  A9GInbox *self = static_cast<A9GInbox *>(ctx);
+  if (evt->id == EV_CMTI) {
+    if (self->_newCount < 255) self->_newCount++;
+  } else if (evt->id == EV_CMGL && self->_syncing) {
+    self->_store(evt);
+  }
+}
+
+/**
+ * @brief Keep one listed message; sent/unsent drafts are skipped.
+ */
+void A9GInbox::_store(const A9G_Event *evt) {
+  if (strncmp(evt->param2, "REC", 3)) return;
+  if (_count >= A9G_INBOX_SIZE) {
+    _truncated = true;
+    return;
+  }
+  A9G_InboxMessage *m = &_msgs[_count++];
+  m->index = evt->param1;
+  m->unread = !strcmp(evt->param2, "REC UNREAD");
+  m->processed = false;
+  strncpy(m->sender, evt->number, sizeof(m->sender) - 1);
+  m->sender[sizeof(m->sender) - 1] = '\0';
+  strncpy(m->timestamp, evt->date_time, sizeof(m->timestamp) - 1);
+  m->timestamp[sizeof(m->timestamp) - 1] = '\0';
+  strncpy(m->text, evt->body ? evt->body : evt->message, sizeof(m->text) - 1);
+  m->text[sizeof(m->text) - 1] = '\0';
+}
@@ -0,0 +1,117 @@
+#ifndef A9GINBOX_H
+#define A9GINBOX_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GInbox.h
+ *
+ * @brief SMS inbox kept in sync with the modem's message storage:
+ *        - +CMTI indications tell whether anything new arrived
+ *        - one AT+CMGL fetches all pending messages at once
+ *        - processed messages are deleted in bulk so the storage does not fill up
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GInbox CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_INBOX_SIZE
+#if defined(__AVR__)
+#define A9G_INBOX_SIZE 2             ///< Messages held after a sync
+#else
+#define A9G_INBOX_SIZE 8
+#endif
+#endif
+
+#ifndef A9G_INBOX_TEXT_MAX
+#if defined(__AVR__)
+#define A9G_INBOX_TEXT_MAX 81        ///< Text kept per message (incl. terminator)
+#else
+#define A9G_INBOX_TEXT_MAX 161
+#endif
+#endif
+
+/**
+ * @brief One received message as held by the inbox
+ */
+typedef struct A9G_InboxMessage {
+  uint8_t index;                     ///< Storage index on the modem
+  bool unread;                       ///< Was "REC UNREAD" when listed
+  bool processed;                    ///< Marked with markProcessed()
+  char sender[21];
+  char timestamp[25];
+  char text[A9G_INBOX_TEXT_MAX];     ///< Truncated if longer
+} A9G_InboxMessage;
+
+/**
+ * @class A9GInbox
+ * @brief Fetches received messages in batches and deletes them once handled.
+ *
+ * Typical loop:
+ *   if (inbox.sync()) {
+ *     for (uint8_t i = 0; i < inbox.count(); i++) { handle(inbox.message(i)); inbox.markProcessed(i); }
+ *     inbox.purge();
+ *   }
+ *
+ * Listing a message marks it read on the modem, so a message that was listed
+ * but not handled (or did not fit) is only seen again by listing all messages;
+ * sync() does that by itself when needed.
+ */
+class A9GInbox {
+public:
+  explicit A9GInbox(A9G &modem);
+  ~A9GInbox();
+
+  /**
+     * @brief New message indications (+CMTI) since the last sync.
+     */
+  uint8_t newCount() const { return _newCount; }
+
+  /**
+     * @brief Fetch pending messages with one AT+CMGL, replacing the held ones.
+     *        Without new indications or leftovers nothing is sent to the modem.
+     * @param force List even if nothing new was indicated
+     * @return true if messages are held afterwards
+     */
+  bool sync(bool force = false);
+
+  /**
+     * @brief Messages held since the last sync.
+     */
+  uint8_t count() const { return _count; }
+  const A9G_InboxMessage *message(uint8_t i) const { return i < _count ? &_msgs[i] : nullptr; }
+
+  /**
+     * @brief Flag a held message for deletion by purge().
+     */
+  void markProcessed(uint8_t i);
+
+  /**
+     * @brief Delete processed messages from the modem and drop them here.
+     *        When everything listed was processed (and nothing is left on the
+     *        modem) all read messages go with a single AT+CMGD=1,1; otherwise
+     *        the processed indices are deleted one by one.
+     * @return Number of messages deleted
+     */
+  uint8_t purge();
+
+  /**
+     * @brief The last listing had more messages than A9G_INBOX_SIZE.
+     */
+  bool truncated() const { return _truncated; }
+
+private:
+  A9G *_modem;
+  A9G_InboxMessage _msgs[A9G_INBOX_SIZE];
+  uint8_t _count;
+  uint8_t _newCount;
+  bool _truncated;
+  bool _leftover;                    ///< Read messages on the modem that may not be handled yet
+  bool _syncing;
+
+  static void _onEvent(A9G_Event *evt, void *ctx);
+  void _store(const A9G_Event *evt);
+};
+
+#endif  // A9GINBOX_H
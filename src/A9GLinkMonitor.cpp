@@ -0,0 +1,141 @@
+#include "A9GLinkMonitor.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GLinkMonitor IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9GLinkMonitor::A9GLinkMonitor(A9G &modem, unsigned long interval)
+  : _modem(&modem),
+    _lastRound(0),
+    _interval(interval),
+    _polled(false),
+    _step(STEP_IDLE),
+    _minCsq(A9G_LINK_MIN_CSQ),
+    _maxBer(A9G_LINK_MAX_BER),
+    _maxDrop(A9G_LINK_MAX_DROP) {
+  reset();
+  _modem->addEventHandler(_onEvent, this);
+}
+
+A9GLinkMonitor::~A9GLinkMonitor() {
+  _modem->removeEventHandler(_onEvent, this);
+}
+
+void A9GLinkMonitor::reset() {
+  _head = 0;
+  _count = 0;
+  _lastSample = 0;
+}
+
+void A9GLinkMonitor::setThresholds(uint8_t minCsq, uint8_t maxBer, int maxDrop) {
+  _minCsq = minCsq;
+  _maxBer = maxBer;
+  _maxDrop = maxDrop;
+}
+
+/**
+ * @brief One round is AT+CSQ then AT+CREG?, each sent once the modem is idle.
+ */
+void A9GLinkMonitor::loop() {
+  if (_step == STEP_IDLE) {
+    if (!_interval) return;
+    if (_polled && millis() - _lastRound < _interval) return;
+    if (_modem->requestSignalQuality()) {
+      _step = STEP_CSQ;
+      _lastRound = millis();
+      _polled = true;
+    }
+    return;
+  }
+  // Our query, or a command started after it, is still running
+  if (_modem->isBusy()) return;
+  if (_step == STEP_CSQ) {
+    if (_modem->requestRegistration()) _step = STEP_CREG;
+    return;
+  }
+  _step = STEP_IDLE;
+}
+
+const A9G_LinkSample *A9GLinkMonitor::sample(uint8_t i) const {
+  return i < _count ? &_samples[(_head + i) % A9G_LINK_WINDOW] : nullptr;
+}
+
+const A9G_LinkSample *A9GLinkMonitor::_newest() const {
+  return _count ? sample(_count - 1) : nullptr;
+}
+
+uint8_t A9GLinkMonitor::minSignal() const {
+  if (!_count) return 0;
+  uint8_t m = 31;
+  for (uint8_t i = 0; i < _count; i++) {
+    uint8_t r = _rssiOf(*sample(i));
+    if (r < m) m = r;
+  }
+  return m;
+}
+
+uint8_t A9GLinkMonitor::meanSignal() const {
+  if (!_count) return 0;
+  uint16_t sum = 0;
+  for (uint8_t i = 0; i < _count; i++) sum += _rssiOf(*sample(i));
+  return (sum + _count / 2) / _count;
+}
+
+int A9GLinkMonitor::trend() const {
+  if (_count < 4) return 0;
+  uint8_t half = _count / 2;
+  long older = 0, newer = 0;
+  for (uint8_t i = 0; i < half; i++) {
+    older += _rssiOf(*sample(i));
+    newer += _rssiOf(*sample(_count - half + i));
+  }
+  return (int)((newer - older) * 10 / half);
+}
+
+bool A9GLinkMonitor::registered() const {
+  const A9G_LinkSample *s = _newest();
+  return s && (s->reg == REG_HOME || s->reg == REG_ROAMING);
+}
+
+bool A9GLinkMonitor::_fresh() const {
+  if (!_count) return false;
+  if (!_interval) return true;
+  return millis() - _lastSample <= 3 * _interval;
+}
+
+bool A9GLinkMonitor::linkGood() const {
+  if (!_fresh()) return true;
+  const A9G_LinkSample *s = _newest();
+  if (s->reg != REG_UNKNOWN && !registered()) return false;
+  if (s->rssi > 31 || s->rssi < _minCsq) return false;
+  if (meanSignal() < _minCsq) return false;
+  if (s->ber <= 7 && s->ber > _maxBer) return false;
+  return trend() >= -_maxDrop;
+}
+
+void A9GLinkMonitor::_add(uint8_t rssi, uint8_t ber) {
+  if (_count == A9G_LINK_WINDOW) {
+    _head = (_head + 1) % A9G_LINK_WINDOW;
+    _count--;
+  }
+  A9G_LinkSample *s = &_samples[(_head + _count) % A9G_LINK_WINDOW];
+  s->rssi = rssi;
+  s->ber = ber;
+  s->reg = _modem->registrationStatus();
+  _count++;
+  _lastSample = millis();
+}
+
+/**
+ * @brief Event handler registered on the modem.
+ */
+void A9GLinkMonitor::_onEvent(A9G_Event *evt, void *ctx) {
+  A9GLinkMonitor *self = static_cast<A9GLinkMonitor *>(ctx);
+  if (evt->id == EV_CSQ) {
+    self->_add(self->_modem->signalQuality(), self->_modem->bitErrorRate());
+  } else if (evt->id == EV_CREG && self->_count) {
+    // The registration answer of a round belongs to its CSQ sample
+    A9G_LinkSample *s = &self->_samples[(self->_head + self->_count - 1) % A9G_LINK_WINDOW];
+    s->reg = evt->param1;
+  }
+}
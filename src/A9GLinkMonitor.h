@@ -0,0 +1,151 @@
+#ifndef A9GLINKMONITOR_H
+#define A9GLINKMONITOR_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GLinkMonitor.h
+ *
+ * @brief Background network quality monitor:
+ *        - AT+CSQ and AT+CREG? go out periodically as non-blocking queries
+ *        - every +CSQ answer becomes a sample (RSSI, BER, registration) in a
+ *          fixed-size rolling window
+ *        - min / mean / trend of the window and a "link good enough" verdict
+ *          that A9Gmod can use to hold publishes back
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GLinkMonitor CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_LINK_WINDOW
+#if defined(__AVR__)
+#define A9G_LINK_WINDOW 8            ///< Samples in the rolling window
+#else
+#define A9G_LINK_WINDOW 16
+#endif
+#endif
+
+#ifndef A9G_LINK_INTERVAL
+#define A9G_LINK_INTERVAL 30000      ///< ms between two AT+CSQ / AT+CREG? rounds
+#endif
+
+#ifndef A9G_LINK_MIN_CSQ
+#define A9G_LINK_MIN_CSQ 8           ///< Weakest RSSI index considered usable (8 = -97 dBm)
+#endif
+
+#ifndef A9G_LINK_MAX_BER
+#define A9G_LINK_MAX_BER 5           ///< Worst BER class considered usable (0..7)
+#endif
+
+#ifndef A9G_LINK_MAX_DROP
+#define A9G_LINK_MAX_DROP 30         ///< Steepest tolerated fall of trend(), tenths of an RSSI step
+#endif
+
+/**
+ * @brief One +CSQ answer with the registration state at that time
+ */
+typedef struct A9G_LinkSample {
+  uint8_t rssi;                      ///< 0..31, 99 = not detectable
+  uint8_t ber;                       ///< 0..7, 99 = unknown
+  uint8_t reg;                       ///< A9G_RegStatus
+} A9G_LinkSample;
+
+/**
+ * @class A9GLinkMonitor
+ * @brief Keeps a rolling window of link quality samples without blocking.
+ *
+ * Typical loop:
+ *   monitor.loop();             // sends a query when due, never waits
+ *   a9gmod.processMQTT();       // with a9gmod.setLinkMonitor(&monitor) it holds
+ *                               // queued messages while !monitor.linkGood()
+ *
+ * Samples also come from +CSQ answers requested by anyone else. Samples older
+ * than three intervals count as no information, and without information the
+ * link is considered good, so a monitor that is not polled blocks nothing.
+ */
+class A9GLinkMonitor {
+public:
+  explicit A9GLinkMonitor(A9G &modem, unsigned long interval = A9G_LINK_INTERVAL);
+  ~A9GLinkMonitor();
+
+  /**
+     * @brief Issue the next query when it is due. Call from loop().
+     */
+  void loop();
+
+  /**
+     * @brief Time between rounds; 0 stops polling (samples still arrive from
+     *        other +CSQ answers and never go stale).
+     */
+  void setInterval(unsigned long interval) { _interval = interval; }
+
+  /**
+     * @brief Limits used by linkGood().
+     * @param minCsq  Weakest usable RSSI index for the latest sample and the mean
+     * @param maxBer  Worst usable BER class of the latest sample
+     * @param maxDrop Steepest tolerated fall of trend()
+     */
+  void setThresholds(uint8_t minCsq, uint8_t maxBer, int maxDrop);
+
+  /**
+     * @brief Forget all samples.
+     */
+  void reset();
+
+  /**
+     * @brief Samples in the window, and the i-th one (0 = oldest).
+     */
+  uint8_t samples() const { return _count; }
+  const A9G_LinkSample *sample(uint8_t i) const;
+
+  /**
+     * @brief Weakest and mean RSSI index of the window (0 when empty;
+     *        "not detectable" counts as 0).
+     */
+  uint8_t minSignal() const;
+  uint8_t meanSignal() const;
+
+  /**
+     * @brief Mean RSSI of the newer half of the window minus that of the
+     *        older half, in tenths of an RSSI step (one step = 2 dB).
+     *        0 with fewer than 4 samples.
+     */
+  int trend() const;
+
+  /**
+     * @brief Latest sample is registered on the home network or roaming.
+     */
+  bool registered() const;
+
+  /**
+     * @brief Whether sending is worth it: registered, latest and mean RSSI
+     *        above the minimum, BER acceptable and the signal not falling fast.
+     *        true while there are no recent samples.
+     */
+  bool linkGood() const;
+
+private:
+  typedef enum { STEP_IDLE, STEP_CSQ, STEP_CREG } Step;
+
+  A9G *_modem;
+  A9G_LinkSample _samples[A9G_LINK_WINDOW];
+  uint8_t _head;                     ///< Oldest sample
+  uint8_t _count;
+  unsigned long _lastSample;         ///< millis() of the newest sample
+  unsigned long _lastRound;
+  unsigned long _interval;
+  bool _polled;                      ///< At least one round was started
+  Step _step;
+  uint8_t _minCsq;
+  uint8_t _maxBer;
+  int _maxDrop;
+
+  static void _onEvent(A9G_Event *evt, void *ctx);
+  void _add(uint8_t rssi, uint8_t ber);
+  const A9G_LinkSample *_newest() const;
+  bool _fresh() const;
+  static uint8_t _rssiOf(const A9G_LinkSample &s) { return s.rssi <= 31 ? s.rssi : 0; }
+};
+
+#endif  // A9GLINKMONITOR_H
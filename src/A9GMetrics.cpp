@@ -0,0 +1,156 @@
+#include "A9GMetrics.h"
+#include "A9GCmd.h"
+
+#ifdef A9G_ENABLE_METRICS
+
+/* ------------------------------------------------------------------
+ *                   A9G_Metrics IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+#define SUB_BITS A9G_METRICS_SUB_BITS
+#define SUB_MASK ((1U << SUB_BITS) - 1)
+
+/**
+ * @brief Command prefixes (after "AT+") and their class, first match wins.
+ */
+static const struct {
+  const char *prefix;
+  A9G_MetricClass cls;
+} classPrefixes[] = {
+  { "MQTTPUB", MC_MQTTPUB },
+  { "MQTTSUB", MC_MQTTSUB },
+  { "MQTTUNSUB", MC_MQTTSUB },
+  { "MQTTCONN", MC_MQTTCONN },
+  { "MQTTDISCONN", MC_MQTTCONN },
+  { "CGATT", MC_CGATT },
+  { "CGDCONT", MC_PDP },
+  { "CGACT", MC_PDP },
+  { "GPS", MC_GPS },
+  { "AGPS", MC_GPS },
+  { "GPNT", MC_GPS },
+  { "CMG", MC_SMS },
+  { "CSQ", MC_STATUS },
+  { "CREG", MC_STATUS },
+  { "CCID", MC_STATUS },
+  { "EGMR", MC_STATUS },
+};
+
+A9G_Metrics::A9G_Metrics() {
+  reset();
+}
+
+void A9G_Metrics::reset() {
+  memset(_counters, 0, sizeof(_counters));
+  memset(_hist, 0, sizeof(_hist));
+  _openClass = -1;
+  _openStart = 0;
+}
+
+void A9G_Metrics::begin(const char *cmd, size_t len) {
+  _counters[CNT_COMMANDS]++;
+  _openClass = MC_OTHER;
+  _openStart = millis();
+  if (len < 3 || strncmp(cmd, "AT+", 3)) return;
+  for (size_t i = 0; i < sizeof(classPrefixes) / sizeof(classPrefixes[0]); i++) {
+    size_t n = strlen(classPrefixes[i].prefix);
+    if (len >= 3 + n && !strncmp(cmd + 3, classPrefixes[i].prefix, n)) {
+      _openClass = classPrefixes[i].cls;
+      return;
+    }
+  }
+}
+
+void A9G_Metrics::end(bool timedOut) {
+  if (_openClass < 0) return;
+  if (!timedOut) record((A9G_MetricClass)_openClass, millis() - _openStart);
+  _openClass = -1;
+}
+
+void A9G_Metrics::record(A9G_MetricClass cls, unsigned long ms) {
+  if (ms > A9G_METRICS_MAX_MS) ms = A9G_METRICS_MAX_MS;
+  A9G_Histogram *h = &_hist[cls];
+  uint16_t *b = &h->buckets[bucketOf(ms)];
+  if (*b < 0xFFFF) (*b)++;
+  if (!h->count || ms < h->minMs) h->minMs = ms;
+  if (ms > h->maxMs) h->maxMs = ms;
+  h->count++;
+  h->sumMs += ms;
+}
+
+uint8_t A9G_Metrics::bucketOf(unsigned long ms) {
+  if (ms > A9G_METRICS_MAX_MS) ms = A9G_METRICS_MAX_MS;
+  if (ms < (1UL << SUB_BITS)) return ms;
+  uint8_t msb = SUB_BITS;
+  while (ms >> (msb + 1)) msb++;
+  uint8_t group = msb - SUB_BITS + 1;
+  return (group << SUB_BITS) | ((ms >> (msb - SUB_BITS)) & SUB_MASK);
+}
+
+uint32_t A9G_Metrics::bucketUpper(uint8_t bucket) {
+  if (bucket + 1 >= A9G_METRICS_BUCKETS) return A9G_METRICS_MAX_MS;
+  // Lower edge of the next bucket, minus one
+  uint8_t next = bucket + 1;
+  uint8_t group = next >> SUB_BITS;
+  uint32_t sub = next & SUB_MASK;
+  if (!group) return sub - 1;
+  return (1UL << (group + SUB_BITS - 1)) + (sub << (group - 1)) - 1;
+}
+
+uint32_t A9G_Metrics::percentile(A9G_MetricClass cls, uint16_t permille) const {
+  const A9G_Histogram *h = &_hist[cls];
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < A9G_METRICS_BUCKETS; i++) total += h->buckets[i];
+  if (!total) return 0;
+  uint32_t rank = (total * permille + 999) / 1000;
+  if (!rank) rank = 1;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < A9G_METRICS_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= rank) {
+      uint32_t upper = bucketUpper(i);
+      return upper > h->maxMs ? h->maxMs : upper;
+    }
+  }
+  return h->maxMs;
+}
+
+size_t A9G_Metrics::snapshotCounters(char *buf, size_t len) const {
+  if (!buf || !len) return 0;
+  A9G_TextBuilder out(buf, len);
+  for (uint8_t c = 0; c < CNT_MAX; c++) {
+    if (c) out.add(' ');
+    out.add(counterName((A9G_Counter)c)).add('=').add((unsigned long)_counters[c]);
+  }
+  return out.overflow() ? 0 : out.length();
+}
+
+size_t A9G_Metrics::snapshotLatency(A9G_MetricClass cls, char *buf, size_t len) const {
+  if (!buf || !len || cls >= MC_MAX) return 0;
+  const A9G_Histogram *h = &_hist[cls];
+  if (!h->count) return 0;
+  A9G_TextBuilder out(buf, len);
+  out.add("n=").add((unsigned long)h->count)
+    .add(" min=").add((unsigned int)h->minMs)
+    .add(" avg=").add((unsigned long)(h->sumMs / h->count))
+    .add(" p50=").add((unsigned long)percentile(cls, 500))
+    .add(" p90=").add((unsigned long)percentile(cls, 900))
+    .add(" p99=").add((unsigned long)percentile(cls, 990))
+    .add(" max=").add((unsigned int)h->maxMs);
+  return out.overflow() ? 0 : out.length();
+}
+
+const char *A9G_Metrics::className(A9G_MetricClass cls) {
+  static const char *const names[MC_MAX] = {
+    "mqttpub", "mqttsub", "mqttconn", "cgatt", "pdp", "gps", "sms", "status", "other"
+  };
+  return cls < MC_MAX ? names[cls] : "";
+}
+
+const char *A9G_Metrics::counterName(A9G_Counter c) {
+  static const char *const names[CNT_MAX] = {
+    "out", "in", "cmd", "tmo", "err", "perr", "trunc", "urc", "bp", "mqrx"
+  };
+  return c < CNT_MAX ? names[c] : "";
+}
+
+#endif  // A9G_ENABLE_METRICS
@@ -0,0 +1,149 @@
+#ifndef A9GMETRICS_H
+#define A9GMETRICS_H
+
+#include <Arduino.h>
+
+/*!
+ * @file A9GMetrics.h
+ *
+ * @brief Opt-in link instrumentation: AT round-trip latency histograms per
+ *        command class and monotonic counters (bytes, timeouts, errors, ...).
+ *
+ * Build with A9G_ENABLE_METRICS defined to turn it on. Without it the
+ * A9G_METRIC_* hooks expand to nothing and no storage is reserved.
+ */
+
+/* ------------------------------------------------------------------
+ *                      METRICS CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_METRICS_SUB_BITS
+#if defined(__AVR__)
+#define A9G_METRICS_SUB_BITS 1       ///< log2 of the buckets per power of two (precision)
+#else
+#define A9G_METRICS_SUB_BITS 2
+#endif
+#endif
+
+#define A9G_METRICS_MAX_MS 65535UL   ///< Latencies above this land in the last bucket
+#define A9G_METRICS_BUCKETS ((17 - A9G_METRICS_SUB_BITS) << A9G_METRICS_SUB_BITS)
+
+/**
+ * @brief Command classes with their own latency histogram
+ */
+typedef enum A9G_MetricClass {
+  MC_MQTTPUB = 0,
+  MC_MQTTSUB,        ///< AT+MQTTSUB (subscribe and unsubscribe)
+  MC_MQTTCONN,       ///< AT+MQTTCONN / AT+MQTTDISCONN
+  MC_CGATT,          ///< AT+CGATT
+  MC_PDP,            ///< AT+CGDCONT / AT+CGACT
+  MC_GPS,            ///< AT+GPS / AT+AGPS / AT+GPSRD / AT+GPNT
+  MC_SMS,            ///< AT+CMGS ... +CMGS, AT+CMGL / AT+CMGR / AT+CMGD
+  MC_STATUS,         ///< AT+CSQ / AT+CREG / AT+CCID / AT+EGMR
+  MC_OTHER,
+  MC_MAX
+} A9G_MetricClass;
+
+/**
+ * @brief Monotonic counters
+ */
+typedef enum A9G_Counter {
+  CNT_BYTES_OUT = 0, ///< Bytes handed to the modem
+  CNT_BYTES_IN,      ///< Bytes read from the modem
+  CNT_COMMANDS,      ///< Command lines sent
+  CNT_TIMEOUTS,      ///< Commands without a final result in time
+  CNT_ERRORS,        ///< ERROR / +CME ERROR / +CMS ERROR results
+  CNT_PARSE_ERRORS,  ///< Over-long +TERMs, undecodable PDUs
+  CNT_TRUNCATED,     ///< Response data or payloads cut to fit a buffer
+  CNT_URC_DROPPED,   ///< +TERM lines nobody recognized
+  CNT_BACKPRESSURE,  ///< Commands or messages rejected because a queue was full
+  CNT_MQTT_RX,       ///< MQTT messages received
+  CNT_MAX
+} A9G_Counter;
+
+/**
+ * @brief Fixed-memory log-linear histogram of latencies in ms.
+ *        Values below 2^SUB_BITS get their own bucket; above that every power
+ *        of two is split into 2^SUB_BITS equal buckets (relative error < 2^-SUB_BITS).
+ */
+typedef struct A9G_Histogram {
+  uint16_t buckets[A9G_METRICS_BUCKETS];  ///< Saturating counts
+  uint32_t count;
+  uint32_t sumMs;
+  uint16_t minMs;
+  uint16_t maxMs;
+} A9G_Histogram;
+
+/**
+ * @class A9G_Metrics
+ * @brief Storage and formatting of the metrics; owned by A9G.
+ */
+class A9G_Metrics {
+public:
+  A9G_Metrics();
+
+  void add(A9G_Counter c, uint32_t n = 1) { _counters[c] += n; }
+  uint32_t counter(A9G_Counter c) const { return _counters[c]; }
+
+  /**
+     * @brief Note the start of a command line (classified by its prefix).
+     */
+  void begin(const char *cmd, size_t len);
+
+  /**
+     * @brief Final result of the command noted by begin(); ignored if none is open.
+     *        A timed-out command is not recorded (its latency is unknown).
+     */
+  void end(bool timedOut);
+
+  void record(A9G_MetricClass cls, unsigned long ms);
+  const A9G_Histogram &histogram(A9G_MetricClass cls) const { return _hist[cls]; }
+
+  /**
+     * @brief Latency below which the given share of samples falls.
+     * @param permille 500 = median, 990 = p99
+     * @return Upper edge of the bucket in ms (0 if empty)
+     */
+  uint32_t percentile(A9G_MetricClass cls, uint16_t permille) const;
+
+  /**
+     * @brief Counters as "out=.. in=.. cmd=.. ..." (no quotes or commas, so
+     *        the text goes through AT+MQTTPUB without escaping).
+     * @return Length written, 0 if the buffer was too small
+     */
+  size_t snapshotCounters(char *buf, size_t len) const;
+
+  /**
+     * @brief One histogram as "n=.. min=.. avg=.. p50=.. p90=.. p99=.. max=..".
+     * @return Length written, 0 if the buffer was too small or the class is empty
+     */
+  size_t snapshotLatency(A9G_MetricClass cls, char *buf, size_t len) const;
+
+  /**
+     * @brief Zero everything.
+     */
+  void reset();
+
+  static const char *className(A9G_MetricClass cls);
+  static const char *counterName(A9G_Counter c);
+  static uint8_t bucketOf(unsigned long ms);
+  static uint32_t bucketUpper(uint8_t bucket);
+
+private:
+  uint32_t _counters[CNT_MAX];
+  A9G_Histogram _hist[MC_MAX];
+  int8_t _openClass;                 ///< Class of the command in flight (-1 = none)
+  unsigned long _openStart;
+};
+
+#ifdef A9G_ENABLE_METRICS
+#define A9G_METRIC_ADD(m, counter, n) (m).add(counter, n)
+#define A9G_METRIC_BEGIN(m, cmd, len) (m).begin(cmd, len)
+#define A9G_METRIC_END(m, timedOut) (m).end(timedOut)
+#else
+#define A9G_METRIC_ADD(m, counter, n) ((void)0)
+#define A9G_METRIC_BEGIN(m, cmd, len) ((void)0)
+#define A9G_METRIC_END(m, timedOut) ((void)0)
+#endif
+
+#endif  // A9GMETRICS_H
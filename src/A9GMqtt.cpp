@@ -0,0 +1,365 @@
+#include "A9GMqtt.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GMqttClient IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+#define BODY 5  // fixed header (1) + longest remaining length (4)
+
+A9GMqttClient::A9GMqttClient(A9G &modem)
+  : _modem(&modem),
+    _connected(false),
+    _connack(0xFF),
+    _keepAlive(0),
+    _nextId(1),
+    _lastTx(0),
+    _pingPending(false),
+    _pingSent(0),
+    _ackTimeouts(0),
+    _txLen(0),
+    _rxHeader(0),
+    _rxStage(0),
+    _rxRemaining(0),
+    _rxShift(0),
+    _rxLen(0),
+    _rxSkip(false),
+    _rxBusy(false),
+    _oversized(0),
+    _tcpLost(0),
+    _waitType(0),
+    _waitId(0),
+    _waitDone(false),
+    _waitOk(false),
+    _msgCb(nullptr),
+    _msgCtx(nullptr),
+    _pubCb(nullptr),
+    _pubCtx(nullptr) {
+  memset(_inFlight, 0, sizeof(_inFlight));
+}
+
+void A9GMqttClient::onMessage(A9G_MQTTBinaryCallback cb, void *ctx) {
+  _msgCb = cb;
+  _msgCtx = ctx;
+}
+
+void A9GMqttClient::onPublishResult(void (*cb)(void *ctx, bool ok), void *ctx) {
+  _pubCb = cb;
+  _pubCtx = ctx;
+}
+
+bool A9GMqttClient::connect(const char *host, uint16_t port, const char *clientId,
+                            const char *user, const char *pass,
+                            uint16_t keepAlive, bool cleanSession) {
+  if (_connected) disconnect();
+  _connack = 0xFF;
+  _rxStage = 0;
+  _lost();
+  if (!_modem->tcpConnect(host, port)) return false;
+  _tcpLost = _modem->tcpDropped();
+
+  uint8_t flags = cleanSession ? 0x02 : 0;
+  if (user) flags |= 0x80;
+  if (user && pass) flags |= 0x40;
+  static const uint8_t protocol[] = { 0, 4, 'M', 'Q', 'T', 'T', 4 };
+  _begin();
+  bool fits = _putBytes(protocol, sizeof(protocol)) && _putBytes(&flags, 1) &&
+              _putShort(keepAlive) && _putString(clientId) &&
+              (!user || _putString(user)) && (!user || !pass || _putString(pass));
+  _keepAlive = keepAlive;
+  _connected = fits && _send(CONNECT << 4) && _waitReply(CONNACK, 0) && _connack == 0;
+  if (!_connected) _modem->tcpClose();
+  return _connected;
+}
+
+bool A9GMqttClient::publish(const char *topic, const uint8_t *payload, size_t len,
+                            uint8_t qos, bool retain) {
+  if (!_connected) return false;
+  if (qos > 1) qos = 1;
+  InFlight *slot = nullptr;
+  if (qos) {
+    for (uint8_t i = 0; i < A9G_MQTT_INFLIGHT && !slot; i++) {
+      if (!_inFlight[i].id) slot = &_inFlight[i];
+    }
+    if (!slot) return false;
+  }
+  uint16_t id = qos ? _packetId() : 0;
+  _begin();
+  if (!_putString(topic) || (qos && !_putShort(id)) || !_putBytes(payload, len)) return false;
+  if (!_send((PUBLISH << 4) | (qos << 1) | (retain ? 1 : 0))) return false;
+  if (slot) {
+    slot->id = id;
+    slot->sent = millis();
+  }
+  return true;
+}
+
+bool A9GMqttClient::subscribe(const char *topic, uint8_t qos) {
+  if (!_connected) return false;
+  uint16_t id = _packetId();
+  return _sendSubscribe(topic, qos, id) && _waitReply(SUBACK, id);
+}
+
+bool A9GMqttClient::subscribeNonBlocking(const char *topic, uint8_t qos) {
+  return _connected && _sendSubscribe(topic, qos, _packetId());
+}
+
+bool A9GMqttClient::unsubscribe(const char *topic) {
+  if (!_connected) return false;
+  uint16_t id = _packetId();
+  _begin();
+  if (!_putShort(id) || !_putString(topic)) return false;
+  return _send((UNSUBSCRIBE << 4) | 0x02) && _waitReply(UNSUBACK, id);
+}
+
+void A9GMqttClient::disconnect() {
+  if (_connected) {
+    _begin();
+    _send(DISCONNECT << 4);
+  }
+  _lost();
+  _modem->tcpClose();
+}
+
+void A9GMqttClient::loop() {
+  _modem->pollModem();
+  _readPackets();
+  if (!_connected) return;
+  if (!_modem->tcpConnected()) {
+    _lost();
+    return;
+  }
+  if (_modem->tcpDropped() != _tcpLost) {
+    // Bytes of the stream are gone, packet boundaries can no longer be found
+    disconnect();
+    return;
+  }
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < A9G_MQTT_INFLIGHT; i++) {
+    if (_inFlight[i].id && now - _inFlight[i].sent >= A9G_MQTT_ACK_TIMEOUT) {
+      _ackTimeouts++;
+      _ackPublish(_inFlight[i].id, false);
+    }
+  }
+  if (!_keepAlive) return;
+  unsigned long period = _keepAlive * 1000UL;
+  if (_pingPending && now - _pingSent >= period) {
+    // No PINGRESP within a whole keepalive period: the broker is gone
+    disconnect();
+  } else if (!_pingPending && now - _lastTx >= period / 4 * 3) {
+    _begin();
+    if (_send(PINGREQ << 4)) {
+      _pingPending = true;
+      _pingSent = now;
+    }
+  }
+}
+
+bool A9GMqttClient::canPublish(uint8_t qos) const {
+  return !qos || inFlight() < A9G_MQTT_INFLIGHT;
+}
+
+uint8_t A9GMqttClient::inFlight() const {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < A9G_MQTT_INFLIGHT; i++) {
+    if (_inFlight[i].id) n++;
+  }
+  return n;
+}
+
+/* ------------------------------------------------------------------
+ *   PACKET BUILDING
+ * ------------------------------------------------------------------ */
+
+void A9GMqttClient::_begin() {
+  _txLen = BODY;
+}
+
+bool A9GMqttClient::_putBytes(const uint8_t *data, size_t len) {
+  if (len > sizeof(_tx) - _txLen) return false;
+  memcpy(_tx + _txLen, data, len);
+  _txLen += len;
+  return true;
+}
+
+bool A9GMqttClient::_putShort(uint16_t v) {
+  uint8_t b[2] = { (uint8_t)(v >> 8), (uint8_t)v };
+  return _putBytes(b, 2);
+}
+
+bool A9GMqttClient::_putString(const char *str) {
+  size_t len = strlen(str);
+  return len <= 0xFFFF && _putShort(len) && _putBytes((const uint8_t *)str, len);
+}
+
+/**
+ * @brief Put the fixed header in front of the body and send the packet.
+ */
+bool A9GMqttClient::_send(uint8_t header) {
+  size_t remaining = _txLen - BODY;
+  uint8_t varint[4];
+  uint8_t n = 0;
+  do {
+    varint[n] = remaining & 0x7F;
+    remaining >>= 7;
+    if (remaining) varint[n] |= 0x80;
+    n++;
+  } while (remaining);
+  uint8_t *start = _tx + BODY - 1 - n;
+  start[0] = header;
+  memcpy(start + 1, varint, n);
+  if (!_modem->tcpSend(start, _tx + _txLen - start)) {
+    _lost();
+    return false;
+  }
+  _lastTx = millis();
+  return true;
+}
+
+bool A9GMqttClient::_sendSubscribe(const char *topic, uint8_t qos, uint16_t id) {
+  uint8_t q = qos > 1 ? 1 : qos;
+  _begin();
+  if (!_putShort(id) || !_putString(topic) || !_putBytes(&q, 1)) return false;
+  return _send((SUBSCRIBE << 4) | 0x02);
+}
+
+uint16_t A9GMqttClient::_packetId() {
+  uint16_t id = _nextId++;
+  if (!_nextId) _nextId = 1;  // 0 is not a valid packet id
+  return id;
+}
+
+/**
+ * @brief Block until the reply of type/id arrived (or the timeout).
+ */
+bool A9GMqttClient::_waitReply(uint8_t type, uint16_t id) {
+  _waitType = type;
+  _waitId = id;
+  _waitDone = false;
+  unsigned long start = millis();
+  while (!_waitDone && _modem->tcpConnected() && millis() - start < A9G_MQTT_REPLY_TIMEOUT) {
+    _modem->feedWatchdog();
+    _modem->pollModem();
+    _readPackets();
+  }
+  _waitType = 0;
+  return _waitDone && _waitOk;
+}
+
+/* ------------------------------------------------------------------
+ *   INBOUND PACKETS
+ * ------------------------------------------------------------------ */
+
+void A9GMqttClient::_readPackets() {
+  if (_rxBusy) return;  // a callback called back into us; finish that packet first
+  int c;
+  while ((c = _modem->tcpRead()) >= 0) {
+    if (_rxStage == 0) {
+      _rxHeader = c;
+      _rxRemaining = 0;
+      _rxShift = 0;
+      _rxStage = 1;
+    } else if (_rxStage == 1) {
+      _rxRemaining |= (uint32_t)(c & 0x7F) << _rxShift;
+      _rxShift += 7;
+      if ((c & 0x80) && _rxShift < 28) continue;
+      _rxLen = 0;
+      _rxSkip = _rxRemaining > A9G_MQTT_PACKET_MAX;
+      if (_rxSkip) _oversized++;
+      _rxStage = 2;
+    } else {
+      if (!_rxSkip) _rx[_rxLen] = c;
+      _rxLen++;
+    }
+    if (_rxStage == 2 && _rxLen == _rxRemaining) {
+      _rxStage = 0;
+      if (!_rxSkip) _handlePacket();
+    }
+  }
+}
+
+void A9GMqttClient::_handlePacket() {
+  uint8_t type = _rxHeader >> 4;
+  uint16_t id = _rxLen >= 2 ? (_rx[0] << 8) | _rx[1] : 0;
+  switch (type) {
+    case CONNACK:
+      if (_rxLen < 2) break;
+      _connack = _rx[1];
+      id = 0;
+      break;
+    case PUBLISH: {
+      uint8_t qos = (_rxHeader >> 1) & 0x03;
+      size_t topicLen = id;
+      size_t pos = 2 + topicLen;
+      if (pos + (qos ? 2 : 0) > _rxLen) return;
+      uint16_t msgId = qos ? (_rx[pos] << 8) | _rx[pos + 1] : 0;
+      if (qos) pos += 2;
+      // Terminate the topic in place: move it over its length field
+      memmove(_rx, _rx + 2, topicLen);
+      _rx[topicLen] = '\0';
+      _rx[_rxLen] = '\0';
+      if (_msgCb) {
+        _rxBusy = true;
+        _msgCb(_msgCtx, (const char *)_rx, _rx + pos, _rxLen - pos);
+        _rxBusy = false;
+      }
+      if (qos) {
+        _begin();
+        _putShort(msgId);
+        _send(qos == 1 ? PUBACK << 4 : PUBREC << 4);
+      }
+      return;
+    }
+    case PUBREL:
+      _begin();
+      _putShort(id);
+      _send(PUBCOMP << 4);
+      return;
+    case PUBACK:
+      _ackPublish(id, true);
+      return;
+    case SUBACK:
+      // The granted QoS follows the id; 0x80 is a refusal
+      if (_rxLen < 3 || _rx[2] == 0x80) {
+        if (_waitType == SUBACK && _waitId == id) {
+          _waitOk = false;
+          _waitDone = true;
+        }
+        return;
+      }
+      break;
+    case UNSUBACK:
+      break;
+    case PINGRESP:
+      _pingPending = false;
+      return;
+    default:
+      return;
+  }
+  if (_waitType == type && _waitId == id) {
+    _waitOk = true;
+    _waitDone = true;
+  }
+}
+
+/**
+ * @brief Release the in-flight slot of a QoS 1 publish and report its outcome.
+ */
+void A9GMqttClient::_ackPublish(uint16_t id, bool ok) {
+  if (!id) return;
+  for (uint8_t i = 0; i < A9G_MQTT_INFLIGHT; i++) {
+    if (_inFlight[i].id == id) {
+      _inFlight[i].id = 0;
+      if (_pubCb) _pubCb(_pubCtx, ok);
+      return;
+    }
+  }
+}
+
+/**
+ * @brief The session is over: fail what is still in flight.
+ */
+void A9GMqttClient::_lost() {
+  _connected = false;
+  _pingPending = false;
+  for (uint8_t i = 0; i < A9G_MQTT_INFLIGHT; i++) _ackPublish(_inFlight[i].id, false);
+}
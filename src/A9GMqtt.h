@@ -0,0 +1,209 @@
+#ifndef A9GMQTT_H
+#define A9GMQTT_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GMqtt.h
+ *
+ * @brief MQTT 3.1.1 client running over the A9G TCP socket instead of the
+ *        firmware's AT+MQTT* commands:
+ *        - binary payloads (AT+MQTTPUB only carries text)
+ *        - CONNECT, PUBLISH QoS 0/1 with PUBACK tracking, SUBSCRIBE,
+ *          UNSUBSCRIBE, PINGREQ keepalive, DISCONNECT
+ *        - every packet leaves in a single AT+CIPSEND
+ *        A9Gmod uses it as its transport after useNativeMQTT().
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GMqttClient CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_MQTT_PACKET_MAX
+#if defined(__AVR__)
+#define A9G_MQTT_PACKET_MAX 128      ///< Largest packet sent or received; bigger inbound packets are skipped
+#else
+#define A9G_MQTT_PACKET_MAX 1024
+#endif
+#endif
+
+#ifndef A9G_MQTT_INFLIGHT
+#if defined(__AVR__)
+#define A9G_MQTT_INFLIGHT 2          ///< QoS 1 publishes waiting for their PUBACK
+#else
+#define A9G_MQTT_INFLIGHT 8
+#endif
+#endif
+
+#ifndef A9G_MQTT_REPLY_TIMEOUT
+#define A9G_MQTT_REPLY_TIMEOUT 10000 ///< ms to wait for CONNACK / SUBACK / UNSUBACK
+#endif
+
+#ifndef A9G_MQTT_ACK_TIMEOUT
+#define A9G_MQTT_ACK_TIMEOUT 20000   ///< ms after which a missing PUBACK counts as a failed publish
+#endif
+
+/**
+ * @class A9GMqttClient
+ * @brief Minimal MQTT 3.1.1 client on top of A9G::tcpConnect() / tcpSend().
+ *
+ * Usage:
+ *   A9GMqttClient mqtt(a9g);
+ *   mqtt.onMessage(onData, nullptr);
+ *   mqtt.connect("broker.example.com", 1883, "tracker-1");
+ *   mqtt.publish("t/raw", frame, sizeof(frame), 1);
+ *   ...
+ *   mqtt.loop();                // in loop(): inbound packets, PUBACKs, keepalive
+ *
+ * QoS 2 publishes are sent as QoS 1 and subscriptions are limited to QoS 1,
+ * so the broker never starts a QoS 2 exchange.
+ */
+class A9GMqttClient {
+public:
+  explicit A9GMqttClient(A9G &modem);
+
+  /**
+     * @brief Open the socket, send CONNECT and wait for CONNACK.
+     * @return true if the broker accepted (connackCode() == 0)
+     */
+  bool connect(const char *host, uint16_t port, const char *clientId,
+               const char *user = nullptr, const char *pass = nullptr,
+               uint16_t keepAlive = 60, bool cleanSession = true);
+
+  /**
+     * @brief Send PUBLISH. QoS 1 takes an in-flight slot until its PUBACK.
+     * @return false if not connected, the packet does not fit
+     *         A9G_MQTT_PACKET_MAX, all in-flight slots are taken (see
+     *         canPublish()) or the send failed
+     */
+  bool publish(const char *topic, const uint8_t *payload, size_t len,
+               uint8_t qos = 0, bool retain = false);
+
+  /**
+     * @brief Whether a publish of @p qos has an in-flight slot. False is
+     *        backpressure: the slots free up as PUBACKs arrive or expire.
+     */
+  bool canPublish(uint8_t qos) const;
+
+  /**
+     * @brief Subscribe and wait for the SUBACK.
+     * @param qos 0 or 1
+     */
+  bool subscribe(const char *topic, uint8_t qos = 0);
+
+  /**
+     * @brief Send SUBSCRIBE without waiting for the SUBACK, which loop()
+     *        then ignores (a refusal goes unnoticed).
+     */
+  bool subscribeNonBlocking(const char *topic, uint8_t qos = 0);
+  bool unsubscribe(const char *topic);
+
+  /**
+     * @brief Send DISCONNECT and close the socket.
+     */
+  void disconnect();
+
+  /**
+     * @brief Pump the modem, handle inbound packets, keepalive and PUBACK expiry.
+     *        Received bytes lost to a full A9G_TCP_RX_SIZE buffer end the session.
+     */
+  void loop();
+
+  bool connected() const { return _connected; }
+
+  /**
+     * @brief Return code of the last CONNACK (0 = accepted, 0xFF = none received).
+     */
+  uint8_t connackCode() const { return _connack; }
+
+  /**
+     * @brief QoS 1 publishes still waiting for their PUBACK.
+     */
+  uint8_t inFlight() const;
+
+  /**
+     * @brief Publishes whose PUBACK did not come within A9G_MQTT_ACK_TIMEOUT.
+     */
+  uint32_t ackTimeouts() const { return _ackTimeouts; }
+
+  /**
+     * @brief Inbound packets skipped because they exceed A9G_MQTT_PACKET_MAX.
+     */
+  uint32_t oversized() const { return _oversized; }
+
+  /**
+     * @brief Receive inbound PUBLISH messages. The payload is also terminated,
+     *        so text payloads can be used as strings.
+     */
+  void onMessage(A9G_MQTTBinaryCallback cb, void *ctx = nullptr);
+
+  /**
+     * @brief Called with (ok = PUBACK received) for every QoS 1 publish.
+     */
+  void onPublishResult(void (*cb)(void *ctx, bool ok), void *ctx = nullptr);
+
+private:
+  enum {
+    CONNECT = 1, CONNACK, PUBLISH, PUBACK, PUBREC, PUBREL, PUBCOMP,
+    SUBSCRIBE, SUBACK, UNSUBSCRIBE, UNSUBACK, PINGREQ, PINGRESP, DISCONNECT
+  };
+
+  A9G *_modem;
+  bool _connected;
+  uint8_t _connack;
+  uint16_t _keepAlive;           ///< Seconds, 0 = no keepalive
+  uint16_t _nextId;
+  unsigned long _lastTx;         ///< millis() of the last packet sent
+  bool _pingPending;
+  unsigned long _pingSent;
+
+  struct InFlight {
+    uint16_t id;                 ///< 0 = free slot
+    unsigned long sent;
+  };
+  InFlight _inFlight[A9G_MQTT_INFLIGHT];
+  uint32_t _ackTimeouts;
+
+  // Packet being sent: the body is built from offset 5, the fixed header
+  // goes right in front of it
+  uint8_t _tx[A9G_MQTT_PACKET_MAX];
+  size_t _txLen;
+
+  // Packet being received
+  uint8_t _rx[A9G_MQTT_PACKET_MAX + 1];
+  uint8_t _rxHeader;
+  uint8_t _rxStage;              ///< 0 = header, 1 = remaining length, 2 = body
+  uint32_t _rxRemaining;
+  uint8_t _rxShift;
+  size_t _rxLen;
+  bool _rxSkip;                  ///< Body too large, dropped byte by byte
+  bool _rxBusy;                  ///< Inside a message callback
+  uint32_t _oversized;
+  uint32_t _tcpLost;             ///< A9G::tcpDropped() when the session started
+
+  // Reply a blocking call waits for
+  uint8_t _waitType;
+  uint16_t _waitId;
+  bool _waitDone;
+  bool _waitOk;
+
+  A9G_MQTTBinaryCallback _msgCb;
+  void *_msgCtx;
+  void (*_pubCb)(void *ctx, bool ok);
+  void *_pubCtx;
+
+  void _begin();
+  bool _putShort(uint16_t v);
+  bool _putString(const char *str);
+  bool _putBytes(const uint8_t *data, size_t len);
+  bool _send(uint8_t header);
+  bool _sendSubscribe(const char *topic, uint8_t qos, uint16_t id);
+  bool _waitReply(uint8_t type, uint16_t id);
+  uint16_t _packetId();
+  void _readPackets();
+  void _handlePacket();
+  void _ackPublish(uint16_t id, bool ok);
+  void _lost();
+};
+
+#endif  // A9GMQTT_H
@@ -0,0 +1,109 @@
+#include "A9GNmea.h"
+
+/* ------------------------------------------------------------------
+ *                   NMEA DECODING
+ * ------------------------------------------------------------------ */
+
+static int8_t hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+/**
+ * @brief Decimal field as a fixed-point integer with @p decimals digits
+ *        after the point ("12.3", 2 -> 1230). Extra digits are cut.
+ */
+static int32_t fixedField(const char *p, uint8_t decimals) {
+  bool neg = *p == '-';
+  if (neg) p++;
+  int32_t v = 0;
+  while (*p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+  if (*p == '.') p++;
+  for (uint8_t i = 0; i < decimals; i++) {
+    v *= 10;
+    if (*p >= '0' && *p <= '9') v += *p++ - '0';
+  }
+  return neg ? -v : v;
+}
+
+/**
+ * @brief "ddmm.mmmmm" / "dddmm.mmmmm" with its hemisphere to 1e-7 degrees.
+ */
+static bool coordField(const char *p, char hemi, int32_t *out) {
+  if (*p < '0' || *p > '9') return false;
+  int32_t minutesE5 = fixedField(p, 5);      // ddmm.mmmmm * 1e5
+  int32_t deg = minutesE5 / 10000000L;
+  minutesE5 -= deg * 10000000L;              // mm.mmmmm * 1e5
+  if (minutesE5 >= 6000000L) return false;
+  // minutes / 60 * 1e7 = minutesE5 * 100 / 60
+  int32_t v = deg * 10000000L + minutesE5 * 5 / 3;
+  *out = hemi == 'S' || hemi == 'W' ? -v : v;
+  return hemi == 'N' || hemi == 'S' || hemi == 'E' || hemi == 'W';
+}
+
+A9G_NmeaSentence A9G_nmeaParse(const char *sentence, A9G_GPSFix *fix) {
+  const char *s = sentence;
+  if (*s == '$') s++;
+
+  // Checksum: XOR of everything between '$' and '*'
+  uint8_t sum = 0;
+  const char *p = s;
+  while (*p && *p != '*' && *p != '\r' && *p != '\n') sum ^= (uint8_t)*p++;
+  if (*p == '*') {
+    int8_t hi = hexValue(p[1]);
+    int8_t lo = hexValue(p[2]);
+    if (hi < 0 || lo < 0 || ((hi << 4) | lo) != sum) return NMEA_NONE;
+  }
+
+  // Split into fields (at most 15 are used)
+  const char *field[15];
+  uint8_t n = 0;
+  field[n++] = s;
+  for (p = s; *p && *p != '*' && *p != '\r' && *p != '\n' && n < 15; p++) {
+    if (*p == ',') field[n++] = p + 1;
+  }
+  if (p - s < 6 || s[5] != ',') return NMEA_NONE;
+  const char *type = s + 2;  // after the talker id
+
+  // Empty fields start with ',' (or the end), so each parse sees a stop character
+  if (!strncmp_P(type, PSTR("RMC"), 3) && n >= 10) {
+    A9G_GPSFix f = *fix;
+    f.valid = *field[2] == 'A';
+    f.time = fixedField(field[1], 0);
+    if (f.valid) {
+      if (!coordField(field[3], *field[4], &f.latE7) ||
+          !coordField(field[5], *field[6], &f.lonE7)) return NMEA_NONE;
+      // knots -> cm/s: 1 kn = 51.444 cm/s
+      f.speedCms = (uint16_t)((fixedField(field[7], 2) * 5144L + 50) / 10000L);
+      f.course = fixedField(field[8], 2);
+    }
+    f.date = fixedField(field[9], 0);
+    f.stamp = millis();
+    *fix = f;
+    return NMEA_RMC;
+  }
+  if (!strncmp_P(type, PSTR("GGA"), 3) && n >= 10) {
+    if (*field[6] == '0' || *field[6] == ',') return NMEA_GGA;  // no fix, nothing to take
+    fix->sats = fixedField(field[7], 0);
+    fix->hdop = fixedField(field[8], 2);
+    fix->altCm = fixedField(field[9], 2);
+    return NMEA_GGA;
+  }
+  return NMEA_OTHER;
+}
+
+/* ------------------------------------------------------------------
+ *                   DISTANCES
+ * ------------------------------------------------------------------ */
+
+float A9G_geoScaleX(int32_t latE7) {
+  return A9G_GEO_SCALE_Y * cos(latE7 * (float)(M_PI / 180e7));
+}
+
+float A9G_geoDistance(int32_t lat1E7, int32_t lon1E7, int32_t lat2E7, int32_t lon2E7) {
+  float dx = (float)((int64_t)lon2E7 - lon1E7) * A9G_geoScaleX(lat1E7 / 2 + lat2E7 / 2);
+  float dy = (float)((int64_t)lat2E7 - lat1E7) * A9G_GEO_SCALE_Y;
+  return sqrt(dx * dx + dy * dy);
+}
@@ -0,0 +1,77 @@
+#ifndef A9GNMEA_H
+#define A9GNMEA_H
+
+#include <Arduino.h>
+
+/*!
+ * @file A9GNmea.h
+ *
+ * @brief NMEA 0183 decoding of the GPS output (AT+GPSRD):
+ *        - RMC and GGA sentences of any talker (GP, GN, BD, ...) with
+ *          checksum verification
+ *        - positions in integer 1e-7 degrees, no floating point parsing
+ *        - a flat-earth distance helper for the short ranges of geofences
+ *          and track filters
+ *
+ * Nothing here touches the modem, so it runs on the host too.
+ */
+
+#define A9G_NMEA_MAX 83              ///< Longest sentence (82 characters) plus terminator
+
+/**
+ * @brief Sentence kinds A9G_nmeaParse() understands
+ */
+typedef enum A9G_NmeaSentence {
+  NMEA_NONE = 0,       ///< Malformed or bad checksum (fix untouched)
+  NMEA_OTHER,          ///< Well-formed, but not a sentence decoded here (GSA, GSV, ...)
+  NMEA_GGA,            ///< Altitude, satellites, HDOP
+  NMEA_RMC             ///< Position, speed, course, date: completes a fix
+} A9G_NmeaSentence;
+
+/**
+ * @brief One GPS fix, assembled from the sentences of one report
+ */
+typedef struct A9G_GPSFix {
+  int32_t latE7;       ///< Latitude, 1e-7 degrees (north positive)
+  int32_t lonE7;       ///< Longitude, 1e-7 degrees (east positive)
+  int32_t altCm;       ///< Altitude above mean sea level (GGA)
+  uint16_t speedCms;   ///< Ground speed, cm/s
+  uint16_t course;     ///< Course over ground, 0.01 degrees
+  uint16_t hdop;       ///< Horizontal dilution of precision x 100 (GGA)
+  uint8_t sats;        ///< Satellites used (GGA)
+  bool valid;          ///< RMC status 'A'
+  uint32_t time;       ///< UTC time as hhmmss
+  uint32_t date;       ///< UTC date as ddmmyy
+  unsigned long stamp; ///< millis() when the RMC arrived
+} A9G_GPSFix;
+
+/**
+ * @brief A position, e.g. a polygon vertex
+ */
+typedef struct A9G_GeoPoint {
+  int32_t latE7;
+  int32_t lonE7;
+} A9G_GeoPoint;
+
+/**
+ * @brief Decode one sentence into @p fix.
+ * @param sentence With or without the leading '$', up to CR/LF or terminator;
+ *                 the "*hh" checksum is verified when present
+ * @return Which sentence it was; only GGA and RMC change @p fix
+ */
+A9G_NmeaSentence A9G_nmeaParse(const char *sentence, A9G_GPSFix *fix);
+
+/**
+ * @brief Meters east per 1e-7 degree of longitude at latitude @p latE7
+ *        (north: A9G_GEO_SCALE_Y).
+ *        Good to about 0.5 % within a few tens of kilometers.
+ */
+float A9G_geoScaleX(int32_t latE7);
+#define A9G_GEO_SCALE_Y 0.0111319f   ///< Meters per 1e-7 degree of latitude
+
+/**
+ * @brief Distance in meters between two positions (equirectangular).
+ */
+float A9G_geoDistance(int32_t lat1E7, int32_t lon1E7, int32_t lat2E7, int32_t lon2E7);
+
+#endif  // A9GNMEA_H
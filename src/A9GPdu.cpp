@@ -0,0 +1,535 @@
+#include "A9GPdu.h"
+
+/* ------------------------------------------------------------------
+ *                   GSM 03.38 ALPHABET TABLES
+ * ------------------------------------------------------------------ */
+
+/**
+ * @brief Default alphabet, septet -> Unicode code point.
+ *        0x1B is the escape to the extension table (0xFFFF never matches).
+ */
+static const uint16_t GSM7_BASIC[128] PROGMEM = {
+  0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC,
+  0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
+  0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8,
+  0x03A3, 0x0398, 0x039E, 0xFFFF, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
+  0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
+  0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+  0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+  0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+  0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+  0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+  0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+  0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+  0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+  0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+  0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+  0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0
+};
+
+/**
+ * @brief Extension table, reached through 0x1B.
+ */
+static const uint8_t GSM7_EXT_CODE[] PROGMEM = {
+  0x0A, 0x14, 0x28, 0x29, 0x2F, 0x3C, 0x3D, 0x3E, 0x40, 0x65
+};
+static const uint16_t GSM7_EXT_CP[] PROGMEM = {
+  0x000C, 0x005E, 0x007B, 0x007D, 0x005C, 0x005B, 0x007E, 0x005D, 0x007C, 0x20AC
+};
+#define GSM7_EXT_COUNT (sizeof(GSM7_EXT_CODE) / sizeof(GSM7_EXT_CODE[0]))
+
+/* ------------------------------------------------------------------
+ *   UTF-8 / ALPHABET HELPERS
+ * ------------------------------------------------------------------ */
+
+/**
+ * @brief Decode one UTF-8 character and advance; malformed input yields '?'.
+ */
+static uint32_t utf8Next(const char **s) {
+  const uint8_t *p = (const uint8_t *)*s;
+  uint32_t cp;
+  uint8_t extra;
+  if (p[0] < 0x80) {
+    cp = p[0];
+    extra = 0;
+  } else if ((p[0] & 0xE0) == 0xC0) {
+    cp = p[0] & 0x1F;
+    extra = 1;
+  } else if ((p[0] & 0xF0) == 0xE0) {
+    cp = p[0] & 0x0F;
+    extra = 2;
+  } else if ((p[0] & 0xF8) == 0xF0) {
+    cp = p[0] & 0x07;
+    extra = 3;
+  } else {
+    *s += 1;
+    return '?';
+  }
+  for (uint8_t i = 1; i <= extra; i++) {
+    if ((p[i] & 0xC0) != 0x80) {
+      *s += i;
+      return '?';
+    }
+    cp = (cp << 6) | (p[i] & 0x3F);
+  }
+  *s += 1 + extra;
+  return cp;
+}
+
+/**
+ * @brief Append a code point as UTF-8 if it fits completely.
+ * @return false if there is no room (the text is then cut here)
+ */
+static bool utf8Put(uint32_t cp, char *out, size_t cap, size_t *len) {
+  char tmp[4];
+  uint8_t n;
+  if (cp < 0x80) {
+    tmp[0] = cp;
+    n = 1;
+  } else if (cp < 0x800) {
+    tmp[0] = 0xC0 | (cp >> 6);
+    tmp[1] = 0x80 | (cp & 0x3F);
+    n = 2;
+  } else if (cp < 0x10000) {
+    tmp[0] = 0xE0 | (cp >> 12);
+    tmp[1] = 0x80 | ((cp >> 6) & 0x3F);
+    tmp[2] = 0x80 | (cp & 0x3F);
+    n = 3;
+  } else {
+    tmp[0] = 0xF0 | (cp >> 18);
+    tmp[1] = 0x80 | ((cp >> 12) & 0x3F);
+    tmp[2] = 0x80 | ((cp >> 6) & 0x3F);
+    tmp[3] = 0x80 | (cp & 0x3F);
+    n = 4;
+  }
+  if (*len + n >= cap) return false;
+  memcpy(out + *len, tmp, n);
+  *len += n;
+  out[*len] = '\0';
+  return true;
+}
+
+/**
+ * @brief GSM-7 septets for a code point.
+ * @return 1 or 2 (escape + extension), 0 if not representable
+ */
+static uint8_t gsm7Encode(uint32_t cp, uint8_t *code) {
+  if ((cp >= 'A' && cp <= 'Z') || (cp >= 'a' && cp <= 'z') || (cp >= '0' && cp <= '9')) {
+    code[0] = cp;
+    return 1;
+  }
+  if (cp >= 0xFFFF) return 0;
+  for (uint8_t i = 0; i < 128; i++) {
+    if (pgm_read_word(&GSM7_BASIC[i]) == cp) {
+      code[0] = i;
+      return 1;
+    }
+  }
+  for (uint8_t i = 0; i < GSM7_EXT_COUNT; i++) {
+    if (pgm_read_word(&GSM7_EXT_CP[i]) == cp) {
+      code[0] = 0x1B;
+      code[1] = pgm_read_byte(&GSM7_EXT_CODE[i]);
+      return 2;
+    }
+  }
+  return 0;
+}
+
+static uint32_t gsm7Decode(uint8_t septet, bool escaped) {
+  if (escaped) {
+    for (uint8_t i = 0; i < GSM7_EXT_COUNT; i++) {
+      if (pgm_read_byte(&GSM7_EXT_CODE[i]) == septet) {
+        return pgm_read_word(&GSM7_EXT_CP[i]);
+      }
+    }
+  }
+  uint16_t cp = pgm_read_word(&GSM7_BASIC[septet & 0x7F]);
+  return cp == 0xFFFF ? ' ' : cp;
+}
+
+/**
+ * @brief Septets (GSM-7) or 16-bit units (UCS2) a code point costs.
+ */
+static uint8_t unitCost(uint32_t cp, A9G_SMSEncoding enc) {
+  if (enc == SMS_ENC_GSM7) {
+    uint8_t code[2];
+    return gsm7Encode(cp, code);
+  }
+  return cp > 0xFFFF ? 2 : 1;
+}
+
+/**
+ * @brief Locate the bytes of one part. Characters are never split across parts.
+ * @return false if the text has fewer parts
+ */
+static bool partRange(const char *text, A9G_SMSEncoding enc, uint8_t part, uint8_t parts,
+                      const char **start, const char **end) {
+  size_t limit;
+  if (enc == SMS_ENC_GSM7) {
+    limit = parts > 1 ? A9G_SMS_GSM7_PART : A9G_SMS_GSM7_SINGLE;
+  } else {
+    limit = parts > 1 ? A9G_SMS_UCS2_PART : A9G_SMS_UCS2_SINGLE;
+  }
+  const char *p = text;
+  uint16_t current = 1;
+  size_t used = 0;
+  *start = text;
+  while (*p) {
+    const char *next = p;
+    uint8_t cost = unitCost(utf8Next(&next), enc);
+    if (used + cost > limit) {
+      if (current == part) break;
+      current++;
+      used = 0;
+      if (current == part) *start = p;
+    }
+    used += cost;
+    p = next;
+  }
+  *end = p;
+  return current == part;
+}
+
+/* ------------------------------------------------------------------
+ *   PUBLIC CODEC
+ * ------------------------------------------------------------------ */
+
+A9G_SMSEncoding A9G_pduEncodingFor(const char *utf8) {
+  uint8_t code[2];
+  for (const char *p = utf8; p && *p;) {
+    if (!gsm7Encode(utf8Next(&p), code)) return SMS_ENC_UCS2;
+  }
+  return SMS_ENC_GSM7;
+}
+
+uint8_t A9G_pduPartCount(const char *utf8) {
+  A9G_SMSEncoding enc = A9G_pduEncodingFor(utf8);
+  size_t total = 0;
+  for (const char *p = utf8; *p;) {
+    total += unitCost(utf8Next(&p), enc);
+  }
+  if (total <= (enc == SMS_ENC_GSM7 ? A9G_SMS_GSM7_SINGLE : A9G_SMS_UCS2_SINGLE)) {
+    return 1;
+  }
+  // Walk with the per-part limit; boundaries never split a character
+  uint16_t parts = 2;
+  const char *start;
+  const char *end;
+  while (partRange(utf8, enc, parts, parts, &start, &end) && *end) {
+    if (++parts > 255) return 0;
+  }
+  return parts;
+}
+
+size_t A9G_pduEncodeSubmit(const char *number, const char *utf8,
+                           uint8_t part, uint8_t parts, uint8_t ref,
+                           uint8_t *out, size_t outCap) {
+  if (!number || !utf8 || !out || part < 1 || part > parts) return 0;
+
+  A9G_SMSEncoding enc = A9G_pduEncodingFor(utf8);
+  const char *start;
+  const char *end;
+  if (!partRange(utf8, enc, part, parts, &start, &end)) return 0;
+
+  size_t n = 0;
+#define PDU_PUT(b) \
+  do { \
+    if (n >= outCap) return 0; \
+    out[n++] = (uint8_t)(b); \
+  } while (0)
+
+  PDU_PUT(0x00);                         // SCA length 0: SMSC stored on the SIM
+  PDU_PUT(0x01 | (parts > 1 ? 0x40 : 0));  // SMS-SUBMIT, no VP, UDHI if concatenated
+  PDU_PUT(0x00);                         // TP-MR, assigned by the modem
+
+  // Destination address as swapped semi-octets
+  const char *digits = number;
+  uint8_t type = 0x81;
+  if (*digits == '+') {
+    type = 0x91;
+    digits++;
+  }
+  uint8_t nibbles[20];
+  uint8_t count = 0;
+  for (const char *d = digits; *d && count < sizeof(nibbles); d++) {
+    if (*d >= '0' && *d <= '9') nibbles[count++] = *d - '0';
+    else if (*d == '*') nibbles[count++] = 0x0A;
+    else if (*d == '#') nibbles[count++] = 0x0B;
+  }
+  PDU_PUT(count);
+  PDU_PUT(type);
+  for (uint8_t i = 0; i < count; i += 2) {
+    uint8_t hi = (i + 1 < count) ? nibbles[i + 1] : 0x0F;
+    PDU_PUT(nibbles[i] | (hi << 4));
+  }
+
+  PDU_PUT(0x00);                         // TP-PID
+  PDU_PUT(enc == SMS_ENC_GSM7 ? 0x00 : 0x08);  // TP-DCS
+  size_t udlPos = n;
+  PDU_PUT(0x00);                         // TP-UDL, patched below
+
+  uint8_t udh[6] = { 0x05, 0x00, 0x03, ref, parts, part };
+  size_t udhLen = parts > 1 ? sizeof(udh) : 0;
+  size_t udMax = outCap - n < 140 ? outCap - n : 140;
+  if (udhLen > udMax) return 0;
+  memcpy(out + n, udh, udhLen);
+
+  if (enc == SMS_ENC_GSM7) {
+    memset(out + n + udhLen, 0, udMax - udhLen);
+    // Septets start on the first septet boundary after the header
+    size_t bit = ((udhLen * 8 + 6) / 7) * 7;
+    for (const char *p = start; p < end;) {
+      uint8_t code[2];
+      uint8_t septets = gsm7Encode(utf8Next(&p), code);
+      for (uint8_t s = 0; s < septets; s++) {
+        size_t idx = bit / 8;
+        uint8_t shift = bit % 8;
+        if (idx >= udMax || (shift > 1 && idx + 1 >= udMax)) return 0;
+        out[n + idx] |= code[s] << shift;
+        if (shift > 1) out[n + idx + 1] |= code[s] >> (8 - shift);
+        bit += 7;
+      }
+    }
+    out[udlPos] = bit / 7;
+    n += (bit + 7) / 8;
+  } else {
+    size_t ud = udhLen;
+    for (const char *p = start; p < end;) {
+      uint32_t cp = utf8Next(&p);
+      uint16_t units[2];
+      uint8_t count16 = 1;
+      if (cp > 0xFFFF) {
+        cp -= 0x10000;
+        units[0] = 0xD800 | (cp >> 10);
+        units[1] = 0xDC00 | (cp & 0x3FF);
+        count16 = 2;
+      } else {
+        units[0] = cp;
+      }
+      for (uint8_t u = 0; u < count16; u++) {
+        if (ud + 2 > udMax) return 0;
+        out[n + ud++] = units[u] >> 8;
+        out[n + ud++] = units[u] & 0xFF;
+      }
+    }
+    out[udlPos] = ud;
+    n += ud;
+  }
+#undef PDU_PUT
+  return n;
+}
+
+/**
+ * @brief Swapped-nibble BCD octet (as used in TP-SCTS) to its value.
+ */
+static uint8_t swappedBCD(uint8_t b) {
+  return ((b & 0x0F) * 10 + (b >> 4)) % 100;
+}
+
+bool A9G_pduDecodeDeliver(const uint8_t *pdu, size_t len, A9G_SMSPdu *out) {
+  memset(out, 0, sizeof(A9G_SMSPdu));
+  out->partCount = 1;
+  out->partIndex = 1;
+  if (!len) return false;
+
+  size_t i = 1 + pdu[0];  // skip SCA
+  if (i + 2 > len) return false;
+  uint8_t firstOctet = pdu[i++];
+  if ((firstOctet & 0x03) != 0x00) return false;  // not an SMS-DELIVER
+  bool udhi = firstOctet & 0x40;
+
+  // Originating address
+  uint8_t oaLen = pdu[i++];
+  if (i + 1 + (oaLen + 1) / 2 > len) return false;
+  uint8_t oaType = pdu[i++];
+  const uint8_t *oa = pdu + i;
+  size_t sl = 0;
+  if ((oaType & 0x70) == 0x50) {
+    // Alphanumeric sender: GSM-7 packed, oaLen counts semi-octets
+    uint8_t septets = (oaLen * 4) / 7;
+    for (uint8_t s = 0; s < septets; s++) {
+      size_t bit = s * 7;
+      uint16_t pair = oa[bit / 8] | ((bit / 8 + 1 < (size_t)(oaLen + 1) / 2) ? oa[bit / 8 + 1] << 8 : 0);
+      if (!utf8Put(gsm7Decode((pair >> (bit % 8)) & 0x7F, false), out->sender, sizeof(out->sender), &sl)) break;
+    }
+  } else {
+    if ((oaType & 0x70) == 0x10) out->sender[sl++] = '+';
+    for (uint8_t d = 0; d < oaLen && sl < sizeof(out->sender) - 1; d++) {
+      uint8_t nib = (d & 1) ? (oa[d / 2] >> 4) : (oa[d / 2] & 0x0F);
+      if (nib == 0x0F) break;
+      out->sender[sl++] = nib < 10 ? '0' + nib : (nib == 0x0A ? '*' : '#');
+    }
+    out->sender[sl] = '\0';
+  }
+  i += (oaLen + 1) / 2;
+
+  // PID, DCS, SCTS(7), UDL
+  if (i + 10 > len) return false;
+  i++;  // TP-PID
+  uint8_t dcs = pdu[i++];
+  const uint8_t *ts = pdu + i;
+  // "yy/MM/dd,hh:mm:ss+zz", the zone's bit 3 is the sign
+  const uint8_t fields[7] = {
+    swappedBCD(ts[0]), swappedBCD(ts[1]), swappedBCD(ts[2]),
+    swappedBCD(ts[3]), swappedBCD(ts[4]), swappedBCD(ts[5]),
+    swappedBCD(ts[6] & 0xF7)
+  };
+  static const char seps[5] = { '/', '/', ',', ':', ':' };
+  char *t = out->timestamp;
+  for (uint8_t f = 0; f < 7; f++) {
+    *t++ = '0' + fields[f] / 10;
+    *t++ = '0' + fields[f] % 10;
+    if (f < 5) *t++ = seps[f];
+    else if (f == 5) *t++ = (ts[6] & 0x08) ? '-' : '+';
+  }
+  *t = '\0';
+  i += 7;
+  uint8_t udl = pdu[i++];
+
+  uint8_t group = dcs >> 4;
+  if (group <= 0x07) {
+    uint8_t alphabet = (dcs >> 2) & 0x03;
+    out->encoding = alphabet == 2 ? SMS_ENC_UCS2 : (alphabet == 1 ? SMS_ENC_8BIT : SMS_ENC_GSM7);
+  } else if (group == 0x0E) {
+    out->encoding = SMS_ENC_UCS2;
+  } else if (group == 0x0F) {
+    out->encoding = (dcs & 0x04) ? SMS_ENC_8BIT : SMS_ENC_GSM7;
+  } else {
+    out->encoding = SMS_ENC_GSM7;
+  }
+
+  const uint8_t *ud = pdu + i;
+  size_t udBytes = len - i;
+  size_t udhLen = 0;
+  if (udhi && udBytes) {
+    udhLen = ud[0] + 1;
+    if (udhLen > udBytes) return false;
+    for (size_t h = 1; h + 1 < udhLen;) {
+      uint8_t iei = ud[h];
+      uint8_t ieLen = ud[h + 1];
+      const uint8_t *ie = ud + h + 2;
+      if (h + 2 + ieLen > udhLen) break;
+      if (iei == 0x00 && ieLen == 3) {
+        out->concatRef = ie[0];
+        out->partCount = ie[1];
+        out->partIndex = ie[2];
+      } else if (iei == 0x08 && ieLen == 4) {
+        out->concatRef = (ie[0] << 8) | ie[1];
+        out->partCount = ie[2];
+        out->partIndex = ie[3];
+      }
+      h += 2 + ieLen;
+    }
+  }
+
+  size_t tl = 0;
+  if (out->encoding == SMS_ENC_GSM7) {
+    if (((size_t)udl * 7 + 7) / 8 > udBytes) return false;
+    bool escaped = false;
+    for (size_t s = (udhLen * 8 + 6) / 7; s < udl; s++) {
+      size_t bit = s * 7;
+      uint16_t pair = ud[bit / 8] | ((bit / 8 + 1 < udBytes) ? ud[bit / 8 + 1] << 8 : 0);
+      uint8_t septet = (pair >> (bit % 8)) & 0x7F;
+      if (septet == 0x1B && !escaped) {
+        escaped = true;
+        continue;
+      }
+      if (!utf8Put(gsm7Decode(septet, escaped), out->text, sizeof(out->text), &tl)) break;
+      escaped = false;
+    }
+  } else if (out->encoding == SMS_ENC_UCS2) {
+    if (udl > udBytes) return false;
+    for (size_t b = udhLen; b + 1 < udl; b += 2) {
+      uint32_t cp = (ud[b] << 8) | ud[b + 1];
+      if (cp >= 0xD800 && cp <= 0xDBFF && b + 3 < udl) {
+        uint16_t low = (ud[b + 2] << 8) | ud[b + 3];
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        b += 2;
+      }
+      if (!utf8Put(cp, out->text, sizeof(out->text), &tl)) break;
+    }
+  } else {
+    if (udl > udBytes) return false;
+    for (size_t b = udhLen; b < udl && tl < sizeof(out->text) - 1; b++) {
+      out->text[tl++] = ud[b];
+    }
+    out->text[tl] = '\0';
+  }
+  return true;
+}
+
+/* ------------------------------------------------------------------
+ *                   A9G_SMSReassembler IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9G_SMSReassembler::A9G_SMSReassembler() {
+  for (uint8_t s = 0; s < A9G_SMS_CONCAT_SLOTS; s++) {
+    _slots[s].used = false;
+  }
+}
+
+bool A9G_SMSReassembler::add(const A9G_SMSPdu &part, char *text, size_t textCap) {
+  if (part.partCount <= 1 || part.partCount > A9G_SMS_CONCAT_MAX_PARTS ||
+      part.partIndex < 1 || part.partIndex > part.partCount) {
+    // Single message, or one we cannot hold: hand the part over as is
+    strncpy(text, part.text, textCap - 1);
+    text[textCap - 1] = '\0';
+    return true;
+  }
+
+  Slot *slot = nullptr;
+  for (uint8_t s = 0; s < A9G_SMS_CONCAT_SLOTS && !slot; s++) {
+    Slot *c = &_slots[s];
+    if (c->used && c->ref == part.concatRef && c->total == part.partCount &&
+        !strcmp(c->sender, part.sender)) {
+      slot = c;
+    }
+  }
+  if (!slot) {
+    // A free slot, otherwise evict the oldest incomplete message
+    slot = &_slots[0];
+    for (uint8_t s = 0; s < A9G_SMS_CONCAT_SLOTS; s++) {
+      Slot *c = &_slots[s];
+      if (!c->used) {
+        slot = c;
+        break;
+      }
+      if (c->started < slot->started) slot = c;
+    }
+    slot->used = true;
+    strcpy(slot->sender, part.sender);
+    slot->ref = part.concatRef;
+    slot->total = part.partCount;
+    slot->received = 0;
+    slot->started = millis();
+  }
+
+  strcpy(slot->parts[part.partIndex - 1], part.text);
+  slot->received |= 1 << (part.partIndex - 1);
+  if (slot->received != (1 << slot->total) - 1) return false;
+
+  size_t tl = 0;
+  text[0] = '\0';
+  for (uint8_t p = 0; p < slot->total; p++) {
+    size_t pl = strlen(slot->parts[p]);
+    if (tl + pl >= textCap) {
+      pl = textCap - 1 - tl;
+      // Do not cut a UTF-8 sequence in half
+      while (pl && (slot->parts[p][pl] & 0xC0) == 0x80) pl--;
+    }
+    memcpy(text + tl, slot->parts[p], pl);
+    tl += pl;
+  }
+  text[tl] = '\0';
+  slot->used = false;
+  return true;
+}
+
+void A9G_SMSReassembler::expire() {
+  unsigned long now = millis();
+  for (uint8_t s = 0; s < A9G_SMS_CONCAT_SLOTS; s++) {
+    if (_slots[s].used && now - _slots[s].started >= A9G_SMS_CONCAT_TIMEOUT) {
+      _slots[s].used = false;
+    }
+  }
+}
@@ -0,0 +1,145 @@
+#ifndef A9GPDU_H
+#define A9GPDU_H
+
+#include <Arduino.h>
+
+/*!
+ * @file A9GPdu.h
+ *
+ * @brief SMS PDU codec (3GPP TS 23.040 / 23.038) used by the PDU-mode SMS path:
+ *        - GSM 7-bit default alphabet (with extension table) packing
+ *        - UCS2 for text that GSM-7 cannot carry
+ *        - UDH concatenation for long messages and reassembly of inbound parts
+ *
+ * Text in and out is UTF-8. Nothing here touches the modem, so it runs on the host too.
+ */
+
+/* ------------------------------------------------------------------
+ *                      PDU CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_SMS_PDU_MAX
+#define A9G_SMS_PDU_MAX 176          ///< Largest PDU handled (SCA + TPDU) in bytes
+#endif
+
+#ifndef A9G_SMS_PART_TEXT_MAX
+#if defined(__AVR__)
+#define A9G_SMS_PART_TEXT_MAX 81     ///< UTF-8 text of one decoded part (incl. terminator)
+#else
+#define A9G_SMS_PART_TEXT_MAX 161
+#endif
+#endif
+
+#ifndef A9G_SMS_CONCAT_SLOTS
+#if defined(__AVR__)
+#define A9G_SMS_CONCAT_SLOTS 1       ///< Multipart messages reassembled at the same time
+#else
+#define A9G_SMS_CONCAT_SLOTS 2
+#endif
+#endif
+
+#ifndef A9G_SMS_CONCAT_MAX_PARTS
+#if defined(__AVR__)
+#define A9G_SMS_CONCAT_MAX_PARTS 2   ///< Parts per reassembled message (at most 8)
+#else
+#define A9G_SMS_CONCAT_MAX_PARTS 4
+#endif
+#endif
+
+#ifndef A9G_SMS_CONCAT_TIMEOUT
+#define A9G_SMS_CONCAT_TIMEOUT 600000UL  ///< ms before an incomplete message is dropped
+#endif
+
+#define A9G_SMS_GSM7_SINGLE 160      ///< Septets in a single GSM-7 SMS
+#define A9G_SMS_GSM7_PART 153        ///< Septets per part with a concatenation header
+#define A9G_SMS_UCS2_SINGLE 70       ///< UCS2 units in a single SMS
+#define A9G_SMS_UCS2_PART 67         ///< UCS2 units per part with a concatenation header
+
+/**
+ * @brief Data coding of a message (TP-DCS alphabet bits)
+ */
+typedef enum A9G_SMSEncoding {
+  SMS_ENC_GSM7 = 0x00,
+  SMS_ENC_8BIT = 0x04,
+  SMS_ENC_UCS2 = 0x08
+} A9G_SMSEncoding;
+
+/**
+ * @brief One decoded SMS-DELIVER
+ */
+typedef struct A9G_SMSPdu {
+  char sender[21];                     ///< Originating address, '+' for international
+  char timestamp[21];                  ///< "yy/MM/dd,hh:mm:ss+zz" (zz in quarter hours)
+  A9G_SMSEncoding encoding;
+  uint16_t concatRef;                  ///< Concatenation reference (0 if single)
+  uint8_t partCount;                   ///< 1 if not concatenated
+  uint8_t partIndex;                   ///< 1-based part number
+  char text[A9G_SMS_PART_TEXT_MAX];    ///< UTF-8 text (8-bit data is copied raw)
+} A9G_SMSPdu;
+
+/**
+ * @brief Encoding needed for a UTF-8 text (GSM-7 if every character fits).
+ */
+A9G_SMSEncoding A9G_pduEncodingFor(const char *utf8);
+
+/**
+ * @brief Number of SMS needed for a text, 0 if it needs more than 255.
+ */
+uint8_t A9G_pduPartCount(const char *utf8);
+
+/**
+ * @brief Build the SMS-SUBMIT PDU of one part of a text.
+ *        The PDU starts with a zero-length SCA (use the SIM's SMSC), so
+ *        AT+CMGS takes the returned length minus one.
+ * @param part  1-based part number
+ * @param parts Total parts (from A9G_pduPartCount()); >1 adds a concatenation UDH
+ * @param ref   Concatenation reference shared by all parts
+ * @return PDU length in bytes, 0 if it does not fit or the arguments are invalid
+ */
+size_t A9G_pduEncodeSubmit(const char *number, const char *utf8,
+                           uint8_t part, uint8_t parts, uint8_t ref,
+                           uint8_t *out, size_t outCap);
+
+/**
+ * @brief Decode an SMS-DELIVER PDU (including the leading SCA).
+ * @return false if the PDU is malformed or not an SMS-DELIVER
+ */
+bool A9G_pduDecodeDeliver(const uint8_t *pdu, size_t len, A9G_SMSPdu *out);
+
+/**
+ * @class A9G_SMSReassembler
+ * @brief Collects the parts of concatenated messages until they are complete.
+ *        Single-part messages pass straight through.
+ */
+class A9G_SMSReassembler {
+public:
+  A9G_SMSReassembler();
+
+  /**
+     * @brief Add a decoded part.
+     * @param text    Receives the full UTF-8 text once all parts arrived
+     * @return true when @p text holds a complete message
+     */
+  bool add(const A9G_SMSPdu &part, char *text, size_t textCap);
+
+  /**
+     * @brief Drop incomplete messages older than A9G_SMS_CONCAT_TIMEOUT.
+     */
+  void expire();
+
+private:
+  struct Slot {
+    bool used;
+    char sender[21];
+    uint16_t ref;
+    uint8_t total;
+    uint8_t received;                  ///< Bitmask of parts seen
+    unsigned long started;
+    char parts[A9G_SMS_CONCAT_MAX_PARTS][A9G_SMS_PART_TEXT_MAX];
+  };
+  static_assert(A9G_SMS_CONCAT_MAX_PARTS >= 1 && A9G_SMS_CONCAT_MAX_PARTS <= 8,
+                "A9G_SMS_CONCAT_MAX_PARTS must fit the 8-bit mask of parts seen");
+  Slot _slots[A9G_SMS_CONCAT_SLOTS];
+};
+
+#endif  // A9GPDU_H
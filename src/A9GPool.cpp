@@ -0,0 +1,293 @@
+#include "A9GPool.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GPool IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9GPool::A9GPool()
+  : _count(0),
+    _primary(-1),
+    _topicCount(0),
+    _user(nullptr),
+    _pass(nullptr),
+    _checkInterval(30000),
+    _onMessage(nullptr) {
+  _clientID[0] = '\0';
+}
+
+bool A9GPool::addModem(A9Gmod &client) {
+  if (_count >= A9G_POOL_MAX_MODEMS) return false;
+  Member *m = &_members[_count];
+  m->pool = this;
+  m->client = &client;
+  m->index = _count;
+  m->healthy = false;
+  m->connecting = false;
+  m->stale = false;
+  m->disconnecting = false;
+  m->rejoin = false;
+  m->subscribed = 0;
+  m->lastCheck = 0;
+  client.onMQTTMessage(_onClientMessage, m);
+  _count++;
+  return true;
+}
+
+bool A9GPool::setMQTTServer(const char *host, uint16_t port) {
+  bool ok = true;
+  for (uint8_t i = 0; i < _count; i++) {
+    ok = _members[i].client->setMQTTServer(host, port) && ok;
+  }
+  return ok;
+}
+
+uint8_t A9GPool::connectAll(const char *clientID, const char *user, const char *pass) {
+  strncpy(_clientID, clientID, sizeof(_clientID) - 1);
+  _clientID[sizeof(_clientID) - 1] = '\0';
+  _user = user;
+  _pass = pass;
+
+  uint8_t connected = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    Member *m = &_members[i];
+    m->healthy = _connect(m);
+    m->client->holdQueue(!m->healthy);
+    m->lastCheck = millis();
+    if (m->healthy) connected++;
+  }
+  _electPrimary();
+  return connected;
+}
+
+bool A9GPool::publish(const char *topic, const char *payload) {
+  int target = selectModem();
+  if (target < 0) return false;
+  return _members[target].client->queueMQTT(topic, payload);
+}
+
+bool A9GPool::subscribe(const char *topic) {
+  uint8_t t = 0;
+  while (t < _topicCount && strcmp(_topics[t], topic)) t++;
+  if (t == _topicCount) {
+    if (_topicCount >= A9G_POOL_MAX_TOPICS || strlen(topic) >= A9G_MQTT_TOPIC_MAX) {
+      return false;
+    }
+    strcpy(_topics[_topicCount++], topic);
+  }
+  if (_primary < 0) return false;
+  Member *p = &_members[_primary];
+  if (!p->client->subscribeMQTT(topic)) return false;
+  p->subscribed |= (uint8_t)(1 << t);
+  return true;
+}
+
+void A9GPool::onMessage(A9G_PoolMessageCallback callback) {
+  _onMessage = callback;
+}
+
+void A9GPool::loop() {
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < _count; i++) {
+    Member *m = &_members[i];
+    m->client->processMQTT();
+
+    if (m->connecting && !m->client->connectingMQTT()) {
+      m->connecting = false;
+      m->healthy = m->client->isMQTTConnected();
+      m->client->holdQueue(!m->healthy);
+    }
+
+    // Repeated publish failures take a module out without waiting for the
+    // probe; so does a reported loss of registration (answer or +CREG URC)
+    A9G_RegStatus reg = m->client->modem().registrationStatus();
+    if (m->healthy && (m->client->publishFailures() >= A9G_POOL_MAX_FAILURES ||
+                       (reg != REG_HOME && reg != REG_ROAMING && reg != REG_UNKNOWN))) {
+      _markDown(m);
+      m->lastCheck = now;
+    }
+    if (now - m->lastCheck >= _checkInterval) {
+      m->lastCheck = now;
+      _checkHealth(m);
+    }
+    if (m->rejoin && !m->healthy && !m->connecting) {
+      _reconnect(m);
+    }
+    if (!m->healthy && m->client->pendingMQTT()) {
+      _drainFrom(m);
+    }
+  }
+  if (_primary < 0 || !_members[_primary].healthy) {
+    _electPrimary();
+  }
+  _subscribeNext();
+}
+
+bool A9GPool::isHealthy(uint8_t modem) const {
+  return modem < _count && _members[modem].healthy;
+}
+
+int A9GPool::selectModem() const {
+  int best = -1;
+  int bestScore = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    const Member *m = &_members[i];
+    if (!m->healthy || m->client->pendingMQTT() >= A9G_MQTT_QUEUE_LEN) continue;
+    int csq = m->client->modem().signalQuality();
+    if (csq > 31) csq = 0;  // 99 = unknown, rank it as the weakest link
+    int score = m->client->pendingMQTT() * A9G_POOL_DEPTH_WEIGHT + (31 - csq);
+    if (best < 0 || score < bestScore) {
+      best = i;
+      bestScore = score;
+    }
+  }
+  return best;
+}
+
+uint8_t A9GPool::pending() const {
+  uint8_t total = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    total += _members[i].client->pendingMQTT();
+  }
+  return total;
+}
+
+/* ------------------------------------------------------------------
+ *   INTERNAL HELPERS
+ * ------------------------------------------------------------------ */
+
+/**
+ * @brief Merge inbound messages into the pool callback. Only the primary
+ *        carries the subscriptions; anything else is a leftover of an old
+ *        session and would be a duplicate.
+ */
+void A9GPool::_onClientMessage(void *ctx, const char *topic, const char *payload) {
+  Member *m = static_cast<Member *>(ctx);
+  if (m->index != m->pool->_primary) return;
+  if (m->pool->_onMessage) {
+    m->pool->_onMessage(m->index, topic, payload);
+  }
+}
+
+/**
+ * @brief "<clientID>-<index>": every module needs its own client ID.
+ */
+void A9GPool::_memberID(const Member *m, char *id, size_t cap) const {
+  A9G_TextBuilder out(id, cap);
+  out.add(_clientID).add('-').add((unsigned int)m->index);
+}
+
+bool A9GPool::_connect(Member *m) {
+  char id[sizeof(_clientID) + 4];
+  _memberID(m, id, sizeof(id));
+  if (_user) {
+    return m->client->connectMQTT(id, _user, _pass ? _pass : "");
+  }
+  return m->client->connectMQTT(id);
+}
+
+/**
+ * @brief Have loop() reconnect a down module whose last reported
+ *        registration is good, then queue the next AT+CREG? / AT+CSQ.
+ *        Nothing waits; the answers are judged by loop() as they arrive.
+ */
+void A9GPool::_checkHealth(Member *m) {
+  A9G &modem = m->client->modem();
+  A9G_RegStatus reg = modem.registrationStatus();
+  m->rejoin = !m->healthy && !m->connecting && (reg == REG_HOME || reg == REG_ROAMING);
+  modem.requestRegistration();
+  modem.requestSignalQuality();
+}
+
+/**
+ * @brief Start an asynchronous connect; loop() calls again while the modem
+ *        is busy. A former primary is disconnected first, in case its old
+ *        session survived the outage: the connect goes out once the
+ *        AT+MQTTDISCONN has its result.
+ */
+void A9GPool::_reconnect(Member *m) {
+  if (m->stale) {
+    if (!m->disconnecting) {
+      m->disconnecting = m->client->modem().submitCommand("AT+MQTTDISCONN", PRIO_HIGH, 0,
+                                                          _onDisconnected, m);
+    }
+    return;
+  }
+  char id[sizeof(_clientID) + 4];
+  _memberID(m, id, sizeof(id));
+  m->connecting = m->client->connectMQTTNonBlocking(id, _user, _pass);
+  if (m->connecting) {
+    m->rejoin = false;
+    m->subscribed = 0;  // clean session
+  }
+}
+
+/**
+ * @brief The old session is gone (or was never there, ERROR): the member
+ *        may connect.
+ */
+void A9GPool::_onDisconnected(bool, int, void *ctx) {
+  Member *m = static_cast<Member *>(ctx);
+  m->stale = false;
+  m->disconnecting = false;
+}
+
+/**
+ * @brief Take a module out. Its queue is held so that a failed head publish
+ *        is not retried over and over: the drain moves it elsewhere instead.
+ */
+void A9GPool::_markDown(Member *m) {
+  m->healthy = false;
+  m->client->holdQueue(true);
+  if (_primary == m->index) {
+    _electPrimary();
+  }
+}
+
+/**
+ * @brief Move queued messages of a failed module to healthy ones.
+ */
+void A9GPool::_drainFrom(Member *from) {
+  A9G_MQTTMessage msg;
+  while (from->client->pendingMQTT()) {
+    int target = selectModem();
+    if (target < 0) return;  // Nowhere to go, keep them until something recovers
+    // false: the head publish is still in flight, the next loop() tries again
+    if (!from->client->takeQueuedMQTT(&msg)) break;
+    _members[target].client->queueMQTT(msg.topic, msg.payload, (A9G_Priority)msg.priority,
+                                       msg.qos, msg.retain);
+  }
+}
+
+/**
+ * @brief Pick the first healthy module as primary; _subscribeNext() moves the
+ *        subscriptions to it.
+ */
+void A9GPool::_electPrimary() {
+  int previous = _primary;
+  _primary = -1;
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_members[i].healthy) {
+      _primary = i;
+      break;
+    }
+  }
+  if (_primary >= 0 && _primary != previous) {
+    if (previous >= 0) _members[previous].stale = true;
+    _members[_primary].subscribed = 0;
+  }
+}
+
+/**
+ * @brief Send the first topic the primary does not carry yet, without
+ *        waiting; a busy modem is tried again on the next round.
+ */
+void A9GPool::_subscribeNext() {
+  if (_primary < 0) return;
+  Member *p = &_members[_primary];
+  if (p->connecting) return;
+  for (uint8_t t = 0; t < _topicCount; t++) {
+    if (p->subscribed & (1 << t)) continue;
+    if (p->client->subscribeMQTTNonBlocking(_topics[t])) p->subscribed |= (uint8_t)(1 << t);
+    return;
+  }
+}
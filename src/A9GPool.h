@@ -0,0 +1,179 @@
+#ifndef A9GPOOL_H
+#define A9GPOOL_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GPool.h
+ *
+ * @brief Multi-modem gateway: spreads MQTT publishes over several A9G modules
+ *        attached to one MCU, fails over when a module loses registration and
+ *        merges inbound messages of all modules into one callback.
+ *
+ * Each module keeps its own A9G + A9Gmod pair (and its own Stream), so the pool
+ * also runs on the host with emulated streams.
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GPool CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_POOL_MAX_MODEMS
+#define A9G_POOL_MAX_MODEMS 4        ///< Modules a pool can manage
+#endif
+
+#ifndef A9G_POOL_MAX_TOPICS
+#define A9G_POOL_MAX_TOPICS 4        ///< Subscriptions re-applied on failover
+#endif
+
+#ifndef A9G_POOL_MAX_FAILURES
+#define A9G_POOL_MAX_FAILURES 3      ///< Consecutive publish failures before a module is taken out
+#endif
+
+#ifndef A9G_POOL_DEPTH_WEIGHT
+#define A9G_POOL_DEPTH_WEIGHT 8      ///< Score cost of one queued message, in CSQ steps
+#endif
+
+/**
+ * @brief Callback for messages arriving on any pool member
+ * @param modem Index of the module that received the message
+ */
+typedef void (*A9G_PoolMessageCallback)(uint8_t modem, const char *topic, const char *payload);
+
+/**
+ * @class A9GPool
+ * @brief Load-balances outbound publishes over several A9Gmod clients.
+ *
+ * A publish is queued on the healthy module with the lowest score, where the
+ * score grows with the module's queue depth and shrinks with its CSQ.
+ * Subscriptions live on one "primary" module to avoid duplicate deliveries and
+ * move with it when that module fails; only the primary's messages reach
+ * onMessage(). A former primary reconnects with a clean session, so the
+ * broker drops its old subscriptions.
+ *
+ * Health checks, reconnects, drains and failover subscribes never block
+ * loop(): AT+CREG? / AT+CSQ go through the command scheduler, AT+MQTTCONN and
+ * the subscribes of a new primary (one per round) are sent without waiting.
+ */
+class A9GPool {
+public:
+  A9GPool();
+
+  /**
+     * @brief Add an already-initialized module to the pool.
+     * @return false if A9G_POOL_MAX_MODEMS modules are already registered
+     */
+  bool addModem(A9Gmod &client);
+
+  /**
+     * @brief Number of registered modules.
+     */
+  uint8_t modemCount() const { return _count; }
+
+  /**
+     * @brief Apply the broker host and port to every module.
+     * @return false if the host is too long (see A9Gmod::setMQTTServer())
+     */
+  bool setMQTTServer(const char *host, uint16_t port);
+
+  /**
+     * @brief Connect every module independently. Module i uses "<clientID>-<i>".
+     *        user/pass must stay valid for the lifetime of the pool (reconnects reuse them).
+     * @return Number of modules that connected
+     */
+  uint8_t connectAll(const char *clientID, const char *user = nullptr, const char *pass = nullptr);
+
+  /**
+     * @brief Queue a message on the best module.
+     * @return false if no healthy module has queue space
+     */
+  bool publish(const char *topic, const char *payload);
+
+  /**
+     * @brief Subscribe on the primary module (waits for the answer); the topic
+     *        is re-subscribed from loop() on failover.
+     * @return false if the topic cannot be stored, there is no primary yet
+     *         (loop() subscribes once there is) or the subscribe failed
+     */
+  bool subscribe(const char *topic);
+
+  /**
+     * @brief Receive inbound messages from all modules.
+     */
+  void onMessage(A9G_PoolMessageCallback callback);
+
+  /**
+     * @brief Must be called regularly: polls every module, publishes queued
+     *        messages, runs health checks and moves work away from failed modules.
+     */
+  void loop();
+
+  /**
+     * @brief How often each module is probed with AT+CREG?/AT+CSQ (default
+     *        30 s). A down module is reconnected on the round after it
+     *        reported registration.
+     */
+  void setHealthCheckInterval(unsigned long ms) { _checkInterval = ms; }
+
+  /**
+     * @brief Whether a module is currently registered and accepting publishes.
+     */
+  bool isHealthy(uint8_t modem) const;
+
+  /**
+     * @brief Module the next publish would go to, or -1 if none can take it.
+     */
+  int selectModem() const;
+
+  /**
+     * @brief Module carrying the subscriptions, or -1 if none is healthy.
+     */
+  int primaryModem() const { return _primary; }
+
+  /**
+     * @brief Total number of messages queued across all modules.
+     */
+  uint8_t pending() const;
+
+private:
+  struct Member {
+    A9GPool *pool;
+    A9Gmod *client;
+    uint8_t index;
+    bool healthy;
+    bool connecting;             ///< connectMQTTNonBlocking() in flight
+    bool stale;                  ///< Was primary: may still hold subscriptions
+    bool disconnecting;          ///< AT+MQTTDISCONN of a stale session queued
+    bool rejoin;                 ///< Registered again: loop() sends the connect
+    uint8_t subscribed;          ///< Bit t: _topics[t] sent in the current session
+    unsigned long lastCheck;
+  };
+  static_assert(A9G_POOL_MAX_TOPICS <= 8, "A9G_POOL_MAX_TOPICS must fit the 8-bit subscription mask");
+
+  Member _members[A9G_POOL_MAX_MODEMS];
+  uint8_t _count;
+  int _primary;
+
+  char _topics[A9G_POOL_MAX_TOPICS][A9G_MQTT_TOPIC_MAX];
+  uint8_t _topicCount;
+
+  char _clientID[24];
+  const char *_user;
+  const char *_pass;
+
+  unsigned long _checkInterval;
+  A9G_PoolMessageCallback _onMessage;
+
+  static void _onClientMessage(void *ctx, const char *topic, const char *payload);
+  static void _onDisconnected(bool ok, int error, void *ctx);
+  void _memberID(const Member *m, char *id, size_t cap) const;
+  bool _connect(Member *m);
+  void _reconnect(Member *m);
+  void _checkHealth(Member *m);
+  void _markDown(Member *m);
+  void _drainFrom(Member *from);
+  void _electPrimary();
+  void _subscribeNext();
+};
+
+#endif  // A9GPOOL_H
@@ -0,0 +1,77 @@
+#include "A9GRate.h"
+
+/* ------------------------------------------------------------------
+ *                   A9G_RateController IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9G_RateController::A9G_RateController()
+  : _target(A9G_RATE_TARGET_MS),
+    _minBatch(1),
+    _maxBatch(A9G_RATE_MAX_BATCH) {
+  setLimits(PRIO_HIGH, 0, 2000);
+  setLimits(PRIO_NORMAL, 0, 15000);
+  setLimits(PRIO_LOW, 0, A9G_RATE_MAX_INTERVAL);
+  reset();
+}
+
+void A9G_RateController::reset() {
+  _interval = 0;
+  _batch = _minBatch;
+  _srtt = 0;
+  _results = 0;
+  _failures = 0;
+}
+
+void A9G_RateController::setLimits(A9G_Priority prio, unsigned long floorMs, unsigned long ceilingMs) {
+  if (prio >= PRIO_MAX) return;
+  if (ceilingMs < floorMs) ceilingMs = floorMs;
+  _floor[prio] = floorMs;
+  _ceiling[prio] = ceilingMs;
+}
+
+void A9G_RateController::setBatchLimits(uint8_t minBatch, uint8_t maxBatch) {
+  if (minBatch < 1) minBatch = 1;
+  if (maxBatch > A9G_RATE_MAX_BATCH) maxBatch = A9G_RATE_MAX_BATCH;
+  if (maxBatch < minBatch) maxBatch = minBatch;
+  _minBatch = minBatch;
+  _maxBatch = maxBatch;
+  if (_batch < _minBatch) _batch = _minBatch;
+  if (_batch > _maxBatch) _batch = _maxBatch;
+}
+
+void A9G_RateController::onResult(bool ok, unsigned long rttMs, uint8_t csq) {
+  _results++;
+  if (!ok) {
+    _failures++;
+    _decrease();
+    return;
+  }
+  // Smoothed round trip, gain 1/8 as for TCP
+  if (!_srtt) _srtt = rttMs ? rttMs : 1;
+  else _srtt = _srtt - (_srtt >> 3) + (rttMs >> 3);
+
+  if (_srtt > _target) {
+    _decrease();
+    return;
+  }
+  if (csq > 31 || csq < A9G_RATE_WEAK_CSQ) return;  // hold, do not push a weak link
+  if (_interval) {
+    _interval = _interval > A9G_RATE_STEP_MS ? _interval - A9G_RATE_STEP_MS : 0;
+  } else if (_batch < _maxBatch) {
+    _batch++;
+  }
+}
+
+void A9G_RateController::_decrease() {
+  _interval = _interval ? _interval * 2 : A9G_RATE_STEP_MS;
+  if (_interval > A9G_RATE_MAX_INTERVAL) _interval = A9G_RATE_MAX_INTERVAL;
+  _batch /= 2;
+  if (_batch < _minBatch) _batch = _minBatch;
+}
+
+unsigned long A9G_RateController::interval(A9G_Priority prio) const {
+  if (prio >= PRIO_MAX) prio = PRIO_LOW;
+  if (_interval < _floor[prio]) return _floor[prio];
+  if (_interval > _ceiling[prio]) return _ceiling[prio];
+  return _interval;
+}
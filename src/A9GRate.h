@@ -0,0 +1,130 @@
+#ifndef A9GRATE_H
+#define A9GRATE_H
+
+#include <Arduino.h>
+
+/*!
+ * @file A9GRate.h
+ *
+ * @brief AIMD publish rate control for A9Gmod's outbound queue. Messages are
+ *        flushed in batches; the pause between two flushes and the batch size
+ *        follow the publish round trips:
+ *        - a publish that succeeds within the latency target on a usable
+ *          signal shortens the pause by a fixed step, and once it is at its
+ *          floor grows the batch by one (additive increase)
+ *        - a failed or timed out publish, or a smoothed round trip above the
+ *          target, doubles the pause and halves the batch (multiplicative decrease)
+ */
+
+/* ------------------------------------------------------------------
+ *                      RATE CONTROL CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_RATE_TARGET_MS
+#define A9G_RATE_TARGET_MS 1500      ///< Publish round trip to stay under
+#endif
+
+#ifndef A9G_RATE_STEP_MS
+#define A9G_RATE_STEP_MS 250         ///< Additive decrease of the pause per good publish
+#endif
+
+#ifndef A9G_RATE_MAX_INTERVAL
+#define A9G_RATE_MAX_INTERVAL 60000  ///< Longest pause the controller backs off to
+#endif
+
+#ifndef A9G_RATE_MAX_BATCH
+#define A9G_RATE_MAX_BATCH 4         ///< Messages published per flush at most
+#endif
+
+#ifndef A9G_RATE_WEAK_CSQ
+#define A9G_RATE_WEAK_CSQ 10         ///< Below this RSSI index the rate is not raised
+#endif
+
+/**
+ * @brief Priority of a queued message; selects the pause limits that apply
+ */
+typedef enum A9G_Priority {
+  PRIO_HIGH = 0,
+  PRIO_NORMAL,
+  PRIO_LOW,
+  PRIO_MAX
+} A9G_Priority;
+
+/**
+ * @class A9G_RateController
+ * @brief Pause and batch size for flushing a publish queue.
+ *
+ * The controller keeps one pause; interval() clamps it to the floor and
+ * ceiling of a priority, so urgent messages are never held longer than their
+ * ceiling and bulk ones never go out faster than their floor.
+ */
+class A9G_RateController {
+public:
+  A9G_RateController();
+
+  /**
+     * @brief Back to full speed (pause 0, batch 1) and forget the round trips.
+     */
+  void reset();
+
+  /**
+     * @brief Smoothed round trip above which the rate is lowered.
+     */
+  void setTarget(unsigned long ms) { _target = ms; }
+  unsigned long target() const { return _target; }
+
+  /**
+     * @brief Pause limits for messages of @p prio.
+     */
+  void setLimits(A9G_Priority prio, unsigned long floorMs, unsigned long ceilingMs);
+
+  /**
+     * @brief Batch size range (1..A9G_RATE_MAX_BATCH).
+     */
+  void setBatchLimits(uint8_t minBatch, uint8_t maxBatch);
+
+  /**
+     * @brief Feed the outcome of one publish.
+     * @param ok    The modem answered OK
+     * @param rttMs Time from sending AT+MQTTPUB to its result
+     * @param csq   Current RSSI index (99 = unknown)
+     */
+  void onResult(bool ok, unsigned long rttMs, uint8_t csq);
+
+  /**
+     * @brief Pause before the next flush of a queue whose most urgent message has @p prio.
+     */
+  unsigned long interval(A9G_Priority prio) const;
+
+  /**
+     * @brief Messages to publish per flush.
+     */
+  uint8_t batch() const { return _batch; }
+
+  /**
+     * @brief Smoothed publish round trip (0 before the first result).
+     */
+  unsigned long latency() const { return _srtt; }
+
+  /**
+     * @brief Results seen, and how many of them failed.
+     */
+  uint32_t results() const { return _results; }
+  uint32_t failures() const { return _failures; }
+
+private:
+  unsigned long _interval;
+  unsigned long _target;
+  unsigned long _srtt;
+  unsigned long _floor[PRIO_MAX];
+  unsigned long _ceiling[PRIO_MAX];
+  uint8_t _batch;
+  uint8_t _minBatch;
+  uint8_t _maxBatch;
+  uint32_t _results;
+  uint32_t _failures;
+
+  void _decrease();
+};
+
+#endif  // A9GRATE_H
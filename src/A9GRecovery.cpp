@@ -0,0 +1,244 @@
+#include "A9GRecovery.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GRecovery IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9GRecovery::A9GRecovery(A9G &modem)
+  : _modem(&modem),
+    _resetLine(nullptr),
+    _resetCtx(nullptr),
+    _powerKey(nullptr),
+    _powerCtx(nullptr),
+    _restore(nullptr),
+    _restoreCtx(nullptr),
+    _streak(A9G_RECOVERY_TIMEOUTS),
+    _state(RECOVERY_IDLE),
+    _level(RECOVERY_IDLE),
+    _phase(0),
+    _stepAt(0),
+    _episodeAt(0),
+    _episode(false),
+    _triggered(false),
+    _ready(false),
+    _probePending(false),
+    _probeOk(false),
+    _probesLeft(0),
+    _restoresLeft(0) {
+  resetStats();
+  _modem->addEventHandler(_onEvent, this);
+}
+
+A9GRecovery::~A9GRecovery() {
+  _modem->removeEventHandler(_onEvent, this);
+}
+
+void A9GRecovery::setResetLine(A9G_LineHook hook, void *ctx) {
+  _resetLine = hook;
+  _resetCtx = ctx;
+}
+
+void A9GRecovery::setPowerKey(A9G_LineHook hook, void *ctx) {
+  _powerKey = hook;
+  _powerCtx = ctx;
+}
+
+void A9GRecovery::onRestore(A9G_WarmConfigCallback cb, void *ctx) {
+  _restore = cb;
+  _restoreCtx = ctx;
+}
+
+void A9GRecovery::resetStats() {
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+/**
+ * @brief PROBE -> SOFT_RESET -> RESET_PIN -> POWER_CYCLE -> BACKOFF, each
+ *        level ending as soon as the module answers or reports READY;
+ *        READY leads to RESTORE from any state.
+ */
+void A9GRecovery::loop() {
+  unsigned long now = millis();
+  if (_ready && _state != RECOVERY_RESTORE) {
+    _release();
+    if (!_episode) {
+      // The module rebooted on its own: brownout, watchdog, firmware crash
+      _episode = true;
+      _episodeAt = now;
+      _stats.episodes++;
+    }
+    _enter(RECOVERY_RESTORE, now);
+  }
+
+  switch (_state) {
+    case RECOVERY_IDLE:
+      if (_triggered || (_streak && _modem->timeoutStreak() >= _streak)) {
+        _episode = true;
+        _episodeAt = now;
+        _stats.episodes++;
+        _enter(RECOVERY_PROBE, now);
+      }
+      _triggered = false;
+      break;
+
+    case RECOVERY_PROBE:
+      if (_probePending) break;
+      if (_probeOk) {
+        _stats.probesOk++;
+        _finish(now);
+      } else if (!_probesLeft) {
+        _escalate(now);
+      } else if (_modem->submitCommand("AT", PRIO_HIGH, 0, _onProbe, this,
+                                       A9G_RECOVERY_PROBE_TIMEOUT)) {
+        _probePending = true;
+        _probesLeft--;
+      }
+      break;
+
+    case RECOVERY_RESET_PIN:
+      if (_phase == 1 && now - _stepAt >= A9G_RECOVERY_RESET_PULSE) {
+        _resetLine(false, _resetCtx);
+        _phase = 0;
+        _stepAt = now;
+      }
+      if (!_phase && now - _stepAt >= A9G_RECOVERY_BOOT_TIMEOUT) _escalate(now);
+      break;
+
+    case RECOVERY_POWER_CYCLE:
+      // 1: pressed (off), 2: released, 3: pressed (on), 0: waiting for READY
+      if ((_phase & 1) && now - _stepAt >= A9G_RECOVERY_PWRKEY_PULSE) {
+        _powerKey(false, _powerCtx);
+        _phase = _phase == 1 ? 2 : 0;
+        _stepAt = now;
+      } else if (_phase == 2 && now - _stepAt >= A9G_RECOVERY_OFF_TIME) {
+        _powerKey(true, _powerCtx);
+        _phase = 3;
+        _stepAt = now;
+      }
+      if (!_phase && now - _stepAt >= A9G_RECOVERY_BOOT_TIMEOUT) _escalate(now);
+      break;
+
+    case RECOVERY_SOFT_RESET:
+      if (now - _stepAt >= A9G_RECOVERY_BOOT_TIMEOUT) _escalate(now);
+      break;
+
+    case RECOVERY_RESTORE:
+      if (_ready) {
+        // Booted again meanwhile: what was configured is lost once more
+        _ready = false;
+        _restoresLeft = A9G_RECOVERY_RESTORES;
+      } else if (now - _stepAt < A9G_RECOVERY_RESTORE_RETRY) {
+        break;
+      }
+      if (!_restore || _restore(*_modem, _restoreCtx)) {
+        _finish(millis());
+        break;
+      }
+      _stats.restoreFails++;
+      _stepAt = millis();
+      if (!--_restoresLeft) {
+        // Configuration keeps failing: reset harder than what led here
+        if (_level < RECOVERY_PROBE) _level = RECOVERY_PROBE;
+        _escalate(_stepAt);
+      }
+      break;
+
+    case RECOVERY_BACKOFF:
+      if (now - _stepAt >= A9G_RECOVERY_BACKOFF) _enter(RECOVERY_PROBE, now);
+      break;
+  }
+}
+
+void A9GRecovery::_onEvent(A9G_Event *evt, void *ctx) {
+  if (evt->id != EV_READY) return;
+  A9GRecovery *self = static_cast<A9GRecovery *>(ctx);
+  self->_ready = true;
+  self->_stats.boots++;
+}
+
+/**
+ * @brief Any answer, ERROR included, shows the module is alive.
+ */
+void A9GRecovery::_onProbe(bool ok, int error, void *ctx) {
+  A9GRecovery *self = static_cast<A9GRecovery *>(ctx);
+  self->_probePending = false;
+  self->_probeOk = ok || error >= 0;
+}
+
+void A9GRecovery::_escalate(unsigned long now) {
+  int next = _level < RECOVERY_PROBE ? RECOVERY_PROBE : _level + 1;
+  if (next == RECOVERY_RESET_PIN && !_resetLine) next++;
+  if (next == RECOVERY_POWER_CYCLE && !_powerKey) next++;
+  if (next > RECOVERY_POWER_CYCLE) {
+    _stats.failures++;
+    next = RECOVERY_BACKOFF;
+  }
+  _enter((A9G_RecoveryState)next, now);
+}
+
+void A9GRecovery::_enter(A9G_RecoveryState next, unsigned long now) {
+  _state = next;
+  _stepAt = now;
+  _phase = 0;
+  switch (next) {
+    case RECOVERY_PROBE:
+      _level = next;
+      _probesLeft = A9G_RECOVERY_PROBES;
+      _probePending = false;
+      _probeOk = false;
+      break;
+    case RECOVERY_SOFT_RESET:
+      _level = next;
+      _ready = false;
+      _stats.softResets++;
+      _modem->restartModem();
+      break;
+    case RECOVERY_RESET_PIN:
+      _level = next;
+      _ready = false;
+      _stats.pinResets++;
+      _modem->modemRestarted();
+      _resetLine(true, _resetCtx);
+      _phase = 1;
+      break;
+    case RECOVERY_POWER_CYCLE:
+      _level = next;
+      _ready = false;
+      _stats.powerCycles++;
+      _modem->modemRestarted();
+      _powerKey(true, _powerCtx);
+      _phase = 1;
+      break;
+    case RECOVERY_RESTORE:
+      _ready = false;
+      _restoresLeft = A9G_RECOVERY_RESTORES;
+      _stepAt = now - A9G_RECOVERY_RESTORE_RETRY;  // first attempt right away
+      break;
+    case RECOVERY_BACKOFF:
+      _level = RECOVERY_IDLE;
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief A line must not stay asserted when READY cuts a pulse short.
+ */
+void A9GRecovery::_release() {
+  if (!(_phase & 1)) return;
+  if (_state == RECOVERY_RESET_PIN) _resetLine(false, _resetCtx);
+  if (_state == RECOVERY_POWER_CYCLE) _powerKey(false, _powerCtx);
+  _phase = 0;
+}
+
+void A9GRecovery::_finish(unsigned long now) {
+  if (_episode) {
+    _stats.lastOutageMs = now - _episodeAt;
+    if (_stats.lastOutageMs > _stats.maxOutageMs) _stats.maxOutageMs = _stats.lastOutageMs;
+  }
+  _episode = false;
+  _state = RECOVERY_IDLE;
+  _level = RECOVERY_IDLE;
+  _triggered = false;
+}
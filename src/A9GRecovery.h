@@ -0,0 +1,183 @@
+#ifndef A9GRECOVERY_H
+#define A9GRECOVERY_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GRecovery.h
+ *
+ * @brief Brings a wedged module back without rebooting the MCU:
+ *        - AT probes first, since a single lost answer is no reason to reset
+ *        - then AT+RST=1, a pulse on the reset line and a power key cycle,
+ *          each through a hook the sketch supplies for its wiring
+ *        - READY is awaited in loop(), never by blocking
+ *        - the sketch's warm configuration (APN, broker, GPS) is replayed
+ *          after every boot, also after one the module did on its own
+ *        - counters per escalation level and the outage times
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GRecovery CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_RECOVERY_TIMEOUTS
+#define A9G_RECOVERY_TIMEOUTS 3          ///< Commands in a row without an answer that start a recovery
+#endif
+
+#ifndef A9G_RECOVERY_PROBES
+#define A9G_RECOVERY_PROBES 2            ///< AT probes before the module is reset
+#endif
+
+#ifndef A9G_RECOVERY_PROBE_TIMEOUT
+#define A9G_RECOVERY_PROBE_TIMEOUT 1000UL  ///< ms one AT probe may take
+#endif
+
+#ifndef A9G_RECOVERY_BOOT_TIMEOUT
+#define A9G_RECOVERY_BOOT_TIMEOUT 20000UL  ///< ms to wait for READY after a reset
+#endif
+
+#ifndef A9G_RECOVERY_RESET_PULSE
+#define A9G_RECOVERY_RESET_PULSE 200UL   ///< ms the reset line is held active
+#endif
+
+#ifndef A9G_RECOVERY_PWRKEY_PULSE
+#define A9G_RECOVERY_PWRKEY_PULSE 3000UL ///< ms the power key is held for one press
+#endif
+
+#ifndef A9G_RECOVERY_OFF_TIME
+#define A9G_RECOVERY_OFF_TIME 3000UL     ///< ms between the power-off and the power-on press
+#endif
+
+#ifndef A9G_RECOVERY_RESTORES
+#define A9G_RECOVERY_RESTORES 3          ///< Warm configuration attempts after one boot
+#endif
+
+#ifndef A9G_RECOVERY_RESTORE_RETRY
+#define A9G_RECOVERY_RESTORE_RETRY 5000UL  ///< ms between two of them
+#endif
+
+#ifndef A9G_RECOVERY_BACKOFF
+#define A9G_RECOVERY_BACKOFF 60000UL     ///< ms to wait after every level failed, before the next round
+#endif
+
+/**
+ * @brief Where the controller is
+ */
+typedef enum A9G_RecoveryState {
+  RECOVERY_IDLE = 0,     ///< The module answers
+  RECOVERY_PROBE,        ///< AT probes
+  RECOVERY_SOFT_RESET,   ///< AT+RST=1 sent, waiting for READY
+  RECOVERY_RESET_PIN,    ///< Reset line pulsed, waiting for READY
+  RECOVERY_POWER_CYCLE,  ///< Power key pressed off and on, waiting for READY
+  RECOVERY_RESTORE,      ///< READY seen, warm configuration pending
+  RECOVERY_BACKOFF       ///< Every level failed, waiting for the next round
+} A9G_RecoveryState;
+
+/**
+ * @brief Replays the configuration a boot lost (AT+CGATT, APN, broker,
+ *        GPS); called from loop(), so it may block
+ * @return false to retry it later (e.g. not registered yet)
+ */
+typedef bool (*A9G_WarmConfigCallback)(A9G &modem, void *ctx);
+
+/**
+ * @brief Recovery statistics
+ */
+typedef struct A9G_RecoveryStats {
+  uint16_t episodes;     ///< Recoveries started
+  uint16_t probesOk;     ///< ... that ended with an answered probe
+  uint16_t softResets;   ///< AT+RST=1 sent
+  uint16_t pinResets;    ///< Reset line pulses
+  uint16_t powerCycles;  ///< Power key cycles
+  uint16_t boots;        ///< READY seen (also unrequested reboots)
+  uint16_t restoreFails; ///< Warm configuration attempts that failed
+  uint16_t failures;     ///< Rounds in which every level failed
+  uint32_t lastOutageMs; ///< Start of the last recovery until it ended
+  uint32_t maxOutageMs;
+} A9G_RecoveryStats;
+
+/**
+ * @class A9GRecovery
+ * @brief Recovery controller for one A9G; listens to EV_READY.
+ *
+ * Usage:
+ *   A9GRecovery recovery(a9g);
+ *   recovery.setResetLine(pulseResetPin);       // optional
+ *   recovery.setPowerKey(pressPowerKey);        // optional
+ *   recovery.onRestore(configureModem);
+ *   ...
+ *   recovery.loop();                            // from loop(), never waits for READY
+ *   if (mqttFailing) recovery.trigger();
+ */
+class A9GRecovery {
+public:
+  explicit A9GRecovery(A9G &modem);
+  ~A9GRecovery();
+
+  void loop();
+
+  /**
+     * @brief Start a recovery on the next loop(), e.g. when the application
+     *        sees its own traffic fail. Ignored while one is running.
+     */
+  void trigger() { _triggered = true; }
+
+  /**
+     * @param streak Unanswered commands in a row (A9G::timeoutStreak()) that
+     *               start a recovery by themselves; 0 = only trigger()
+     */
+  void setTimeoutStreak(uint8_t streak) { _streak = streak; }
+
+  /**
+     * @brief Without a hook the level is skipped.
+     */
+  void setResetLine(A9G_LineHook hook, void *ctx = nullptr);
+
+  /**
+     * @brief The power key is pressed twice: off, A9G_RECOVERY_OFF_TIME,
+     *        on. A module that was already off boots on the first press;
+     *        its READY then ends the cycle before the second one.
+     */
+  void setPowerKey(A9G_LineHook hook, void *ctx = nullptr);
+
+  void onRestore(A9G_WarmConfigCallback cb, void *ctx = nullptr);
+
+  A9G_RecoveryState state() const { return _state; }
+  bool recovering() const { return _state != RECOVERY_IDLE; }
+
+  const A9G_RecoveryStats &stats() const { return _stats; }
+  void resetStats();
+
+private:
+  A9G *_modem;
+  A9G_LineHook _resetLine;
+  void *_resetCtx;
+  A9G_LineHook _powerKey;
+  void *_powerCtx;
+  A9G_WarmConfigCallback _restore;
+  void *_restoreCtx;
+  uint8_t _streak;
+
+  A9G_RecoveryState _state;
+  A9G_RecoveryState _level;      ///< Escalation level reached in this round
+  uint8_t _phase;                ///< Step of a line pulse (0 = waiting for READY)
+  unsigned long _stepAt;         ///< millis() the current step started
+  unsigned long _episodeAt;      ///< millis() the recovery started
+  bool _episode;                 ///< A recovery is counted as running
+  bool _triggered;
+  bool _ready;                   ///< EV_READY since the last reset was issued
+  bool _probePending;
+  bool _probeOk;
+  uint8_t _probesLeft;
+  uint8_t _restoresLeft;
+  A9G_RecoveryStats _stats;
+
+  static void _onEvent(A9G_Event *evt, void *ctx);
+  static void _onProbe(bool ok, int error, void *ctx);
+  void _enter(A9G_RecoveryState next, unsigned long now);
+  void _escalate(unsigned long now);
+  void _release();
+  void _finish(unsigned long now);
+};
+
+#endif  // A9GRECOVERY_H
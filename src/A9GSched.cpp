@@ -0,0 +1,170 @@
+#include "A9Gmod.h"
+
+/* ------------------------------------------------------------------
+ *                   A9G COMMAND SCHEDULER
+ *
+ *  Background commands wait in a small queue and are started by
+ *  pollModem() whenever nothing else is in flight:
+ *    - the most urgent effective class goes first, the oldest on a tie;
+ *      every A9G_CMD_AGING ms of waiting raises a command by one class
+ *    - a command past its maxWait is dropped instead of sent late
+ *    - the same line queued again replaces the waiting copy
+ *    - a foreground command refused for isBusy() claims the channel, so
+ *      it is next once the command in flight completes
+ *    - holdQueues() keeps all but PRIO_HIGH commands (probes) waiting
+ *  A command that is already on the wire cannot be taken back; the
+ *  latency of an urgent command is bounded by the timeout of the one in
+ *  flight (A9G_QUERY_TIMEOUT for the status queries).
+ * ------------------------------------------------------------------ */
+
+bool A9G::submitCommand(const char *cmd, A9G_Priority priority, unsigned long maxWait,
+                        A9G_CommandCallback cb, void *ctx, unsigned long timeout) {
+  A9G_Cmd<A9G_CMD_QUEUE_TEXT> line;
+  line.add(cmd).end();
+  return _submit(line, priority, maxWait, cb, ctx, timeout);
+}
+
+bool A9G::cancelCommand(const char *cmd) {
+  A9G_Cmd<A9G_CMD_QUEUE_TEXT> line;
+  line.add(cmd).end();
+  if (line.overflow()) return false;
+  for (uint8_t i = 0; i < _cmdCount; i++) {
+    if (!strcmp(_cmdQueue[i].text, line.c_str())) {
+      _cmdDrop(i, CMD_CANCELLED);
+      return true;
+    }
+  }
+  return false;
+}
+
+void A9G::claimChannel(A9G_Priority priority) {
+  unsigned long now = millis();
+  // An older claim of a more urgent class stands until it runs out
+  if (_claimed && now - _claimAt < A9G_CMD_CLAIM && _claimPriority < priority) return;
+  _claimed = true;
+  _claimPriority = priority;
+  _claimAt = now;
+}
+
+bool A9G::_submit(const A9G_CmdBuilder &cmd, A9G_Priority priority, unsigned long maxWait,
+                  A9G_CommandCallback cb, void *ctx, unsigned long timeout) {
+  if (cmd.overflow() || priority >= PRIO_MAX) {
+    A9G_METRIC_ADD(_metrics, CNT_TRUNCATED, 1);
+    return false;
+  }
+  unsigned long now = millis();
+  CmdJob *job = nullptr;
+  for (uint8_t i = 0; i < _cmdCount; i++) {
+    if (!strcmp(_cmdQueue[i].text, cmd.c_str())) {
+      // Keep the older entry's place in line; the new caller gets the result
+      job = &_cmdQueue[i];
+      if (job->cb) job->cb(false, CMD_SUPERSEDED, job->ctx);
+      _cmdStats.superseded++;
+      if (priority < job->priority) job->priority = priority;
+      job->maxWait = maxWait ? now - job->queuedAt + maxWait : 0;
+      break;
+    }
+  }
+  if (!job) {
+    if (_cmdCount == A9G_CMD_QUEUE_LEN) {
+      // Make room by dropping the least urgent entry, if it is less urgent
+      uint8_t worst = 0;
+      for (uint8_t i = 1; i < _cmdCount; i++) {
+        if (_cmdRank(_cmdQueue[i], now) > _cmdRank(_cmdQueue[worst], now)) worst = i;
+      }
+      if (_cmdRank(_cmdQueue[worst], now) <= (long)priority * (long)A9G_CMD_AGING) {
+        A9G_METRIC_ADD(_metrics, CNT_BACKPRESSURE, 1);
+        return false;
+      }
+      _cmdStats.evicted++;
+      _cmdDrop(worst, CMD_EVICTED);
+    }
+    job = &_cmdQueue[_cmdCount++];
+    strcpy(job->text, cmd.c_str());
+    job->queuedAt = now;
+    job->maxWait = maxWait;
+    job->priority = priority;
+  }
+  job->cb = cb;
+  job->ctx = ctx;
+  job->timeout = timeout;
+  return true;
+}
+
+/**
+ * @brief Start the most urgent queued command; called from pollModem()
+ *        after the SMS pipeline had its turn.
+ */
+void A9G::_cmdPump() {
+  if (!_cmdCount || _awaitingResult || _smsState != SMS_IDLE || _smsHold) return;
+  unsigned long now = millis();
+  for (uint8_t i = _cmdCount; i-- > 0;) {
+    const CmdJob &job = _cmdQueue[i];
+    if (job.maxWait && now - job.queuedAt > job.maxWait) {
+      _cmdStats.expired++;
+      _cmdDrop(i, CMD_EXPIRED);
+    }
+  }
+  long rank;
+  int best = _cmdBest(now, &rank, _queueHold ? PRIO_NORMAL : PRIO_MAX);
+  if (best < 0) return;
+  if (_claimed) {
+    if (now - _claimAt >= A9G_CMD_CLAIM) {
+      _claimed = false;
+    } else if (rank >= (long)_claimPriority * (long)A9G_CMD_AGING) {
+      return;  // the foreground caller goes first
+    }
+  }
+
+  CmdJob &job = _cmdQueue[best];
+  A9G_Cmd<A9G_CMD_QUEUE_TEXT> cmd;
+  cmd.add(job.text);
+  if (!_sendAsync(cmd, job.timeout, true)) return;  // TX queue full, retry next poll
+  unsigned long waited = now - job.queuedAt;
+  if (waited > _cmdStats.maxWaitMs) _cmdStats.maxWaitMs = waited;
+  _cmdStats.sent++;
+  _jobCb = job.cb;
+  _jobCtx = job.ctx;
+  _jobError = 0;
+  job.cb = nullptr;
+  _cmdDrop(best, 0);
+}
+
+/**
+ * @brief Index of the queued command to run next (-1 if none) and its rank,
+ *        among those of a class more urgent than @p below.
+ */
+int A9G::_cmdBest(unsigned long now, long *rank, A9G_Priority below) {
+  int best = -1;
+  for (uint8_t i = 0; i < _cmdCount; i++) {
+    if (_cmdQueue[i].priority >= below) continue;
+    long r = _cmdRank(_cmdQueue[i], now);
+    if (best < 0 || r < *rank ||
+        (r == *rank && now - _cmdQueue[i].queuedAt > now - _cmdQueue[best].queuedAt)) {
+      best = i;
+      *rank = r;
+    }
+  }
+  return best;
+}
+
+/**
+ * @brief Effective class in ms units: lower is more urgent. A command that
+ *        waited A9G_CMD_AGING ms ranks with the class above its own.
+ */
+long A9G::_cmdRank(const CmdJob &job, unsigned long now) const {
+  return (long)job.priority * (long)A9G_CMD_AGING - (long)(now - job.queuedAt);
+}
+
+/**
+ * @brief Remove a queued command, telling its caller why unless @p error is 0.
+ */
+void A9G::_cmdDrop(uint8_t index, int error) {
+  A9G_CommandCallback cb = _cmdQueue[index].cb;
+  void *ctx = _cmdQueue[index].ctx;
+  for (uint8_t i = index; i + 1 < _cmdCount; i++) {
+    _cmdQueue[i] = _cmdQueue[i + 1];
+  }
+  _cmdCount--;
+  if (cb && error) cb(false, error, ctx);
+}
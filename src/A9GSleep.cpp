@@ -0,0 +1,233 @@
+#include "A9GSleep.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GSleep IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9GSleep::A9GSleep(A9G &modem, A9Gmod *mqtt)
+  : _modem(&modem),
+    _mqtt(mqtt),
+    _wakeLine(nullptr),
+    _wakeCtx(nullptr),
+    _period(A9G_SLEEP_PERIOD),
+    _urgent(PRIO_HIGH),
+    _smsUrgent(true),
+    _state(SLEEP_STOPPED),
+    _windowAt(0),
+    _stepAt(0),
+    _failedAt(0),
+    _failed(false),
+    _wakeRequest(false),
+    _wakeUrgent(false),
+    _fixWanted(false),
+    _fixSeen(false),
+    _gpsStarted(false),
+    _gpsOwned(false),
+    _gpsAt(0) {
+  resetStats();
+  _modem->addEventHandler(_onEvent, this);
+}
+
+A9GSleep::~A9GSleep() {
+  _modem->removeEventHandler(_onEvent, this);
+}
+
+void A9GSleep::setUrgent(A9G_Priority level, bool sms) {
+  _urgent = level;
+  _smsUrgent = sms;
+}
+
+void A9GSleep::setWakeLine(A9G_LineHook hook, void *ctx) {
+  _wakeLine = hook;
+  _wakeCtx = ctx;
+}
+
+void A9GSleep::resetStats() {
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+bool A9GSleep::begin() {
+  if (_state != SLEEP_STOPPED) return true;
+  _state = SLEEP_ASLEEP;
+  _windowAt = millis();
+  _failed = false;
+  return _sleep();
+}
+
+bool A9GSleep::stop() {
+  if (_state == SLEEP_STOPPED) return true;
+  _gpsEnd();
+  if (_modem->modemAsleep() && !_modem->wakeModem()) {
+    _stats.failures++;
+    return false;
+  }
+  if (_state == SLEEP_BURST) _stats.awakeMs += millis() - _stepAt;
+  if (_wakeLine && _state != SLEEP_ASLEEP) _wakeLine(false, _wakeCtx);
+  _hold(false);
+  _state = SLEEP_STOPPED;
+  return true;
+}
+
+unsigned long A9GSleep::nextWindow() const {
+  if (_state == SLEEP_STOPPED || _state == SLEEP_BURST) return 0;
+  unsigned long elapsed = millis() - _windowAt;
+  unsigned long period = _period * 1000UL;
+  return elapsed < period ? period - elapsed : 0;
+}
+
+/**
+ * @brief ASLEEP -> (WAKING) -> BURST -> ASLEEP. A failed AT+SLEEP leaves
+ *        the state as it was and is retried A9G_SLEEP_RETRY later.
+ */
+void A9GSleep::loop() {
+  if (_state == SLEEP_STOPPED) return;
+  unsigned long now = millis();
+  if (_failed) {
+    if (now - _failedAt < A9G_SLEEP_RETRY) return;
+    _failed = false;
+  }
+
+  switch (_state) {
+    case SLEEP_ASLEEP:
+      if (!_modem->modemAsleep()) {
+        // begin() failed, or the module rebooted and left sleep mode
+        _sleep();
+      } else if (_urgentWork()) {
+        _open(now, true);
+      } else if (now - _windowAt >= _period * 1000UL) {
+        _open(now, false);
+      }
+      break;
+
+    case SLEEP_WAKING:
+      if (now - _stepAt >= A9G_SLEEP_WAKE_GUARD) _burst(now);
+      break;
+
+    case SLEEP_BURST:
+      _gpsStep(now);
+      if (now - _stepAt >= A9G_SLEEP_MAX_AWAKE ||
+          (now - _stepAt >= A9G_SLEEP_MIN_AWAKE && _idle())) {
+        _sleep();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void A9GSleep::_onEvent(A9G_Event *evt, void *ctx) {
+  A9GSleep *self = static_cast<A9GSleep *>(ctx);
+  if (evt->id == EV_GPS_FIX && evt->fix && evt->fix->valid && self->_gpsStarted) {
+    self->_fixSeen = true;
+  }
+}
+
+/**
+ * @brief Work that should not wait for the next window. A full outbox
+ *        counts, since it refuses the next message.
+ */
+bool A9GSleep::_urgentWork() const {
+  if (_wakeRequest) return true;
+  if (_smsUrgent && _modem->smsPending()) return true;
+  if (!_mqtt || !_mqtt->pendingMQTT()) return false;
+  if (_mqtt->pendingMQTT() >= A9G_MQTT_QUEUE_LEN) return true;
+  return _urgent < PRIO_MAX && _mqtt->mostUrgent() <= _urgent;
+}
+
+bool A9GSleep::_idle() const {
+  if (_fixWanted || _modem->isBusy()) return false;
+  if (_modem->smsPending() || _modem->commandsQueued()) return false;
+  return !_mqtt || !_mqtt->pendingMQTT();
+}
+
+void A9GSleep::_hold(bool hold) {
+  _modem->holdQueues(hold);
+  if (_mqtt) _mqtt->holdQueue(hold);
+}
+
+void A9GSleep::_open(unsigned long now, bool urgent) {
+  _wakeUrgent = urgent;
+  if (_wakeLine) {
+    _wakeLine(true, _wakeCtx);
+    _state = SLEEP_WAKING;
+    _stepAt = now;
+    return;
+  }
+  _burst(now);
+}
+
+bool A9GSleep::_burst(unsigned long now) {
+  if (!_modem->wakeModem()) {
+    _stats.failures++;
+    _failed = true;
+    _failedAt = millis();
+    if (_wakeLine) _wakeLine(false, _wakeCtx);
+    _state = SLEEP_ASLEEP;
+    return false;
+  }
+  _wakeRequest = false;
+  _stats.wakes++;
+  if (_wakeUrgent) _stats.urgentWakes++;
+  _stats.jobs += _modem->smsPending() + _modem->commandsQueued() + (_fixWanted ? 1 : 0);
+  if (_mqtt) _stats.jobs += _mqtt->pendingMQTT();
+  _windowAt = now;
+  _state = SLEEP_BURST;
+  _stepAt = millis();
+  _hold(false);
+  return true;
+}
+
+/**
+ * @brief The queues are held before AT+SLEEP, so nothing new starts
+ *        between the decision and the module falling asleep.
+ */
+bool A9GSleep::_sleep() {
+  _gpsEnd();
+  _hold(true);
+  if (!_modem->sleepModem()) {
+    _stats.failures++;
+    _failed = true;
+    _failedAt = millis();
+    if (_state == SLEEP_BURST) _hold(false);
+    return false;
+  }
+  if (_state == SLEEP_BURST) {
+    _stats.awakeMs += millis() - _stepAt;
+    if (_wakeLine) _wakeLine(false, _wakeCtx);
+  }
+  _state = SLEEP_ASLEEP;
+  _stepAt = millis();
+  return true;
+}
+
+/**
+ * @brief A receiver the sketch already powers is only watched; one powered
+ *        here reports every second and is switched off again afterwards.
+ */
+void A9GSleep::_gpsStep(unsigned long now) {
+  if (!_fixWanted) return;
+  if (!_gpsStarted) {
+    _gpsOwned = !_modem->gpsPowered();
+    if (_gpsOwned && (!_modem->enableGPS() || !_modem->setGPSReport(1))) {
+      if (_modem->gpsPowered()) _modem->disableGPS();
+      _fixWanted = false;
+      return;
+    }
+    _gpsStarted = true;
+    _fixSeen = false;
+    _gpsAt = now;
+    return;
+  }
+  if (_fixSeen || now - _gpsAt >= A9G_SLEEP_GPS_TIMEOUT) _gpsEnd();
+}
+
+void A9GSleep::_gpsEnd() {
+  if (!_gpsStarted) return;
+  if (_gpsOwned) {
+    _modem->setGPSReport(0);
+    _modem->disableGPS();
+  }
+  _gpsStarted = false;
+  _fixWanted = false;
+}
@@ -0,0 +1,184 @@
+#ifndef A9GSLEEP_H
+#define A9GSLEEP_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GSleep.h
+ *
+ * @brief Radio-on windows: the module sleeps (AT+SLEEP) while the work for
+ *        it piles up, then does all of it in one burst:
+ *        - queued publishes, SMS and scheduled commands are held between
+ *          windows; requested GPS reads wait for the next one as well
+ *        - a window opens every setPeriod() seconds, or right away for
+ *          urgent work (a message of the urgent class, an SMS, a full
+ *          outbox, wake())
+ *        - the burst lasts until the queues are empty, at least
+ *          A9G_SLEEP_MIN_AWAKE for downlink traffic, at most
+ *          A9G_SLEEP_MAX_AWAKE; unfinished work waits for the next window
+ *        - an optional DTR / wake line is raised for the whole burst
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GSleep CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_SLEEP_PERIOD
+#define A9G_SLEEP_PERIOD 300UL         ///< Seconds between two radio windows
+#endif
+
+#ifndef A9G_SLEEP_MIN_AWAKE
+#define A9G_SLEEP_MIN_AWAKE 3000UL     ///< ms a burst stays open for answers and downlink messages
+#endif
+
+#ifndef A9G_SLEEP_MAX_AWAKE
+#define A9G_SLEEP_MAX_AWAKE 60000UL    ///< ms after which a burst ends with work still queued
+#endif
+
+#ifndef A9G_SLEEP_WAKE_GUARD
+#define A9G_SLEEP_WAKE_GUARD 100UL     ///< ms between raising the wake line and the first command
+#endif
+
+#ifndef A9G_SLEEP_GPS_TIMEOUT
+#define A9G_SLEEP_GPS_TIMEOUT 60000UL  ///< ms a burst waits for a requested fix
+#endif
+
+#ifndef A9G_SLEEP_RETRY
+#define A9G_SLEEP_RETRY 5000UL         ///< ms before a failed AT+SLEEP is tried again
+#endif
+
+/**
+ * @brief Where the scheduler is
+ */
+typedef enum A9G_SleepState {
+  SLEEP_STOPPED = 0,     ///< Not started, or stop()ped: the module stays awake
+  SLEEP_ASLEEP,          ///< Work is held until the next window
+  SLEEP_WAKING,          ///< Wake line raised, waiting out its guard time
+  SLEEP_BURST            ///< Awake, the queues are released
+} A9G_SleepState;
+
+/**
+ * @brief Window statistics; awakeMs / jobs is the radio time per work item
+ */
+typedef struct A9G_SleepStats {
+  uint16_t wakes;        ///< Windows opened
+  uint16_t urgentWakes;  ///< ... of them before their time
+  uint16_t failures;     ///< AT+SLEEP exchanges that failed
+  uint32_t jobs;         ///< Work items waiting when the windows opened
+  uint32_t awakeMs;      ///< Time spent in bursts
+} A9G_SleepStats;
+
+/**
+ * @class A9GSleep
+ * @brief Batches the work of one A9G (and optionally its A9Gmod outbox)
+ *        into radio windows; listens to EV_GPS_FIX.
+ *
+ * Usage:
+ *   A9GSleep sleep(a9g, &mqtt);
+ *   sleep.setPeriod(600);
+ *   sleep.setWakeLine(raiseDtr);       // optional
+ *   sleep.begin();                     // holds the queues, AT+SLEEP=1
+ *   ...
+ *   sleep.loop();                      // from loop(), next to processMQTT()
+ *   mqtt.queueMQTT(topic, reading);    // waits for the next window
+ *   mqtt.queueMQTT(topic, alarm, PRIO_HIGH);  // opens one now
+ *   sleep.requestFix();                // GPS read in the next window
+ *
+ * Decisions are taken in loop(), never inside pollModem(), because
+ * AT+SLEEP waits for its answer.
+ */
+class A9GSleep {
+public:
+  explicit A9GSleep(A9G &modem, A9Gmod *mqtt = nullptr);
+  ~A9GSleep();
+
+  /**
+     * @brief Hold the queues and put the module to sleep; the first window
+     *        opens A9G_SLEEP_PERIOD later. False (and retried by loop())
+     *        if AT+SLEEP failed.
+     */
+  bool begin();
+
+  /**
+     * @brief Wake the module for good and release the queues.
+     */
+  bool stop();
+
+  void loop();
+
+  /**
+     * @param seconds Time between two windows, counted from the start of
+     *                the last one (an urgent one included)
+     */
+  void setPeriod(uint32_t seconds) { _period = seconds; }
+
+  /**
+     * @brief Queued messages of @p level or more urgent open a window at
+     *        once (PRIO_MAX: none do). With @p sms, so does a queued SMS.
+     */
+  void setUrgent(A9G_Priority level, bool sms = true);
+
+  /**
+     * @brief DTR or another wake input of the module, held active for the
+     *        whole burst.
+     */
+  void setWakeLine(A9G_LineHook hook, void *ctx = nullptr);
+
+  /**
+     * @brief Open a window on the next loop(), for the sketch's own urgent work.
+     */
+  void wake() { _wakeRequest = true; }
+
+  /**
+     * @brief Power the GPS in the next window and keep it open until a valid
+     *        fix (A9G::gpsFix()) or A9G_SLEEP_GPS_TIMEOUT.
+     */
+  void requestFix() { _fixWanted = true; }
+  bool fixPending() const { return _fixWanted; }
+
+  A9G_SleepState state() const { return _state; }
+  bool awake() const { return _state == SLEEP_BURST; }
+
+  /**
+     * @brief ms until the next scheduled window (0 while one is open).
+     */
+  unsigned long nextWindow() const;
+
+  const A9G_SleepStats &stats() const { return _stats; }
+  void resetStats();
+
+private:
+  A9G *_modem;
+  A9Gmod *_mqtt;
+  A9G_LineHook _wakeLine;
+  void *_wakeCtx;
+  uint32_t _period;
+  A9G_Priority _urgent;
+  bool _smsUrgent;
+
+  A9G_SleepState _state;
+  unsigned long _windowAt;       ///< millis() the last window opened (or begin())
+  unsigned long _stepAt;         ///< millis() the current state started
+  unsigned long _failedAt;       ///< millis() of the last failed AT+SLEEP
+  bool _failed;
+  bool _wakeRequest;
+  bool _wakeUrgent;              ///< The window being opened is an urgent one
+  bool _fixWanted;
+  bool _fixSeen;                 ///< Valid EV_GPS_FIX since the GPS was started
+  bool _gpsStarted;              ///< The burst started the GPS read
+  bool _gpsOwned;                ///< ... and powered the receiver for it
+  unsigned long _gpsAt;
+  A9G_SleepStats _stats;
+
+  static void _onEvent(A9G_Event *evt, void *ctx);
+  bool _urgentWork() const;
+  bool _idle() const;
+  void _hold(bool hold);
+  void _open(unsigned long now, bool urgent);
+  bool _burst(unsigned long now);
+  bool _sleep();
+  void _gpsStep(unsigned long now);
+  void _gpsEnd();
+};
+
+#endif  // A9GSLEEP_H
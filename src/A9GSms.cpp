@@ -0,0 +1,172 @@
+#include "A9Gmod.h"
+
+/* ------------------------------------------------------------------
+ *                   A9G SMS SEND PIPELINE
+ *
+ *  queueSMS() only stores the message. pollModem() then walks each
+ *  job through:
+ *    [AT+CMGF=<mode> -> OK]  (only if the modem is not known to be in that mode)
+ *    AT+CMGS="<number>" -> '>' -> <body><Ctrl+Z> -> +CMGS: <mr> -> OK      (text)
+ *    AT+CMGS=<tpdu length> -> '>' -> <hex PDU><Ctrl+Z> -> +CMGS: <mr> -> OK (PDU)
+ *  Any ERROR / +CMS ERROR / timeout fails the job and moves on.
+ *  A concatenated PDU message is one job per part, all with the same id.
+ * ------------------------------------------------------------------ */
+
+uint8_t A9G::queueSMS(const char *number, const char *message,
+                      A9G_SMSCallback cb, void *ctx) {
+  if (_smsCount >= A9G_SMS_QUEUE_LEN) {
+    A9G_METRIC_ADD(_metrics, CNT_BACKPRESSURE, 1);
+    return 0;
+  }
+  if (strlen(number) >= A9G_SMS_NUMBER_MAX || strlen(message) >= A9G_SMS_BODY_MAX) {
+    return 0;
+  }
+  SMSJob *job = &_smsQueue[(_smsHead + _smsCount) % A9G_SMS_QUEUE_LEN];
+  strcpy(job->number, number);
+  strcpy(job->body, message);
+  job->cb = cb;
+  job->ctx = ctx;
+  job->id = _smsNextId++;
+  if (!_smsNextId) _smsNextId = 1;  // 0 means "rejected"
+  job->pduLen = 0;
+  job->part = 1;
+  job->parts = 1;
+  _smsCount++;
+  return job->id;
+}
+
+uint8_t A9G::queueSMSPdu(const char *number, const char *message,
+                         A9G_SMSCallback cb, void *ctx) {
+  uint8_t parts = A9G_pduPartCount(message);
+  if (!parts || parts > A9G_SMS_QUEUE_LEN - _smsCount) return 0;
+  uint8_t ref = _smsConcatRef++;
+
+  // Encode every part first so a failing one leaves the queue untouched
+  for (uint8_t part = 1; part <= parts; part++) {
+    SMSJob *job = &_smsQueue[(_smsHead + _smsCount + part - 1) % A9G_SMS_QUEUE_LEN];
+    size_t n = A9G_pduEncodeSubmit(number, message, part, parts, ref,
+                                   (uint8_t *)job->body, sizeof(job->body));
+    if (!n) return 0;
+    job->pduLen = n;
+    job->part = part;
+    job->parts = parts;
+    job->number[0] = '\0';
+    job->cb = cb;
+    job->ctx = ctx;
+    job->id = _smsNextId;
+  }
+  _smsCount += parts;
+  uint8_t id = _smsNextId++;
+  if (!_smsNextId) _smsNextId = 1;
+  return id;
+}
+
+/**
+ * @brief Advance the pipeline; called from pollModem() after parsing.
+ */
+void A9G::_smsStep() {
+  isBusy();  // applies the timeout of the step in flight
+
+  if (_smsState == SMS_IDLE) {
+    if (!_smsCount || _awaitingResult || _smsHold || _queueHold) return;
+    SMSJob *job = &_smsQueue[_smsHead];
+    int8_t mode = job->pduLen ? 0 : 1;
+    if (_smsTextMode != mode) {
+      A9G_Cmd<16> cmd;
+      cmd.add(GF("AT+CMGF=")).add((int)mode).end();
+      if (_sendAsync(cmd, 2000)) _smsState = SMS_WAIT_MODE;
+      return;
+    }
+    A9G_Cmd<16 + 3 * A9G_SMS_NUMBER_MAX> cmd;
+    if (job->pduLen) {
+      cmd.add(GF("AT+CMGS=")).add(job->pduLen - 1).end();  // the SCA octet is not counted
+    } else {
+      cmd.add(GF("AT+CMGS=")).addQuoted(job->number).end();
+    }
+    if (_sendAsync(cmd, A9G_SMS_PROMPT_TIMEOUT)) _smsState = SMS_WAIT_PROMPT;
+    return;
+  }
+
+  if (_smsState == SMS_SEND_BODY) {
+    SMSJob *job = &_smsQueue[_smsHead];
+    A9G_Cmd<2 * A9G_SMS_BODY_MAX + 2> body;
+    if (job->pduLen) {
+      body.addHex((const uint8_t *)job->body, job->pduLen);
+    } else {
+      body.add(job->body);
+    }
+    body.add((char)0x1A);  // Ctrl+Z
+    if (!_txAsync || body.length() <= txFree() || body.length() > A9G_TX_QUEUE_SIZE) {
+      _queueTx(body.data(), body.length());
+      _smsState = SMS_WAIT_RESULT;
+    }
+    // else: wait for TX queue space on a later poll
+  }
+}
+
+/**
+ * @brief '>' seen: the body may go out now; the result timer starts here.
+ */
+void A9G::_smsOnPrompt() {
+  _smsState = SMS_SEND_BODY;
+  _awaitStart = millis();
+  _awaitTimeout = A9G_SMS_RESULT_TIMEOUT;
+  _smsStep();
+}
+
+/**
+ * @brief Final result code while a job is active.
+ */
+void A9G::_smsOnResult(bool ok) {
+  switch (_smsState) {
+    case SMS_WAIT_MODE:
+      if (ok) {
+        _smsTextMode = _smsQueue[_smsHead].pduLen ? 0 : 1;
+        _smsState = SMS_IDLE;  // next _smsStep() sends AT+CMGS
+      } else {
+        _smsTextMode = -1;
+        _smsFinish(false, _lastError);
+      }
+      break;
+
+    case SMS_WAIT_PROMPT:
+    case SMS_SEND_BODY: {
+      // No prompt, or no room to send the body: leave the input mode with ESC
+      uint8_t esc = 0x1B;
+      _queueTx(&esc, 1);
+      _smsFinish(false, ok ? -1 : _lastError);
+      break;
+    }
+
+    case SMS_WAIT_RESULT:
+      _smsFinish(ok, ok ? 0 : _lastError);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief Drop the head job and report it. A failed part also drops the
+ *        rest of its message; a message is reported once, after its last part.
+ */
+void A9G::_smsFinish(bool ok, int error) {
+  SMSJob job = _smsQueue[_smsHead];
+  int ref = ok ? _smsRef : -1;
+  _smsHead = (_smsHead + 1) % A9G_SMS_QUEUE_LEN;
+  _smsCount--;
+  while (!ok && _smsCount && _smsQueue[_smsHead].id == job.id) {
+    _smsHead = (_smsHead + 1) % A9G_SMS_QUEUE_LEN;
+    _smsCount--;
+  }
+  _smsState = SMS_IDLE;
+  _smsRef = -1;
+  _awaitingResult = false;
+  A9G_TRACE_D(_debugMode, _trace, ok ? TR_SMS_SENT : TR_SMS_FAILED, job.id, job.part);
+  if (ok && job.part < job.parts) return;
+  // Called last: the callback may queue the next message
+  if (job.cb) {
+    job.cb(job.id, ok, ref, ok ? 0 : error, job.ctx);
+  }
+}
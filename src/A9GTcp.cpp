@@ -0,0 +1,168 @@
+#include "A9Gmod.h"
+
+/* ------------------------------------------------------------------
+ *                   A9G TCP SOCKET
+ *
+ *  Single connection mode (AT+CIPMUX=0, the default):
+ *    AT+CIPSTART="TCP","<host>",<port> -> OK -> CONNECT OK | CONNECT FAIL
+ *    AT+CIPSEND=<n> -> '>' -> <n bytes> -> OK (SEND OK on some firmware)
+ *    +CIPRCV:<n>,<n bytes>   received data, any time
+ *    CLOSED                  the peer or the network closed the socket
+ *  The parser copies received bytes into a ring buffer read with tcpRead().
+ * ------------------------------------------------------------------ */
+
+bool A9G::tcpConnect(const char *host, uint16_t port) {
+  if (!_modemStream) return false;
+  if (_tcpState != TCP_CLOSED) tcpClose();
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(GF("AT+CIPSTART=\"TCP\",")).addQuoted(host).add(',').add((unsigned int)port).end();
+  if (cmd.overflow()) return false;
+
+  _tcpRxHead = 0;
+  _tcpRxCount = 0;
+  _tcpState = TCP_CONNECTING;
+  _runParsed(cmd, A9G_TCP_CONNECT_TIMEOUT);
+  // CONNECT OK usually follows the OK; an ERROR is followed by CONNECT FAIL or nothing
+  unsigned long start = millis();
+  while (_tcpState == TCP_CONNECTING && _lastResultOk &&
+         millis() - start < A9G_TCP_CONNECT_TIMEOUT) {
+    feedWatchdog();
+    pollModem();
+  }
+  if (_tcpState == TCP_CONNECTING) _tcpState = TCP_CLOSED;
+  return _tcpState == TCP_CONNECTED;
+}
+
+bool A9G::tcpSend(const uint8_t *data, size_t len) {
+  if (!_modemStream || _tcpState != TCP_CONNECTED) return false;
+  if (isBusy()) _waitIdle();
+  _flushTx();
+  _smsHold = true;
+  bool ok = true;
+  while (ok && len) {
+    size_t n = len < A9G_TCP_SEND_MAX ? len : A9G_TCP_SEND_MAX;
+    A9G_Cmd<24> cmd;
+    cmd.add(GF("AT+CIPSEND=")).add((unsigned long)n).end();
+    _tcpPrompt = false;
+    _tcpWaitPrompt = true;
+    ok = _sendAsync(cmd, A9G_TCP_SEND_TIMEOUT);
+    while (ok && !_tcpPrompt && isBusy()) {
+      feedWatchdog();
+      pollModem();
+    }
+    _tcpWaitPrompt = false;
+    // ERROR or timeout instead of the prompt ends the command
+    ok = ok && _tcpPrompt;
+    if (ok) {
+      // Binary data bypasses the TX queue; it must not be split by other writes
+      _modemStream->write(data, n);
+      A9G_METRIC_ADD(_metrics, CNT_BYTES_OUT, n);
+      _tcpWaitSend = true;
+      while (isBusy()) {
+        feedWatchdog();
+        pollModem();
+      }
+      _tcpWaitSend = false;
+      ok = _lastResultOk && _tcpState == TCP_CONNECTED;
+    }
+    data += n;
+    len -= n;
+  }
+  _smsHold = false;
+  return ok;
+}
+
+bool A9G::tcpClose() {
+  if (!_modemStream) return false;
+  A9G_Cmd<16> cmd;
+  cmd.add(GF("AT+CIPCLOSE")).end();
+  bool ok = _runParsed(cmd, A9G_QUERY_TIMEOUT);
+  _tcpState = TCP_CLOSED;
+  return ok;
+}
+
+int A9G::tcpRead() {
+  if (!_tcpRxCount) return -1;
+  uint8_t c = _tcpRx[_tcpRxHead];
+  _tcpRxHead = (_tcpRxHead + 1) % A9G_TCP_RX_SIZE;
+  _tcpRxCount--;
+  return c;
+}
+
+size_t A9G::tcpRead(uint8_t *buf, size_t len) {
+  size_t n = 0;
+  while (n < len && _tcpRxCount) {
+    buf[n++] = tcpRead();
+  }
+  return n;
+}
+
+/* ------------------------------------------------------------------
+ *   HTTP
+ * ------------------------------------------------------------------ */
+
+int A9G::httpPost(const char *url, const char *contentType, const char *body) {
+  if (!_modemStream || !body || strlen(body) > A9G_HTTP_POST_MAX) return -1;
+  // Nothing shows the firmware decodes \22 / \0A here, so no body that needs them
+  if (strpbrk(body, "\"\r\n")) return -1;
+  // URL and type plus the body as it is
+  A9G_Cmd<128 + A9G_HTTP_POST_MAX> cmd;
+  cmd.add(GF("AT+HTTPPOST=")).addQuoted(url).add(',').addQuoted(contentType)
+    .add(",\"", 2).add(body).add('"').end();
+  if (cmd.overflow()) return -1;
+
+  _httpStatus = -1;
+  if (!_runParsed(cmd, A9G_HTTP_TIMEOUT)) return -1;
+  // The response may come after the OK
+  unsigned long start = millis();
+  while (_httpStatus < 0 && millis() - start < A9G_HTTP_TIMEOUT) {
+    feedWatchdog();
+    pollModem();
+  }
+  return _httpStatus;
+}
+
+/**
+ * @brief Parser hook while a +CIPRCV is in progress.
+ * @return false if the byte is not part of it (malformed header)
+ */
+bool A9G::_tcpRxByte(char c) {
+  if (_tcpRxStage == 1) {
+    if (c >= '0' && c <= '9') {
+      _tcpRxLeft = _tcpRxLeft * 10 + (c - '0');
+      return true;
+    }
+    if (c == ' ') return true;
+    _tcpRxStage = c == ',' && _tcpRxLeft ? 2 : 0;
+    if (!_tcpRxStage) A9G_METRIC_ADD(_metrics, CNT_PARSE_ERRORS, 1);
+    return c == ',';
+  }
+  if (_tcpRxCount < A9G_TCP_RX_SIZE) {
+    _tcpRx[(_tcpRxHead + _tcpRxCount) % A9G_TCP_RX_SIZE] = c;
+    _tcpRxCount++;
+  } else {
+    _tcpDropped++;
+  }
+  if (!--_tcpRxLeft) _tcpRxStage = 0;
+  return true;
+}
+
+/**
+ * @brief Plain lines other than OK / ERROR: socket state changes and the
+ *        status line of an AT+HTTPPOST response. SEND OK / SEND FAIL only
+ *        end a CIPSEND data phase; one trailing the OK must not complete
+ *        whatever command was sent next.
+ */
+void A9G::_tcpOnLine(const char *line) {
+  if (!strncmp_P(line, PSTR("HTTP/1."), 7) && line[8] == ' ') {
+    _httpStatus = atoi(line + 9);
+  } else if (!strcmp_P(line, PSTR("CONNECT OK")) || !strcmp_P(line, PSTR("ALREADY CONNECT"))) {
+    if (_tcpState == TCP_CONNECTING) _tcpState = TCP_CONNECTED;
+  } else if (!strcmp_P(line, PSTR("CONNECT FAIL")) || !strcmp_P(line, PSTR("CLOSED"))) {
+    _tcpState = TCP_CLOSED;
+  } else if (!strcmp_P(line, PSTR("SEND OK")) || !strcmp_P(line, PSTR("SEND FAIL"))) {
+    if (!_tcpWaitSend) return;
+    _tcpWaitSend = false;
+    _onResult(line[5] == 'O');
+  }
+}
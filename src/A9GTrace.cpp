@@ -0,0 +1,66 @@
+#include "A9GTrace.h"
+#include "A9GCmd.h"
+#include "A9GErrors.h"
+
+/* ------------------------------------------------------------------
+ *                   A9G_Trace IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9G_Trace::A9G_Trace() : _head(0), _tail(0), _dropped(0) {}
+
+bool A9G_Trace::pop(A9G_TraceRecord *out) {
+  uint8_t tail = _tail;
+  if (tail == _head) return false;
+  *out = _ring[tail];
+  _tail = (tail + 1) & (A9G_TRACE_SIZE - 1);
+  return true;
+}
+
+uint8_t A9G_Trace::drain(Print &out, uint8_t max) {
+  A9G_TraceRecord rec;
+  char line[96];
+  uint8_t n = 0;
+  while (n < max && pop(&rec)) {
+    if (format(rec, line, sizeof(line))) out.println(line);
+    n++;
+  }
+  return n;
+}
+
+uint8_t A9G_Trace::drainBinary(Print &out, uint8_t max) {
+  A9G_TraceRecord rec;
+  uint8_t n = 0;
+  while (n < max && pop(&rec)) {
+    out.write((const uint8_t *)&rec, sizeof(rec));
+    n++;
+  }
+  return n;
+}
+
+size_t A9G_Trace::format(const A9G_TraceRecord &rec, char *buf, size_t len) {
+  static const char levels[] = "?EWID";
+  if (!buf || !len) return 0;
+  A9G_TextBuilder out(buf, len);
+  unsigned long us = rec.time % 1000;
+  out.add("[A9G] ").add((unsigned long)(rec.time / 1000)).add('.');
+  if (us < 100) out.add('0');
+  if (us < 10) out.add('0');
+  out.add(us).add(' ')
+    .add(levels[rec.level < sizeof(levels) - 1 ? rec.level : 0]).add(' ')
+    .add(eventName(rec.event)).add(' ')
+    .add((int)rec.a).add(' ')
+    .add((long)rec.b);
+  const __FlashStringHelper *name = nullptr;
+  if (rec.event == TR_CME_ERROR) name = A9G_cmeErrorName(rec.a);
+  else if (rec.event == TR_CMS_ERROR) name = A9G_cmsErrorName(rec.a);
+  if (name) out.add(' ').add(name);
+  return out.overflow() ? 0 : out.length();
+}
+
+const char *A9G_Trace::eventName(uint8_t event) {
+  static const char *const names[TR_EVENT_MAX] = {
+    "MODEM_OK", "MODEM_SILENT", "SIGNAL", "READY", "NO_SIM", "CME_ERROR",
+    "CMS_ERROR", "SMS_SENT", "SMS_FAILED", "PDU_UNDECODABLE", "CMD_TIMEOUT"
+  };
+  return event < TR_EVENT_MAX ? names[event] : "UNKNOWN";
+}
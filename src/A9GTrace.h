@@ -0,0 +1,169 @@
+#ifndef A9GTRACE_H
+#define A9GTRACE_H
+
+#include <Arduino.h>
+
+/*!
+ * @file A9GTrace.h
+ *
+ * @brief Deferred logging: the library stores small binary records (time,
+ *        event id, two numbers) in a ring buffer instead of printing text.
+ *        drain() formats them later, when the sketch has time, or
+ *        drainBinary() ships the raw records for decoding on the host.
+ *
+ * Levels below A9G_TRACE_LEVEL compile to nothing; with level 0 no ring is
+ * reserved at all.
+ */
+
+/* ------------------------------------------------------------------
+ *                      TRACE CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#define A9G_TRACE_OFF 0
+#define A9G_TRACE_ERROR 1
+#define A9G_TRACE_WARN 2
+#define A9G_TRACE_INFO 3
+#define A9G_TRACE_DEBUG 4              ///< Only recorded while the A9G debug mode is on
+
+#ifndef A9G_TRACE_LEVEL
+#define A9G_TRACE_LEVEL A9G_TRACE_DEBUG  ///< Most verbose level compiled in
+#endif
+
+#ifndef A9G_TRACE_SIZE
+#if defined(__AVR__)
+#define A9G_TRACE_SIZE 16              ///< Records in the ring (power of two, at most 128)
+#else
+#define A9G_TRACE_SIZE 64
+#endif
+#endif
+
+/**
+ * @brief What a record is about; the meaning of its arguments is noted per id
+ */
+typedef enum A9G_TraceEvent {
+  TR_MODEM_OK = 0,       ///< init(): module answered
+  TR_MODEM_SILENT,       ///< init(): no answer
+  TR_SIGNAL,             ///< a = dBm (0 if unknown), b = CSQ
+  TR_READY,              ///< waitForModemReady(): READY seen
+  TR_NO_SIM,             ///< waitForModemReady(): NO SIM CARD seen
+  TR_CME_ERROR,          ///< a = +CME ERROR code
+  TR_CMS_ERROR,          ///< a = +CMS ERROR code
+  TR_SMS_SENT,           ///< a = message id, b = part
+  TR_SMS_FAILED,         ///< a = message id, b = part
+  TR_PDU_UNDECODABLE,    ///< a = PDU length
+  TR_CMD_TIMEOUT,        ///< b = timeout in ms
+  TR_EVENT_MAX
+} A9G_TraceEvent;
+
+/**
+ * @brief One binary record (12 bytes)
+ */
+typedef struct A9G_TraceRecord {
+  uint32_t time;         ///< micros() when recorded
+  uint8_t event;         ///< A9G_TraceEvent
+  uint8_t level;         ///< A9G_TRACE_ERROR .. A9G_TRACE_DEBUG
+  int16_t a;
+  int32_t b;
+} A9G_TraceRecord;
+
+/**
+ * @class A9G_Trace
+ * @brief Single-producer / single-consumer record ring.
+ *
+ * put() only moves the head and pop() only the tail, so records may be
+ * consumed from another context than the one producing them. When the ring
+ * is full new records are dropped and counted.
+ */
+class A9G_Trace {
+public:
+  A9G_Trace();
+
+  void put(uint8_t level, A9G_TraceEvent event, int16_t a = 0, int32_t b = 0) {
+    uint8_t head = _head;
+    uint8_t next = (head + 1) & (A9G_TRACE_SIZE - 1);
+    if (next == _tail) {
+      if (_dropped < 0xFFFF) _dropped++;
+      return;
+    }
+    A9G_TraceRecord *r = &_ring[head];
+    r->time = micros();
+    r->event = event;
+    r->level = level;
+    r->a = a;
+    r->b = b;
+    _head = next;
+  }
+
+  /**
+     * @brief Take the oldest record.
+     * @return false if the ring is empty
+     */
+  bool pop(A9G_TraceRecord *out);
+
+  /**
+     * @brief Records waiting to be drained.
+     */
+  uint8_t available() const { return (_head - _tail) & (A9G_TRACE_SIZE - 1); }
+
+  /**
+     * @brief Records lost because the ring was full (saturates at 65535).
+     */
+  uint16_t dropped() const { return _dropped; }
+
+  /**
+     * @brief Format and print up to @p max records, one line each.
+     * @return Number of records printed
+     */
+  uint8_t drain(Print &out, uint8_t max = 255);
+
+  /**
+     * @brief Write up to @p max raw records (sizeof(A9G_TraceRecord) bytes each)
+     *        for decoding on the host with format().
+     */
+  uint8_t drainBinary(Print &out, uint8_t max = 255);
+
+  /**
+     * @brief Render a record as "[A9G] <ms>.<us> <L> <EVENT> <a> <b>"; CME/CMS
+     *        errors get their name appended.
+     * @return Length written, 0 if the buffer was too small
+     */
+  static size_t format(const A9G_TraceRecord &rec, char *buf, size_t len);
+
+  static const char *eventName(uint8_t event);
+
+private:
+  static_assert((A9G_TRACE_SIZE & (A9G_TRACE_SIZE - 1)) == 0 && A9G_TRACE_SIZE <= 128,
+                "A9G_TRACE_SIZE must be a power of two up to 128");
+
+  A9G_TraceRecord _ring[A9G_TRACE_SIZE];
+  volatile uint8_t _head;
+  volatile uint8_t _tail;
+  uint16_t _dropped;
+};
+
+/*
+ * Hooks used inside the library. `t` is the A9G_Trace; levels above
+ * A9G_TRACE_LEVEL leave no code behind.
+ */
+#if A9G_TRACE_LEVEL >= A9G_TRACE_ERROR
+#define A9G_TRACE_E(t, ev, a, b) (t).put(A9G_TRACE_ERROR, ev, a, b)
+#else
+#define A9G_TRACE_E(t, ev, a, b) ((void)0)
+#endif
+#if A9G_TRACE_LEVEL >= A9G_TRACE_WARN
+#define A9G_TRACE_W(t, ev, a, b) (t).put(A9G_TRACE_WARN, ev, a, b)
+#else
+#define A9G_TRACE_W(t, ev, a, b) ((void)0)
+#endif
+#if A9G_TRACE_LEVEL >= A9G_TRACE_INFO
+#define A9G_TRACE_I(t, ev, a, b) (t).put(A9G_TRACE_INFO, ev, a, b)
+#else
+#define A9G_TRACE_I(t, ev, a, b) ((void)0)
+#endif
+#if A9G_TRACE_LEVEL >= A9G_TRACE_DEBUG
+#define A9G_TRACE_D(dbg, t, ev, a, b) ((dbg) ? (t).put(A9G_TRACE_DEBUG, ev, a, b) : (void)0)
+#else
+#define A9G_TRACE_D(dbg, t, ev, a, b) ((void)0)
+#endif
+
+#endif  // A9GTRACE_H
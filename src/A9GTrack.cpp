@@ -0,0 +1,142 @@
+#include "A9GTrack.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GTrack IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9GTrack::A9GTrack(A9G &modem, uint16_t toleranceM)
+  : _modem(&modem),
+    _tolerance(toleranceM),
+    _maxInterval(0),
+    _cb(nullptr),
+    _ctx(nullptr),
+    _in(0),
+    _out(0) {
+  reset();
+  _modem->addEventHandler(_onEvent, this);
+}
+
+A9GTrack::~A9GTrack() {
+  _modem->removeEventHandler(_onEvent, this);
+}
+
+void A9GTrack::onBatch(A9G_TrackBatchCallback cb, void *ctx) {
+  _cb = cb;
+  _ctx = ctx;
+}
+
+/**
+ * @brief The newest fix is held back as the end of the candidate segment
+ *        anchor -> fix. When the next fix arrives and that longer segment
+ *        no longer passes within the tolerance of every fix in between, the
+ *        held fix becomes a key point.
+ */
+void A9GTrack::update(const A9G_GPSFix &fix) {
+  if (!fix.valid) return;
+  _in++;
+  A9G_TrackPoint p = { fix.latE7, fix.lonE7, fix.time };
+  if (!_hasAnchor) {
+    _emit(p);
+    return;
+  }
+  if (_hasLast) {
+    bool keep = !_fits(p);
+    // Fixes within the tolerance of the anchor are close to any segment
+    // starting there, so they need not be checked again
+    if (!keep && A9G_geoDistance(_anchor.latE7, _anchor.lonE7, _last.latE7, _last.lonE7) > _tolerance) {
+      if (_windowCount < A9G_TRACK_WINDOW) {
+        _window[_windowCount++] = _last;
+      } else {
+        keep = true;
+      }
+    }
+    if (keep) _emit(_last);
+  }
+  _last = p;
+  _hasLast = true;
+  if (_maxInterval && millis() - _anchorStamp >= _maxInterval * 1000UL) _emit(_last);
+}
+
+void A9GTrack::flush() {
+  if (_hasLast) _emit(_last);
+  if (_batchCount && _cb) _cb(_ctx, _batch, _batchCount);
+  _batchCount = 0;
+}
+
+void A9GTrack::reset() {
+  _hasAnchor = false;
+  _hasLast = false;
+  _windowCount = 0;
+  _batchCount = 0;
+}
+
+void A9GTrack::_onEvent(A9G_Event *evt, void *ctx) {
+  if (evt->id == EV_GPS_FIX && evt->fix) {
+    static_cast<A9GTrack *>(ctx)->update(*evt->fix);
+  }
+}
+
+void A9GTrack::_emit(const A9G_TrackPoint &p) {
+  _batch[_batchCount++] = p;
+  _out++;
+  if (_batchCount == A9G_TRACK_BATCH) {
+    if (_cb) _cb(_ctx, _batch, _batchCount);
+    _batchCount = 0;
+  }
+  _anchor = p;
+  _anchorStamp = millis();
+  _hasAnchor = true;
+  _hasLast = false;
+  _windowCount = 0;
+}
+
+/**
+ * @brief true if the window and the held fix all lie within the tolerance
+ *        of the segment anchor -> @p end. Flat-earth meters around the anchor.
+ */
+bool A9GTrack::_fits(const A9G_TrackPoint &end) const {
+  float scaleX = A9G_geoScaleX(_anchor.latE7);
+  float bx = (float)((int64_t)end.lonE7 - _anchor.lonE7) * scaleX;
+  float by = (float)((int64_t)end.latE7 - _anchor.latE7) * A9G_GEO_SCALE_Y;
+  float len2 = bx * bx + by * by;
+  float tol2 = (float)_tolerance * _tolerance;
+  for (uint8_t i = 0; i <= _windowCount; i++) {
+    const A9G_TrackPoint &q = i < _windowCount ? _window[i] : _last;
+    float px = (float)((int64_t)q.lonE7 - _anchor.lonE7) * scaleX;
+    float py = (float)((int64_t)q.latE7 - _anchor.latE7) * A9G_GEO_SCALE_Y;
+    // Closest point of the segment, not of the infinite line, so that
+    // turning back is not lost
+    float t = len2 > 0 ? (px * bx + py * by) / len2 : 0;
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+    float dx = px - t * bx;
+    float dy = py - t * by;
+    if (dx * dx + dy * dy > tol2) return false;
+  }
+  return true;
+}
+
+/* ------------------------------------------------------------------
+ *                   BATCH ENCODING
+ * ------------------------------------------------------------------ */
+
+static long secondsOfDay(uint32_t hhmmss) {
+  return (hhmmss / 10000) * 3600L + (hhmmss / 100 % 100) * 60L + hhmmss % 100;
+}
+
+size_t A9G_trackEncode(const A9G_TrackPoint *points, uint8_t count, char *buf, size_t cap) {
+  A9G_TextBuilder out(buf, cap);
+  for (uint8_t i = 0; i < count; i++) {
+    const A9G_TrackPoint &p = points[i];
+    if (!i) {
+      out.add((unsigned long)p.time).add(',').add((long)p.latE7).add(',').add((long)p.lonE7);
+      continue;
+    }
+    const A9G_TrackPoint &prev = points[i - 1];
+    long dt = (secondsOfDay(p.time) - secondsOfDay(prev.time) + 86400L) % 86400L;
+    out.add(';').add(dt)
+      .add(',').add((long)(p.latE7 - prev.latE7))
+      .add(',').add((long)(p.lonE7 - prev.lonE7));
+  }
+  return out.overflow() ? 0 : out.length();
+}
@@ -0,0 +1,131 @@
+#ifndef A9GTRACK_H
+#define A9GTRACK_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GTrack.h
+ *
+ * @brief Streaming track simplification of the GPS fixes (EV_GPS_FIX):
+ *        - opening-window simplification: a fix is only kept when dropping
+ *          it would move the reconstructed route by more than the tolerance
+ *        - bounded memory: the window holds A9G_TRACK_WINDOW points, a full
+ *          window (or setMaxInterval()) forces a key point
+ *        - key points are collected into batches of A9G_TRACK_BATCH and
+ *          handed to a callback, A9G_trackEncode() packs one for publishing
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GTrack CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_TRACK_WINDOW
+#if defined(__AVR__)
+#define A9G_TRACK_WINDOW 8           ///< Points checked against the candidate segment
+#else
+#define A9G_TRACK_WINDOW 32
+#endif
+#endif
+
+#ifndef A9G_TRACK_BATCH
+#if defined(__AVR__)
+#define A9G_TRACK_BATCH 8            ///< Key points per batch
+#else
+#define A9G_TRACK_BATCH 32
+#endif
+#endif
+
+#ifndef A9G_TRACK_TOLERANCE
+#define A9G_TRACK_TOLERANCE 15       ///< Default route error in meters
+#endif
+
+/**
+ * @brief One key point of the simplified track
+ */
+typedef struct A9G_TrackPoint {
+  int32_t latE7;
+  int32_t lonE7;
+  uint32_t time;       ///< UTC time of the fix as hhmmss
+} A9G_TrackPoint;
+
+/**
+ * @brief Receives a full batch (and the rest on flush()); the points are only
+ *        valid during the call
+ */
+typedef void (*A9G_TrackBatchCallback)(void *ctx, const A9G_TrackPoint *points, uint8_t count);
+
+/**
+ * @brief Pack points as text: "hhmmss,lat,lon" for the first point, then
+ *        ";dt,dlat,dlon" per point (seconds and 1e-7 degree differences).
+ * @return Length written (terminated), 0 if @p cap is too small
+ */
+size_t A9G_trackEncode(const A9G_TrackPoint *points, uint8_t count, char *buf, size_t cap);
+
+/**
+ * @class A9GTrack
+ * @brief Track simplifier; listens to the A9G's EV_GPS_FIX.
+ *
+ * Usage:
+ *   A9GTrack track(a9g, 10);                 // 10 m route error
+ *   track.onBatch(publishBatch, nullptr);    // A9G_trackEncode() + publishMQTT()
+ *   a9g.setGPSReport(1);
+ *   ...
+ *   track.flush();                           // end of trip
+ */
+class A9GTrack {
+public:
+  explicit A9GTrack(A9G &modem, uint16_t toleranceM = A9G_TRACK_TOLERANCE);
+  ~A9GTrack();
+
+  void setTolerance(uint16_t meters) { _tolerance = meters; }
+
+  /**
+     * @brief Emit a key point at least every @p seconds while fixes arrive (0 = off).
+     */
+  void setMaxInterval(uint16_t seconds) { _maxInterval = seconds; }
+
+  void onBatch(A9G_TrackBatchCallback cb, void *ctx = nullptr);
+
+  /**
+     * @brief Feed a fix; called automatically for EV_GPS_FIX. Invalid fixes are ignored.
+     */
+  void update(const A9G_GPSFix &fix);
+
+  /**
+     * @brief Emit the last position as a key point and deliver the open batch.
+     */
+  void flush();
+
+  /**
+     * @brief Start a new track, dropping the window and the open batch.
+     */
+  void reset();
+
+  uint32_t pointsIn() const { return _in; }
+  uint32_t pointsOut() const { return _out; }
+
+private:
+  A9G *_modem;
+  uint16_t _tolerance;
+  uint16_t _maxInterval;
+  A9G_TrackBatchCallback _cb;
+  void *_ctx;
+
+  A9G_TrackPoint _anchor;        ///< Last key point
+  unsigned long _anchorStamp;
+  A9G_TrackPoint _last;          ///< Newest fix, end of the candidate segment
+  bool _hasAnchor;
+  bool _hasLast;
+  A9G_TrackPoint _window[A9G_TRACK_WINDOW];  ///< Fixes between anchor and _last
+  uint8_t _windowCount;
+  A9G_TrackPoint _batch[A9G_TRACK_BATCH];
+  uint8_t _batchCount;
+  uint32_t _in;
+  uint32_t _out;
+
+  static void _onEvent(A9G_Event *evt, void *ctx);
+  void _emit(const A9G_TrackPoint &p);
+  bool _fits(const A9G_TrackPoint &end) const;
+};
+
+#endif  // A9GTRACK_H
@@ -0,0 +1,144 @@
+#include "A9GTtff.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GTtff IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9GTtff::A9GTtff(A9G &modem)
+  : _modem(&modem),
+    _save(nullptr),
+    _saveCtx(nullptr),
+    _hasLast(false),
+    _lastTimeKnown(false),
+    _lastAt(0),
+    _ephemerisAge(A9G_TTFF_EPHEMERIS_AGE),
+    _agpsEnabled(true),
+    _session(false),
+    _sessionStart(0),
+    _fixed(false),
+    _decide(false),
+    _dirty(false) {
+  memset(&_last, 0, sizeof(_last));
+  resetStats();
+  _modem->addEventHandler(_onEvent, this);
+}
+
+A9GTtff::~A9GTtff() {
+  _modem->removeEventHandler(_onEvent, this);
+}
+
+void A9GTtff::onSave(A9G_WarmSaveCallback cb, void *ctx) {
+  _save = cb;
+  _saveCtx = ctx;
+}
+
+void A9GTtff::restore(const A9G_GpsWarmState &state, uint32_t ageSec) {
+  _last = state;
+  _hasLast = true;
+  _dirty = false;
+  // Ages beyond the millis() range are as good as unknown
+  _lastTimeKnown = ageSec < 0xFFFFFFFFUL / 1000;
+  if (_lastTimeKnown) _lastAt = millis() - ageSec * 1000UL;
+}
+
+uint32_t A9GTtff::fixAge() const {
+  if (!_hasLast || !_lastTimeKnown) return A9G_TTFF_AGE_UNKNOWN;
+  return (millis() - _lastAt) / 1000UL;
+}
+
+bool A9GTtff::ephemerisStale() const {
+  return fixAge() >= _ephemerisAge;
+}
+
+unsigned long A9GTtff::acquiring() const {
+  if (!_session || _fixed || !_modem->gpsPowered()) return 0;
+  return millis() - _sessionStart;
+}
+
+void A9GTtff::resetStats() {
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+/**
+ * @brief A new power on with a stale ephemeris gets AT+AGPS=1, but only if
+ *        the network is attached; without GPRS the download would just fail
+ *        after its timeout.
+ */
+void A9GTtff::loop() {
+  _sync();
+  if (!_decide) return;
+  _decide = false;
+  if (!_agpsEnabled || !ephemerisStale()) return;
+  if (_modem->isGPRSAttached() && _modem->enableAGPS()) _stats.agps++;
+}
+
+size_t A9GTtff::snapshot(char *buf, size_t len) const {
+  A9G_TextBuilder out(buf, len);
+  out.add(GF("n=")).add((unsigned int)_stats.fixes)
+    .add(GF(" miss=")).add((unsigned int)_stats.misses)
+    .add(GF(" agps=")).add((unsigned int)_stats.agps)
+    .add(GF(" last=")).add((unsigned long)_stats.lastMs)
+    .add(GF(" min=")).add((unsigned long)_stats.minMs)
+    .add(GF(" avg=")).add((unsigned long)(_stats.fixes ? _stats.sumMs / _stats.fixes : 0))
+    .add(GF(" max=")).add((unsigned long)_stats.maxMs);
+  return out.overflow() ? 0 : out.length();
+}
+
+void A9GTtff::_onEvent(A9G_Event *evt, void *ctx) {
+  if (evt->id == EV_GPS_FIX && evt->fix) {
+    static_cast<A9GTtff *>(ctx)->_onFix(*evt->fix);
+  }
+}
+
+void A9GTtff::_onFix(const A9G_GPSFix &fix) {
+  if (!fix.valid) return;
+  _sync();
+  _last.latE7 = fix.latE7;
+  _last.lonE7 = fix.lonE7;
+  _last.date = fix.date;
+  _last.time = fix.time;
+  _hasLast = true;
+  _lastTimeKnown = true;
+  _lastAt = millis();
+  _dirty = true;
+  if (!_session || _fixed) return;
+
+  _fixed = true;
+  _decide = false;  // too late to help this one
+  uint32_t ms = _lastAt - _sessionStart;
+  if (!_stats.fixes || ms < _stats.minMs) _stats.minMs = ms;
+  if (ms > _stats.maxMs) _stats.maxMs = ms;
+  _stats.lastMs = ms;
+  _stats.sumMs += ms;
+  _stats.fixes++;
+  _saveState();
+}
+
+/**
+ * @brief Follow the modem's GPS power state: a new power-on time starts a
+ *        session, power off ends it.
+ */
+void A9GTtff::_sync() {
+  if (!_modem->gpsPowered()) {
+    if (_session) _endSession();
+    return;
+  }
+  if (_session && _sessionStart == _modem->gpsPoweredAt()) return;
+  if (_session) _endSession();
+  _session = true;
+  _sessionStart = _modem->gpsPoweredAt();
+  _fixed = false;
+  _decide = true;
+}
+
+void A9GTtff::_endSession() {
+  if (!_fixed) _stats.misses++;
+  _session = false;
+  _decide = false;
+  if (_dirty) _saveState();  // where the unit was when the GPS went off
+}
+
+void A9GTtff::_saveState() {
+  if (_save && _hasLast) _save(_saveCtx, _last);
+  _dirty = false;
+}
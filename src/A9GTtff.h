@@ -0,0 +1,155 @@
+#ifndef A9GTTFF_H
+#define A9GTTFF_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GTtff.h
+ *
+ * @brief Time-to-first-fix management:
+ *        - every GPS power on (enableGPS(), also from A9GGpsDuty) is timed
+ *          until its first valid fix
+ *        - AT+AGPS=1 only when GPRS is attached and the last fix is older
+ *          than the ephemeris lifetime, otherwise the receiver's own warm
+ *          state is used
+ *        - the last fix is handed to a save callback, and restore() brings
+ *          it back after a reset (with its age, if the sketch knows it)
+ *        - TTFF statistics as counters and a text snapshot
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GTtff CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_TTFF_EPHEMERIS_AGE
+#define A9G_TTFF_EPHEMERIS_AGE 7200UL  ///< Seconds after the last fix the ephemeris counts as stale
+#endif
+
+#ifndef A9G_TTFF_AGE_UNKNOWN
+#define A9G_TTFF_AGE_UNKNOWN 0xFFFFFFFFUL  ///< restore() age when the time since saving is not known
+#endif
+
+/**
+ * @brief What is kept across resets for a warm start
+ */
+typedef struct A9G_GpsWarmState {
+  int32_t latE7;
+  int32_t lonE7;
+  uint32_t date;       ///< UTC date of the fix as ddmmyy
+  uint32_t time;       ///< UTC time of the fix as hhmmss
+} A9G_GpsWarmState;
+
+/**
+ * @brief Called after the first fix of a power on and when the GPS goes off,
+ *        e.g. to write the state to EEPROM (at most twice per power cycle)
+ */
+typedef void (*A9G_WarmSaveCallback)(void *ctx, const A9G_GpsWarmState &state);
+
+/**
+ * @brief TTFF statistics
+ */
+typedef struct A9G_TtffStats {
+  uint16_t fixes;      ///< Power ons that reached a fix
+  uint16_t misses;     ///< Power ons that ended without one
+  uint16_t agps;       ///< AT+AGPS=1 downloads
+  uint32_t lastMs;
+  uint32_t minMs;
+  uint32_t maxMs;
+  uint32_t sumMs;
+} A9G_TtffStats;
+
+/**
+ * @class A9GTtff
+ * @brief Watches the GPS power state and EV_GPS_FIX of one A9G.
+ *
+ * Usage:
+ *   A9GTtff ttff(a9g);
+ *   ttff.onSave(saveToEeprom, nullptr);
+ *   if (loadFromEeprom(&state)) ttff.restore(state);
+ *   ...
+ *   ttff.loop();        // from loop(): decides about AGPS after a power on
+ */
+class A9GTtff {
+public:
+  explicit A9GTtff(A9G &modem);
+  ~A9GTtff();
+
+  /**
+     * @brief Start a power on that was not yet seen; AGPS is decided here,
+     *        since it waits for the download.
+     */
+  void loop();
+
+  void onSave(A9G_WarmSaveCallback cb, void *ctx = nullptr);
+
+  /**
+     * @param ageSec Seconds since @p state was saved, A9G_TTFF_AGE_UNKNOWN
+     *               if there is no clock (the ephemeris then counts as stale)
+     */
+  void restore(const A9G_GpsWarmState &state, uint32_t ageSec = A9G_TTFF_AGE_UNKNOWN);
+
+  /**
+     * @brief Last known position (this run or restored), e.g. as a
+     *        provisional location until the first fix.
+     */
+  bool hasLastFix() const { return _hasLast; }
+  const A9G_GpsWarmState &lastFix() const { return _last; }
+
+  /**
+     * @brief Seconds since the last fix, A9G_TTFF_AGE_UNKNOWN without one.
+     */
+  uint32_t fixAge() const;
+
+  /**
+     * @brief AGPS is worth it: no fix within A9G_TTFF_EPHEMERIS_AGE.
+     */
+  bool ephemerisStale() const;
+
+  void setEphemerisAge(uint32_t seconds) { _ephemerisAge = seconds; }
+
+  /**
+     * @brief Disable AGPS, e.g. on metered links.
+     */
+  void setAgps(bool enabled) { _agpsEnabled = enabled; }
+
+  /**
+     * @brief Milliseconds since the current power on while waiting for its
+     *        first fix, 0 otherwise.
+     */
+  unsigned long acquiring() const;
+
+  const A9G_TtffStats &stats() const { return _stats; }
+  void resetStats();
+
+  /**
+     * @brief "n=.. miss=.. agps=.. last=.. min=.. avg=.. max=.." (ms).
+     * @return Length written, 0 if the buffer was too small
+     */
+  size_t snapshot(char *buf, size_t len) const;
+
+private:
+  A9G *_modem;
+  A9G_WarmSaveCallback _save;
+  void *_saveCtx;
+  A9G_GpsWarmState _last;
+  bool _hasLast;
+  bool _lastTimeKnown;           ///< _lastAt is meaningful
+  unsigned long _lastAt;         ///< millis() of the last fix
+  uint32_t _ephemerisAge;
+  bool _agpsEnabled;
+
+  bool _session;                 ///< A power on is being followed
+  unsigned long _sessionStart;   ///< Its gpsPoweredAt()
+  bool _fixed;                   ///< ... and it reached a fix
+  bool _decide;                  ///< AGPS still to be decided for it
+  bool _dirty;                   ///< _last changed since the last save
+  A9G_TtffStats _stats;
+
+  static void _onEvent(A9G_Event *evt, void *ctx);
+  void _onFix(const A9G_GPSFix &fix);
+  void _sync();
+  void _endSession();
+  void _saveState();
+};
+
+#endif  // A9GTTFF_H
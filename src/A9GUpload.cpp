@@ -0,0 +1,170 @@
+#include "A9GUpload.h"
+
+/* ------------------------------------------------------------------
+ *                   A9GUploader IMPLEMENTATION
+ * ------------------------------------------------------------------ */
+
+A9GUploader::A9GUploader(A9G &modem)
+  : _modem(&modem),
+    _port(80),
+    _type("application/x-ndjson"),
+    _postLimit(A9G_HTTP_POST_MAX < A9G_UPLOAD_CHUNK ? A9G_HTTP_POST_MAX : A9G_UPLOAD_CHUNK),
+    _len(0) {
+  _host[0] = '\0';
+  _path[0] = '\0';
+}
+
+bool A9GUploader::setEndpoint(const char *host, uint16_t port, const char *path) {
+  size_t hostLen = strlen(host);
+  size_t pathLen = strlen(path);
+  if (hostLen >= sizeof(_host) || pathLen >= sizeof(_path)) return false;
+  memcpy(_host, host, hostLen + 1);
+  memcpy(_path, path, pathLen + 1);
+  _port = port;
+  return true;
+}
+
+void A9GUploader::setPostLimit(size_t bytes) {
+  if (bytes > A9G_HTTP_POST_MAX) bytes = A9G_HTTP_POST_MAX;
+  if (bytes > A9G_UPLOAD_CHUNK) bytes = A9G_UPLOAD_CHUNK;
+  _postLimit = bytes;
+}
+
+/**
+ * @brief Records are collected in the chunk buffer. If the whole backlog
+ *        fits there and under the post limit, and httpPost() can carry it
+ *        as it is, it goes out as AT+HTTPPOST; the first record that does
+ *        not fit starts the chunked request.
+ */
+A9G_UploadResult A9GUploader::upload(A9G_RecordReader reader, void *ctx, uint32_t count) {
+  A9G_UploadResult r = { false, -1, UPLOAD_NONE, 0, 0, 0 };
+  bool chunked = false;
+  _len = 0;
+  uint32_t i = 0;
+  while (i < count) {
+    // Records are separated by '\n', also across chunk boundaries
+    size_t sep = r.records > r.skipped ? 1 : 0;
+    size_t room = _len + sep < A9G_UPLOAD_CHUNK ? A9G_UPLOAD_CHUNK - _len - sep : 0;
+    size_t n = reader(ctx, i, _body() + _len + sep, room);
+    if (!n) break;
+    if (n > room) {
+      if (n + sep > A9G_UPLOAD_CHUNK) {
+        // Would not fit even an empty chunk
+        r.skipped++;
+        r.records++;
+        i++;
+        continue;
+      }
+      if (!chunked) {
+        chunked = _startChunked();
+        if (!chunked) return r;
+        r.mode = UPLOAD_CHUNKED;
+      }
+      r.bytes += _len;
+      if (!_sendChunk()) {
+        _modem->tcpClose();
+        r.records = 0;
+        return r;
+      }
+      _len = 0;
+      continue;  // same record again, into the empty chunk
+    }
+    if (sep) _body()[_len] = '\n';
+    _len += sep + n;
+    r.records++;
+    i++;
+  }
+
+  if (r.records == r.skipped) {
+    // Nothing to send; skipped records are still consumed
+    r.ok = true;
+    return r;
+  }
+  _body()[_len] = '\0';
+  // '"' and line breaks would need escapes inside AT+HTTPPOST (see httpPost())
+  if (!chunked && _len <= _postLimit && !strpbrk(_body(), "\"\r\n")) {
+    char url[16 + A9G_UPLOAD_HOST_MAX + A9G_UPLOAD_PATH_MAX];
+    A9G_TextBuilder u(url, sizeof(url));
+    u.add(GF("http://")).add(_host).add(':').add((unsigned int)_port).add(_path);
+    r.mode = UPLOAD_HTTPPOST;
+    r.bytes = _len;
+    r.status = _modem->httpPost(url, _type, _body());
+  } else {
+    if (!chunked) {
+      if (!_startChunked()) return r;
+      r.mode = UPLOAD_CHUNKED;
+    }
+    r.bytes += _len;
+    // Last data chunk, then the zero-length chunk that ends the body
+    bool sent = !_len || _sendChunk();
+    _len = 0;
+    sent = sent && _sendChunk();
+    if (sent) r.status = _readStatus();
+    _modem->tcpClose();
+  }
+  r.ok = r.status >= 200 && r.status < 300;
+  if (!r.ok) r.records = 0;
+  return r;
+}
+
+/**
+ * @brief Open the socket and send the request head.
+ */
+bool A9GUploader::_startChunked() {
+  if (_modem->tcpState() != TCP_CLOSED) return false;  // someone else uses the socket
+  if (!_modem->tcpConnect(_host, _port)) return false;
+  A9G_Cmd<160 + A9G_UPLOAD_HOST_MAX + A9G_UPLOAD_PATH_MAX> head;
+  head.add(GF("POST ")).add(_path).add(GF(" HTTP/1.1\r\nHost: ")).add(_host)
+    .add(GF("\r\nContent-Type: ")).add(_type)
+    .add(GF("\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"));
+  if (head.overflow() || !_modem->tcpSend(head.data(), head.length())) {
+    _modem->tcpClose();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Send the buffered body bytes as one chunk: <hex size> CR LF <data> CR LF.
+ *        The size line is written right in front of the data.
+ */
+bool A9GUploader::_sendChunk() {
+  static const char digits[] = "0123456789ABCDEF";
+  char *start = _body() - 2;
+  start[0] = '\r';
+  start[1] = '\n';
+  size_t v = _len;
+  do {
+    *--start = digits[v & 0x0F];
+    v >>= 4;
+  } while (v);
+  // With _len == 0 this is "0\r\n\r\n", the end of the body
+  char *end = _body() + _len;
+  end[0] = '\r';
+  end[1] = '\n';
+  return _modem->tcpSend((const uint8_t *)start, end + 2 - start);
+}
+
+/**
+ * @brief Wait for the status line of the response ("HTTP/1.1 200 OK").
+ * @return Status code, -1 on timeout or a closed socket without one
+ */
+int A9GUploader::_readStatus() {
+  char line[16];
+  uint8_t n = 0;
+  unsigned long start = millis();
+  while (millis() - start < A9G_HTTP_TIMEOUT) {
+    _modem->feedWatchdog();
+    _modem->pollModem();
+    int c;
+    while ((c = _modem->tcpRead()) >= 0) {
+      if (c == '\n') {
+        line[n] = '\0';
+        return !strncmp_P(line, PSTR("HTTP/1."), 7) && n > 9 ? atoi(line + 9) : -1;
+      }
+      if (n < sizeof(line) - 1) line[n++] = c;
+    }
+    if (!_modem->tcpConnected()) break;
+  }
+  return -1;
+}
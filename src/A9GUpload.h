@@ -0,0 +1,129 @@
+#ifndef A9GUPLOAD_H
+#define A9GUPLOAD_H
+
+#include "A9Gmod.h"
+
+/*!
+ * @file A9GUpload.h
+ *
+ * @brief Bulk upload of spooled records over HTTP:
+ *        - records are read one by one from a caller supplied reader and
+ *          joined with '\n' into one request body
+ *        - a backlog that fits A9G_HTTP_POST_MAX and holds no '"' or line
+ *          break (a single plain record) goes out as one AT+HTTPPOST,
+ *          anything else as a chunked POST on the TCP socket, one
+ *          AT+CIPSEND per chunk, so the body never has to fit in RAM
+ *        - the result tells how many records were consumed, so the caller
+ *          drops exactly those from its spool
+ */
+
+/* ------------------------------------------------------------------
+ *                      A9GUploader CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_UPLOAD_CHUNK
+#if defined(__AVR__)
+#define A9G_UPLOAD_CHUNK 128         ///< Body bytes per HTTP chunk (one AT+CIPSEND)
+#else
+#define A9G_UPLOAD_CHUNK 512
+#endif
+#endif
+
+#ifndef A9G_UPLOAD_HOST_MAX
+#define A9G_UPLOAD_HOST_MAX 48       ///< Host name capacity (incl. terminator)
+#endif
+
+#ifndef A9G_UPLOAD_PATH_MAX
+#define A9G_UPLOAD_PATH_MAX 48       ///< Path capacity (incl. terminator)
+#endif
+
+/**
+ * @brief Reads one spooled record.
+ * @param index 0-based position in the backlog
+ * @param buf   Where to write the record (no terminator needed)
+ * @param cap   Room in @p buf
+ * @return Length of the whole record, even if it is larger than @p cap
+ *         (it is then asked again with more room); 0 ends the backlog early
+ */
+typedef size_t (*A9G_RecordReader)(void *ctx, uint32_t index, char *buf, size_t cap);
+
+/**
+ * @brief How the body went out
+ */
+typedef enum A9G_UploadMode {
+  UPLOAD_NONE = 0,
+  UPLOAD_HTTPPOST,     ///< One AT+HTTPPOST, body inline
+  UPLOAD_CHUNKED       ///< POST with Transfer-Encoding: chunked over AT+CIPSEND
+} A9G_UploadMode;
+
+/**
+ * @brief Outcome of one upload()
+ */
+typedef struct A9G_UploadResult {
+  bool ok;             ///< 2xx status received
+  int status;          ///< HTTP status, -1 if none
+  uint8_t mode;        ///< A9G_UploadMode
+  uint32_t records;    ///< Records consumed: sent, or skipped because larger than a chunk
+  uint32_t skipped;
+  uint32_t bytes;      ///< Body bytes sent
+} A9G_UploadResult;
+
+/**
+ * @class A9GUploader
+ * @brief Sends a backlog of records in one HTTP request.
+ *
+ * Usage:
+ *   A9GUploader up(a9g);
+ *   up.setEndpoint("example.com", 80, "/ingest");
+ *   A9G_UploadResult r = up.upload(readSpool, &spool, spool.count());
+ *   if (r.ok) spool.drop(r.records);
+ *
+ * The chunked path uses the modem's only TCP socket; it fails while an
+ * A9GMqttClient holds it, the AT+HTTPPOST path still works then.
+ */
+class A9GUploader {
+public:
+  explicit A9GUploader(A9G &modem);
+
+  /**
+     * @brief Server of the POST requests. Host and path are copied.
+     * @return false if they do not fit A9G_UPLOAD_HOST_MAX / A9G_UPLOAD_PATH_MAX
+     */
+  bool setEndpoint(const char *host, uint16_t port, const char *path);
+
+  /**
+     * @brief Content-Type of the body (default "application/x-ndjson"). Not copied.
+     */
+  void setContentType(const char *type) { _type = type; }
+
+  /**
+     * @brief Largest body still sent with AT+HTTPPOST (clamped to
+     *        A9G_HTTP_POST_MAX); 0 always uses the chunked path. Bodies with
+     *        '"' or line breaks always use it as well.
+     */
+  void setPostLimit(size_t bytes);
+
+  /**
+     * @brief Upload records 0..count-1 (blocking).
+     */
+  A9G_UploadResult upload(A9G_RecordReader reader, void *ctx, uint32_t count);
+
+private:
+  A9G *_modem;
+  char _host[A9G_UPLOAD_HOST_MAX];
+  char _path[A9G_UPLOAD_PATH_MAX];
+  uint16_t _port;
+  const char *_type;
+  size_t _postLimit;
+
+  // Chunk being built: room for the size line in front and CR LF behind
+  char _buf[8 + A9G_UPLOAD_CHUNK + 3];
+  size_t _len;                   ///< Body bytes in the chunk
+
+  char *_body() { return _buf + 8; }
+  bool _startChunked();
+  bool _sendChunk();
+  int _readStatus();
+};
+
+#endif  // A9GUPLOAD_H
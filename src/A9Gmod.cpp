@@ -1,8 +1,6 @@
 #include "A9Gmod.h"
-
-#ifndef GF
-#define GF(x) (reinterpret_cast<const __FlashStringHelper *>(PSTR(x)))
-#endif
+#include "A9GLinkMonitor.h"
+#include "A9GMqtt.h"
 
 /* ------------------------------------------------------------------
  *                   A9G IMPLEMENTATION
@@ -11,10 +9,80 @@
 A9G::A9G(bool debugMode)
   : _modemStream(nullptr),
     _debugMode(debugMode),
-    _defaultWaitMS(60000),
+    _defaultWaitMS(A9G_DEFAULT_TIMEOUT),
+    _watchdog(nullptr),
+    _watchdogCtx(nullptr),
     _hasSMS(false),
     _smsIndex(0),
-    _onEventCallback(nullptr) {}
+    _lastCSQ(99),
+    _lastBER(99),
+    _regStatus(REG_UNKNOWN),
+    _gprsAttached(-1),
+    _rxTermFound(false),
+    _rxTermEnded(false),
+    _rxReadingData(false),
+    _rxTermLen(0),
+    _rxTermDataLen(0),
+    _rxTermDataLost(false),
+    _rxEventId(EV_NONE),
+    _rxLineLen(0),
+    _rxBodyEvent(EV_NONE),
+    _rxBodyLen(0),
+    _rxBodyNibble(-1),
+    _txHead(0),
+    _txCount(0),
+    _txAsync(false),
+    _awaitingResult(false),
+    _awaitBackground(false),
+    _lastResultOk(false),
+    _lastError(0),
+    _awaitStart(0),
+    _awaitTimeout(A9G_ASYNC_RESULT_TIMEOUT),
+    _timeoutStreak(0),
+    _asleep(false),
+    _queueHold(false),
+    _cmdCount(0),
+    _jobCb(nullptr),
+    _jobCtx(nullptr),
+    _jobError(0),
+    _claimed(false),
+    _claimPriority(PRIO_MAX),
+    _claimAt(0),
+    _smsHead(0),
+    _smsCount(0),
+    _smsNextId(1),
+    _smsState(SMS_IDLE),
+    _smsStateStart(0),
+    _smsRef(-1),
+    _smsTextMode(-1),
+    _smsHold(false),
+    _smsConcatRef(0),
+    _smsRxCallback(nullptr),
+    _smsRxCtx(nullptr),
+    _tcpState(TCP_CLOSED),
+    _tcpWaitPrompt(false),
+    _tcpPrompt(false),
+    _tcpWaitSend(false),
+    _tcpRxHead(0),
+    _tcpRxCount(0),
+    _tcpDropped(0),
+    _tcpRxStage(0),
+    _tcpRxLeft(0),
+    _httpStatus(-1),
+    _nmeaLen(0),
+    _nmeaOn(false),
+    _gpsOn(false),
+    _gpsOnAt(0),
+    _onEventCallback(nullptr) {
+  memset(_rxTerm, 0, sizeof(_rxTerm));
+  memset(_rxTermData, 0, sizeof(_rxTermData));
+  memset(&_gpsFix, 0, sizeof(_gpsFix));
+  memset(&_cmdStats, 0, sizeof(_cmdStats));
+  for (int i = 0; i < A9G_MAX_EVENT_HANDLERS; i++) {
+    _handlers[i] = nullptr;
+    _handlerCtx[i] = nullptr;
+  }
+}
 
 /**
  * @brief Initialize the A9G module by sending "AT" and waiting for "OK".
@@ -22,41 +90,69 @@ A9G::A9G(bool debugMode)
 bool A9G::init(Stream *serial) {
   _modemStream = serial;
   // Send basic "AT" check
-  _modemStream->println("AT");
+  _sendCommand(GF("AT"));
 
   // Wait a couple of seconds for the "OK" response
-  if (_waitForOkResponse(2000)) {
-    if (_debugMode) {
-      Serial.println("[A9G] A9G module responded OK!");
-    }
+  if (_waitForOkResponse(_defaultWaitMS)) {
+    A9G_TRACE_D(_debugMode, _trace, TR_MODEM_OK, 0, 0);
     return true;
   }
-  if (_debugMode) {
-    Serial.println("[A9G] A9G module not responding!");
-  }
+  A9G_TRACE_W(_trace, TR_MODEM_SILENT, 0, 0);
   return false;
 }
 
 /**
- * @brief Just an example test function that prints out data infinitely.
+ * @brief Just an example test function that prints out data for a while.
  */
-void A9G::testDebugCommand(char *data) {
+void A9G::testDebugCommand(const char *data, unsigned long duration) {
   if (!_modemStream) return;
-  _modemStream->println(data);
-  while (true) {
-    while (_modemStream->available()) {
+  _sendCommand(data);
+  unsigned long start = millis();
+  while (millis() - start < duration) {
+    feedWatchdog();
+    if (_modemStream->available()) {
       Serial.write(_modemStream->read());
     }
   }
 }
 
+void A9G::onWatchdog(A9G_WatchdogCallback cb, void *ctx) {
+  _watchdog = cb;
+  _watchdogCtx = ctx;
+}
+
 /**
  * @brief Continuously parse available data from the modem
  *        and trigger event callbacks if relevant data is found.
  */
 void A9G::pollModem() {
   if (!_modemStream) return;
+  _pumpTx();
   _internalModemParser();
+  _smsStep();
+  _cmdPump();
+}
+
+void A9G::setAsyncTx(bool enable) {
+  if (!enable) _flushTx();
+  _txAsync = enable;
+}
+
+bool A9G::isBusy() {
+  if (_awaitingResult && millis() - _awaitStart >= _awaitTimeout) {
+    if (_awaitBackground) {
+      _jobError = CMD_TIMEOUT;
+    } else {
+      _lastError = CMD_TIMEOUT;
+    }
+    A9G_TRACE_W(_trace, TR_CMD_TIMEOUT, 0, (int32_t)_awaitTimeout);
+    A9G_METRIC_ADD(_metrics, CNT_TIMEOUTS, 1);
+    A9G_METRIC_END(_metrics, true);
+    uint8_t streak = _timeoutStreak;  // _onResult() clears it for answers
+    _onResult(false);
+    _timeoutStreak = streak < 255 ? streak + 1 : streak;
+  }
+  return _awaitingResult || _smsState != SMS_IDLE;
 }
 
 /**
@@ -64,38 +160,42 @@ void A9G::pollModem() {
  */
 void A9G::readIMEI() {
   if (!_modemStream) return;
-  _modemStream->println("AT+EGMR=2,7");
-  _waitForOkResponse(1000);
+  _sendCommand(GF("AT+EGMR=2,7"));
+  _waitForOkResponse(_defaultWaitMS);
 }
 
 /**
  * @brief AT+CSQ to read signal quality
  */
- void A9G::readSignalQuality() {
+void A9G::readSignalQuality(unsigned long timeout) {
   if (!_modemStream) return;
-  _modemStream->println("AT+CSQ");
-  unsigned long start = millis();
-  String result;
-  while (millis() - start < 1000) {
-    while (_modemStream->available()) {
-      result += (char)_modemStream->read();
-    }
-  }
-  int csqValue = -1;
-  int index = result.indexOf("+CSQ: ");
-  if (index != -1) {
-    int commaIndex = result.indexOf(',', index);
-    if (commaIndex != -1) {
-      csqValue = result.substring(index + 6, commaIndex).toInt();
-    }
-  }
+  int csqValue = querySignalQuality(timeout);
   if (csqValue >= 0 && csqValue <= 31) {
-    int signalDbm = (2 * csqValue) - 113;
-    Serial.println("[A9G] SIGNAL: " + String(signalDbm) + " dBm");
+    A9G_TRACE_I(_trace, TR_SIGNAL, (2 * csqValue) - 113, csqValue);
   } else {
-    Serial.println("[A9G] SIGNAL:  NULL");
+    A9G_TRACE_I(_trace, TR_SIGNAL, 0, 99);
   }
-  while (_modemStream->available()){}
+}
+
+bool A9G::requestSignalQuality() {
+  if (!_modemStream) return false;
+  A9G_Cmd<10> cmd;
+  cmd.add(GF("AT+CSQ")).end();
+  return _submit(cmd, PRIO_LOW, 0, nullptr, nullptr, A9G_QUERY_TIMEOUT);
+}
+
+bool A9G::requestRegistration() {
+  if (!_modemStream) return false;
+  A9G_Cmd<12> cmd;
+  cmd.add(GF("AT+CREG?")).end();
+  return _submit(cmd, PRIO_LOW, 0, nullptr, nullptr, A9G_QUERY_TIMEOUT);
+}
+
+bool A9G::requestClock() {
+  if (!_modemStream) return false;
+  A9G_Cmd<12> cmd;
+  cmd.add(GF("AT+CCLK?")).end();
+  return _submit(cmd, PRIO_LOW, 0, nullptr, nullptr, A9G_QUERY_TIMEOUT);
 }
 
 /**
@@ -103,243 +203,438 @@ void A9G::readIMEI() {
  */
 void A9G::readCCID() {
   if (!_modemStream) return;
-  _modemStream->println("AT+CCID");
-  _waitForOkResponse(1000);
+  _sendCommand(GF("AT+CCID"));
+  _waitForOkResponse(_defaultWaitMS);
 }
 
 /**
- * @brief Wait for the "READY" message (blocking).
+ * @brief AT+CSQ without printing; stores and returns the RSSI index
  */
- bool A9G::waitForModemReady() {
+int A9G::querySignalQuality(unsigned long timeout) {
+  if (!_modemStream) return 99;
+  char response[64];
+  _sendCommand(GF("AT+CSQ"));
+  if (!_waitForOkResponse(timeout ? timeout : _defaultWaitMS, response, sizeof(response))) {
+    return _lastCSQ;
+  }
+  const char *p = strstr(response, "+CSQ:");
+  if (p) {
+    int csq = atoi(p + 5);
+    _lastCSQ = (csq >= 0 && csq <= 31) ? csq : 99;
+  }
+  return _lastCSQ;
+}
+
+/**
+ * @brief AT+CREG? -> "+CREG: <n>,<stat>"; registered means home or roaming
+ */
+bool A9G::isNetworkRegistered() {
   if (!_modemStream) return false;
-  char buffer[100];
-  int idx = 0;
-  memset(buffer, 0, sizeof(buffer));
-  _modemStream->println("AT");
-  while (true) {
-    if (_modemStream->available()) {
-      char c = _modemStream->read();
-      buffer[idx++] = c;
-      if (idx >= (int)sizeof(buffer) - 1) {
-        idx = 0;
-      }
-      buffer[idx] = '\0';
-      if (strstr(buffer, "READY") != nullptr) {
-        Serial.println("[A9G] READY");
-        return true;
-      }
-      if (strstr(buffer, "NO SIM CARD") != nullptr) {
-        if (_debugMode) {
-          Serial.println("[A9G] NO SIM CARD");
-        }
-      }
+  char response[64];
+  _sendCommand(GF("AT+CREG?"));
+  if (!_waitForOkResponse(_defaultWaitMS, response, sizeof(response))) {
+    return false;
+  }
+  const char *p = strstr(response, "+CREG:");
+  if (p) {
+    const char *comma = strchr(p, ',');
+    _regStatus = (A9G_RegStatus)atoi(comma ? comma + 1 : p + 6);
+  }
+  return _regStatus == REG_HOME || _regStatus == REG_ROAMING;
+}
+
+/**
+ * @brief Wait for the "READY" message (blocking, at most @p timeout ms).
+ */
+bool A9G::waitForModemReady(unsigned long timeout) {
+  if (!_modemStream) return false;
+  char tail[16];  // last characters received, enough for "NO SIM CARD"
+  uint8_t n = 0;
+  bool noSim = false;
+  tail[0] = '\0';
+  _sendCommand(GF("AT"));
+  unsigned long start = millis();
+  while (millis() - start < timeout) {
+    feedWatchdog();
+    if (!_modemStream->available()) continue;
+    char c = _modemStream->read();
+    A9G_METRIC_ADD(_metrics, CNT_BYTES_IN, 1);
+    if (n == sizeof(tail) - 1) {
+      memmove(tail, tail + 1, --n);
+    }
+    tail[n++] = c;
+    tail[n] = '\0';
+    if (strstr(tail, "READY") != nullptr) {
+      A9G_TRACE_I(_trace, TR_READY, 0, 0);
+      _lastError = 0;
+      return true;
+    }
+    if (!noSim && strstr(tail, "NO SIM CARD") != nullptr) {
+      noSim = true;
+      A9G_TRACE_W(_trace, TR_NO_SIM, 0, 0);
     }
   }
-  while (_modemStream->available()){}
+  _lastError = CMD_TIMEOUT;
+  A9G_TRACE_W(_trace, TR_CMD_TIMEOUT, 0, (int32_t)timeout);
   return false;
 }
 
+bool A9G::restartModem() {
+  if (!_modemStream) return false;
+  modemRestarted();
+  A9G_Cmd<12> cmd;
+  cmd.add(GF("AT+RST=1")).end();
+  // Nothing waits for its OK: the module may reboot before sending one
+  return _queueTx(cmd.data(), cmd.length());
+}
+
+void A9G::modemRestarted() {
+  if (_awaitingResult) {
+    // Reported like a timeout, through the owner of the command
+    if (_awaitBackground) {
+      _jobError = CMD_TIMEOUT;
+    } else {
+      _lastError = CMD_TIMEOUT;
+    }
+    _onResult(false);
+  }
+  _txHead = 0;
+  _txCount = 0;
+  _rxTermFound = false;
+  _rxBodyEvent = EV_NONE;
+  _tcpRxStage = 0;
+  _nmeaOn = false;
+  _smsTextMode = -1;
+  _tcpState = TCP_CLOSED;
+  _gpsOn = false;
+  _gprsAttached = -1;
+  _regStatus = REG_UNKNOWN;
+  _timeoutStreak = 0;
+  _asleep = false;
+}
+
+bool A9G::sleepModem(uint8_t mode) {
+  A9G_Cmd<16> cmd;
+  cmd.add(GF("AT+SLEEP=")).add((unsigned int)mode).end();
+  if (!_runParsed(cmd, _defaultWaitMS)) return false;
+  _asleep = true;
+  return true;
+}
+
+/**
+ * @brief A sleeping UART may take the first characters only as a wake-up,
+ *        so AT is repeated until it is answered (ERROR counts as awake).
+ */
+bool A9G::wakeModem() {
+  A9G_Cmd<8> probe;
+  probe.add(GF("AT")).end();
+  bool awake = false;
+  for (uint8_t i = 0; i < A9G_WAKE_PROBES && !awake; i++) {
+    awake = _runParsed(probe, A9G_WAKE_PROBE_TIMEOUT) || !timedOut();
+  }
+  if (!awake) return false;
+  A9G_Cmd<16> cmd;
+  cmd.add(GF("AT+SLEEP=0")).end();
+  if (!_runParsed(cmd, _defaultWaitMS)) return false;
+  _asleep = false;
+  return true;
+}
+
 /* ----------------------------------------------------
  *         GPRS & APN 
  * ---------------------------------------------------- */
 bool A9G::isGPRSAttached() {
-  if (!_modemStream) return false;
-  _modemStream->println("AT+CGATT?");
-  return _waitForOkResponse(2000);
+  A9G_Cmd<12> cmd;
+  cmd.add(GF("AT+CGATT?")).end();
+  _gprsAttached = -1;
+  return _runParsed(cmd, _defaultWaitMS) && _gprsAttached == 1;
 }
 
 bool A9G::attachGPRS(const char* apn, const char* user, const char* pwd) {
   if (!_modemStream) return false;
-  _modemStream->println("AT+CGATT=1");
-  _modemStream->print("+CGDCONT=1,\"IP\",\"");
-  _modemStream->print(apn);
-  _modemStream->println("\"");
   if (!user) user = "";
   if (!pwd)  pwd  = "";
-  _modemStream->print("+CSTT=\"");
-  _modemStream->print(apn);
-  _modemStream->print("\",\"");
-  _modemStream->print(user);
-  _modemStream->print("\",\"");
-  _modemStream->print(pwd);
-  _modemStream->println("\"");
-  _modemStream->println("+CGACT=1,1");
-  _modemStream->println("+CIPMUX=1");
-  return _waitForOkResponse(2000);
+  // One command per line, each must be answered OK before the next goes out
+  _sendCommand(GF("AT+CGATT=1"));
+  if (!_waitForOkResponse(_defaultWaitMS)) return false;
+  if (!setAPN("IP", apn)) return false;
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(GF("AT+CSTT=")).addQuoted(apn).add(',').addQuoted(user).add(',').addQuoted(pwd).end();
+  if (!_writeCommand(cmd) || !_waitForOkResponse(_defaultWaitMS)) return false;
+  if (!activatePDP()) return false;
+  _sendCommand(GF("AT+CIPMUX=1"));
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 bool A9G::detachGPRS() {
   if (!_modemStream) return false;
-  _modemStream->println("AT+CGATT=0");
-  return _waitForOkResponse(2000);
+  _sendCommand(GF("AT+CGATT=0"));
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 bool A9G::setAPN(const char *pdpType, const char *apn) {
   if (!_modemStream) return false;
-  _modemStream->print("AT+CGDCONT=1,\"");
-  _modemStream->print(pdpType);
-  _modemStream->print("\",\"");
-  _modemStream->print(apn);
-  _modemStream->println("\"");
-  return _waitForOkResponse(2000);
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(GF("AT+CGDCONT=1,")).addQuoted(pdpType).add(',').addQuoted(apn).end();
+  if (!_writeCommand(cmd)) return false;
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 bool A9G::activatePDP() {
   if (!_modemStream) return false;
-  _modemStream->println("AT+CGACT=1,1");
-  return _waitForOkResponse(2000);
+  _sendCommand(GF("AT+CGACT=1,1"));
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 bool A9G::deactivatePDP() {
   // Placeholder if desired:
-  // _modemStream->println("AT+CGACT=0,1");
-  // return _waitForOkResponse(2000);
+  // _sendCommand("AT+CGACT=0,1");
+  // return _waitForOkResponse(_defaultWaitMS);
   return false;
 }
 
 /* ----------------------------------------------------
  *         GPS 
  * ---------------------------------------------------- */
+/**
+ * @brief GPS power goes through the parser, so NMEA reports and URCs that
+ *        arrive meanwhile are still decoded instead of being swallowed.
+ */
 bool A9G::enableGPS() {
-  if (!_modemStream) return false;
-  _modemStream->println("AT+GPS=1");
-  return _waitForOkResponse(2000);
+  A9G_Cmd<12> cmd;
+  cmd.add(GF("AT+GPS=1")).end();
+  if (!_runParsed(cmd, _defaultWaitMS)) return false;
+  _gpsPowerOn();
+  return true;
 }
 
 bool A9G::disableGPS() {
-  if (!_modemStream) return false;
-  _modemStream->println("AT+GPS=0");
-  return _waitForOkResponse(2000);
+  A9G_Cmd<12> cmd;
+  cmd.add(GF("AT+GPS=0")).end();
+  if (!_runParsed(cmd, _defaultWaitMS)) return false;
+  _gpsOn = false;
+  return true;
 }
 
 bool A9G::enableAGPS() {
-  if (!_modemStream) return false;
-  _modemStream->println("AT+AGPS=1");
-  return _waitForOkResponse(2000);
+  A9G_Cmd<12> cmd;
+  cmd.add(GF("AT+AGPS=1")).end();
+  if (!_runParsed(cmd, A9G_AGPS_TIMEOUT)) return false;
+  _gpsPowerOn();
+  return true;
+}
+
+/**
+ * @brief Note a power on; an already running receiver keeps its start time.
+ */
+void A9G::_gpsPowerOn() {
+  if (_gpsOn) return;
+  _gpsOn = true;
+  _gpsOnAt = millis();
+}
+
+bool A9G::setGPSReport(uint8_t seconds) {
+  A9G_Cmd<16> cmd;
+  cmd.add(GF("AT+GPSRD=")).add((unsigned int)seconds).end();
+  return _runParsed(cmd, _defaultWaitMS);
+}
+
+/**
+ * @brief Decode one NMEA sentence into _gpsFix; an RMC completes the report
+ *        and is dispatched as EV_GPS_FIX.
+ */
+void A9G::_gpsSentence(const char *sentence, A9G_Event *evt) {
+  A9G_NmeaSentence kind = A9G_nmeaParse(sentence, &_gpsFix);
+  if (kind == NMEA_NONE) {
+    A9G_METRIC_ADD(_metrics, CNT_PARSE_ERRORS, 1);
+    return;
+  }
+  if (kind != NMEA_RMC) return;
+  evt->id = EV_GPS_FIX;
+  evt->fix = &_gpsFix;
+  _dispatchEvent(evt);
 }
 
 /**
  * @brief Sends AT+GPSRD=1, then collects whatever GPS NMEA data arrives 
- *        for ~1 second. Returns that raw data to the caller.
+ *        for ~1 second into the caller's buffer.
  */
-String A9G::getGPS() {
-  if (!_modemStream) return "";
+size_t A9G::getGPS(char *buf, size_t len, unsigned long window) {
+  if (buf && len) buf[0] = '\0';
+  if (!_modemStream || !buf || !len) return 0;
 
   // Start GPS data output:
-  _modemStream->println("AT+GPSRD=1");
+  _sendCommand(GF("AT+GPSRD=1"));
   _waitForOkResponse(500);
 
-  // Read for ~1 second
+  // Read for the window; what does not fit is still consumed
   unsigned long start = millis();
-  String result;
-  while (millis() - start < 1000) {
-    while (_modemStream->available()) {
-      result += (char)_modemStream->read();
-    }
+  size_t n = 0;
+  bool lost = false;
+  while (millis() - start < window) {
+    feedWatchdog();
+    if (!_modemStream->available()) continue;
+    char c = _modemStream->read();
+    A9G_METRIC_ADD(_metrics, CNT_BYTES_IN, 1);
+    if (n < len - 1) buf[n++] = c;
+    else lost = true;
   }
-  return result;
+  buf[n] = '\0';
+  if (lost) A9G_METRIC_ADD(_metrics, CNT_TRUNCATED, 1);
+  (void)lost;
+  return n;
 }
 
+#if A9G_STRING_API
+String A9G::getGPS() {
+  char buf[A9G_GPS_TEXT_MAX];
+  getGPS(buf, sizeof(buf));
+  return String(buf);
+}
+#endif
+
 /* ----------------------------------------------------
  *         MQTT 
  * ---------------------------------------------------- */
+/**
+ * @brief AT+MQTTCONN=<broker>,<port>,<id>,<keepalive>,<clean>,<user>,<pass>
+ */
+static void buildConnect(A9G_CmdBuilder &cmd, const char *broker, int port,
+                         const char *user, const char *pass, const char *clientID,
+                         uint8_t keepAlive, uint16_t cleanSession) {
+  cmd.add(GF("AT+MQTTCONN=")).addQuoted(broker).add(',').add(port).add(',')
+    .addQuoted(clientID).add(',').add(keepAlive).add(',').add(cleanSession).add(',')
+    .addQuoted(user ? user : "").add(',').addQuoted(pass ? pass : "").end();
+}
+
 bool A9G::connectBroker(const char *broker, int port,
                         const char *user, const char *pass,
                         const char *clientID, uint8_t keepAlive,
                         uint16_t cleanSession) {
   if (!_modemStream) return false;
-  _modemStream->print("AT+MQTTCONN=\"");
-  _modemStream->print(broker);
-  _modemStream->print("\",");
-  _modemStream->print(port);
-  _modemStream->print(",\"");
-  _modemStream->print(clientID);
-  _modemStream->print("\",");
-  _modemStream->print(keepAlive);
-  _modemStream->print(",");
-  _modemStream->print(cleanSession);
-  _modemStream->print(",\"");
-  _modemStream->print(user);
-  _modemStream->print("\",\"");
-  _modemStream->print(pass);
-  _modemStream->println("\"");
-  return _waitForOkResponse(2000);
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  buildConnect(cmd, broker, port, user, pass, clientID, keepAlive, cleanSession);
+  if (!_writeCommand(cmd)) return false;
+  return _waitForOkResponse(_defaultWaitMS);
+}
+
+bool A9G::connectBrokerNonBlocking(const char *broker, int port,
+                                   const char *user, const char *pass,
+                                   const char *clientID, uint8_t keepAlive,
+                                   uint16_t cleanSession) {
+  if (!_modemStream || !_channelFree(PRIO_NORMAL)) return false;
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  buildConnect(cmd, broker, port, user, pass, clientID, keepAlive, cleanSession);
+  return _sendClaimed(cmd, _defaultWaitMS);
 }
 
 bool A9G::connectBroker(const char *broker, int port,
                         const char *clientID,
                         uint8_t keepAlive, uint16_t cleanSession) {
   if (!_modemStream) return false;
-  _modemStream->print("AT+MQTTCONN=\"");
-  _modemStream->print(broker);
-  _modemStream->print("\",");
-  _modemStream->print(port);
-  _modemStream->print(",\"");
-  _modemStream->print(clientID);
-  _modemStream->print("\",");
-  _modemStream->print(keepAlive);
-  _modemStream->print(",");
-  _modemStream->println(cleanSession);
-  return _waitForOkResponse(2000);
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(GF("AT+MQTTCONN=")).addQuoted(broker).add(',').add(port).add(',')
+    .addQuoted(clientID).add(',').add(keepAlive).add(',').add(cleanSession).end();
+  if (!_writeCommand(cmd)) return false;
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 bool A9G::connectBroker(const char *broker, int port) {
   if (!_modemStream) return false;
-  char tempID[10] = { 0 };
-  sprintf(tempID, "%ld", random(10000, 99999));
-  _modemStream->print("AT+MQTTCONN=\"");
-  _modemStream->print(broker);
-  _modemStream->print("\",");
-  _modemStream->print(port);
-  _modemStream->print(",\"");
-  _modemStream->print(tempID);
-  _modemStream->print("\",120,0");
-  _modemStream->println();
-  return _waitForOkResponse(2000);
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(GF("AT+MQTTCONN=")).addQuoted(broker).add(',').add(port).add(GF(",\""))
+    .add(random(10000, 99999)).add(GF("\",120,0")).end();
+  if (!_writeCommand(cmd)) return false;
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 bool A9G::disconnectBroker() {
   if (!_modemStream) return false;
-  _modemStream->println("AT+MQTTDISCONN");
-  return _waitForOkResponse(2000);
+  _sendCommand(GF("AT+MQTTDISCONN"));
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 bool A9G::subscribeTopic(const char *topic, uint8_t qos, unsigned long timeout) {
   if (!_modemStream) return false;
-  _modemStream->print("AT+MQTTSUB=\"");
-  _modemStream->print(topic);
-  _modemStream->print("\",");
-  _modemStream->print(qos);
-  _modemStream->print(",");
-  _modemStream->println(timeout);
-  return _waitForOkResponse(2000);
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(GF("AT+MQTTSUB=")).addQuoted(topic).add(',').add(qos).add(',').add(timeout).end();
+  if (!_writeCommand(cmd)) return false;
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 bool A9G::subscribeTopic(const char *topic) {
   if (!_modemStream) return false;
-  _modemStream->print("AT+MQTTSUB=\"");
-  _modemStream->print(topic);
-  _modemStream->print("\",1,0");
-  _modemStream->println();
-  return _waitForOkResponse(2000);
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(GF("AT+MQTTSUB=")).addQuoted(topic).add(GF(",1,0")).end();
+  if (!_writeCommand(cmd)) return false;
+  return _waitForOkResponse(_defaultWaitMS);
+}
+
+bool A9G::subscribeTopicNonBlocking(const char *topic) {
+  if (!_modemStream || !_channelFree(PRIO_NORMAL)) return false;
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(GF("AT+MQTTSUB=")).addQuoted(topic).add(GF(",1,0")).end();
+  return _sendClaimed(cmd, _defaultWaitMS);
 }
 
 bool A9G::unsubscribeTopic(const char *topic) {
   if (!_modemStream) return false;
-  _modemStream->print("AT+MQTTUNSUB=\"");
-  _modemStream->print(topic);
-  _modemStream->println("\"");
-  return _waitForOkResponse(2000);
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(GF("AT+MQTTUNSUB=")).addQuoted(topic).end();
+  if (!_writeCommand(cmd)) return false;
+  return _waitForOkResponse(_defaultWaitMS);
+}
+
+/**
+ * @brief AT+MQTTPUB=<topic>,<msg>,<qos>,<dup>,<retain>
+ */
+static void buildPublish(A9G_CmdBuilder &cmd, const char *topic, const char *msg,
+                         uint8_t qos, bool retain) {
+  if (qos > 2) qos = 2;
+  cmd.add(GF("AT+MQTTPUB=")).addQuoted(topic).add(',').addQuoted(msg).add(',')
+    .add((char)('0' + qos)).add(GF(",0,")).add(retain ? '1' : '0').end();
+}
+
+bool A9G::publishTopicNonBlocking(const char *topic, const char *msg, uint8_t qos, bool retain,
+                                  A9G_Priority priority) {
+  if (!_modemStream || !_channelFree(priority)) return false;
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  buildPublish(cmd, topic, msg, qos, retain);
+  return _sendClaimed(cmd, A9G_ASYNC_RESULT_TIMEOUT);
+}
+
+/**
+ * @brief Whether a foreground command of class @p priority may go out now.
+ *        If not, it is next in line once the channel is free, unless a
+ *        queued command aged past it.
+ */
+bool A9G::_channelFree(A9G_Priority priority) {
+  long rank;
+  if (isBusy() || (_cmdBest(millis(), &rank) >= 0 && rank < (long)priority * (long)A9G_CMD_AGING)) {
+    claimChannel(priority);
+    A9G_METRIC_ADD(_metrics, CNT_BACKPRESSURE, 1);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief _sendAsync() for a caller that passed _channelFree(): the claim is
+ *        spent once its own command is out. Other foreground steps (the SMS
+ *        pipeline, blocking calls) leave it standing.
+ */
+bool A9G::_sendClaimed(const A9G_CmdBuilder &cmd, unsigned long timeout) {
+  if (!_sendAsync(cmd, timeout)) return false;
+  _claimed = false;
+  return true;
 }
 
-bool A9G::publishTopic(const char *topic, const char *msg) {
+bool A9G::publishTopic(const char *topic, const char *msg, uint8_t qos, bool retain) {
   if (!_modemStream) return false;
-  _modemStream->print("AT+MQTTPUB=\"");
-  _modemStream->print(topic);
-  _modemStream->print("\",\"");
-  _modemStream->print(msg);
-  _modemStream->println("\",2,0,0");
-  return _waitForOkResponse(2000);
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  buildPublish(cmd, topic, msg, qos, retain);
+  if (!_writeCommand(cmd)) return false;
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 /* ----------------------------------------------------
@@ -347,82 +642,119 @@ bool A9G::publishTopic(const char *topic, const char *msg) {
  * ---------------------------------------------------- */
 bool A9G::activateTextMode() {
   if (!_modemStream) return false;
-  _modemStream->println("AT+CNMI=0,1,0,0,0");
-  return _waitForOkResponse(2000);
+  _sendCommand(GF("AT+CNMI=0,1,0,0,0"));
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 bool A9G::setSMSFormatReading(bool mode) {
   if (!_modemStream) return false;
-  _modemStream->print("AT+CMGF=");
-  _modemStream->println(mode ? 1 : 0);
-  return _waitForOkResponse(2000);
+  _sendCommand(mode ? GF("AT+CMGF=1") : GF("AT+CMGF=0"));
+  _smsTextMode = mode ? 1 : 0;
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 bool A9G::setMessageStorage() {
   if (!_modemStream) return false;
-  _modemStream->println("AT+CPMS=\"ME\",\"ME\",\"ME\"");
-  return _waitForOkResponse(2000);
+  _sendCommand(GF("AT+CPMS=\"ME\",\"ME\",\"ME\""));
+  return _waitForOkResponse(_defaultWaitMS);
 }
 
 void A9G::checkMessageStorage() {
   if (!_modemStream) return;
-  _modemStream->println("AT+CPBS?");
+  _sendCommand(GF("AT+CPBS?"));
 }
 
 void A9G::readSMS(uint8_t index) {
   if (!_modemStream) return;
-  _modemStream->print("AT+CMGR=");
-  _modemStream->println(index);
+  A9G_Cmd<16> cmd;
+  cmd.add(GF("AT+CMGR=")).add(index).end();
+  _writeCommand(cmd);
 }
 
-void A9G::deleteSMS(uint8_t index, A9G_MessageType type) {
-  if (!_modemStream) return;
-  _modemStream->print("AT+CMGD=");
-  _modemStream->print(index);
-  _modemStream->print(",");
-  _modemStream->println(type);
+bool A9G::deleteSMS(uint8_t index, A9G_MessageType type) {
+  A9G_Cmd<16> cmd;
+  cmd.add(GF("AT+CMGD=")).add(index).add(',').add((int)type).end();
+  return _runParsed(cmd, 5000);
+}
+
+bool A9G::deleteSMS(uint8_t index) {
+  A9G_Cmd<16> cmd;
+  cmd.add(GF("AT+CMGD=")).add(index).end();
+  return _runParsed(cmd, 5000);
 }
 
+bool A9G::listSMS(bool unreadOnly) {
+  A9G_Cmd<24> cmd;
+  cmd.add(GF("AT+CMGL="));
+  if (_smsTextMode == 0) {
+    cmd.add(unreadOnly ? '0' : '4');
+  } else {
+    cmd.add(unreadOnly ? GF("\"REC UNREAD\"") : GF("\"ALL\""));
+  }
+  cmd.end();
+  _hasSMS = false;
+  return _runParsed(cmd, 20000);
+}
+
+/**
+ * @brief Blocking wrapper around the send pipeline. The pipeline cannot
+ *        advance inside another blocking wait (_smsHold), so that is refused;
+ *        a holdQueues() hold is lifted for the call.
+ */
 bool A9G::sendSMS(const char *number, const char *message) {
-  if (!_modemStream) return false;
-  _modemStream->println("AT+CMGF=1");
-  delay(100);
-  _modemStream->print("AT+CMGS=\"");
-  _modemStream->print(number);
-  _modemStream->print("\"\r\n");
-  delay(100);
-  _modemStream->print(message);
-  _modemStream->write(0x1A);  // Ctrl+Z
-  delay(100);
-  _modemStream->println("AT");
-  return _waitForOkResponse(2000);
+  if (!_modemStream || _smsHold) return false;
+  struct Result {
+    bool done;
+    bool ok;
+    static void onDone(uint8_t, bool ok, int, int, void *ctx) {
+      Result *r = static_cast<Result *>(ctx);
+      r->done = true;
+      r->ok = ok;
+    }
+  } result = { false, false };
+
+  uint8_t id = queueSMS(number, message, Result::onDone, &result);
+  if (!id) return false;
+  bool held = _queueHold;
+  _queueHold = false;
+  unsigned long start = millis();
+  while (!result.done && millis() - start < A9G_SMS_SEND_TIMEOUT) {
+    feedWatchdog();
+    pollModem();
+  }
+  _queueHold = held;
+  if (!result.done) {
+    // Still queued or in flight: its callback must not reach this frame
+    for (uint8_t i = 0; i < _smsCount; i++) {
+      SMSJob &job = _smsQueue[(_smsHead + i) % A9G_SMS_QUEUE_LEN];
+      if (job.id == id) job.cb = nullptr;
+    }
+    _lastError = CMD_TIMEOUT;
+  }
+  return result.ok;
 }
 
 void A9G::sendSMSNonBlocking(const char *number, const char *message) {
-  if (!_modemStream) return;
-  _modemStream->print("AT+CMGS=\"");
-  _modemStream->print(number);
-  _modemStream->print("\"\r\n");
-  delay(100);
-  _modemStream->print(message);
-  _modemStream->write((char)26);  // Ctrl+Z
-  delay(100);
-  _modemStream->println("AT");
+  queueSMS(number, message);
+}
+
+void A9G::onSMSReceived(A9G_SMSReceivedCallback cb, void *ctx) {
+  _smsRxCallback = cb;
+  _smsRxCtx = ctx;
 }
 
 /* ----------------------------------------------------
  *         ERROR PRINTS 
+ *   Recorded in the trace ring; drain() prints them.
  * ---------------------------------------------------- */
 void A9G::printCMEError(int err) {
-  // Just an example printing of known codes:
-  Serial.print("CME Error code: ");
-  Serial.println(err);
+  A9G_TRACE_E(_trace, TR_CME_ERROR, err, 0);
+  (void)err;
 }
 
 void A9G::printCMSError(int err) {
-  // Just an example printing of known codes:
-  Serial.print("CMS Error code: ");
-  Serial.println(err);
+  A9G_TRACE_E(_trace, TR_CMS_ERROR, err, 0);
+  (void)err;
 }
 
 /**
@@ -432,45 +764,257 @@ void A9G::setEventCallback(void (*cb)(A9G_Event *)) {
   _onEventCallback = cb;
 }
 
+bool A9G::addEventHandler(A9G_EventHandler handler, void *ctx) {
+  for (int i = 0; i < A9G_MAX_EVENT_HANDLERS; i++) {
+    if (!_handlers[i]) {
+      _handlers[i] = handler;
+      _handlerCtx[i] = ctx;
+      return true;
+    }
+  }
+  return false;
+}
+
+void A9G::removeEventHandler(A9G_EventHandler handler, void *ctx) {
+  for (int i = 0; i < A9G_MAX_EVENT_HANDLERS; i++) {
+    if (_handlers[i] == handler && _handlerCtx[i] == ctx) {
+      _handlers[i] = nullptr;
+      _handlerCtx[i] = nullptr;
+    }
+  }
+}
+
 /* ------------------------------------------------------------------
  *   INTERNAL PARSING HELPERS
  * ------------------------------------------------------------------ */
 
 /**
- * @brief Waits up to 'timeout' ms for the substring "OK" from the modem.
- * @return true if found "OK", false otherwise
+ * @brief Send a complete command line with a single write().
+ * @return false if the builder overflowed (nothing is sent then)
+ */
+bool A9G::_writeCommand(const A9G_CmdBuilder &cmd) {
+  if (!_modemStream) return false;
+  if (cmd.overflow()) {
+    A9G_METRIC_ADD(_metrics, CNT_TRUNCATED, 1);
+    return false;
+  }
+  // A blocking command must neither consume the OK of a command in flight
+  // nor end up inside an SMS body
+  if (isBusy()) _waitIdle();
+  A9G_METRIC_BEGIN(_metrics, cmd.c_str(), cmd.length());
+  return _queueTx(cmd.data(), cmd.length());
+}
+
+/**
+ * @brief Start a non-blocking command; its OK/ERROR completes it later.
+ * @return false if another command is in flight or the TX queue is too full
+ */
+bool A9G::_sendAsync(const A9G_CmdBuilder &cmd, unsigned long timeout, bool background) {
+  if (!_modemStream || cmd.overflow()) return false;
+  if (_awaitingResult || (_txAsync && cmd.length() > txFree())) {
+    A9G_METRIC_ADD(_metrics, CNT_BACKPRESSURE, 1);
+    return false;
+  }
+  A9G_METRIC_BEGIN(_metrics, cmd.c_str(), cmd.length());
+  if (!_queueTx(cmd.data(), cmd.length())) return false;
+  _awaitingResult = true;
+  _awaitBackground = background;
+  _awaitStart = millis();
+  _awaitTimeout = timeout;
+  return true;
+}
+
+/**
+ * @brief Hand bytes to the modem. In async TX mode they are queued (all or
+ *        nothing) and trickled out by _pumpTx(); otherwise written directly.
+ * @return false if the queue cannot take all bytes
+ */
+bool A9G::_queueTx(const uint8_t *data, size_t len) {
+  if (!_txAsync) {
+    _flushTx();
+    _modemStream->write(data, len);
+    A9G_METRIC_ADD(_metrics, CNT_BYTES_OUT, len);
+    return true;
+  }
+  if (len > A9G_TX_QUEUE_SIZE) {
+    // Can never fit: fall back to a direct (blocking) write
+    _flushTx();
+    _modemStream->write(data, len);
+    A9G_METRIC_ADD(_metrics, CNT_BYTES_OUT, len);
+    return true;
+  }
+  if (len > txFree()) {
+    A9G_METRIC_ADD(_metrics, CNT_BACKPRESSURE, 1);
+    return false;
+  }
+  size_t tail = (_txHead + _txCount) % A9G_TX_QUEUE_SIZE;
+  for (size_t i = 0; i < len; i++) {
+    _txBuf[tail] = data[i];
+    tail = (tail + 1) % A9G_TX_QUEUE_SIZE;
+  }
+  _txCount += len;
+  A9G_METRIC_ADD(_metrics, CNT_BYTES_OUT, len);
+  _pumpTx();
+  return true;
+}
+
+/**
+ * @brief Write only as many queued bytes as the UART can take right now.
+ */
+void A9G::_pumpTx() {
+  if (!_txCount || !_modemStream) return;
+  int room = _modemStream->availableForWrite();
+  while (room > 0 && _txCount) {
+    size_t chunk = A9G_TX_QUEUE_SIZE - _txHead;  // contiguous part
+    if (chunk > _txCount) chunk = _txCount;
+    if (chunk > (size_t)room) chunk = room;
+    size_t written = _modemStream->write(_txBuf + _txHead, chunk);
+    if (!written) break;
+    _txHead = (_txHead + written) % A9G_TX_QUEUE_SIZE;
+    _txCount -= written;
+    room -= written;
+  }
+  if (!_txCount) _txHead = 0;
+}
+
+/**
+ * @brief Push out everything still queued, blocking if necessary.
+ */
+void A9G::_flushTx() {
+  while (_txCount && _modemStream) {
+    feedWatchdog();
+    size_t chunk = A9G_TX_QUEUE_SIZE - _txHead;
+    if (chunk > _txCount) chunk = _txCount;
+    _modemStream->write(_txBuf + _txHead, chunk);
+    _txHead = (_txHead + chunk) % A9G_TX_QUEUE_SIZE;
+    _txCount -= chunk;
+  }
+  _txHead = 0;
+}
+
+/**
+ * @brief Blocking command whose response lines go through the parser, so
+ *        the events they carry are dispatched while waiting for OK.
+ */
+bool A9G::_runParsed(const A9G_CmdBuilder &cmd, unsigned long timeout) {
+  if (!_modemStream) return false;
+  if (isBusy()) _waitIdle();
+  _flushTx();
+  _smsHold = true;
+  bool sent = _sendAsync(cmd, timeout);
+  while (sent && isBusy()) {
+    feedWatchdog();
+    pollModem();
+  }
+  _smsHold = false;
+  return sent && _lastResultOk;
+}
+
+/**
+ * @brief Keep pumping until the command or SMS step in flight has its result.
+ */
+void A9G::_waitIdle() {
+  // Each async step has its own timeout (applied by isBusy()), so this ends.
+  // Queued SMS are not started meanwhile, the blocking caller goes first.
+  _smsHold = true;
+  while (isBusy()) {
+    feedWatchdog();
+    pollModem();
+  }
+  _smsHold = false;
+}
+
+/**
+ * @brief Final result (OK / ERROR / +CME / +CMS) of a non-blocking command.
+ */
+void A9G::_onResult(bool ok) {
+  if (!_awaitingResult) return;
+  _awaitingResult = false;
+  _timeoutStreak = 0;
+  if (_awaitBackground) {
+    _awaitBackground = false;
+    A9G_CommandCallback cb = _jobCb;
+    _jobCb = nullptr;
+    if (cb) cb(ok, ok ? 0 : _jobError, _jobCtx);
+    return;
+  }
+  _lastResultOk = ok;
+  if (ok) _lastError = 0;
+  if (_smsState != SMS_IDLE) {
+    _smsOnResult(ok);
+  }
+}
+
+/**
+ * @brief Send a fixed command, appending CR LF.
  */
-bool A9G::_waitForOkResponse(int timeout) {
+bool A9G::_sendCommand(const char *command) {
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(command).end();
+  return _writeCommand(cmd);
+}
+
+bool A9G::_sendCommand(const __FlashStringHelper *command) {
+  A9G_Cmd<A9G_CMD_BUFFER_SIZE> cmd;
+  cmd.add(command).end();
+  return _writeCommand(cmd);
+}
+
+/**
+ * @brief Waits up to 'timeout' ms for the substring "OK" from the modem;
+ *        an ERROR / +CME ERROR / +CMS ERROR line ends the wait early.
+ *        If 'capture' is given, the raw response text is copied into it.
+ * @return true if found "OK", false otherwise (lastError() tells which)
+ */
+bool A9G::_waitForOkResponse(unsigned long timeout, char *capture, size_t captureLen) {
   if (!_modemStream) return false;
 
   char response[150];
   memset(response, 0, sizeof(response));
-  long start_time = millis();
+  unsigned long start_time = millis();
   int idx = 0;
 
-  // Create a minimal event structure in case we parse some inbound lines
-  A9G_Event *evt = (A9G_Event *)malloc(sizeof(A9G_Event));
-  if (!evt) return false;
-
-  // Zero out the event
-  memset(evt, 0, sizeof(A9G_Event));
-
-  while ((millis() - start_time) < (unsigned long)timeout) {
-    while (_modemStream->available()) {
-      char c = _modemStream->read();
-      if (idx < (int)sizeof(response) - 1) {
-        response[idx++] = c;
-        response[idx] = '\0';
-      }
+  // One character per pass, so a chatty modem cannot stretch the deadline
+  while ((millis() - start_time) < timeout) {
+    feedWatchdog();
+    _pumpTx();
+    if (!_modemStream->available()) continue;
+    char c = _modemStream->read();
+    A9G_METRIC_ADD(_metrics, CNT_BYTES_IN, 1);
+    if (idx < (int)sizeof(response) - 1) {
+      response[idx++] = c;
+      response[idx] = '\0';
+    }
 
-      // If we see "OK" anywhere in the buffer, success
-      if (strstr(response, "OK")) {
-        free(evt);
-        return true;
+    // If we see "OK" anywhere in the buffer, success
+    if (strstr(response, "OK")) {
+      A9G_METRIC_END(_metrics, false);
+      _lastError = 0;
+      _timeoutStreak = 0;
+      if (capture && captureLen) {
+        strncpy(capture, response, captureLen - 1);
+        capture[captureLen - 1] = '\0';
       }
+      return true;
     }
+    const char *error;
+    if (c == '\n' && (error = strstr(response, "ERROR")) != nullptr) {
+      A9G_METRIC_ADD(_metrics, CNT_ERRORS, 1);
+      A9G_METRIC_END(_metrics, false);
+      // "+CME ERROR: <n>" carries a code, a plain ERROR does not
+      _lastError = error[5] == ':' ? atoi(error + 6) : 0;
+      _timeoutStreak = 0;
+      if (capture && captureLen) capture[0] = '\0';
+      return false;
+    }
+  }
+  _lastError = CMD_TIMEOUT;
+  if (_timeoutStreak < 255) _timeoutStreak++;
+  A9G_METRIC_ADD(_metrics, CNT_TIMEOUTS, 1);
+  A9G_METRIC_END(_metrics, true);
+  if (capture && captureLen) {
+    capture[0] = '\0';
   }
-  free(evt);
   return false;
 }
 
@@ -478,87 +1022,299 @@ bool A9G::_waitForOkResponse(int timeout) {
  * @brief Main internal parser that checks for +TERM lines
  */
 void A9G::_internalModemParser() {
-  A9G_Event *evt = (A9G_Event *)malloc(sizeof(A9G_Event));
-  if (!evt) return;
+  A9G_Event event;
+  A9G_Event *evt = &event;
   memset(evt, 0, sizeof(A9G_Event));
 
-  static char term[100];
-  static char termData[128];
-  static bool termFound = false;
-  static bool termEnded = false;
-  static bool readingTermData = false;
-  static int termLen = 0;
-  static int termDataLen = 0;
-
   while (_modemStream->available()) {
     char c = _modemStream->read();
+    A9G_METRIC_ADD(_metrics, CNT_BYTES_IN, 1);
+    // Socket data is binary and not line based
+    if (_tcpRxStage && _tcpRxByte(c)) continue;
+    // The line after an SMS header is the message itself, whatever it starts with
+    if (_rxBodyEvent != EV_NONE) {
+      if (c != '\r' && c != '\n') {
+        _rxBodyByte(c);
+        continue;
+      }
+      if (!_rxBodyLen && c == '\n') continue;  // end of the header line
+      _rxBodyDone(evt);
+      break;
+    }
+    // Plain lines: only the final result codes matter here
+    if (!_rxTermFound) {
+      // NMEA sentences of AT+GPSRD arrive as "$..." lines
+      if (c == '$' && !_rxLineLen) {
+        _nmeaOn = true;
+        _nmeaLen = 0;
+        continue;
+      }
+      if (_nmeaOn) {
+        if (c != '\r' && c != '\n') {
+          if (_nmeaLen < sizeof(_nmea) - 1) _nmea[_nmeaLen++] = c;
+          continue;
+        }
+        _nmeaOn = false;
+        _nmea[_nmeaLen] = '\0';
+        _gpsSentence(_nmea, evt);
+        if (evt->id == EV_GPS_FIX) break;
+        continue;
+      }
+      // The SMS / CIPSEND prompt "> " is not terminated by CR/LF
+      if (c == '>' && !_rxLineLen && _smsState == SMS_WAIT_PROMPT) {
+        _smsOnPrompt();
+        continue;
+      }
+      if (c == '>' && !_rxLineLen && _tcpWaitPrompt) {
+        _tcpPrompt = true;
+        continue;
+      }
+      if (c == '\r' || c == '\n') {
+        _rxLine[_rxLineLen] = '\0';
+        if (!strcmp(_rxLine, "OK")) {
+          A9G_METRIC_END(_metrics, false);
+          _onResult(true);
+        } else if (!strcmp(_rxLine, "ERROR")) {
+          A9G_METRIC_ADD(_metrics, CNT_ERRORS, 1);
+          A9G_METRIC_END(_metrics, false);
+          _onResult(false);
+        } else if (!strcmp(_rxLine, "READY")) {
+          _rxLineLen = 0;
+          modemRestarted();
+          evt->id = EV_READY;
+          _dispatchEvent(evt);
+          break;
+        } else if (_rxLineLen) {
+          _tcpOnLine(_rxLine);
+        }
+        _rxLineLen = 0;
+        continue;
+      }
+      if (c != '+' || _rxLineLen) {
+        if (_rxLineLen < sizeof(_rxLine) - 1) _rxLine[_rxLineLen++] = c;
+        continue;
+      }
+    }
     // Detect start of +TERM
-    if (c == '+' && !termFound) {
-      termFound = true;
-      termEnded = false;
-      readingTermData = false;
-      termLen = 0;
-      termDataLen = 0;
+    if (c == '+' && !_rxTermFound) {
+      _rxTermFound = true;
+      _rxTermEnded = false;
+      _rxReadingData = false;
+      _rxTermLen = 0;
+      _rxTermDataLen = 0;
+      _rxTermDataLost = false;
       continue;
     }
     // If found +TERM and see '=' or ':', then the "term" ends
-    if ((c == '=' || c == ':') && termFound && !termEnded) {
-      term[termLen] = '\0';
-      termEnded = true;
-      // Identify it
-      int id = _identifyTermString(term);
-      evt->id = (A9G_EventID)id;
+    if ((c == '=' || c == ':') && _rxTermFound && !_rxTermEnded) {
+      _rxTerm[_rxTermLen] = '\0';
+      _rxTermEnded = true;
+      // Identify it (kept on the instance: the data may complete on a later poll)
+      _rxEventId = (A9G_EventID)_identifyTermString(_rxTerm);
+      if (_rxEventId == EV_CIPRCV) {
+        // "+CIPRCV:<len>,<data>": the bytes go to the socket buffer
+        _rxTermFound = false;
+        _tcpRxStage = 1;
+        _tcpRxLeft = 0;
+      }
       continue;
     }
     // Building the +TERM
-    if (termFound && !termEnded) {
-      term[termLen++] = c;
-      if (termLen >= 99) {
-        termFound = false;
+    if (_rxTermFound && !_rxTermEnded) {
+      _rxTerm[_rxTermLen++] = c;
+      if (_rxTermLen >= 99) {
+        A9G_METRIC_ADD(_metrics, CNT_PARSE_ERRORS, 1);
+        _rxTermFound = false;
       }
-    } else if (termEnded && !readingTermData) {
-      // Now we read the data part
-      readingTermData = true;
-    } else if (termEnded && readingTermData) {
+    } else if (_rxTermEnded && !_rxReadingData &&
+               (c == ' ' || (_rxEventId != EV_CTZV && _rxEventId != EV_CCLK))) {
+      // Now we read the data part. The character after ':' is skipped, except
+      // for the time reports, which may start right after it ("+CTZV:25/...")
+      _rxReadingData = true;
+    } else if (_rxTermEnded) {
+      _rxReadingData = true;
       if (c == '\r') {
         // We have the full termData
-        _handlePotentialEvent(evt, termData, termDataLen);
-        // Dispatch if needed
-        _dispatchEvent(evt);
+        evt->id = _rxEventId;
+        if (_rxTermDataLost) A9G_METRIC_ADD(_metrics, CNT_TRUNCATED, 1);
+        if (evt->id == EV_NONE) A9G_METRIC_ADD(_metrics, CNT_URC_DROPPED, 1);
+        _handlePotentialEvent(evt, _rxTermData, _rxTermDataLen);
+        if (evt->id == EV_CMT || evt->id == EV_NEW_SMS_RECEIVED || evt->id == EV_CMGL) {
+          // Dispatched once the body line is in
+          _rxBodyEvent = evt->id;
+          strncpy(_rxBodyHeader, _rxTermData, sizeof(_rxBodyHeader) - 1);
+          _rxBodyHeader[sizeof(_rxBodyHeader) - 1] = '\0';
+          _rxBodyLen = 0;
+          _rxBodyNibble = -1;
+        } else {
+          _dispatchEvent(evt);
+        }
+        if (evt->id == EV_GPSRD) {
+          // The first sentence of a report shares the line with "+GPSRD:"
+          _gpsSentence(_rxTermData, evt);
+        }
+        if (evt->id == EV_CME || evt->id == EV_CMS) {
+          if (_awaitBackground) {
+            _jobError = evt->error;
+          } else {
+            _lastError = evt->error;
+          }
+          A9G_TRACE_W(_trace, evt->id == EV_CME ? TR_CME_ERROR : TR_CMS_ERROR, evt->error, 0);
+          A9G_METRIC_ADD(_metrics, CNT_ERRORS, 1);
+          A9G_METRIC_END(_metrics, false);
+          _onResult(false);
+        } else if (evt->id == EV_CMGS) {
+          _smsRef = evt->param1;
+        }
 
         // Reset flags
-        termFound = false;
-        termEnded = false;
-        readingTermData = false;
-        termLen = 0;
-        termDataLen = 0;
-        memset(term, 0, sizeof(term));
-        memset(termData, 0, sizeof(termData));
+        _rxTermFound = false;
+        _rxTermEnded = false;
+        _rxReadingData = false;
+        _rxTermLen = 0;
+        _rxTermDataLen = 0;
+        memset(_rxTerm, 0, sizeof(_rxTerm));
+        memset(_rxTermData, 0, sizeof(_rxTermData));
         break;
       } else {
-        if (termDataLen < 127) {
-          termData[termDataLen++] = c;
-          termData[termDataLen] = '\0';
+        if (_rxTermDataLen < 127) {
+          _rxTermData[_rxTermDataLen++] = c;
+          _rxTermData[_rxTermDataLen] = '\0';
+        } else {
+          _rxTermDataLost = true;
         }
       }
     }
   }
-  free(evt);
+}
+
+/**
+ * @brief Store one character of an SMS body line. In PDU mode the line is
+ *        hex and is decoded on the fly, so only the PDU bytes are kept.
+ */
+void A9G::_rxBodyByte(char c) {
+  if (_smsTextMode != 0) {
+    if (_rxBodyLen < sizeof(_rxBody) - 1) _rxBody[_rxBodyLen++] = c;
+    return;
+  }
+  int8_t nib;
+  if (c >= '0' && c <= '9') nib = c - '0';
+  else if (c >= 'A' && c <= 'F') nib = c - 'A' + 10;
+  else if (c >= 'a' && c <= 'f') nib = c - 'a' + 10;
+  else return;
+  if (_rxBodyNibble < 0) {
+    _rxBodyNibble = nib;
+  } else {
+    if (_rxBodyLen < sizeof(_rxBody)) _rxBody[_rxBodyLen++] = (_rxBodyNibble << 4) | nib;
+    _rxBodyNibble = -1;
+  }
+}
+
+/**
+ * @brief Copy the n-th double-quoted field of a response line.
+ */
+static bool quotedField(const char *data, uint8_t n, char *out, size_t cap) {
+  const char *p = data;
+  for (;;) {
+    const char *open = strchr(p, '"');
+    if (!open) break;
+    const char *close = strchr(open + 1, '"');
+    if (!close) break;
+    if (!n--) {
+      size_t len = close - open - 1;
+      if (len > cap - 1) len = cap - 1;
+      memcpy(out, open + 1, len);
+      out[len] = '\0';
+      return true;
+    }
+    p = close + 1;
+  }
+  out[0] = '\0';
+  return false;
+}
+
+/**
+ * @brief Header and body of an inbound SMS are complete: fill the event,
+ *        report whole messages to onSMSReceived() and dispatch.
+ *
+ * Text mode headers:  +CMT: "<oa>",...  +CMGR: "<stat>","<oa>",...  +CMGL: <idx>,"<stat>","<oa>",...
+ * PDU mode headers:   +CMT: ,<len>      +CMGR: <stat>,,<len>         +CMGL: <idx>,<stat>,,<len>
+ */
+void A9G::_rxBodyDone(A9G_Event *evt) {
+  static const char *const statNames[] = { "REC UNREAD", "REC READ", "STO UNSENT", "STO SENT" };
+  evt->id = _rxBodyEvent;
+  _rxBodyEvent = EV_NONE;
+  const char *hdr = _rxBodyHeader;
+  uint8_t oaField = 0;
+  if (evt->id == EV_CMGL) {
+    evt->param1 = atoi(hdr);
+  }
+  if (evt->id != EV_CMT) {
+    oaField = 1;
+    if (_smsTextMode != 0) {
+      quotedField(hdr, 0, evt->param2, sizeof(evt->param2));
+    } else {
+      // Numeric <stat> is the first field of +CMGR and the second of +CMGL
+      const char *stat = hdr;
+      if (evt->id == EV_CMGL) {
+        stat = strchr(hdr, ',');
+        stat = stat ? stat + 1 : hdr;
+      }
+      int n = atoi(stat);
+      if (n >= 0 && n <= 3) strcpy(evt->param2, statNames[n]);
+    }
+  }
+  // Listed messages belong to the inbox, the callback only sees new ones
+  bool report = _smsRxCallback && evt->id != EV_CMGL;
+
+  A9G_SMSPdu pdu;
+  if (_smsTextMode == 0) {
+    if (A9G_pduDecodeDeliver(_rxBody, _rxBodyLen, &pdu)) {
+      strncpy(evt->number, pdu.sender, sizeof(evt->number) - 1);
+      strncpy(evt->date_time, pdu.timestamp, sizeof(evt->date_time) - 1);
+      strncpy(evt->message, pdu.text, sizeof(evt->message) - 1);
+      evt->body = pdu.text;
+      if (report) {
+        char text[A9G_SMS_CONCAT_MAX_PARTS * (A9G_SMS_PART_TEXT_MAX - 1) + 1];
+        _smsParts.expire();
+        if (_smsParts.add(pdu, text, sizeof(text))) {
+          _smsRxCallback(pdu.sender, pdu.timestamp, text, _smsRxCtx);
+        }
+      }
+    } else {
+      A9G_METRIC_ADD(_metrics, CNT_PARSE_ERRORS, 1);
+      A9G_TRACE_W(_trace, TR_PDU_UNDECODABLE, _rxBodyLen, 0);
+    }
+  } else {
+    char *text = (char *)_rxBody;
+    text[_rxBodyLen] = '\0';
+    quotedField(hdr, oaField, pdu.sender, sizeof(pdu.sender));
+    quotedField(hdr, oaField + 2, evt->date_time, sizeof(evt->date_time));
+    strncpy(evt->number, pdu.sender, sizeof(evt->number) - 1);
+    strncpy(evt->message, text, sizeof(evt->message) - 1);
+    evt->body = text;
+    if (report) {
+      _smsRxCallback(pdu.sender, evt->date_time, text, _smsRxCtx);
+    }
+  }
+  _rxBodyLen = 0;
+  _dispatchEvent(evt);
 }
 
 /**
  * @brief Identify the term string to match an event ID
  */
 uint8_t A9G::_identifyTermString(const char *termStr) {
-  const char *availableTerms[] = {
-    "CREG", "CTZV", "CIEV", "CPMS", "CMT", "CMTI", "CMGL", "CMGR", "GPSRD", "CGATT", "AGPS",
-    "GPNT", "MQTTPUBLISH", "CMGS", "CME ERROR", "CMS ERROR", "CSQ", "EGMR", "CCID"
-  };
-  // Map them in the same order as A9G_EventID
-  for (int i = 0; i < 19; i++) {
-    if (!strcmp(termStr, availableTerms[i])) {
+  // One flash string per A9G_EventID, in the same order, separated by '\0'
+  static const char availableTerms[] PROGMEM =
+    "CREG\0CTZV\0CIEV\0CPMS\0CMT\0CMTI\0CMGL\0CMGR\0GPSRD\0CGATT\0AGPS\0"
+    "GPNT\0MQTTPUBLISH\0CMGS\0CME ERROR\0CMS ERROR\0CSQ\0EGMR\0CCID\0CIPRCV\0CCLK\0";
+  PGM_P term = availableTerms;
+  for (uint8_t i = 0; pgm_read_byte(term); i++) {
+    if (!strcmp_P(termStr, term)) {
       return i;  // match index
     }
+    term += strlen_P(term) + 1;
   }
   return EV_NONE;
 }
@@ -568,7 +1324,7 @@ uint8_t A9G::_identifyTermString(const char *termStr) {
  */
  void A9G::_handlePotentialEvent(A9G_Event *evt, const char *data, int len) {
   if (evt->id == EV_MQTTPUBLISH) {
-    
+    A9G_METRIC_ADD(_metrics, CNT_MQTT_RX, 1);
     // We use pointers into the data buffer (which may not be null-terminated, so we work only within len)
     const char *p = data;
     
@@ -591,8 +1347,10 @@ uint8_t A9G::_identifyTermString(const char *termStr) {
     }
     if (firstComma) {
       int topicLen = firstComma - p;
-      if (topicLen > (int)sizeof(evt->topic) - 1)
+      if (topicLen > (int)sizeof(evt->topic) - 1) {
         topicLen = sizeof(evt->topic) - 1;
+        A9G_METRIC_ADD(_metrics, CNT_TRUNCATED, 1);
+      }
       strncpy(evt->topic, p, topicLen);
       evt->topic[topicLen] = '\0';
       
@@ -610,7 +1368,8 @@ uint8_t A9G::_identifyTermString(const char *termStr) {
         }
       }
       if (secondComma) {
-        // Skip token2 by moving past this comma:
+        // token2 is the payload length (kept in param1); the payload runs to the end
+        evt->param1 = atoi(p);
         p = secondComma + 1;
         offset = p - data;
         remaining = len - offset;
@@ -627,37 +1386,64 @@ uint8_t A9G::_identifyTermString(const char *termStr) {
           p = thirdComma + 1;
           // Now, remaining length for payload:
           int payloadLen = len - (p - data);
-          if (payloadLen > (int)sizeof(evt->message) - 1)
+          if (payloadLen > (int)sizeof(evt->message) - 1) {
             payloadLen = sizeof(evt->message) - 1;
+            A9G_METRIC_ADD(_metrics, CNT_TRUNCATED, 1);
+          }
           strncpy(evt->message, p, payloadLen);
           evt->message[payloadLen] = '\0';
         } else {
           // If no third comma is found, assume the rest is payload.
           int payloadLen = remaining;
-          if (payloadLen > (int)sizeof(evt->message) - 1)
+          if (payloadLen > (int)sizeof(evt->message) - 1) {
             payloadLen = sizeof(evt->message) - 1;
+            A9G_METRIC_ADD(_metrics, CNT_TRUNCATED, 1);
+          }
           strncpy(evt->message, p, payloadLen);
           evt->message[payloadLen] = '\0';
         }
       }
     }
-  } else if (evt->id == EV_CME) {
+  } else if (evt->id == EV_CME || evt->id == EV_CMS) {
     // parse numeric code
     evt->error = atoi(data);
   } else if (evt->id == EV_CMTI) {
-    // new SMS index
-    // ...
-  } else if (evt->id == EV_CMGS || evt->id == EV_CMGL) {
-    // handle SMS
-    // ...
+    // "+CMTI: "<mem>",<index>"
+    quotedField(data, 0, evt->param2, sizeof(evt->param2));
+    const char *comma = (const char *)memchr(data, ',', len);
+    evt->param1 = comma ? atoi(comma + 1) : 0;
+    _hasSMS = true;
+    _smsIndex = evt->param1;
+  } else if (evt->id == EV_CMGS) {
+    // "+CMGS: <mr>"
+    evt->param1 = atoi(data);
   } else if (evt->id == EV_CSQ) {
-    // parse signal quality
-    char tmp[10] = { 0 };
-    for (int i = 0; i < len; i++) {
-      if (data[i] == ',') break;
-      tmp[i] = data[i];
+    // "+CSQ: <rssi>,<ber>": rssi in param1, ber as text in param2
+    evt->param1 = atoi(data);
+    _lastCSQ = (evt->param1 >= 0 && evt->param1 <= 31) ? evt->param1 : 99;
+    const char *comma = (const char *)memchr(data, ',', len);
+    if (comma) {
+      size_t n = len - (comma + 1 - data);
+      if (n > sizeof(evt->param2) - 1) n = sizeof(evt->param2) - 1;
+      memcpy(evt->param2, comma + 1, n);
+      evt->param2[n] = '\0';
+      int ber = atoi(evt->param2);
+      _lastBER = (ber >= 0 && ber <= 7) ? ber : 99;
     }
-    evt->param1 = atoi(tmp);
+  } else if (evt->id == EV_CTZV || evt->id == EV_CCLK) {
+    // Time text, decoded by whoever keeps time (A9GClock)
+    size_t n = (size_t)len < sizeof(evt->message) - 1 ? (size_t)len : sizeof(evt->message) - 1;
+    memcpy(evt->message, data, n);
+    evt->message[n] = '\0';
+  } else if (evt->id == EV_CGATT) {
+    // "+CGATT: <state>"
+    evt->param1 = atoi(data);
+    _gprsAttached = evt->param1 == 1 ? 1 : 0;
+  } else if (evt->id == EV_CREG) {
+    // "+CREG: <stat>" (URC) or "+CREG: <n>,<stat>" (query)
+    const char *comma = (const char *)memchr(data, ',', len);
+    evt->param1 = atoi(comma ? comma + 1 : data);
+    _regStatus = (A9G_RegStatus)evt->param1;
   }
   // etc. for other event types
 }
@@ -670,6 +1456,11 @@ void A9G::_dispatchEvent(A9G_Event *evt) {
   if (_onEventCallback) {
     _onEventCallback(evt);
   }
+  for (int i = 0; i < A9G_MAX_EVENT_HANDLERS; i++) {
+    if (_handlers[i]) {
+      _handlers[i](evt, _handlerCtx[i]);
+    }
+  }
 }
 
 
@@ -677,31 +1468,85 @@ void A9G::_dispatchEvent(A9G_Event *evt) {
  *                   A9Gmod IMPLEMENTATION
  * ------------------------------------------------------------------ */
 
-A9Gmod *A9Gmod::_activeInstance = nullptr;
-
 A9Gmod::A9Gmod(A9G &a9gRef)
   : _a9g(&a9gRef),
     _mqttConnected(false),
-    _mqttBroker(""),
     _mqttPort(1883),
-    _mqttUserCallback(nullptr) {
-  _activeInstance = this;
-  // Tie into the A9G's event system
-  _a9g->setEventCallback(_onModemEvent);
+    _mqttUserCallback(nullptr),
+    _mqttCtxCallback(nullptr),
+    _mqttCtx(nullptr),
+    _mqttDataCallback(nullptr),
+    _mqttDataCtx(nullptr),
+    _native(nullptr),
+    _outHead(0),
+    _outCount(0),
+    _publishFailures(0),
+    _publishInFlight(false),
+    _hold(false),
+    _connectInFlight(false),
+    _linkMonitor(nullptr),
+    _adaptive(false),
+    _batchLeft(0),
+    _lastFlush(0),
+    _publishStart(0),
+    _dupNext(0),
+    _dupWindow(0),
+    _dupDropped(0) {
+  resetPublishStats();
+  memset(_dupHash, 0, sizeof(_dupHash));
+  memset(_dupTime, 0, sizeof(_dupTime));
+  _mqttBroker[0] = '\0';
+  // Tie into the A9G's event system (one handler per A9Gmod, so several
+  // modems can each carry their own client)
+  _a9g->addEventHandler(_onModemEvent, this);
+}
+
+A9Gmod::~A9Gmod() {
+  useNativeMQTT(nullptr);
+  _a9g->removeEventHandler(_onModemEvent, this);
 }
 
-void A9Gmod::setMQTTServer(const char *host, uint16_t port) {
-  _mqttBroker = host;
+bool A9Gmod::setMQTTServer(const char *host, uint16_t port) {
+  size_t len = host ? strlen(host) : 0;
+  if (len >= sizeof(_mqttBroker)) return false;
+  memcpy(_mqttBroker, host, len);
+  _mqttBroker[len] = '\0';
   _mqttPort = port;
+  return true;
 }
 
 void A9Gmod::onMQTTMessage(A9G_MQTTCallback callback) {
   _mqttUserCallback = callback;
 }
 
+void A9Gmod::onMQTTMessage(A9G_MQTTContextCallback callback, void *ctx) {
+  _mqttCtxCallback = callback;
+  _mqttCtx = ctx;
+}
+
+void A9Gmod::onMQTTData(A9G_MQTTBinaryCallback callback, void *ctx) {
+  _mqttDataCallback = callback;
+  _mqttDataCtx = ctx;
+}
+
+void A9Gmod::useNativeMQTT(A9GMqttClient *client) {
+  if (_native) {
+    _native->onMessage(nullptr);
+    _native->onPublishResult(nullptr);
+  }
+  _native = client;
+  _mqttConnected = client && client->connected();
+  if (client) {
+    client->onMessage(_onNativeMessage, this);
+    client->onPublishResult(_onNativePublish, this);
+  }
+}
+
 bool A9Gmod::connectMQTT(const char *clientID) {
-  bool ok = _a9g->connectBroker(_mqttBroker.c_str(), _mqttPort, clientID, 60, 1);
+  if (_native) return connectMQTT(clientID, nullptr, nullptr);
+  bool ok = _a9g->connectBroker(_mqttBroker, _mqttPort, clientID, 60, 1);
   _mqttConnected = ok;
+  if (ok) _publishFailures = 0;
   return ok;
 }
 
@@ -710,43 +1555,330 @@ bool A9Gmod::connectMQTT(const char *clientID,
                          const char *pass,
                          uint8_t keepAlive,
                          uint16_t cleanSession) {
-  bool ok = _a9g->connectBroker(_mqttBroker.c_str(), _mqttPort, user, pass,
-                                clientID, keepAlive, cleanSession);
+  bool ok;
+  if (_native) {
+    // The AT API passes "" for no credentials, MQTT leaves the field out
+    ok = _native->connect(_mqttBroker, _mqttPort, clientID,
+                          user && *user ? user : nullptr, pass && *pass ? pass : nullptr,
+                          keepAlive, cleanSession != 0);
+  } else {
+    ok = _a9g->connectBroker(_mqttBroker, _mqttPort, user, pass,
+                             clientID, keepAlive, cleanSession);
+  }
   _mqttConnected = ok;
+  if (ok) _publishFailures = 0;
   return ok;
 }
 
+/**
+ * @brief AT path only: the native client's connect waits for its CONNACK,
+ *        so with useNativeMQTT() this is the blocking connectMQTT().
+ */
+bool A9Gmod::connectMQTTNonBlocking(const char *clientID, const char *user, const char *pass,
+                                    uint8_t keepAlive, uint16_t cleanSession) {
+  if (_native) return connectMQTT(clientID, user, pass, keepAlive, cleanSession);
+  if (_connectInFlight) return false;
+  _mqttConnected = false;
+  _connectInFlight = _a9g->connectBrokerNonBlocking(_mqttBroker, _mqttPort, user, pass,
+                                                    clientID, keepAlive, cleanSession);
+  return _connectInFlight;
+}
+
 bool A9Gmod::isMQTTConnected() {
+  if (_native) _mqttConnected = _native->connected();
   return _mqttConnected;
 }
 
 void A9Gmod::processMQTT() {
-  // Pump the A9G parser
-  _a9g->pollModem();
+  if (_native) {
+    // Pumps the A9G parser, then handles the MQTT packets that came in
+    _native->loop();
+    _mqttConnected = _native->connected();
+  } else {
+    // Pump the A9G parser
+    _a9g->pollModem();
+  }
+
+  if (_connectInFlight && !_a9g->isBusy()) {
+    _connectInFlight = false;
+    _mqttConnected = _a9g->lastResultOk();
+    if (_mqttConnected) _publishFailures = 0;
+  }
+
+  if (_a9g->asyncTx() && !_native) {
+    _processQueueNonBlocking();
+    return;
+  }
+
+  // Publish at most one queued message (one batch with adaptive rate) per
+  // call to keep loop() latency bounded
+  if (!_outCount || _hold || !_mqttConnected || !_linkUsable() || !_flushDue()) return;
+  do {
+    A9G_MQTTMessage *msg = &_outbox[_outHead];
+    // Every in-flight slot taken: the head waits for a PUBACK, the batch goes on then
+    if (_native && !_native->canPublish(msg->qos)) break;
+    _publishStart = millis();
+    bool ok = publishMQTT(msg->topic, msg->payload, msg->qos, msg->retain);
+    _publishDone(ok);
+    if (!ok) break;
+    _outHead = (_outHead + 1) % A9G_MQTT_QUEUE_LEN;
+    _outCount--;
+  } while (_batchLeft && _outCount);
+}
+
+/**
+ * @brief Async TX variant: the head message stays queued until the modem
+ *        answered its AT+MQTTPUB, so a failed publish is retried.
+ */
+void A9Gmod::_processQueueNonBlocking() {
+  if (_publishInFlight) {
+    if (_a9g->isBusy()) return;
+    _publishInFlight = false;
+    bool ok = _a9g->lastResultOk();
+    _countResult(_outbox[_outHead].qos, ok);
+    _publishDone(ok);
+    if (ok) {
+      _outHead = (_outHead + 1) % A9G_MQTT_QUEUE_LEN;
+      _outCount--;
+      _publishFailures = 0;
+    } else if (_publishFailures < 255) {
+      _publishFailures++;
+    }
+  }
+  if (_outCount && !_hold && _mqttConnected && _linkUsable() && _flushDue()) {
+    A9G_MQTTMessage *msg = &_outbox[_outHead];
+    // false here is backpressure: TX queue full or modem busy, try next call
+    _publishStart = millis();
+    _publishInFlight = _a9g->publishTopicNonBlocking(msg->topic, msg->payload, msg->qos, msg->retain,
+                                                       (A9G_Priority)msg->priority);
+    if (_publishInFlight) _pubStats.sent[msg->qos]++;
+  }
+}
+
+A9G_Priority A9Gmod::mostUrgent() const {
+  uint8_t prio = PRIO_MAX;
+  for (uint8_t i = 0; i < _outCount; i++) {
+    uint8_t p = _outbox[(_outHead + i) % A9G_MQTT_QUEUE_LEN].priority;
+    if (p < prio) prio = p;
+  }
+  return (A9G_Priority)prio;
+}
+
+void A9Gmod::setAdaptiveRate(bool enable) {
+  _adaptive = enable;
+  _rate.reset();
+  _batchLeft = 0;
+}
+
+/**
+ * @brief Whether the queue may be flushed now. Starts a new batch once the
+ *        pause for the most urgent queued message is over.
+ */
+bool A9Gmod::_flushDue() {
+  if (!_adaptive) {
+    _batchLeft = 1;
+    return true;
+  }
+  if (_batchLeft) return true;
+  if (millis() - _lastFlush < _rate.interval(mostUrgent())) return false;
+  _batchLeft = _rate.batch();
+  return true;
+}
+
+/**
+ * @brief Account one publish of the head message (removed by the caller on
+ *        success). A failure or an emptied queue ends the batch.
+ */
+void A9Gmod::_publishDone(bool ok) {
+  if (_adaptive) _rate.onResult(ok, millis() - _publishStart, _a9g->signalQuality());
+  if (_batchLeft) _batchLeft--;
+  if (!ok || _outCount <= 1) _batchLeft = 0;
+  if (!_batchLeft) _lastFlush = millis();
+}
+
+void A9Gmod::_countResult(uint8_t qos, bool ok) {
+  if (ok) _pubStats.completed[qos]++;
+  else _pubStats.failed[qos]++;
+}
+
+void A9Gmod::resetPublishStats() {
+  memset(&_pubStats, 0, sizeof(_pubStats));
+}
+
+uint32_t A9Gmod::inFlight() const {
+  uint32_t n = 0;
+  for (uint8_t q = 1; q <= 2; q++) {
+    n += _pubStats.sent[q] - _pubStats.completed[q] - _pubStats.failed[q];
+  }
+  return n;
+}
+
+void A9Gmod::setDuplicateWindow(unsigned long windowMs) {
+  _dupWindow = windowMs;
+}
+
+/**
+ * @brief Remember an inbound message (FNV-1a over topic and payload; neither
+ *        transport reports a message id) and report whether it was seen
+ *        within the window.
+ */
+bool A9Gmod::_isDuplicate(const char *topic, const uint8_t *payload, size_t len) {
+  if (!_dupWindow) return false;
+  uint32_t h = 2166136261UL;
+  for (const char *p = topic; *p; p++) h = (h ^ (uint8_t)*p) * 16777619UL;
+  h = (h ^ 0xFF) * 16777619UL;  // separator, so "a" + "bc" differs from "ab" + "c"
+  for (size_t i = 0; i < len; i++) h = (h ^ payload[i]) * 16777619UL;
+  if (!h) h = 1;  // 0 marks an empty slot
+
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < A9G_MQTT_DEDUP_SIZE; i++) {
+    if (_dupHash[i] == h && now - _dupTime[i] < _dupWindow) {
+      _dupDropped++;
+      return true;
+    }
+  }
+  _dupHash[_dupNext] = h;
+  _dupTime[_dupNext] = now;
+  _dupNext = (_dupNext + 1) % A9G_MQTT_DEDUP_SIZE;
+  return false;
 }
 
-bool A9Gmod::publishMQTT(const char *topic, const char *payload) {
+bool A9Gmod::_linkUsable() const {
+  return !_linkMonitor || _linkMonitor->linkGood();
+}
+
+bool A9Gmod::publishMQTT(const char *topic, const char *payload, uint8_t qos, bool retain) {
+  if (_native) return publishMQTT(topic, (const uint8_t *)payload, strlen(payload), qos, retain);
   if (!_mqttConnected) return false;
-  return _a9g->publishTopic(topic, payload);
+  if (qos > 2) qos = 2;
+  _pubStats.sent[qos]++;
+  bool ok = _a9g->publishTopic(topic, payload, qos, retain);
+  _countResult(qos, ok);
+  if (ok) {
+    _publishFailures = 0;
+  } else if (_publishFailures < 255) {
+    _publishFailures++;
+  }
+  return ok;
+}
+
+/**
+ * @brief Native transport: QoS 0 completes when sent, QoS 1 (and 2, sent as 1)
+ *        when its PUBACK arrives (_onNativePublish()). A full in-flight window
+ *        is backpressure, not a failure of the link.
+ */
+bool A9Gmod::publishMQTT(const char *topic, const uint8_t *payload, size_t len,
+                         uint8_t qos, bool retain) {
+  if (!_native || !_native->connected()) return false;
+  if (qos > 1) qos = 1;
+  if (!_native->canPublish(qos)) return false;
+  _pubStats.sent[qos]++;
+  bool ok = _native->publish(topic, payload, len, qos, retain);
+  if (!ok || !qos) _countResult(qos, ok);
+  if (ok) {
+    _publishFailures = 0;
+  } else if (_publishFailures < 255) {
+    _publishFailures++;
+  }
+  return ok;
+}
+
+#ifdef A9G_ENABLE_METRICS
+bool A9Gmod::publishMetrics(const char *prefix) {
+  A9G_Metrics &m = _a9g->metrics();
+  char topic[A9G_MQTT_TOPIC_MAX];
+  char payload[A9G_MQTT_PAYLOAD_MAX + 64];
+  size_t plen = strlen(prefix);
+  if (plen + 10 > sizeof(topic)) return false;
+  bool ok = true;
+
+  memcpy(topic, prefix, plen);
+  strcpy(topic + plen, "/cnt");
+  ok &= m.snapshotCounters(payload, sizeof(payload)) && publishMQTT(topic, payload);
+  for (uint8_t c = 0; c < MC_MAX; c++) {
+    A9G_MetricClass cls = (A9G_MetricClass)c;
+    if (!m.snapshotLatency(cls, payload, sizeof(payload))) continue;
+    topic[plen] = '/';
+    strcpy(topic + plen + 1, A9G_Metrics::className(cls));
+    ok &= publishMQTT(topic, payload);
+  }
+  return ok;
+}
+#endif
+
+bool A9Gmod::queueMQTT(const char *topic, const char *payload, A9G_Priority priority,
+                       uint8_t qos, bool retain) {
+  if (_outCount >= A9G_MQTT_QUEUE_LEN) {
+    A9G_METRIC_ADD(_a9g->metrics(), CNT_BACKPRESSURE, 1);
+    return false;
+  }
+  if (strlen(topic) >= A9G_MQTT_TOPIC_MAX || strlen(payload) >= A9G_MQTT_PAYLOAD_MAX) {
+    return false;
+  }
+  A9G_MQTTMessage *msg = &_outbox[(_outHead + _outCount) % A9G_MQTT_QUEUE_LEN];
+  strcpy(msg->topic, topic);
+  strcpy(msg->payload, payload);
+  msg->priority = priority < PRIO_MAX ? priority : PRIO_LOW;
+  msg->qos = qos <= 2 ? qos : 2;
+  msg->retain = retain;
+  _outCount++;
+  return true;
+}
+
+bool A9Gmod::takeQueuedMQTT(A9G_MQTTMessage *out) {
+  if (!_outCount) return false;
+  if (_publishInFlight) {
+    // The head message is the modem's until its result is in
+    if (_a9g->isBusy()) return false;
+    _publishInFlight = false;
+    _countResult(_outbox[_outHead].qos, _a9g->lastResultOk());
+    _publishDone(_a9g->lastResultOk());
+    if (_a9g->lastResultOk()) {
+      _outHead = (_outHead + 1) % A9G_MQTT_QUEUE_LEN;
+      _outCount--;
+      if (!_outCount) return false;
+    }
+  }
+  if (out) {
+    *out = _outbox[_outHead];
+  }
+  _outHead = (_outHead + 1) % A9G_MQTT_QUEUE_LEN;
+  _outCount--;
+  return true;
 }
 
 bool A9Gmod::subscribeMQTT(const char *topic) {
   if (!_mqttConnected) return false;
+  if (_native) return _native->subscribe(topic);
   return _a9g->subscribeTopic(topic);
 }
 
+bool A9Gmod::subscribeMQTTNonBlocking(const char *topic) {
+  if (!_mqttConnected) return false;
+  if (_native) return _native->subscribeNonBlocking(topic);
+  return _a9g->subscribeTopicNonBlocking(topic);
+}
+
 bool A9Gmod::subscribeMQTT(const char *topic, uint8_t qos, unsigned long timeout) {
   if (!_mqttConnected) return false;
+  // The native client waits A9G_MQTT_REPLY_TIMEOUT for the SUBACK
+  if (_native) return _native->subscribe(topic, qos);
   return _a9g->subscribeTopic(topic, qos, timeout);
 }
 
 bool A9Gmod::unsubscribeMQTT(const char *topic) {
   if (!_mqttConnected) return false;
+  if (_native) return _native->unsubscribe(topic);
   return _a9g->unsubscribeTopic(topic);
 }
 
 bool A9Gmod::disconnectMQTT() {
   if (!_mqttConnected) return false;
+  if (_native) {
+    _native->disconnect();
+    _mqttConnected = false;
+    return true;
+  }
   bool ret = _a9g->disconnectBroker();
   if (ret) {
     _mqttConnected = false;
@@ -760,12 +1892,10 @@ int A9Gmod::connectionState() {
 }
 
 /**
- * @brief Static callback that A9G calls whenever there's a new event. 
+ * @brief Static handler that A9G calls whenever there's a new event.
  */
-void A9Gmod::_onModemEvent(A9G_Event *evt) {
-  if (_activeInstance) {
-    _activeInstance->_handleModemEvent(evt);
-  }
+void A9Gmod::_onModemEvent(A9G_Event *evt, void *ctx) {
+  static_cast<A9Gmod *>(ctx)->_handleModemEvent(evt);
 }
 
 /**
@@ -774,9 +1904,37 @@ void A9Gmod::_onModemEvent(A9G_Event *evt) {
 void A9Gmod::_handleModemEvent(A9G_Event *evt) {
   // If it's an MQTT publish event, pass it to the user callback
   if (evt->id == EV_MQTTPUBLISH) {
+    if (_isDuplicate(evt->topic, (const uint8_t *)evt->message, strlen(evt->message))) return;
     if (_mqttUserCallback) {
       _mqttUserCallback(evt->topic, evt->message);
     }
+    if (_mqttCtxCallback) {
+      _mqttCtxCallback(_mqttCtx, evt->topic, evt->message);
+    }
+    if (_mqttDataCallback) {
+      _mqttDataCallback(_mqttDataCtx, evt->topic, (const uint8_t *)evt->message, strlen(evt->message));
+    }
   }
   // You could handle other events here (lost connection, etc.)
 }
+
+/**
+ * @brief Inbound PUBLISH of the native client (payload terminated by the client).
+ */
+void A9Gmod::_onNativeMessage(void *ctx, const char *topic, const uint8_t *payload, size_t len) {
+  A9Gmod *self = static_cast<A9Gmod *>(ctx);
+  if (self->_isDuplicate(topic, payload, len)) return;
+  if (self->_mqttUserCallback) {
+    self->_mqttUserCallback(topic, (const char *)payload);
+  }
+  if (self->_mqttCtxCallback) {
+    self->_mqttCtxCallback(self->_mqttCtx, topic, (const char *)payload);
+  }
+  if (self->_mqttDataCallback) {
+    self->_mqttDataCallback(self->_mqttDataCtx, topic, payload, len);
+  }
+}
+
+void A9Gmod::_onNativePublish(void *ctx, bool ok) {
+  static_cast<A9Gmod *>(ctx)->_countResult(1, ok);
+}
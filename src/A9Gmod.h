@@ -3,6 +3,13 @@
 
 #include <Arduino.h>
 #include <Stream.h>
+#include "A9GCmd.h"
+#include "A9GPdu.h"
+#include "A9GMetrics.h"
+#include "A9GTrace.h"
+#include "A9GErrors.h"
+#include "A9GRate.h"
+#include "A9GNmea.h"
 
 /*!
  * @file A9Gmod.h
@@ -15,6 +22,186 @@
  * V0.1.25.3.4
  */
 
+/* ------------------------------------------------------------------
+ *                      A9G CONFIGURATION
+ * ------------------------------------------------------------------ */
+
+#ifndef A9G_MAX_EVENT_HANDLERS
+#define A9G_MAX_EVENT_HANDLERS 4     ///< Context handlers that may listen to one A9G
+#endif
+
+#ifndef A9G_MQTT_QUEUE_LEN
+#define A9G_MQTT_QUEUE_LEN 8         ///< Outbound messages A9Gmod can hold before publishing
+#endif
+
+#ifndef A9G_MQTT_TOPIC_MAX
+#define A9G_MQTT_TOPIC_MAX 64        ///< Topic capacity (incl. terminator) of a queued message
+#endif
+
+#ifndef A9G_MQTT_PAYLOAD_MAX
+#define A9G_MQTT_PAYLOAD_MAX 128     ///< Payload capacity (incl. terminator) of a queued message
+#endif
+
+#ifndef A9G_MQTT_DEFAULT_QOS
+#define A9G_MQTT_DEFAULT_QOS 2       ///< QoS of publishes that do not name one
+#endif
+
+#ifndef A9G_MQTT_DEDUP_SIZE
+#if defined(__AVR__)
+#define A9G_MQTT_DEDUP_SIZE 4        ///< Inbound messages remembered for duplicate suppression
+#else
+#define A9G_MQTT_DEDUP_SIZE 16
+#endif
+#endif
+
+#ifndef A9G_MQTT_BROKER_MAX
+#define A9G_MQTT_BROKER_MAX 64       ///< Broker host capacity (incl. terminator) kept by A9Gmod
+#endif
+
+#ifndef A9G_STRING_API
+#define A9G_STRING_API 1             ///< 0 removes the legacy Arduino String overloads (no heap use at all)
+#endif
+
+#ifndef A9G_GPS_TEXT_MAX
+#if defined(__AVR__)
+#define A9G_GPS_TEXT_MAX 128         ///< NMEA text kept by the String overload of getGPS()
+#else
+#define A9G_GPS_TEXT_MAX 512
+#endif
+#endif
+
+#ifndef A9G_TX_QUEUE_SIZE
+#if defined(__AVR__)
+#define A9G_TX_QUEUE_SIZE 128        ///< Outbound byte queue used in async TX mode
+#else
+#define A9G_TX_QUEUE_SIZE 512
+#endif
+#endif
+
+#ifndef A9G_ASYNC_RESULT_TIMEOUT
+#define A9G_ASYNC_RESULT_TIMEOUT 10000  ///< ms a non-blocking command may wait for OK/ERROR
+#endif
+
+#ifndef A9G_DEFAULT_TIMEOUT
+#define A9G_DEFAULT_TIMEOUT 2000UL   ///< ms a blocking command waits for its result (setDefaultTimeout())
+#endif
+
+#ifndef A9G_READY_TIMEOUT
+#define A9G_READY_TIMEOUT 30000UL    ///< ms waitForModemReady() waits for READY after power on
+#endif
+
+#ifndef A9G_GPS_READ_WINDOW
+#define A9G_GPS_READ_WINDOW 1000UL   ///< ms getGPS() collects NMEA text
+#endif
+
+#ifndef A9G_DEBUG_ECHO_TIME
+#define A9G_DEBUG_ECHO_TIME 10000UL  ///< ms testDebugCommand() echoes the modem output
+#endif
+
+#ifndef A9G_SLEEP_MODE
+#define A9G_SLEEP_MODE 1             ///< AT+SLEEP=<n> sent by sleepModem()
+#endif
+
+#ifndef A9G_WAKE_PROBES
+#define A9G_WAKE_PROBES 3            ///< AT probes wakeModem() sends; the first bytes may wake the UART only
+#endif
+
+#ifndef A9G_WAKE_PROBE_TIMEOUT
+#define A9G_WAKE_PROBE_TIMEOUT 300UL ///< ms each of them may take
+#endif
+
+#ifndef A9G_QUERY_TIMEOUT
+#define A9G_QUERY_TIMEOUT 2000       ///< ms a background status query (AT+CSQ, AT+CREG?) may take
+#endif
+
+#ifndef A9G_AGPS_TIMEOUT
+#define A9G_AGPS_TIMEOUT 30000       ///< ms AT+AGPS=1 may take to download the assistance data
+#endif
+
+#ifndef A9G_CMD_QUEUE_LEN
+#if defined(__AVR__)
+#define A9G_CMD_QUEUE_LEN 2          ///< Background commands waiting for the channel
+#else
+#define A9G_CMD_QUEUE_LEN 8
+#endif
+#endif
+
+#ifndef A9G_CMD_QUEUE_TEXT
+#if defined(__AVR__)
+#define A9G_CMD_QUEUE_TEXT 32        ///< Longest queued command line (incl. CR LF and terminator)
+#else
+#define A9G_CMD_QUEUE_TEXT 64
+#endif
+#endif
+
+#ifndef A9G_CMD_AGING
+#define A9G_CMD_AGING 5000UL         ///< ms of waiting that raise a queued command by one priority class
+#endif
+
+#ifndef A9G_CMD_CLAIM
+#define A9G_CMD_CLAIM 1000UL         ///< ms a refused foreground command keeps queued ones back
+#endif
+
+#ifndef A9G_SMS_QUEUE_LEN
+#if defined(__AVR__)
+#define A9G_SMS_QUEUE_LEN 1          ///< Outgoing SMS that can wait in the send pipeline
+#else
+#define A9G_SMS_QUEUE_LEN 4
+#endif
+#endif
+
+#ifndef A9G_SMS_NUMBER_MAX
+#define A9G_SMS_NUMBER_MAX 20        ///< Destination number capacity (incl. terminator)
+#endif
+
+#ifndef A9G_SMS_BODY_MAX
+#define A9G_SMS_BODY_MAX 161         ///< Text-mode body capacity (incl. terminator)
+#endif
+
+#ifndef A9G_SMS_PROMPT_TIMEOUT
+#define A9G_SMS_PROMPT_TIMEOUT 5000  ///< ms to wait for the '>' prompt after AT+CMGS
+#endif
+
+#ifndef A9G_SMS_RESULT_TIMEOUT
+#define A9G_SMS_RESULT_TIMEOUT 60000 ///< ms to wait for +CMGS / +CMS ERROR after the body
+#endif
+
+#ifndef A9G_SMS_SEND_TIMEOUT
+#define A9G_SMS_SEND_TIMEOUT 90000UL ///< ms sendSMS() waits in all, queued messages ahead included
+#endif
+
+#ifndef A9G_TCP_RX_SIZE
+#if defined(__AVR__)
+#define A9G_TCP_RX_SIZE 128          ///< Received socket bytes held until tcpRead()
+#else
+#define A9G_TCP_RX_SIZE 1024
+#endif
+#endif
+
+#ifndef A9G_TCP_SEND_MAX
+#define A9G_TCP_SEND_MAX 512         ///< Largest AT+CIPSEND block; longer sends are split
+#endif
+
+#ifndef A9G_TCP_CONNECT_TIMEOUT
+#define A9G_TCP_CONNECT_TIMEOUT 15000  ///< ms to wait for CONNECT OK after AT+CIPSTART
+#endif
+
+#ifndef A9G_TCP_SEND_TIMEOUT
+#define A9G_TCP_SEND_TIMEOUT 10000   ///< ms one AT+CIPSEND block may take, prompt included
+#endif
+
+#ifndef A9G_HTTP_POST_MAX
+#if defined(__AVR__)
+#define A9G_HTTP_POST_MAX 128        ///< Largest body httpPost() sends inline in AT+HTTPPOST
+#else
+#define A9G_HTTP_POST_MAX 512
+#endif
+#endif
+
+#ifndef A9G_HTTP_TIMEOUT
+#define A9G_HTTP_TIMEOUT 30000       ///< ms to wait for the HTTP status line of a request
+#endif
+
 /* ------------------------------------------------------------------
  *                      A9G EVENT STRUCTS & ENUMS
  * ------------------------------------------------------------------ */
@@ -24,7 +211,7 @@
  */
 typedef enum A9G_EventID {
   EV_CREG = 0,
-  EV_CTZV,
+  EV_CTZV,             ///< Network time report; evt->message holds the data
   EV_CIEV,
   EV_CPMS,
   EV_CMT,
@@ -42,6 +229,10 @@ typedef enum A9G_EventID {
   EV_CSQ,
   EV_IMEI,
   EV_CCID,
+  EV_CIPRCV,           ///< Socket data; consumed by the TCP receive buffer, never dispatched
+  EV_CCLK,             ///< Clock answer; evt->message holds the data ("yy/MM/dd,hh:mm:ss+zz")
+  EV_GPS_FIX,          ///< An RMC sentence completed a fix (evt->fix)
+  EV_READY,            ///< The module booted ("READY" line); modemRestarted() already ran
   EV_MAX,
   EV_NONE
 } A9G_EventID;
@@ -243,8 +434,108 @@ typedef struct A9G_Event {
   int param1;          ///< For numeric parameters
   char param2[30];     ///< For additional textual data
   char param3[50];     ///< Extension if needed
+  const char *body;    ///< Full SMS text of EV_CMT / EV_NEW_SMS_RECEIVED / EV_CMGL (valid during dispatch)
+  const A9G_GPSFix *fix;  ///< Fix of EV_GPS_FIX (valid during dispatch)
 } A9G_Event;
 
+/**
+ * @brief Event handler that also receives the context it was registered with.
+ *        Lets several objects (e.g. one A9Gmod per modem) listen to their own A9G.
+ */
+typedef void (*A9G_EventHandler)(A9G_Event *evt, void *ctx);
+
+/**
+ * @brief Completion callback of a queued SMS
+ * @param id    Id returned by queueSMS()
+ * @param ok    true once the network accepted the message (+CMGS)
+ * @param ref   Message reference from +CMGS (-1 if none)
+ * @param error CMS error code, or -1 on timeout (0 when ok)
+ */
+typedef void (*A9G_SMSCallback)(uint8_t id, bool ok, int ref, int error, void *ctx);
+
+/**
+ * @brief Outcomes of a queued command other than OK and +CME / +CMS codes
+ */
+typedef enum A9G_CmdError {
+  CMD_TIMEOUT = -1,    ///< No final result in time
+  CMD_EXPIRED = -2,    ///< maxWait passed before the channel was free
+  CMD_SUPERSEDED = -3, ///< The same command was queued again
+  CMD_EVICTED = -4,    ///< Pushed out of a full queue by a more urgent one
+  CMD_CANCELLED = -5   ///< cancelCommand()
+} A9G_CmdError;
+
+/**
+ * @brief Completion callback of a queued command
+ * @param ok    true on OK
+ * @param error CME / CMS error code or an A9G_CmdError (0 when ok)
+ */
+typedef void (*A9G_CommandCallback)(bool ok, int error, void *ctx);
+
+/**
+ * @brief Command scheduler statistics
+ */
+typedef struct A9G_SchedulerStats {
+  uint16_t sent;           ///< Queued commands that went out
+  uint16_t superseded;     ///< Dropped for a newer copy of themselves
+  uint16_t expired;        ///< Dropped at their deadline
+  uint16_t evicted;        ///< Dropped for a more urgent command
+  uint32_t maxWaitMs;      ///< Longest time a sent command waited in the queue
+} A9G_SchedulerStats;
+
+/**
+ * @brief Called on every pass of a blocking wait, e.g. to reset a hardware
+ *        watchdog (wdt_reset(), esp_task_wdt_reset())
+ */
+typedef void (*A9G_WatchdogCallback)(void *ctx);
+
+/**
+ * @brief Drives a GPIO line of the module: @p active true asserts it (reset
+ *        held, power key pressed, DTR / wake line raised), false releases it
+ */
+typedef void (*A9G_LineHook)(bool active, void *ctx);
+
+/**
+ * @brief Callback for a complete inbound SMS (+CMT delivery or +CMGR read).
+ *        Concatenated PDU messages are reported once, after the last part.
+ * @param sender    Originating number
+ * @param timestamp Service centre time stamp as sent by the modem
+ * @param text      UTF-8 text
+ */
+typedef void (*A9G_SMSReceivedCallback)(const char *sender, const char *timestamp,
+                                        const char *text, void *ctx);
+
+/**
+ * @brief Steps of the SMS send pipeline
+ */
+typedef enum A9G_SMSState {
+  SMS_IDLE = 0,
+  SMS_WAIT_MODE,     ///< AT+CMGF=1 sent, waiting for OK
+  SMS_WAIT_PROMPT,   ///< AT+CMGS sent, waiting for '>'
+  SMS_SEND_BODY,     ///< Prompt seen, body waiting for TX queue space
+  SMS_WAIT_RESULT    ///< Body sent, waiting for +CMGS / +CMS ERROR and OK
+} A9G_SMSState;
+
+/**
+ * @brief Network registration state as reported by +CREG
+ */
+typedef enum A9G_RegStatus {
+  REG_NOT_REGISTERED = 0,
+  REG_HOME,
+  REG_SEARCHING,
+  REG_DENIED,
+  REG_UNKNOWN,
+  REG_ROAMING
+} A9G_RegStatus;
+
+/**
+ * @brief State of the single TCP socket (AT+CIPSTART / AT+CIPCLOSE)
+ */
+typedef enum A9G_TcpState {
+  TCP_CLOSED = 0,
+  TCP_CONNECTING,    ///< AT+CIPSTART sent, waiting for CONNECT OK
+  TCP_CONNECTED
+} A9G_TcpState;
+
 
 /* ------------------------------------------------------------------
  *                   A9G CLASS (AT COMMAND HANDLER)
@@ -258,6 +549,11 @@ typedef struct A9G_Event {
  *        - GPRS attach, APN setup, etc.
  *        - MQTT connect/publish/subscribe
  *        - GPS enabling and data retrieval
+ *
+ * Every blocking call ends after a bounded time: its own timeout argument,
+ * a dedicated A9G_*_TIMEOUT, or defaultTimeout(). A call that ran out
+ * returns its failure value with lastError() == CMD_TIMEOUT. Waits feed
+ * the hook set with onWatchdog(), so they never trip a hardware watchdog.
  */
 class A9G {
 public:
@@ -281,6 +577,116 @@ public:
      */
   void pollModem();
 
+  /**
+     * @brief Async TX mode: commands are placed in an outbound byte queue and
+     *        pollModem() writes only what availableForWrite() allows, so a full
+     *        UART FIFO never blocks the caller.
+     *        Needs a stream that implements availableForWrite() (HardwareSerial does).
+     */
+  void setAsyncTx(bool enable);
+
+  /**
+     * @brief Bytes still waiting in the outbound queue.
+     */
+  size_t txPending() const { return _txCount; }
+
+  /**
+     * @brief Free space in the outbound queue.
+     */
+  size_t txFree() const { return A9G_TX_QUEUE_SIZE - _txCount; }
+
+  /**
+     * @brief Whether async TX mode is enabled.
+     */
+  bool asyncTx() const { return _txAsync; }
+
+  /**
+     * @brief true while a non-blocking command is waiting for its OK/ERROR.
+     */
+  bool isBusy();
+
+  /**
+     * @brief Error code (+CME / +CMS) of the last failed command, -1 on timeout.
+     */
+  int lastError() const { return _lastError; }
+
+  /**
+     * @brief Outcome of the last non-blocking command once isBusy() turned false.
+     */
+  bool lastResultOk() const { return _lastResultOk; }
+
+  /**
+     * @brief The last blocking call ended because its time ran out.
+     */
+  bool timedOut() const { return _lastError == CMD_TIMEOUT; }
+
+  /**
+     * @brief ms a blocking command without a timeout of its own waits for
+     *        its result (A9G_DEFAULT_TIMEOUT at start).
+     */
+  void setDefaultTimeout(unsigned long ms) { _defaultWaitMS = ms; }
+  unsigned long defaultTimeout() const { return _defaultWaitMS; }
+
+  /**
+     * @brief Hook called on every pass of a blocking wait.
+     */
+  void onWatchdog(A9G_WatchdogCallback cb, void *ctx = nullptr);
+
+  /**
+     * @brief Call the watchdog hook; for code that waits on the modem
+     *        outside the library (A9GMqttClient, A9GUploader use it too).
+     */
+  void feedWatchdog() {
+    if (_watchdog) _watchdog(_watchdogCtx);
+  }
+
+  /* ----------------------------------------------------
+     *         COMMAND SCHEDULER
+     * ---------------------------------------------------- */
+  /**
+     * @brief Queue a background command; pollModem() sends it once the
+     *        channel is free, most urgent first (queued SMS go before it).
+     *        Waiting raises a command by one class every A9G_CMD_AGING ms,
+     *        so low priority polls are delayed, never starved. The same line
+     *        queued again replaces the waiting copy, which keeps its place.
+     *        The result leaves lastResultOk() and lastError() untouched.
+     * @param cmd      Command without CR LF, e.g. "AT+CSQ"
+     * @param maxWait  ms the command may wait for the channel before it is
+     *                 dropped with CMD_EXPIRED (0 = no deadline)
+     * @param cb       Optional completion callback (called from pollModem())
+     * @param timeout  ms the final result may take once sent
+     * @return false if the line is too long, or the queue is full of
+     *         commands at least as urgent
+     */
+  bool submitCommand(const char *cmd, A9G_Priority priority = PRIO_LOW,
+                     unsigned long maxWait = 0, A9G_CommandCallback cb = nullptr,
+                     void *ctx = nullptr, unsigned long timeout = A9G_QUERY_TIMEOUT);
+
+  /**
+     * @brief Drop a queued command (its callback gets CMD_CANCELLED).
+     *        A command already sent runs to its result.
+     * @return false if it was not queued
+     */
+  bool cancelCommand(const char *cmd);
+
+  /**
+     * @brief Commands waiting in the queue (not counting one in flight).
+     */
+  uint8_t commandsQueued() const { return _cmdCount; }
+
+  /**
+     * @brief Call after a foreground command of @p priority was refused
+     *        because isBusy(): for A9G_CMD_CLAIM ms no queued command of a
+     *        lower class is started, so the retry gets the channel as soon
+     *        as the command in flight completes.
+     *        publishTopicNonBlocking() and connectBrokerNonBlocking() claim
+     *        by themselves and release the claim when their command goes out;
+     *        any other claim runs out after A9G_CMD_CLAIM.
+     */
+  void claimChannel(A9G_Priority priority);
+
+  const A9G_SchedulerStats &schedulerStats() const { return _cmdStats; }
+
   /**
       * @brief Allows external access to the modem stream i.e- [available(), read(), print(), println()]
       */
@@ -288,11 +694,12 @@ public:
 
   /**
      * @brief Simple method for sending a custom AT command for debugging
-     * @param data The AT command string to send
+     * @param data     The AT command string to send
+     * @param duration ms to echo the modem output to Serial before returning
      *
-     * This runs in a blocking mode that prints data forever (for test only).
+     * This runs in a blocking mode (for test only).
      */
-  void testDebugCommand(char *data);
+  void testDebugCommand(const char *data, unsigned long duration = A9G_DEBUG_ECHO_TIME);
 
   /* ----------------------------------------------------
      *         BASIC DEVICE & NETWORK INFORMATION
@@ -304,25 +711,126 @@ public:
 
   /**
      * @brief Reads signal quality (CSQ). Will trigger an event with param1 set.
+     * @param timeout ms to wait for the answer, 0 = defaultTimeout()
      */
-  void readSignalQuality();
+  void readSignalQuality(unsigned long timeout = 0);
 
   /**
      * @brief Reads the CCID (SIM chip ID). Will trigger an event with param2 set.
      */
   void readCCID();
 
+  /**
+     * @brief Silent variant of readSignalQuality(): sends AT+CSQ and returns the value.
+     * @param timeout ms to wait for the answer, 0 = defaultTimeout()
+     * @return RSSI index 0..31, or 99 if unknown / not detectable; the last
+     *         known value if the modem did not answer (see timedOut())
+     */
+  int querySignalQuality(unsigned long timeout = 0);
+
+  /**
+     * @brief Last RSSI index seen from AT+CSQ or a +CSQ event (99 if none yet).
+     */
+  int signalQuality() const { return _lastCSQ; }
+
+  /**
+     * @brief Last bit error rate class 0..7 from a +CSQ event (99 if unknown).
+     */
+  int bitErrorRate() const { return _lastBER; }
+
+  /**
+     * @brief Non-blocking AT+CSQ / AT+CREG? / AT+CCLK?: the +CSQ / +CREG /
+     *        +CCLK events carry the answer. These background queries go
+     *        through the command scheduler at PRIO_LOW, so they never hold
+     *        up more urgent traffic, and a query still waiting from an
+     *        earlier call is not queued twice. They leave lastResultOk()
+     *        and lastError() untouched.
+     * @return false if the scheduler queue is full
+     */
+  bool requestSignalQuality();
+  bool requestRegistration();
+  bool requestClock();
+
+  /**
+     * @brief Sends AT+CREG? and reports whether the module is registered
+     *        on its home network or roaming.
+     */
+  bool isNetworkRegistered();
+
+  /**
+     * @brief Last registration state seen from AT+CREG? or a +CREG event.
+     */
+  A9G_RegStatus registrationStatus() const { return _regStatus; }
+
   /**
      * @brief Waits for device "READY" message (blocking).
-     * @return true if modem eventually reports "READY", false if timed out
+     * @param timeout ms to wait, from power on the A9G takes a few seconds
+     * @return true if modem reports "READY", false if timed out
+     */
+  bool waitForModemReady(unsigned long timeout = A9G_READY_TIMEOUT);
+
+  /**
+     * @brief AT+RST=1 without waiting: the module reboots and reports READY
+     *        (EV_READY) some seconds later. The old session is dropped at
+     *        once (modemRestarted()).
+     */
+  bool restartModem();
+
+  /**
+     * @brief Forget what a rebooted module lost: the command in flight fails
+     *        with CMD_TIMEOUT, the outbound queue is dropped, and the socket,
+     *        GPS power, SMS mode, GPRS and registration state are reset.
+     *        Queued SMS and scheduled commands stay. Runs by itself on READY.
+     */
+  void modemRestarted();
+
+  /**
+     * @brief Commands in a row that ended without any answer; any result
+     *        (ERROR too) resets it. A growing streak means a wedged module.
+     */
+  uint8_t timeoutStreak() const { return _timeoutStreak; }
+
+  /**
+     * @brief AT+SLEEP=<mode>: the module sleeps whenever it is idle and
+     *        stays registered. Commands sent meanwhile may lose their first
+     *        bytes, so call wakeModem() before the next burst of traffic.
+     */
+  bool sleepModem(uint8_t mode = A9G_SLEEP_MODE);
+
+  /**
+     * @brief AT probes until one is answered, then AT+SLEEP=0. Blocks for
+     *        at most A9G_WAKE_PROBES x A9G_WAKE_PROBE_TIMEOUT + defaultTimeout().
+     */
+  bool wakeModem();
+
+  /**
+     * @brief sleepModem() succeeded and neither wakeModem() nor a reboot followed.
+     */
+  bool modemAsleep() const { return _asleep; }
+
+  /**
+     * @brief Keep queued SMS and scheduled commands from starting, e.g.
+     *        while the module sleeps; they go out once released. PRIO_HIGH
+     *        commands (recovery probes) are not held, nor are blocking
+     *        calls. A step already in flight completes.
      */
-  bool waitForModemReady();
+  void holdQueues(bool hold) { _queueHold = hold; }
+  bool queuesHeld() const { return _queueHold; }
 
 
   /* ----------------------------------------------------
      *         GPRS & APN HANDLING
      * ---------------------------------------------------- */
+  /**
+     * @brief Queries AT+CGATT? and returns the reported state.
+     *        The answer is also kept for gprsAttached().
+     */
   bool isGPRSAttached();
+
+  /**
+     * @brief Last attach state seen in a +CGATT answer (false if none yet).
+     */
+  bool gprsAttached() const { return _gprsAttached == 1; }
   bool attachGPRS(const char* apn, const char* user = nullptr, const char* pwd = nullptr);
   bool detachGPRS();
   bool setAPN(const char *pdpType, const char *apn);
@@ -346,18 +854,52 @@ public:
   bool disableGPS();
 
   /**
-     * @brief Enables AGPS (AT+AGPS=1).
+     * @brief Enables AGPS (AT+AGPS=1): downloads assistance data and powers
+     *        the GPS. Needs GPRS; waits up to A9G_AGPS_TIMEOUT.
      * @return true on success
      */
   bool enableAGPS();
 
   /**
-     * @brief Retrieves raw NMEA GPS data as a String by sending AT+GPSRD=1.
-     *        This method just returns the lines captured in a short window.
-     *        You can parse them further as needed.
-     * @return String containing NMEA sentences
+     * @brief Whether the GPS was powered by enableGPS()/enableAGPS() (and not
+     *        disabled since), and the millis() of that power on.
+     */
+  bool gpsPowered() const { return _gpsOn; }
+  unsigned long gpsPoweredAt() const { return _gpsOnAt; }
+
+  /**
+     * @brief Retrieves raw NMEA GPS data by sending AT+GPSRD=1.
+     *        This method just copies the lines captured in a short window
+     *        into @p buf (always terminated). You can parse them further as needed.
+     * @param window ms to collect text after the OK (which may take 500 ms)
+     * @return Length of the text; data beyond len - 1 bytes is dropped
+     */
+  size_t getGPS(char *buf, size_t len, unsigned long window = A9G_GPS_READ_WINDOW);
+
+  template <size_t N>
+  size_t getGPS(char (&buf)[N], unsigned long window = A9G_GPS_READ_WINDOW) {
+    return getGPS(buf, N, window);
+  }
+
+  /**
+     * @brief Let the GPS report every @p seconds (AT+GPSRD=<n>, 0 stops).
+     *        pollModem() decodes the RMC/GGA sentences into gpsFix() and
+     *        dispatches EV_GPS_FIX once per report.
+     */
+  bool setGPSReport(uint8_t seconds);
+
+  /**
+     * @brief Latest decoded fix (check valid).
+     */
+  const A9G_GPSFix &gpsFix() const { return _gpsFix; }
+
+#if A9G_STRING_API
+  /**
+     * @brief Same as getGPS(buf, len), returned as a String.
+     * @deprecated Allocates on the heap on every call; use getGPS(buf, len).
      */
   String getGPS();
+#endif
 
 
   /* ----------------------------------------------------
@@ -373,11 +915,108 @@ public:
                      uint8_t keepAlive, uint16_t cleanSession);
 
   bool connectBroker(const char *broker, int port);
+
+  /**
+     * @brief Queue AT+MQTTCONN and return immediately; the result is reported
+     *        through isBusy()/lastResultOk().
+     * @return false (backpressure) if the channel is not free, see
+     *         publishTopicNonBlocking()
+     */
+  bool connectBrokerNonBlocking(const char *broker, int port,
+                                const char *user, const char *pass,
+                                const char *clientID, uint8_t keepAlive = 60,
+                                uint16_t cleanSession = 1);
   bool disconnectBroker();
   bool subscribeTopic(const char *topic, uint8_t qos, unsigned long timeout);
   bool subscribeTopic(const char *topic);
+
+  /**
+     * @brief Send AT+MQTTSUB (QoS 1) without waiting; the result is reported
+     *        through isBusy()/lastResultOk().
+     * @return false (backpressure) if the channel is not free, see
+     *         publishTopicNonBlocking()
+     */
+  bool subscribeTopicNonBlocking(const char *topic);
   bool unsubscribeTopic(const char *topic);
-  bool publishTopic(const char *topic, const char *msg);
+
+  /**
+     * @brief AT+MQTTPUB with the given QoS (0..2) and retain flag.
+     */
+  bool publishTopic(const char *topic, const char *msg,
+                    uint8_t qos = A9G_MQTT_DEFAULT_QOS, bool retain = false);
+
+  /**
+     * @brief Queue AT+MQTTPUB and return immediately; the result is reported
+     *        through isBusy()/lastResultOk().
+     * @param priority Class of the message: when it is refused the channel
+     *                 is claimed for it (claimChannel()), and queued commands
+     *                 that have aged past it go first
+     * @return false (backpressure) if a command is still in flight or the
+     *         outbound queue cannot take the whole line; nothing is sent then
+     */
+  bool publishTopicNonBlocking(const char *topic, const char *msg,
+                               uint8_t qos = A9G_MQTT_DEFAULT_QOS, bool retain = false,
+                               A9G_Priority priority = PRIO_NORMAL);
+
+
+  /* ----------------------------------------------------
+     *         TCP SOCKET (AT+CIPSTART / AT+CIPSEND)
+     * ---------------------------------------------------- */
+  /**
+     * @brief Open the TCP socket (single connection mode) and wait for CONNECT OK.
+     *        GPRS must be attached and the PDP context active.
+     */
+  bool tcpConnect(const char *host, uint16_t port);
+
+  /**
+     * @brief Send raw bytes: AT+CIPSEND=<n> -> '>' -> bytes -> OK, in blocks
+     *        of at most A9G_TCP_SEND_MAX bytes.
+     * @return false if the socket is closed or a block was refused
+     */
+  bool tcpSend(const uint8_t *data, size_t len);
+
+  /**
+     * @brief Close the socket (AT+CIPCLOSE).
+     */
+  bool tcpClose();
+
+  bool tcpConnected() const { return _tcpState == TCP_CONNECTED; }
+  A9G_TcpState tcpState() const { return _tcpState; }
+
+  /**
+     * @brief Received bytes waiting in the buffer; pollModem() fills it from +CIPRCV.
+     */
+  size_t tcpAvailable() const { return _tcpRxCount; }
+
+  /**
+     * @brief Next received byte, -1 if none.
+     */
+  int tcpRead();
+
+  /**
+     * @brief Copy up to @p len received bytes.
+     * @return Bytes copied
+     */
+  size_t tcpRead(uint8_t *buf, size_t len);
+
+  /**
+     * @brief Received bytes lost because the buffer was full.
+     */
+  uint32_t tcpDropped() const { return _tcpDropped; }
+
+
+  /* ----------------------------------------------------
+     *         HTTP
+     * ---------------------------------------------------- */
+  /**
+     * @brief AT+HTTPPOST with the body inline (at most A9G_HTTP_POST_MAX bytes).
+     *        The body goes out as it is; one containing '"', CR or LF is
+     *        refused, since the firmware is not known to decode escapes
+     *        for them. Send such bodies over the socket (A9GUploader does).
+     * @return HTTP status code, or -1 if the body was refused, the command
+     *         failed or no status line came
+     */
+  int httpPost(const char *url, const char *contentType, const char *body);
 
 
   /* ----------------------------------------------------
@@ -388,30 +1027,95 @@ public:
   bool setMessageStorage();
   void checkMessageStorage();
   void readSMS(uint8_t index);
-  void deleteSMS(uint8_t index, A9G_MessageType type);
 
   /**
-     * @brief Send an SMS in a blocking manner
+     * @brief AT+CMGD=<index>,<type>; with a type other than 0 the modem
+     *        deletes every message of that kind and ignores the index.
+     * @return true once the modem answered OK
+     */
+  bool deleteSMS(uint8_t index, A9G_MessageType type);
+
+  /**
+     * @brief Delete the message stored at one index.
+     */
+  bool deleteSMS(uint8_t index);
+
+  /**
+     * @brief List stored messages with AT+CMGL, waiting for the final OK.
+     *        Every message is dispatched as an EV_CMGL event (param1 = index,
+     *        param2 = status, body = text) while this call runs.
+     * @param unreadOnly "REC UNREAD" only (the modem marks them read), else all
+     */
+  bool listSMS(bool unreadOnly = true);
+
+  /**
+     * @brief Send an SMS in a blocking manner. Goes out even while
+     *        holdQueues() is set, after the SMS queued before it.
      * @param number Phone number to send to
      * @param message The message body
-     * @return true if the command was accepted (not a guarantee of final success)
+     * @return true once the network confirmed the message with +CMGS; false
+     *         at once when called from inside another blocking call (e.g. an
+     *         event handler), and after A9G_SMS_SEND_TIMEOUT (timedOut())
      */
   bool sendSMS(const char *number, const char *message);
 
   /**
      * @brief Send an SMS in a non-blocking manner (for advanced usage).
+     *        Same as queueSMS() without a completion callback.
      * @param number Phone number
      * @param message The message body
      */
   void sendSMSNonBlocking(const char *number, const char *message);
 
   /**
-     * @brief Optional helper to delete all messages
+     * @brief Queue an SMS for the send pipeline driven by pollModem():
+     *        AT+CMGS -> wait for '>' -> body + Ctrl+Z -> wait for +CMGS or +CMS ERROR.
+     * @param cb  Optional completion callback (called from pollModem())
+     * @param ctx Passed back to cb
+     * @return Id of the message (1..255), or 0 if the queue is full or the text too long
      */
-  bool deleteAllSMS() {
-    // Not implemented in original
-    return false;
-  }
+  uint8_t queueSMS(const char *number, const char *message,
+                   A9G_SMSCallback cb = nullptr, void *ctx = nullptr);
+
+  /**
+     * @brief Queue an SMS that is sent in PDU mode (AT+CMGF=0).
+     *        The UTF-8 text goes out as GSM-7 when every character fits the
+     *        default alphabet and as UCS2 otherwise. Longer texts are split
+     *        into concatenated parts; each part takes one queue slot.
+     * @param cb  Called once: after the last part, or when a part fails
+     *            (the remaining parts are then dropped)
+     * @return Id shared by all parts, or 0 if the text does not fit the free queue slots
+     */
+  uint8_t queueSMSPdu(const char *number, const char *message,
+                      A9G_SMSCallback cb = nullptr, void *ctx = nullptr);
+
+  /**
+     * @brief Receive inbound messages as plain text, decoded from text or PDU mode.
+     */
+  void onSMSReceived(A9G_SMSReceivedCallback cb, void *ctx = nullptr);
+
+  /**
+     * @brief Messages queued or being sent.
+     */
+  uint8_t smsPending() const { return _smsCount; }
+
+  /**
+     * @brief Delete every stored message (AT+CMGD=1,4).
+     */
+  bool deleteAllSMS() { return deleteSMS(1, ALL_MESSAGE); }
+
+  /**
+     * @brief Whether a +CMTI new message indication arrived, and its index.
+     */
+  bool hasNewSMS() const { return _hasSMS; }
+  int newSMSIndex() const { return _smsIndex; }
+
+#ifdef A9G_ENABLE_METRICS
+  /**
+     * @brief Latency histograms and counters (only with A9G_ENABLE_METRICS).
+     */
+  A9G_Metrics &metrics() { return _metrics; }
+#endif
 
 private:
   /* --------------------------------------
@@ -420,8 +1124,136 @@ private:
   Stream *_modemStream;          ///< The serial interface to A9G
   bool _debugMode;               ///< Debug logs on/off
   unsigned long _defaultWaitMS;  ///< Default wait-time for responses
+  A9G_WatchdogCallback _watchdog;
+  void *_watchdogCtx;
   bool _hasSMS;                  ///< Simple state flag for SMS
   int _smsIndex;                 ///< Tracks SMS index for reading
+  int _lastCSQ;                  ///< Last RSSI index (99 = unknown)
+  int _lastBER;                  ///< Last bit error rate class (99 = unknown)
+  A9G_RegStatus _regStatus;      ///< Last network registration state
+  int8_t _gprsAttached;          ///< Last +CGATT state (-1 = unknown)
+
+  /* --------------------------------------
+     *    PARSER STATE (per instance)
+     * -------------------------------------- */
+  char _rxTerm[100];             ///< +TERM name being collected
+  char _rxTermData[128];         ///< Data following the +TERM
+  bool _rxTermFound;
+  bool _rxTermEnded;
+  bool _rxReadingData;
+  int _rxTermLen;
+  int _rxTermDataLen;
+  bool _rxTermDataLost;          ///< Data did not fit _rxTermData
+  A9G_EventID _rxEventId;        ///< Event identified from the current +TERM
+  char _rxLine[16];              ///< Start of a plain line (for OK / ERROR / CONNECT OK)
+  uint8_t _rxLineLen;
+  A9G_EventID _rxBodyEvent;      ///< SMS header seen, its body line comes next (EV_NONE if not)
+  char _rxBodyHeader[64];        ///< Data of that header
+  uint8_t _rxBody[A9G_SMS_PDU_MAX];  ///< Body line (raw text, or PDU bytes decoded from hex)
+  uint8_t _rxBodyLen;
+  int8_t _rxBodyNibble;          ///< Pending high hex digit (-1 = none)
+
+  /* --------------------------------------
+     *    OUTBOUND QUEUE & ASYNC RESULT
+     * -------------------------------------- */
+  uint8_t _txBuf[A9G_TX_QUEUE_SIZE];
+  size_t _txHead;
+  size_t _txCount;
+  bool _txAsync;
+  bool _awaitingResult;          ///< A non-blocking command is in flight
+  bool _awaitBackground;         ///< ... and its result must not replace lastResultOk()/lastError()
+  bool _lastResultOk;
+  int _lastError;
+  unsigned long _awaitStart;
+  unsigned long _awaitTimeout;
+  uint8_t _timeoutStreak;
+  bool _asleep;
+  bool _queueHold;               ///< holdQueues(): no new SMS step or scheduled command below PRIO_HIGH
+
+  /* --------------------------------------
+     *    COMMAND SCHEDULER
+     * -------------------------------------- */
+  struct CmdJob {
+    char text[A9G_CMD_QUEUE_TEXT];  ///< Line with CR LF
+    A9G_CommandCallback cb;
+    void *ctx;
+    unsigned long queuedAt;
+    unsigned long maxWait;         ///< 0 = no deadline
+    unsigned long timeout;
+    uint8_t priority;
+  };
+  CmdJob _cmdQueue[A9G_CMD_QUEUE_LEN];
+  uint8_t _cmdCount;
+  A9G_CommandCallback _jobCb;    ///< Callback of the queued command in flight
+  void *_jobCtx;
+  int _jobError;                 ///< Its CME / CMS code
+  bool _claimed;                 ///< A foreground command is waiting for the channel
+  uint8_t _claimPriority;
+  unsigned long _claimAt;
+  A9G_SchedulerStats _cmdStats;
+
+  /* --------------------------------------
+     *    SMS SEND PIPELINE
+     * -------------------------------------- */
+  struct SMSJob {
+    char number[A9G_SMS_NUMBER_MAX];
+    char body[A9G_SMS_BODY_MAX];
+    A9G_SMSCallback cb;
+    void *ctx;
+    uint8_t id;
+    uint8_t pduLen;              ///< PDU bytes in body (0 = text mode job)
+    uint8_t part;                ///< 1-based part of a concatenated PDU message
+    uint8_t parts;
+  };
+  SMSJob _smsQueue[A9G_SMS_QUEUE_LEN];
+  uint8_t _smsHead;
+  uint8_t _smsCount;
+  uint8_t _smsNextId;
+  A9G_SMSState _smsState;
+  unsigned long _smsStateStart;
+  int _smsRef;                   ///< Message reference from +CMGS
+  int8_t _smsTextMode;           ///< Last AT+CMGF value sent (-1 = unknown)
+  bool _smsHold;                 ///< Do not start new jobs (blocking call waiting)
+  uint8_t _smsConcatRef;         ///< Reference of the next concatenated PDU message
+
+  /* --------------------------------------
+     *    SMS RECEIVE
+     * -------------------------------------- */
+  A9G_SMSReassembler _smsParts;
+  A9G_SMSReceivedCallback _smsRxCallback;
+  void *_smsRxCtx;
+
+  /* --------------------------------------
+     *    TCP SOCKET
+     * -------------------------------------- */
+  A9G_TcpState _tcpState;
+  bool _tcpWaitPrompt;           ///< AT+CIPSEND sent, '>' expected
+  bool _tcpPrompt;               ///< ... and seen
+  bool _tcpWaitSend;             ///< CIPSEND data written, its OK / SEND OK expected
+  uint8_t _tcpRx[A9G_TCP_RX_SIZE];
+  size_t _tcpRxHead;
+  size_t _tcpRxCount;
+  uint32_t _tcpDropped;
+  uint8_t _tcpRxStage;           ///< +CIPRCV: 0 = none, 1 = length, 2 = data
+  size_t _tcpRxLeft;             ///< Length being parsed, then data bytes still to come
+  int _httpStatus;               ///< Status of the last "HTTP/1.x" line (-1 = none yet)
+
+  /* --------------------------------------
+     *    GPS
+     * -------------------------------------- */
+  char _nmea[A9G_NMEA_MAX];      ///< "$..." line being collected
+  uint8_t _nmeaLen;
+  bool _nmeaOn;
+  A9G_GPSFix _gpsFix;
+  bool _gpsOn;
+  unsigned long _gpsOnAt;
+
+#ifdef A9G_ENABLE_METRICS
+  A9G_Metrics _metrics;
+#endif
+#if A9G_TRACE_LEVEL > A9G_TRACE_OFF
+  A9G_Trace _trace;
+#endif
 
   /**
      * @brief Function pointer for external event callback
@@ -429,10 +1261,44 @@ private:
   typedef void (*A9G_EventCallback)(A9G_Event *evt);
   A9G_EventCallback _onEventCallback;
 
+  /**
+     * @brief Context handlers registered through addEventHandler()
+     */
+  A9G_EventHandler _handlers[A9G_MAX_EVENT_HANDLERS];
+  void *_handlerCtx[A9G_MAX_EVENT_HANDLERS];
+
   /* --------------------------------------
      *    INTERNAL PARSING & HELPERS
      * -------------------------------------- */
-  bool _waitForOkResponse(int timeout);
+  bool _waitForOkResponse(unsigned long timeout, char *capture = nullptr, size_t captureLen = 0);
+  bool _writeCommand(const A9G_CmdBuilder &cmd);
+  bool _sendCommand(const char *command);
+  bool _sendCommand(const __FlashStringHelper *command);
+  bool _queueTx(const uint8_t *data, size_t len);
+  void _pumpTx();
+  void _flushTx();
+  void _waitIdle();
+  void _onResult(bool ok);
+  bool _sendAsync(const A9G_CmdBuilder &cmd, unsigned long timeout, bool background = false);
+  bool _channelFree(A9G_Priority priority);
+  bool _sendClaimed(const A9G_CmdBuilder &cmd, unsigned long timeout);
+  bool _runParsed(const A9G_CmdBuilder &cmd, unsigned long timeout);
+  bool _submit(const A9G_CmdBuilder &cmd, A9G_Priority priority, unsigned long maxWait,
+               A9G_CommandCallback cb, void *ctx, unsigned long timeout);
+  void _cmdPump();
+  int _cmdBest(unsigned long now, long *rank, A9G_Priority below = PRIO_MAX);
+  long _cmdRank(const CmdJob &job, unsigned long now) const;
+  void _cmdDrop(uint8_t index, int error);
+  void _smsStep();
+  void _smsOnPrompt();
+  void _smsOnResult(bool ok);
+  void _smsFinish(bool ok, int error);
+  void _rxBodyByte(char c);
+  void _rxBodyDone(A9G_Event *evt);
+  bool _tcpRxByte(char c);
+  void _tcpOnLine(const char *line);
+  void _gpsSentence(const char *sentence, A9G_Event *evt);
+  void _gpsPowerOn();
   void _handlePotentialEvent(A9G_Event *evt, const char *data, int len);
   uint8_t _identifyTermString(const char *termStr);
   void _processEventsIfAny(A9G_Event *evt);
@@ -448,14 +1314,38 @@ private:
      *    ERROR PRINT METHODS
      * -------------------------------------- */
 public:
+  /**
+     * @brief Record an error code in the trace ring; trace().drain() prints it
+     *        with its name (see A9G_cmeErrorName()).
+     */
   void printCMEError(int err);
   void printCMSError(int err);
 
+#if A9G_TRACE_LEVEL > A9G_TRACE_OFF
+  /**
+     * @brief Deferred log of the library. Call trace().drain(Serial) when
+     *        printing does not disturb the timing, e.g. at the end of loop().
+     */
+  A9G_Trace &trace() { return _trace; }
+#endif
+
   /**
      * @brief Allow external registration of an event callback
      * @param cb The function pointer that receives A9G_Event pointers
      */
   void setEventCallback(void (*cb)(A9G_Event *));
+
+  /**
+     * @brief Register an additional event handler with its own context.
+     *        Handlers are called after the plain callback, in registration order.
+     * @return false if all A9G_MAX_EVENT_HANDLERS slots are taken
+     */
+  bool addEventHandler(A9G_EventHandler handler, void *ctx);
+
+  /**
+     * @brief Remove a handler previously added with the same (handler, ctx) pair.
+     */
+  void removeEventHandler(A9G_EventHandler handler, void *ctx);
 };
 
 
@@ -468,6 +1358,41 @@ public:
  */
 typedef void (*A9G_MQTTCallback)(const char *topic, const char *payload);
 
+/**
+ * @brief Callback for incoming MQTT messages that also receives a user context
+ */
+typedef void (*A9G_MQTTContextCallback)(void *ctx, const char *topic, const char *payload);
+
+/**
+ * @brief Callback for incoming MQTT messages with binary payloads
+ *        (the payload is terminated after @p len bytes as well)
+ */
+typedef void (*A9G_MQTTBinaryCallback)(void *ctx, const char *topic,
+                                       const uint8_t *payload, size_t len);
+
+/**
+ * @brief One outbound message held in the A9Gmod queue
+ */
+typedef struct A9G_MQTTMessage {
+  char topic[A9G_MQTT_TOPIC_MAX];      ///< Destination topic
+  char payload[A9G_MQTT_PAYLOAD_MAX];  ///< Text payload
+  uint8_t priority;                    ///< A9G_Priority
+  uint8_t qos;                         ///< 0..2
+  bool retain;
+} A9G_MQTTMessage;
+
+/**
+ * @brief Publish accounting per QoS level (index 0..2)
+ */
+typedef struct A9G_PublishStats {
+  uint32_t sent[3];                    ///< AT+MQTTPUB issued
+  uint32_t completed[3];               ///< Answered OK
+  uint32_t failed[3];                  ///< Answered ERROR or timed out
+} A9G_PublishStats;
+
+class A9GLinkMonitor;
+class A9GMqttClient;
+
 /**
  * @class A9Gmod
  * @brief A high-level MQTT client wrapper that uses A9G to send AT commands.
@@ -483,15 +1408,41 @@ public:
   A9Gmod(A9G &a9gRef);
 
   /**
-     * @brief Provide the MQTT broker info (host and port).
+     * @brief Detaches from the A9G event system
+     */
+  ~A9Gmod();
+
+  /**
+     * @brief Provide the MQTT broker info (host and port). The host is copied.
+     * @return false if the host does not fit A9G_MQTT_BROKER_MAX (nothing is stored)
      */
-  void setMQTTServer(const char *host, uint16_t port);
+  bool setMQTTServer(const char *host, uint16_t port);
 
   /**
      * @brief Provide a callback for incoming MQTT publish messages.
      */
   void onMQTTMessage(A9G_MQTTCallback callback);
 
+  /**
+     * @brief Same as above, but the callback also receives @p ctx.
+     */
+  void onMQTTMessage(A9G_MQTTContextCallback callback, void *ctx);
+
+  /**
+     * @brief Receive payloads with their length, for binary messages of the
+     *        native transport (also called for AT+MQTT messages).
+     */
+  void onMQTTData(A9G_MQTTBinaryCallback callback, void *ctx = nullptr);
+
+  /**
+     * @brief Run MQTT over the modem's TCP socket with @p client instead of
+     *        the AT+MQTT* commands: connect, publish, subscribe, disconnect
+     *        and processMQTT() go through it. nullptr switches back.
+     *        A9Gmod takes over the client's onMessage / onPublishResult callbacks.
+     */
+  void useNativeMQTT(A9GMqttClient *client);
+  bool nativeMQTT() const { return _native != nullptr; }
+
   /**
      * @brief Connect with just a client ID. KeepAlive=60, CleanSession=1 by default.
      */
@@ -506,6 +1457,18 @@ public:
                    uint8_t keepAlive = 60,
                    uint16_t cleanSession = 1);
 
+  /**
+     * @brief Start a connect without waiting for it; processMQTT() picks up
+     *        the result, connectingMQTT() is true until then.
+     * @return false if the modem cannot take the command now (retry later)
+     */
+  bool connectMQTTNonBlocking(const char *clientID,
+                              const char *user = nullptr,
+                              const char *pass = nullptr,
+                              uint8_t keepAlive = 60,
+                              uint16_t cleanSession = 1);
+  bool connectingMQTT() const { return _connectInFlight; }
+
   /**
      * @brief Is the current MQTT connection active?
      */
@@ -519,8 +1482,102 @@ public:
 
   /**
      * @brief Publish a message to the given topic.
+     * @param qos    0 (fire and forget), 1 or 2; routine telemetry rarely needs 2
+     * @param retain Broker keeps the message for later subscribers
+     */
+  bool publishMQTT(const char *topic, const char *payload,
+                   uint8_t qos = A9G_MQTT_DEFAULT_QOS, bool retain = false);
+
+  /**
+     * @brief Publish a binary payload. Needs the native transport (useNativeMQTT()),
+     *        AT+MQTTPUB cannot carry arbitrary bytes.
+     * @return false on the AT transport, and without counting a failure
+     *         while every in-flight slot is taken (A9GMqttClient::canPublish())
+     */
+  bool publishMQTT(const char *topic, const uint8_t *payload, size_t len,
+                   uint8_t qos = 0, bool retain = false);
+
+  /**
+     * @brief Queue a message; processMQTT() publishes one queued message per call
+     *        (with adaptive rate: one batch per flush interval).
+     * @param priority Selects the interval limits of the rate controller
+     * @return false if the queue is full or topic/payload do not fit
+     */
+  bool queueMQTT(const char *topic, const char *payload, A9G_Priority priority = PRIO_NORMAL,
+                 uint8_t qos = A9G_MQTT_DEFAULT_QOS, bool retain = false);
+
+  /**
+     * @brief Publishes sent, completed and failed per QoS.
+     */
+  const A9G_PublishStats &publishStats() const { return _pubStats; }
+  void resetPublishStats();
+
+  /**
+     * @brief QoS 1/2 publishes sent whose result has not come back yet.
+     */
+  uint32_t inFlight() const;
+
+  /**
+     * @brief Drop inbound messages whose topic and payload were already
+     *        delivered within @p windowMs (QoS 1 redeliveries, on either
+     *        transport). No message id is available, so a reading that
+     *        legitimately repeats within the window is dropped as well.
+     *        Remembers the last A9G_MQTT_DEDUP_SIZE messages; 0 turns it off (default).
+     */
+  void setDuplicateWindow(unsigned long windowMs);
+
+  /**
+     * @brief Inbound messages dropped as duplicates.
+     */
+  uint32_t duplicatesDropped() const { return _dupDropped; }
+
+  /**
+     * @brief Adaptive publish rate: processMQTT() flushes the queue in batches
+     *        whose size and spacing follow the publish round trips, errors and
+     *        signal quality (see A9G_RateController). Off by default.
+     */
+  void setAdaptiveRate(bool enable);
+  A9G_RateController &rateController() { return _rate; }
+
+  /**
+     * @brief Number of messages waiting in the outbound queue.
+     */
+  uint8_t pendingMQTT() const { return _outCount; }
+
+  /**
+     * @brief Most urgent class among the queued messages, PRIO_MAX if none.
+     */
+  A9G_Priority mostUrgent() const;
+
+  /**
+     * @brief Keep queued messages from being published (processMQTT() still
+     *        polls the modem); a publish already in flight completes.
      */
-  bool publishMQTT(const char *topic, const char *payload);
+  void holdQueue(bool hold) { _hold = hold; }
+  bool queueHeld() const { return _hold; }
+
+  /**
+     * @brief Remove the oldest queued message, copying it to @p out.
+     *        Used to move work to another modem on failover. Never waits:
+     *        a head message still being published is not handed out.
+     * @return false if the queue is empty, or its head is in flight (not
+     *         yet: pendingMQTT() stays non-zero, try again after processMQTT())
+     */
+  bool takeQueuedMQTT(A9G_MQTTMessage *out);
+
+  /**
+     * @brief Consecutive failed publishes since the last successful one.
+     */
+  uint8_t publishFailures() const { return _publishFailures; }
+
+#ifdef A9G_ENABLE_METRICS
+  /**
+     * @brief Publish the modem's metrics: counters to "<prefix>/cnt" and each
+     *        non-empty latency histogram to "<prefix>/<class>" (e.g. ".../mqttpub").
+     * @return false if any publish failed
+     */
+  bool publishMetrics(const char *prefix);
+#endif
 
   /**
      * @brief Subscribe to a topic.
@@ -528,6 +1585,13 @@ public:
   bool subscribeMQTT(const char *topic);
   bool subscribeMQTT(const char *topic, uint8_t qos, unsigned long timeout);
 
+  /**
+     * @brief Send a subscribe without waiting for the broker's answer (the
+     *        native client does not wait for the SUBACK, a refusal goes unseen).
+     * @return false if not connected or the modem cannot take it now (retry later)
+     */
+  bool subscribeMQTTNonBlocking(const char *topic);
+
   /**
      * @brief Unsubscribe from a topic.
      */
@@ -543,23 +1607,68 @@ public:
      */
   int connectionState();
 
+  /**
+     * @brief Access the underlying A9G (e.g. for link quality queries).
+     */
+  A9G &modem() { return *_a9g; }
+
+  /**
+     * @brief Hold queued messages in processMQTT() while the monitor reports
+     *        a bad link, instead of publishing into it (nullptr = never hold).
+     */
+  void setLinkMonitor(const A9GLinkMonitor *monitor) { _linkMonitor = monitor; }
+
 private:
   // The underlying A9G module reference
   A9G *_a9g;
   bool _mqttConnected;
-  String _mqttBroker;
+  char _mqttBroker[A9G_MQTT_BROKER_MAX];
   uint16_t _mqttPort;
   A9G_MQTTCallback _mqttUserCallback;
+  A9G_MQTTContextCallback _mqttCtxCallback;
+  void *_mqttCtx;
+  A9G_MQTTBinaryCallback _mqttDataCallback;
+  void *_mqttDataCtx;
+  A9GMqttClient *_native;        ///< Native MQTT transport (nullptr = AT+MQTT*)
 
-  /**
-     * @brief Static pointer for hooking into A9G's event system
-     */
-  static A9Gmod *_activeInstance;
+  // Outbound queue (ring buffer)
+  A9G_MQTTMessage _outbox[A9G_MQTT_QUEUE_LEN];
+  uint8_t _outHead;
+  uint8_t _outCount;
+  uint8_t _publishFailures;
+  bool _publishInFlight;         ///< Head of the queue sent in async TX mode
+  bool _hold;                    ///< holdQueue()
+  bool _connectInFlight;         ///< connectMQTTNonBlocking() waiting for its result
+  const A9GLinkMonitor *_linkMonitor;
+
+  // Adaptive rate
+  A9G_RateController _rate;
+  bool _adaptive;
+  uint8_t _batchLeft;            ///< Messages left in the current flush
+  unsigned long _lastFlush;      ///< millis() when the last flush ended
+  unsigned long _publishStart;   ///< millis() when the publish in flight was sent
+
+  // QoS accounting and inbound duplicate suppression
+  A9G_PublishStats _pubStats;
+  uint32_t _dupHash[A9G_MQTT_DEDUP_SIZE];
+  unsigned long _dupTime[A9G_MQTT_DEDUP_SIZE];
+  uint8_t _dupNext;
+  unsigned long _dupWindow;
+  uint32_t _dupDropped;
 
   /**
-     * @brief A9G's static callback calls this method
+     * @brief A9G's context handler calls this method; ctx is the A9Gmod instance
      */
-  static void _onModemEvent(A9G_Event *evt);
+  static void _onModemEvent(A9G_Event *evt, void *ctx);
+  static void _onNativeMessage(void *ctx, const char *topic, const uint8_t *payload, size_t len);
+  static void _onNativePublish(void *ctx, bool ok);
+
+  void _processQueueNonBlocking();
+  bool _linkUsable() const;
+  bool _flushDue();
+  void _publishDone(bool ok);
+  void _countResult(uint8_t qos, bool ok);
+  bool _isDuplicate(const char *topic, const uint8_t *payload, size_t len);
 
   /**
      * @brief Internal event handler for MQTT-related events